@@ -91,31 +91,113 @@
  * @brief Time slice configuration.
  * @def CONFIG_TIME_SLICE
  *
- * The `CONFIG_TIME_SLICE` constant defines the default time slice given to threads when they are scheduled.
+ * The `CONFIG_TIME_SLICE` constant defines the default time slice given to threads when they are scheduled, each thread
+ * can request a different slice between `CONFIG_MIN_TIME_SLICE` and `CONFIG_MAX_TIME_SLICE`.
  *
  */
 #define CONFIG_TIME_SLICE ((CLOCKS_PER_MS) * 10)
 
+/**
+ * @brief Minimum time slice configuration.
+ * @def CONFIG_MIN_TIME_SLICE
+ *
+ * The `CONFIG_MIN_TIME_SLICE` constant defines the shortest time slice a thread can request, should not be less than
+ * `CONFIG_MIN_TIMER_TIMEOUT`.
+ *
+ */
+#define CONFIG_MIN_TIME_SLICE ((CLOCKS_PER_MS) / 10)
+
+/**
+ * @brief Maximum time slice configuration.
+ * @def CONFIG_MAX_TIME_SLICE
+ *
+ * The `CONFIG_MAX_TIME_SLICE` constant defines the longest time slice a thread can request.
+ *
+ */
+#define CONFIG_MAX_TIME_SLICE ((CLOCKS_PER_MS) * 100)
+
 /**
  * @brief Cache hot threshold configuration.
  * @def CONFIG_CACHE_HOT_THRESHOLD
  *
- * The `CONFIG_CACHE_HOT_THRESHOLD` constant defines the threshold below which a time duration is considered "cache
- * hot", meaning that the data is likely still in the CPU cache.
+ * The `CONFIG_CACHE_HOT_THRESHOLD` constant defines the maximum migration cost of a thread, the time since a thread
+ * last ran below which it is considered "cache hot", meaning that its data is likely still in the CPU cache. The actual
+ * cost is estimated per thread from its recent runtime.
  *
  */
 #define CONFIG_CACHE_HOT_THRESHOLD ((CLOCKS_PER_MS) * 5)
 
+/**
+ * @brief Minimum migration cost configuration.
+ * @def CONFIG_MIN_MIGRATION_COST
+ *
+ * The `CONFIG_MIN_MIGRATION_COST` constant defines the minimum migration cost of a thread, see
+ * `CONFIG_CACHE_HOT_THRESHOLD`.
+ *
+ */
+#define CONFIG_MIN_MIGRATION_COST ((CLOCKS_PER_MS) / 2)
+
+/**
+ * @brief Load balance interval configuration.
+ * @def CONFIG_LOAD_BALANCE_INTERVAL
+ *
+ * The `CONFIG_LOAD_BALANCE_INTERVAL` constant defines the minimum interval between two runs of the periodic load
+ * balancer, which is shared by all CPUs.
+ *
+ */
+#define CONFIG_LOAD_BALANCE_INTERVAL ((CLOCKS_PER_MS) * 4)
+
 /**
  * @brief Maximum mutex slow spin configuration.
  * @def CONFIG_MUTEX_MAX_SLOW_SPIN
  *
- * The `CONFIG_MUTEX_MAX_SLOW_SPIN` constant defines the maximum number of iterations a thread will spin before blocking
- * on a mutex.
+ * The `CONFIG_MUTEX_MAX_SLOW_SPIN` constant defines the maximum number of iterations a thread will spin on a mutex,
+ * while its owner is running on another CPU, before blocking.
  *
  */
 #define CONFIG_MUTEX_MAX_SLOW_SPIN 1000
 
+/**
+ * @brief Lock profiling configuration.
+ * @def CONFIG_LOCK_PROFILE
+ *
+ * The `CONFIG_LOCK_PROFILE` constant defines if every spinlock acquisition should be recorded, per call site, to find
+ * contended locks, see `/dev/perf/locks`. Adds overhead to every acquisition so it should be disabled by default.
+ *
+ */
+#define CONFIG_LOCK_PROFILE false
+
+/**
+ * @brief RCU callback batch configuration.
+ * @def CONFIG_RCU_BATCH_MAX
+ *
+ * The `CONFIG_RCU_BATCH_MAX` constant defines the maximum amount of RCU callbacks that a CPU will invoke each time it
+ * reports a quiescent state, remaining callbacks are deferred to the next timer interrupt.
+ *
+ */
+#define CONFIG_RCU_BATCH_MAX 64
+
+/**
+ * @brief RCU poll interval configuration.
+ * @def CONFIG_RCU_POLL_INTERVAL
+ *
+ * The `CONFIG_RCU_POLL_INTERVAL` constant defines how often a CPU with callbacks waiting for a grace period will check
+ * if the grace period has completed, such that an otherwise idle CPU still invokes its callbacks.
+ *
+ */
+#define CONFIG_RCU_POLL_INTERVAL ((CLOCKS_PER_SEC) / 1000)
+
+/**
+ * @brief Lazy SIMD context switching configuration.
+ * @def CONFIG_SIMD_LAZY
+ *
+ * The `CONFIG_SIMD_LAZY` constant defines if the SIMD state of a thread should only be restored once the thread
+ * actually uses SIMD instructions, detected using `CR0.TS` and the resulting device not available exception, instead of
+ * on every context switch.
+ *
+ */
+#define CONFIG_SIMD_LAZY false
+
 /**
  * @brief Maximum screen lines configuration.
  * @def CONFIG_SCREEN_MAX_LINES
@@ -126,14 +208,54 @@
 #define CONFIG_SCREEN_MAX_LINES 256
 
 /**
- * @brief Maximum bitmap allocator address.
- * @def CONFIG_PMM_BITMAP_MAX_ADDR
+ * @brief Maximum DMA zone address.
+ * @def CONFIG_PMM_DMA_MAX_ADDR
+ *
+ * The `CONFIG_PMM_DMA_MAX_ADDR` constant defines the maximum address below which pages will belong to the DMA zone of
+ * the PMM, pages above this value will belong to the normal zone.
+ *
+ */
+#define CONFIG_PMM_DMA_MAX_ADDR 0x4000000ULL
+
+/**
+ * @brief Pre-zeroed page pool configuration.
+ * @def CONFIG_PMM_ZEROED_PAGES
  *
- * The `CONFIG_PMM_BITMAP_MAX_ADDR` constant defines the maximum address below which pages will be handled by the bitmap
- * allocator, pages above this value will be handled by the free stack allocator.
+ * The `CONFIG_PMM_ZEROED_PAGES` constant defines the maximum amount of free pages that each CPU keeps zeroed ahead of
+ * time.
  *
  */
-#define CONFIG_PMM_BITMAP_MAX_ADDR 0x4000000ULL
+#define CONFIG_PMM_ZEROED_PAGES 128
+
+/**
+ * @brief Pre-zeroed page refill interval configuration.
+ * @def CONFIG_PMM_ZEROED_INTERVAL
+ *
+ * The `CONFIG_PMM_ZEROED_INTERVAL` constant defines how often the thread of each CPU checks if its pre-zeroed page
+ * pool needs to be refilled.
+ *
+ */
+#define CONFIG_PMM_ZEROED_INTERVAL ((CLOCKS_PER_MS) * 10)
+
+/**
+ * @brief Huge page configuration.
+ * @def CONFIG_VMM_HUGE_PAGES
+ *
+ * The `CONFIG_VMM_HUGE_PAGES` constant defines if `vmm_alloc()` should transparently back suitably aligned and sized
+ * regions with 2MiB huge pages.
+ *
+ */
+#define CONFIG_VMM_HUGE_PAGES true
+
+/**
+ * @brief Object cache reclaim interval configuration.
+ * @def CONFIG_CACHE_RECLAIM_INTERVAL
+ *
+ * The `CONFIG_CACHE_RECLAIM_INTERVAL` constant defines the interval at which the object caches return magazines and
+ * free slabs that went unused for a whole interval, see `cache_reclaim()`.
+ *
+ */
+#define CONFIG_CACHE_RECLAIM_INTERVAL (CLOCKS_PER_SEC * 1)
 
 /**
  * @brief Process reaper interval configuration.
@@ -191,6 +313,26 @@
  */
 #define CONFIG_MAX_RINGS 8
 
+/**
+ * @brief I/O ring workers configuration.
+ * @def CONFIG_IORING_WORKERS
+ *
+ * The `CONFIG_IORING_WORKERS` constant defines the amount of kernel threads used to perform I/O ring operations on
+ * files whose vnode does not implement the operation asynchronously.
+ *
+ */
+#define CONFIG_IORING_WORKERS 8
+
+/**
+ * @brief I/O ring workers per process configuration.
+ * @def CONFIG_IORING_PROCESS_WORKERS
+ *
+ * The `CONFIG_IORING_PROCESS_WORKERS` constant defines the maximum amount of I/O ring workers that can perform the
+ * operations of a single process at once.
+ *
+ */
+#define CONFIG_IORING_PROCESS_WORKERS 2
+
 /**
  * @brief Maximum async ring pages configuration.
  * @def CONFIG_MAX_RINGS_PAGES
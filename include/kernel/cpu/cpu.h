@@ -72,6 +72,22 @@ typedef uint16_t cpu_id_t;
  */
 #define CPU_STACK_CANARY 0x1234567890ABCDEFULL
 
+/**
+ * @brief CPU topology.
+ * @struct cpu_topology_t
+ *
+ * Detected using CPUID when the CPU is initialized. Each ID is derived from the APIC ID by shifting away the bits of
+ * the lower levels, meaning that they are unique system wide and two CPUs share a core, last level cache or package if
+ * and only if the corresponding IDs are equal.
+ */
+typedef struct
+{
+    uint32_t apicId;    ///< The initial APIC ID, or x2APIC ID if available.
+    uint32_t coreId;    ///< Shared by SMT siblings.
+    uint32_t llcId;     ///< Shared by all CPUs sharing the last level cache.
+    uint32_t packageId; ///< Shared by all CPUs in the same physical package.
+} cpu_topology_t;
+
 /**
  * @brief CPU structure.
  * @struct cpu_t
@@ -89,6 +105,7 @@ typedef struct cpu
     volatile bool inInterrupt;
     uint64_t oldRflags; ///< The rflags value before disabling interrupts.
     uint16_t cli;       ///< The CLI depth counter used in `cli_push()` and `cli_pop()`.
+    cpu_topology_t topology;
     tss_t tss;
     stack_pointer_t exceptionStack;
     stack_pointer_t doubleFaultStack;
@@ -10,7 +10,9 @@
 #define XCR0_ZMM0_15_ENABLE (1 << 6)
 #define XCR0_ZMM16_32_ENABLE (1 << 7)
 
+#define MSR_TSC_ADJUST 0x3B
 #define MSR_LAPIC 0x1B
+#define MSR_TSC_DEADLINE 0x6E0
 #define MSR_TSC_AUX 0xC0000103
 #define MSR_EFER 0xC0000080
 #define MSR_STAR 0xC0000081
@@ -19,6 +21,7 @@
 #define MSR_FS_BASE 0xC0000100
 #define MSR_GS_BASE 0xC0000101
 #define MSR_KERNEL_GS_BASE 0xc0000102
+#define MSR_XSS 0xDA0
 
 #define EFER_SYSCALL_ENABLE 1
 
@@ -53,8 +56,12 @@
 #define CR4_PAGE_GLOBAL_ENABLE (1 << 7)
 #define CR4_FXSR_ENABLE (1 << 9)
 #define CR4_SIMD_EXCEPTION (1 << 10)
+#define CR4_PCID_ENABLE (1 << 17)
 #define CR4_XSAVE_ENABLE (1 << 18)
 
+#define CR3_PCID_MASK 0xFFF
+#define CR3_NO_FLUSH (1ULL << 63)
+
 static inline void xcr0_write(uint32_t xcr, uint64_t value)
 {
     uint32_t eax = (uint32_t)value;
@@ -77,6 +84,22 @@ static inline void msr_write(uint32_t msr, uint64_t value)
     ASM("wrmsr" : : "c"(msr), "a"(low), "d"(high));
 }
 
+static inline uint64_t tsc_read(void)
+{
+    uint32_t low;
+    uint32_t high;
+    ASM("lfence; rdtsc" : "=a"(low), "=d"(high) : : "memory");
+    return ((uint64_t)high << 32) | (uint64_t)low;
+}
+
+static inline uint64_t tsc_read_aux(uint32_t* aux)
+{
+    uint32_t low;
+    uint32_t high;
+    ASM("rdtscp" : "=a"(low), "=d"(high), "=c"(*aux) : : "memory");
+    return ((uint64_t)high << 32) | (uint64_t)low;
+}
+
 static inline uint64_t rflags_read(void)
 {
     uint64_t rflags;
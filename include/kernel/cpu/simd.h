@@ -11,16 +11,48 @@
  * SIMD (Single Instruction, Multiple Data) context management allows saving and restoring the state of SIMD registers,
  * the fact that SIMD uses its own registers is the reason that we cant use SIMD in the kernel normally.
  *
+ * The instruction used to save the state is selected once at boot, preferring `xsaves`, then `xsaveopt`, then `xsavec`
+ * and finally `xsave` or `fxsave`. All but the last two skip components that are in their initial state and `xsaves`
+ * and `xsaveopt` additionally skip components that have not been modified since they were last restored, making it
+ * cheap to switch between threads that rarely use SIMD.
+ *
+ * ## Lazy Switching
+ *
+ * If `CONFIG_SIMD_LAZY` is enabled, the state of a thread is not restored when it is loaded, instead `CR0.TS` is set
+ * causing the first SIMD instruction executed by the thread to raise a device not available exception, at which point
+ * the state is restored. The state of a thread is only saved if it was restored during its time slice, and if a thread
+ * is loaded on the CPU that still holds its state, nothing needs to be done at all.
+ *
  * @see [XSAVE Instruction](https://www.felixcloutier.com/x86/xsave)
+ * @see [XSAVEOPT Instruction](https://www.felixcloutier.com/x86/xsaveopt)
+ * @see [XSAVES Instruction](https://www.felixcloutier.com/x86/xsaves)
  * @see [FXSAVE Instruction](https://www.felixcloutier.com/x86/fxsave)
  * @see [FNINIT Instruction](https://www.felixcloutier.com/x86/fninit)
  *
  * @{
  */
 
+/**
+ * @brief Instruction used to save and restore SIMD state.
+ * @enum simd_save_t
+ */
+typedef enum
+{
+    SIMD_SAVE_FXSAVE,
+    SIMD_SAVE_XSAVE,
+    SIMD_SAVE_XSAVEC,
+    SIMD_SAVE_XSAVEOPT,
+    SIMD_SAVE_XSAVES,
+} simd_save_t;
+
+/**
+ * @brief SIMD context structure.
+ * @struct simd_ctx_t
+ */
 typedef struct
 {
     uint8_t* buffer;
+    uint16_t cpu; ///< The CPU whose registers hold the latest state when using lazy switching, or `CPU_ID_INVALID`.
 } simd_ctx_t;
 
 uint64_t simd_ctx_init(simd_ctx_t* ctx);
@@ -31,4 +63,13 @@ void simd_ctx_save(simd_ctx_t* ctx);
 
 void simd_ctx_load(simd_ctx_t* ctx);
 
+/**
+ * @brief Handles a device not available exception raised by lazy SIMD switching.
+ *
+ * Restores the SIMD state of the current thread.
+ *
+ * @param ctx The SIMD context of the current thread.
+ */
+void simd_device_not_available(simd_ctx_t* ctx);
+
 /** @} */
@@ -10,6 +10,10 @@
  * Each local APIC is associated with a timer which can be used to generate interrupts at specific intervals, or as we
  * use it, to generate a single interrupt after a specified time.
  *
+ * If the CPU supports it, along with an invariant TSC, the timer is instead used in TSC-deadline mode where the
+ * interrupt fires once the TSC reaches a value written to `MSR_TSC_DEADLINE`, which avoids the rounding of the divided
+ * APIC timer clock and only needs a single MSR write to rearm.
+ *
  * @see [ACPI Specification Version 6.6](https://uefi.org/sites/default/files/resources/ACPI_Spec_6.6.pdf)
  *
  * @{
@@ -23,7 +27,8 @@ typedef enum
 {
     APIC_TIMER_MASKED = 0x10000, ///< Timer is masked (disabled)
     APIC_TIMER_PERIODIC = 0x20000,
-    APIC_TIMER_ONE_SHOT = 0x00000
+    APIC_TIMER_ONE_SHOT = 0x00000,
+    APIC_TIMER_TSC_DEADLINE = 0x40000
 } apic_timer_mode_t;
 
 /**
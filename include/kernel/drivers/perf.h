@@ -20,13 +20,15 @@ typedef struct thread thread_t;
  *
  * The `/dev/perf/cpu` file contains per-CPU performance data in the following format:
  * ```
- * cpu idle_clocks active_clocks interrupt_clocks
- * %lu %lu %lu %lu
- * %lu %lu %lu %lu
+ * cpu idle_clocks active_clocks interrupt_clocks migrations
+ * %lu %lu %lu %lu %lu
+ * %lu %lu %lu %lu %lu
  * ...
- * %lu %lu %lu %lu
+ * %lu %lu %lu %lu %lu
  * ```
  *
+ * Where `migrations` is the amount of threads that have been moved to the CPU from another CPU.
+ *
  * ## Memory performance
  *
  * The `/dev/perf/mem` file contains memory performance data in the following format:
@@ -34,13 +36,113 @@ typedef struct thread thread_t;
  * total_pages %lu
  * free_pages %lu
  * used_pages %lu
+ * zeroed_pages %lu
+ * zeroed_hits %lu
+ * zeroed_misses %lu
+ * ```
+ *
+ * Where `zeroed_pages` is the current size of the PMM's pre-zeroed page pools and `zeroed_hits` and `zeroed_misses`
+ * count the zeroed allocations that were or were not satisfied from those pools.
+ *
+ * ## Cache performance
+ *
+ * The `/dev/perf/cache` file contains statistics for the size class caches backing small kernel allocations in the
+ * following format:
+ * ```
+ * cache allocs hits objects slabs capacity
+ * %s %lu %lu %lu %lu %lu
+ * %s %lu %lu %lu %lu %lu
+ * ...
+ * %s %lu %lu %lu %lu %lu
+ * ```
+ *
+ * Where `hits` is the number of allocations served by a per-CPU magazine without acquiring any lock, `objects`
+ * is the number of currently allocated objects and `capacity` is the total number of objects that fit in the `slabs`
+ * currently owned by the cache.
+ *
+ * ## Scheduler performance
+ *
+ * The `/dev/perf/sched` file contains per-CPU scheduler counters in the following format:
+ * ```
+ * cpu switches involuntary wakeups migrations
+ * %lu %lu %lu %lu %lu
+ * %lu %lu %lu %lu %lu
+ * ...
+ * %lu %lu %lu %lu %lu
+ * ```
+ *
+ * Where `switches` is the amount of times a non-idle thread was switched out, `involuntary` is the amount of those
+ * switches where the thread was still runnable, as in it was preempted, `wakeups` is the amount of unblocked threads
+ * that were then run on the CPU and `migrations` is the same as in `/dev/perf/cpu`.
+ *
+ * ## Scheduler latency
+ *
+ * The `/dev/perf/latency` file contains per-CPU latency histograms, see `perf_hist_t`, in the following format:
+ * ```
+ * cpu latency 0 1 2 ... 31
+ * %lu runqueue %lu %lu %lu ... %lu
+ * %lu wakeup %lu %lu %lu ... %lu
+ * ...
  * ```
  *
+ * Where the columns after `latency` are the buckets of the histogram, `runqueue` is the time from a thread becoming
+ * runnable, either by being submitted or preempted, to it running and `wakeup` is the time from a thread being
+ * unblocked to it running.
+ *
+ * ## Lock contention
+ *
+ * If `CONFIG_LOCK_PROFILE` is enabled, the `/dev/perf/locks` file contains spinlock statistics for each call site, see
+ * `lock_profile_t`, sorted by the time spent waiting, in the following format:
+ * ```
+ * site symbol acquires contended cycles
+ * %p %s %lu %lu %lu
+ * %p %s %lu %lu %lu
+ * ...
+ * %p %s %lu %lu %lu
+ * ```
+ *
+ * Where `site` is the address the lock was acquired from, `symbol` is the function containing that address, `contended`
+ * is the amount of acquisitions that had to wait for another CPU and `cycles` is the total amount of TSC cycles spent
+ * waiting.
+ *
  * @see @ref kernel_proc "Process" for per-process performance data.
  *
  * @{
  */
 
+/**
+ * @brief The amount of buckets in a latency histogram.
+ */
+#define PERF_HIST_BUCKETS 32
+
+/**
+ * @brief Log2 latency histogram.
+ * @struct perf_hist_t
+ *
+ * Bucket `i` counts the latencies in the range `[2^i, 2^(i+1))` nanoseconds, except that the first bucket also counts
+ * zero and the last bucket counts everything above it.
+ */
+typedef struct
+{
+    _Atomic(uint64_t) buckets[PERF_HIST_BUCKETS];
+} perf_hist_t;
+
+/**
+ * @brief Scheduler statistics.
+ * @struct perf_sched_t
+ *
+ * Kept both per-CPU and per-process, see `/dev/perf/sched` and `/dev/perf/latency` for what each member means.
+ */
+typedef struct
+{
+    _Atomic(uint64_t) switches;
+    _Atomic(uint64_t) involuntary;
+    _Atomic(uint64_t) wakeups;
+    _Atomic(uint64_t) migrations; ///< Only used for processes, CPUs store their migrations in their `sched_t`.
+    perf_hist_t runqueue;
+    perf_hist_t wakeup;
+} perf_sched_t;
+
 /**
  * @brief Per-Process performance context.
  * @struct stat_process_ctx_t
@@ -51,6 +153,7 @@ typedef struct
     _Atomic(clock_t)
         kernelClocks;  ///< Total kernel mode CPU time used by this process, does not include interrupt time.
     clock_t startTime; ///< The time when the process was started.
+    perf_sched_t sched; ///< Scheduler statistics of all threads in the process.
 } perf_process_ctx_t;
 
 /**
@@ -64,6 +167,8 @@ typedef struct
 {
     clock_t syscallBegin; ///< The time the current syscall began. Also used to "skip" time spent in interrupts.
     clock_t syscallEnd;
+    clock_t readyTime; ///< The time the thread last became runnable.
+    clock_t wakeTime;  ///< The time the thread was unblocked, or `0` if it has not been unblocked since it last ran.
 } perf_thread_ctx_t;
 
 /**
@@ -109,4 +214,40 @@ void perf_syscall_begin(void);
  */
 void perf_syscall_end(void);
 
+/**
+ * @brief Adds a latency to a histogram.
+ *
+ * @param hist The histogram.
+ * @param latency The latency in nanoseconds.
+ */
+void perf_hist_add(perf_hist_t* hist, clock_t latency);
+
+/**
+ * @brief Called when a thread is unblocked, before it is submitted to the scheduler.
+ *
+ * @param thread The unblocked thread.
+ */
+void perf_sched_wakeup(thread_t* thread);
+
+/**
+ * @brief Called when a thread is submitted to the scheduler.
+ *
+ * @param thread The submitted thread.
+ * @param uptime The current uptime.
+ */
+void perf_sched_submit(thread_t* thread, clock_t uptime);
+
+/**
+ * @brief Called by the scheduler when it switches from one thread to another.
+ *
+ * Must be called with interrupts disabled.
+ *
+ * @param prev The thread that was running, might be the idle thread.
+ * @param next The thread that will run next, might be the idle thread.
+ * @param idle The idle thread of the current CPU.
+ * @param preempted Whether `prev` is still runnable.
+ * @param uptime The current uptime.
+ */
+void perf_sched_switch(thread_t* prev, thread_t* next, thread_t* idle, bool preempted, clock_t uptime);
+
 /** @} */
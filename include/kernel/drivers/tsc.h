@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Invariant Time Stamp Counter
+ * @defgroup kernel_drivers_tsc TSC
+ * @ingroup kernel_drivers
+ *
+ * On CPUs with an invariant TSC the counter runs at a constant rate regardless of power states, which makes it a far
+ * cheaper clock source than the HPET, reading it is a single `rdtscp` instead of an uncached MMIO read.
+ *
+ * ## Calibration
+ *
+ * The frequency of the TSC is measured against the current clock source, usually the HPET, when the module is loaded,
+ * the TSC then continues from the uptime at the end of the calibration such that the uptime never jumps.
+ *
+ * ## Synchronization
+ *
+ * The TSCs of different CPUs are not guaranteed to be in sync, usually because firmware wrote to them, so we first copy
+ * the `MSR_TSC_ADJUST` value of the bootstrap CPU to all other CPUs, and then measure any remaining offset between each
+ * CPU and the bootstrap CPU using a ping-pong handshake. Since the kernel stores the CPU ID in `MSR_TSC_AUX`, `rdtscp`
+ * gives us both the counter and the offset to apply in a single instruction, without needing to disable preemption.
+ *
+ * If any offset is larger than a few microseconds, the TSC is not registered and the previous clock source, usually the
+ * HPET, remains in use, as a thread migrating between CPUs could otherwise see the uptime go backwards.
+ *
+ * CPUs started after the module was loaded are measured by a kernel thread pinned to the bootstrap CPU, since the
+ * handshake can't be done from the CPU's own initialization. If such a CPU turns out to be out of bounds, the TSC is
+ * unregistered again. Until it has been measured, a late CPU relies on `MSR_TSC_ADJUST` alone.
+ *
+ * @see [OSDev TSC](https://wiki.osdev.org/TSC)
+ *
+ * @{
+ */
+
+/**
+ * @brief Get the frequency of the TSC.
+ *
+ * The frequency is measured once when the module is initialized, such that other drivers, for example the APIC
+ * TSC-deadline timer, don't need to do their own calibration.
+ *
+ * @return The amount of TSC ticks per millisecond, or `0` if the TSC has not been calibrated.
+ */
+uint64_t tsc_ticks_per_ms(void);
+
+/** @} */
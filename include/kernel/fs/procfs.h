@@ -120,6 +120,54 @@
  * %llu %llu %llu %llu %llu
  * ```
  *
+ * ## sched
+ *
+ * A readable file that contains scheduler statistics for all threads in the process, the histograms are log2 latency
+ * histograms in nanoseconds with `PERF_HIST_BUCKETS` buckets.
+ *
+ * @see kernel_drivers_performance for the meaning of each value.
+ *
+ * Format:
+ *
+ * ```
+ * switches %llu
+ * involuntary %llu
+ * wakeups %llu
+ * migrations %llu
+ * runqueue %llu %llu ... %llu
+ * wakeup %llu %llu ... %llu
+ * ```
+ *
+ * ## affinity
+ *
+ * A readable file that contains the CPU affinity mask of the process followed by the mask of each of its threads, as
+ * lists of CPU IDs and ranges, for example `0-3,6`. Only existing CPUs are listed.
+ *
+ * @see kernel_sched for how the masks are combined.
+ *
+ * Format:
+ *
+ * ```
+ * process %s
+ * thread %llu %s
+ * ...
+ * ```
+ *
+ * ## slice
+ *
+ * A readable file that contains the time slice given to new threads of the process followed by the time slice of each
+ * of its threads, in nanoseconds.
+ *
+ * @see kernel_sched for how the slice affects scheduling.
+ *
+ * Format:
+ *
+ * ```
+ * process %llu
+ * thread %llu %llu
+ * ...
+ * ```
+ *
  * ## ns (restricted)
  *
  * Opening this file returns a file descriptor referring to the namespace. This file descriptor can be used with the
@@ -188,6 +236,23 @@
  *
  * The file descriptor must be one that was opened from `/[pid]/group`.
  *
+ * ### affinity <cpus> [tid]
+ *
+ * Sets the CPU affinity mask of the process, or of the thread with the specified ID in the process, to the CPUs in
+ * `cpus`, either `all` or a comma separated list of CPU IDs and ranges, for example `0-3,6`. The list must contain at
+ * least one existing CPU.
+ *
+ * Child processes inherit the mask of their parent process, threads always start with all CPUs allowed.
+ *
+ * ### slice <nanoseconds> [tid]
+ *
+ * Sets the time slice, or request size, of all threads in the process and of any threads created later, or only of the
+ * thread with the specified ID in the process. Must be between `CONFIG_MIN_TIME_SLICE` and `CONFIG_MAX_TIME_SLICE`.
+ *
+ * A shorter slice gives the thread earlier deadlines and thus lower latency, without changing its share of CPU time.
+ *
+ * Child processes inherit the slice of their parent process.
+ *
  * ## env (restricted)
  *
  * A directory that contains the environment variables of the process. Each environment variable is represented as a
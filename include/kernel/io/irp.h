@@ -87,6 +87,20 @@ typedef struct irp irp_t;
  * }
  * ```
  *
+ * ## Dispatch
+ *
+ * A vnode handles IRPs by providing an `irp_vtable_t` with one function per major function number, set either directly
+ * in the vnode or as a default for all vnodes of a superblock. For `IRP_MJ_READ` and `IRP_MJ_WRITE` the current frame
+ * describes the user buffer as a MDL, while the open file is stored in the `file` member of the IRP. On success the
+ * handler should store the amount of bytes transferred in `res` and advance `off` to the new file offset, the same way
+ * a `file_ops_t` read or write would advance its offset argument.
+ *
+ * Handlers are called with interrupts enabled and may acquire mutexes, but must never block waiting for data. If the
+ * operation can not be completed immediately the handler should store the IRP, set a cancellation callback and return,
+ * later completing the IRP from whatever context makes it ready. The owner must claim a stored IRP with
+ * `irp_set_cancel(irp, NULL)`, while holding the same lock that its cancellation callback acquires, before completing
+ * it, if the claim returns `IRP_CANCELLED` the IRP is already being cancelled and must be left alone.
+ *
  * ## Error Values
  *
  * The IRP system uses the `err` field to indicate both the current state of the IRP as well as any error that may have
@@ -203,7 +217,7 @@ typedef struct ALIGNED(64) irp
     uint8_t frame;                    ///< The index of the current frame in the stack.
     irp_frame_t stack[IRP_FRAME_MAX]; ///< The frame stack, grows downwards.
     sqe_t sqe;                        // A copy of the submission queue entry associated with this IRP.
-    uint8_t reserved[8];
+    file_t* file;                     ///< The file the IRP operates on, if any, released once the IRP is finished.
 } irp_t;
 
 static_assert(sizeof(irp_t) == 512, "irp_t is not 512 bytes");
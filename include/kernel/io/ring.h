@@ -110,6 +110,32 @@
  * - `ETIMEDOUT`: The verb timed out.
  * - Other values may be returned depending on the verb.
  *
+ * ## Dispatch
+ *
+ * Reads and writes are sent as IRPs to the vnode of the file, if its `irp_vtable_t` implements the major function,
+ * allowing a single `enter()` call to drive any number of outstanding operations without a thread per file. Otherwise,
+ * the operation is queued to a pool of `CONFIG_IORING_WORKERS` kernel threads which perform it using the synchronous
+ * `file_ops_t` of the file, and as such a blocking operation will occupy one worker until it completes, even if it is
+ * cancelled or times out. To prevent a single process from stalling the operations of every other process, at most
+ * `CONFIG_IORING_PROCESS_WORKERS` workers perform the operations of a process at once, the rest stay queued. Pending
+ * polls are rechecked by a separate thread, see `VERB_POLL`.
+ *
+ * If the offset of an operation is `IO_OFF_CUR` the current file offset is used and updated once the operation
+ * completes, operations that overlap on the same file may therefore see the same offset.
+ *
+ * @see kernel_io_irp for how vnodes implement IRP handlers.
+ *
+ * ## Overflow
+ *
+ * Each SQE is only popped from the submission queue if the completion queue has room for the result of every
+ * operation already in flight, otherwise `enter()` stops early and leaves the remaining SQEs for a later call. As such,
+ * the completion queue can only overflow due to `SQE_MULTISHOT` operations or a misbehaving user-space.
+ *
+ * CQEs that do not fit are appended to a kernel-side overflow list, limited to the size of the completion queue, and
+ * `IORING_CTRL_OVERFLOW` is set in the shared control structure. The list is moved into the completion queue, in order,
+ * by every `enter()` call and every new completion, after which the flag is cleared. If the overflow list is full the
+ * CQE is dropped and counted in `cdropped`.
+ *
  * ## Verbs
  *
  * Included below is a list of all currently implemented verbs.
@@ -151,7 +177,13 @@
  *
  * ### `VERB_POLL`
  *
- * Polls a file descriptor for events.
+ * Polls a file descriptor for events, completing once any of the events, `IO_POLL_ERROR` or `IO_POLL_HUP` are ready.
+ * Instead of blocking a thread, the IRP adds a callback entry to the wait queue of the file and is rechecked by the
+ * poll thread each time the queue is signalled.
+ *
+ * With `SQE_MULTISHOT` the verb stays armed after reporting events, posting a CQE with `CQE_MORE` set each time the
+ * queue of the file is signalled while an event is ready. The verb is finished, without `CQE_MORE`, once it reports
+ * `IO_POLL_HUP`, fails, times out or is cancelled.
  *
  * @param fd The file descriptor to poll.
  * @param events The events to wait for.
@@ -186,6 +218,10 @@ typedef struct ioring_ctx
     void* kernelAddr;       ///< Kernel address of the ring.
     size_t pageAmount;      ///< Amount of pages mapped for the ring.
     wait_queue_t waitQueue; ///< Wait queue for completions.
+    lock_t cqLock;          ///< Protects the completion queue tail and the overflow list.
+    list_t overflow;        ///< CQEs that did not fit in the completion queue.
+    size_t overflowAmount;  ///< Length of the overflow list.
+    size_t workers;         ///< Amount of workers performing operations of the ring, protected by the worker lock.
     _Atomic(ioring_ctx_flags_t) flags;
 } ioring_ctx_t;
 
@@ -203,6 +239,11 @@ void ioring_ctx_init(ioring_ctx_t* ctx);
  */
 void ioring_ctx_deinit(ioring_ctx_t* ctx);
 
+/**
+ * @brief Create the worker threads used for operations that can not be dispatched to a vnode, and the poll thread.
+ */
+void ioring_workers_init(void);
+
 /**
  * @brief Notify the context of new SQEs.
  *
@@ -53,12 +53,51 @@ typedef struct cache cache_t;
  * To minimize CPU contention, each CPU has its own active slab from which it allocates and deallocates objects. It will
  * continue using its own slab until its empty, at which point it will try to acquire a new slab from the shared cache.
  *
+ * ### Magazines
+ *
+ * In front of the slabs, each CPU has two "magazines", small LIFO stacks of free objects, called the loaded and the
+ * previous magazine. An allocation pops an object from the loaded magazine and a free pushes an object to it, since
+ * the magazines are only ever accessed by their own CPU this only requires disabling interrupts, no locks or atomic
+ * operations.
+ *
+ * When the loaded magazine is empty (on allocation) or full (on free) it is swapped with the previous magazine, if that
+ * does not help either we exchange a magazine with the "depot" of the cache, a shared list of full and empty
+ * magazines protected by the cache lock. Only when the depot also cannot help do we fall back to the slabs.
+ *
+ * Since there are always two magazines, a CPU alternating between allocating and freeing objects at a magazine
+ * boundary will not thrash the depot.
+ *
+ * The depot holds at most `CACHE_DEPOT_LIMIT` full magazines, any excess magazines have their objects returned to the
+ * slabs. Magazines themselves are allocated from an internal cache that does not use magazines.
+ *
+ * ### Reclaim
+ *
+ * Every `CONFIG_CACHE_RECLAIM_INTERVAL` a kernel thread calls `cache_reclaim()`, which trims each cache to its working
+ * set. For the full and empty magazines in the depot and the free slabs, we track the lowest amount seen since the last
+ * reclaim, that many were never needed during the interval, so their objects are returned to the slabs and the
+ * magazines and slabs themselves are freed. The magazines loaded on each CPU are not reclaimed, but there are at most
+ * two of them per CPU.
+ *
+ * @see https://www.usenix.org/legacy/event/usenix01/full_papers/bonwick/bonwick.pdf for more information on magazines.
+ *
  * ### Constructors and Destructors
  *
  * Initializing objects, as in setting up their inital state, takes time. To avoid paying this cost on every allocation,
  * the cache supports optional constructor and destructor functions. Such that when an object is freed, it remains in
  * its initalized state allowins us to reuse it without reinitialization.
  *
+ * ### Slab Placement
+ *
+ * All slabs are allocated within the `VMM_KERNEL_SLABS_MIN` to `VMM_KERNEL_SLABS_MAX` region of the kernel heap,
+ * aligned to their own size. This means that any pointer within this region belongs to some cache, and that the slab an
+ * object belongs to can be found by simply aligning the pointer down.
+ *
+ * ## Size Classes
+ *
+ * A set of generic caches with power of two object sizes, from `CACHE_SIZE_CLASS_MIN` up to `CACHE_SIZE_CLASS_MAX`, is
+ * used to back small `malloc()` allocations in the kernel, see `cache_alloc_size()`. Since an objects cache can be
+ * found from its address, these allocations dont need a header.
+ *
  * @see https://en.wikipedia.org/wiki/Slab_allocation for more information.
  * @see https://www.kernel.org/doc/gorman/html/understand/understand011.html for an explanation of the Linux kernel slab
  * allocator.
@@ -76,6 +115,16 @@ typedef uint16_t cache_bufctl_t; ///< Buffer control type.
 
 #define CACHE_SLAB_PAGES 64 ///< Number of pages in a slab.
 
+#define CACHE_SLAB_SIZE (CACHE_SLAB_PAGES * PAGE_SIZE) ///< Size of a slab in bytes.
+
+#define CACHE_MAGAZINE_SIZE 16 ///< Number of objects that fit in a magazine.
+
+#define CACHE_DEPOT_LIMIT 8 ///< Maximum number of full and empty magazines, each, stored in the depot of a cache.
+
+#define CACHE_SIZE_CLASS_MIN 16        ///< Object size of the smallest size class.
+#define CACHE_SIZE_CLASS_MAX PAGE_SIZE ///< Object size of the largest size class.
+#define CACHE_SIZE_CLASS_AMOUNT 9      ///< Number of size classes, from 16 bytes to 4 KiB.
+
 /**
  * @brief Cache slab layout structure.
  * @struct cache_slab_layout_t
@@ -106,15 +155,46 @@ typedef struct ALIGNED(CACHE_LINE)
 
 static_assert(sizeof(cache_slab_t) <= 64, "size of cache_slab_t is to large for a single cache line");
 
+/**
+ * @brief Cache magazine structure.
+ * @struct cache_magazine_t
+ */
+typedef struct
+{
+    list_entry_t entry; ///< Entry in one of the depot lists of the cache.
+    uint64_t count;     ///< Number of objects in the magazine.
+    void* rounds[CACHE_MAGAZINE_SIZE];
+} cache_magazine_t;
+
 /**
  * @brief Per-CPU cache context.
  * @struct cache_cpu_t
+ *
+ * Must only be accessed by its own CPU with interrupts disabled.
  */
 typedef struct ALIGNED(CACHE_LINE)
 {
+    cache_magazine_t* loaded;   ///< The magazine objects are allocated from and freed to, can be `NULL`.
+    cache_magazine_t* previous; ///< The previously loaded magazine, can be `NULL`.
     cache_slab_t* active;
+    uint64_t allocs; ///< Number of allocations made on this CPU.
+    uint64_t hits;   ///< Number of allocations served by a magazine of this CPU without acquiring any lock.
+    uint64_t frees;  ///< Number of frees made on this CPU.
 } cache_cpu_t;
 
+/**
+ * @brief Cache statistics.
+ * @struct cache_stats_t
+ */
+typedef struct
+{
+    uint64_t allocs;   ///< Total number of allocations.
+    uint64_t hits;     ///< Total number of allocations served by a per-CPU magazine without acquiring any lock.
+    uint64_t objects;  ///< Number of currently allocated objects.
+    uint64_t slabs;    ///< Number of slabs owned by the cache.
+    uint64_t capacity; ///< Total number of objects that fit in all slabs owned by the cache.
+} cache_stats_t;
+
 /**
  * @brief Cache structure.
  * @struct cache_t
@@ -132,6 +212,16 @@ typedef struct cache
     list_t partial;
     list_t full;
     uint64_t freeCount;
+    uint64_t slabCount;
+    list_t fullMagazines;        ///< Depot of full magazines.
+    list_t emptyMagazines;       ///< Depot of empty magazines.
+    uint64_t fullMagazineCount;  ///< Number of magazines in the full depot.
+    uint64_t emptyMagazineCount; ///< Number of magazines in the empty depot.
+    uint64_t freeMin;            ///< Lowest `freeCount` since the last reclaim.
+    uint64_t fullMagazineMin;    ///< Lowest `fullMagazineCount` since the last reclaim.
+    uint64_t emptyMagazineMin;   ///< Lowest `emptyMagazineCount` since the last reclaim.
+    list_entry_t entry;          ///< Entry in the list of caches considered by `cache_reclaim()`.
+    bool isRegistered;           ///< If the cache has been added to the list of caches, set on its first slab.
     cache_cpu_t cpus[CPU_MAX];
 } cache_t;
 
@@ -158,7 +248,17 @@ typedef struct cache
         .partial = LIST_CREATE((_cache).partial), \
         .full = LIST_CREATE((_cache).full), \
         .freeCount = 0, \
-        .cpus = {0}, \
+        .slabCount = 0, \
+        .fullMagazines = LIST_CREATE((_cache).fullMagazines), \
+        .emptyMagazines = LIST_CREATE((_cache).emptyMagazines), \
+        .fullMagazineCount = 0, \
+        .emptyMagazineCount = 0, \
+        .freeMin = 0, \
+        .fullMagazineMin = 0, \
+        .emptyMagazineMin = 0, \
+        .entry = LIST_ENTRY_CREATE((_cache).entry), \
+        .isRegistered = false, \
+        .cpus = {{0}}, \
     }
 
 /**
@@ -180,4 +280,60 @@ void* cache_alloc(cache_t* cache);
  */
 void cache_free(void* obj);
 
+/**
+ * @brief Check if a pointer is within a slab of any cache.
+ *
+ * @param ptr The pointer to check.
+ * @return `true` if the pointer belongs to a cache, `false` otherwise.
+ */
+bool cache_is_object(const void* ptr);
+
+/**
+ * @brief Get the object size of the cache that an object belongs to.
+ *
+ * @param obj The object, must belong to a cache.
+ * @return The object size of the cache, in bytes.
+ */
+size_t cache_object_size(const void* obj);
+
+/**
+ * @brief Allocate an object from the smallest size class that can fit the given size.
+ *
+ * The object is not zeroed.
+ *
+ * @param size The size of the object, must not be zero or larger than `CACHE_SIZE_CLASS_MAX`.
+ * @return Pointer to the allocated object, or `NULL` on failure.
+ */
+void* cache_alloc_size(size_t size);
+
+/**
+ * @brief Get a size class cache by its index.
+ *
+ * @param index The index of the size class, less than `CACHE_SIZE_CLASS_AMOUNT`.
+ * @return The size class cache.
+ */
+cache_t* cache_size_class_get(uint64_t index);
+
+/**
+ * @brief Return memory held by the caches that went unused since the last call.
+ *
+ * Called periodically by the thread started with `cache_reclaim_init()`.
+ */
+void cache_reclaim(void);
+
+/**
+ * @brief Start the thread periodically calling `cache_reclaim()`.
+ */
+void cache_reclaim_init(void);
+
+/**
+ * @brief Collect statistics for a cache.
+ *
+ * The statistics are collected without acquiring any per-CPU state, so they might be slightly out of date.
+ *
+ * @param cache The cache.
+ * @param stats Will be filled with the statistics.
+ */
+void cache_stats_get(cache_t* cache, cache_stats_t* stats);
+
 /** @} */
\ No newline at end of file
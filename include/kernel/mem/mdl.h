@@ -142,6 +142,17 @@ uint64_t mdl_read(mdl_t* mdl, void* buffer, size_t count, size_t offset);
  */
 uint64_t mdl_write(mdl_t* mdl, const void* buffer, size_t count, size_t offset);
 
+/**
+ * @brief Fill a range of a Memory Descriptor List with a constant byte.
+ *
+ * @param mdl The MDL to fill.
+ * @param value The byte to fill with.
+ * @param count Number of bytes to fill.
+ * @param offset Offset within the MDL to start filling from.
+ * @return The number of bytes filled.
+ */
+uint64_t mdl_set(mdl_t* mdl, uint8_t value, size_t count, size_t offset);
+
 /**
  * @brief Memory Descriptor List Iterator structure.
  * @struct mdl_iter_t
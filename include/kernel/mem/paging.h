@@ -14,12 +14,64 @@
  * @{
  */
 
+/**
+ * @brief Flushes the entire TLB of the current CPU.
+ *
+ * Reloading CR3 does not flush global entries, to flush those we must instead toggle global pages in CR4.
+ *
+ * @param global Whether global entries should also be flushed.
+ */
+static inline void tlb_flush(bool global)
+{
+    if (global)
+    {
+        uint64_t cr4 = cr4_read();
+        cr4_write(cr4 & ~CR4_PAGE_GLOBAL_ENABLE);
+        cr4_write(cr4);
+    }
+    else
+    {
+        cr3_write(cr3_read());
+    }
+}
+
+/**
+ * @brief `invpcid` invalidation types.
+ * @enum invpcid_type_t
+ */
+typedef enum
+{
+    INVPCID_ADDRESS = 0,    ///< Invalidate a single address tagged with the PCID.
+    INVPCID_CONTEXT = 1,    ///< Invalidate all non-global entries tagged with the PCID.
+    INVPCID_ALL_GLOBAL = 2, ///< Invalidate all entries, including global entries, for all PCIDs.
+    INVPCID_ALL = 3,        ///< Invalidate all non-global entries for all PCIDs.
+} invpcid_type_t;
+
+/**
+ * @brief Invalidates TLB entries using `invpcid`.
+ *
+ * Must only be used if the CPU supports the `invpcid` instruction.
+ *
+ * @param type The type of invalidation.
+ * @param pcid The PCID to invalidate, ignored by `INVPCID_ALL_GLOBAL` and `INVPCID_ALL`.
+ * @param addr The address to invalidate, only used by `INVPCID_ADDRESS`.
+ */
+static inline void tlb_invpcid(invpcid_type_t type, uint16_t pcid, const void* addr)
+{
+    struct
+    {
+        uint64_t pcid;
+        uint64_t addr;
+    } desc = {pcid, (uint64_t)addr};
+    ASM("invpcid %0, %1" ::"m"(desc), "r"((uint64_t)type) : "memory");
+}
+
 /**
  * @brief Invalidates a region of pages in the TLB.
  *
  * Even if a page table entry is modified, the CPU might still use a cached version of the entry in the TLB. To ensure
- * our changes are detected we must invalidate this cache using `invlpg` or if many pages are changed, a full TLB flush
- * by reloading CR3.
+ * our changes are detected we must invalidate this cache using `invlpg` or if many pages are changed, a full TLB flush,
+ * which for the higher half must include global entries.
  *
  * @param addr The starting virtual address of the region.
  * @param amount The number of pages to invalidate.
@@ -33,7 +85,7 @@ static inline void tlb_invalidate(void* addr, size_t amount)
 
     if (amount > 16)
     {
-        cr3_write(cr3_read());
+        tlb_flush((uintptr_t)addr >= PML_HIGHER_HALF_START);
     }
     else
     {
@@ -79,7 +131,10 @@ static inline uint64_t pml_new(page_table_t* table, pml_t** outPml)
         return ERR;
     }
     pml_t* pml = PFN_TO_VIRT(pfn);
-    memset(pml, 0, PAGE_SIZE);
+    if (!table->zeroedPages)
+    {
+        memset(pml, 0, PAGE_SIZE);
+    }
     *outPml = pml;
     return 0;
 }
@@ -106,7 +161,18 @@ static inline void pml_free(page_table_t* table, pml_t* pml, pml_level_t level)
             continue;
         }
 
-        if (level > PML1)
+        if (level == PML2 && entry->size)
+        {
+            if (entry->owned)
+            {
+                for (uint64_t j = 0; j < PML_HUGE_PAGES; j++)
+                {
+                    pfn_t pfn = entry->pfn + j;
+                    table->freePages(&pfn, 1);
+                }
+            }
+        }
+        else if (level > PML1)
         {
             pml_free(table, PFN_TO_VIRT(entry->pfn), level - 1);
         }
@@ -133,6 +199,7 @@ static inline uint64_t page_table_init(page_table_t* table, pml_alloc_pages_t al
 {
     table->allocPages = allocPages;
     table->freePages = freePages;
+    table->zeroedPages = false;
     if (pml_new(table, &table->pml4) == ERR)
     {
         return ERR;
@@ -221,6 +288,7 @@ typedef struct
     pml_index_t oldIdx2;
     pml_index_t oldIdx1;
     pml_entry_t* entry;
+    bool huge; ///< If set, `entry` is a PML2 entry mapping a huge page.
 } page_table_traverse_t;
 
 /**
@@ -233,6 +301,7 @@ typedef struct
         .pml3Valid = false, \
         .pml2Valid = false, \
         .pml1Valid = false, \
+        .huge = false, \
     }
 
 /**
@@ -245,6 +314,9 @@ typedef struct
  * apply to lower levels, meaning that the lowest level should be the one with the actual desired permissions.
  * Additionally, the `PML_GLOBAL` flag is not allowed on the PML3 level.
  *
+ * If a huge page is encountered the traversal stops at the PML2 level, `traverse->entry` will then point to the PML2
+ * entry and `traverse->huge` will be set.
+ *
  * @param table The page table.
  * @param traverse The helper structure used to cache each layer.
  * @param addr The target virtual address.
@@ -279,6 +351,15 @@ static inline uint64_t page_table_traverse(page_table_t* table, page_table_trave
     }
 
     pml_index_t newIdx1 = PML_ADDR_TO_INDEX(addr, PML2);
+    if (traverse->pml2->entries[newIdx1].size)
+    {
+        traverse->oldIdx1 = newIdx1;
+        traverse->pml1Valid = false;
+        traverse->entry = &traverse->pml2->entries[newIdx1];
+        traverse->huge = true;
+        return 0;
+    }
+
     if (!traverse->pml1Valid || traverse->oldIdx1 != newIdx1)
     {
         if (page_table_get_pml(table, traverse->pml2, newIdx1, flags | PML_WRITE | PML_USER, &traverse->pml1) == ERR)
@@ -289,9 +370,24 @@ static inline uint64_t page_table_traverse(page_table_t* table, page_table_trave
     }
 
     traverse->entry = &traverse->pml1->entries[PML_ADDR_TO_INDEX(addr, PML1)];
+    traverse->huge = false;
     return 0;
 }
 
+/**
+ * @brief Retrieves the number of pages from a virtual address to the end of the huge page containing it.
+ *
+ * Used to skip over the remainder of a huge page when iterating over a range of pages.
+ *
+ * @param addr The virtual address.
+ * @param amount The maximum number of pages to return.
+ * @return The number of pages, at most `amount`.
+ */
+static inline uint64_t page_table_huge_remaining(const void* addr, uint64_t amount)
+{
+    return MIN(amount, (PML2_SIZE - ((uintptr_t)addr % PML2_SIZE)) / PAGE_SIZE);
+}
+
 /**
  * @brief Retrieves the physical address mapped to a given virtual address.
  *
@@ -317,7 +413,13 @@ static inline uint64_t page_table_get_phys_addr(page_table_t* table, void* addr,
         return ERR;
     }
 
-    *out = PFN_TO_PHYS(traverse.entry->pfn) + offset;
+    pfn_t pfn = traverse.entry->pfn;
+    if (traverse.huge)
+    {
+        pfn += PML_ADDR_TO_INDEX(addr, PML1);
+    }
+
+    *out = PFN_TO_PHYS(pfn) + offset;
     return 0;
 }
 
@@ -345,6 +447,11 @@ static inline bool page_table_is_mapped(page_table_t* table, const void* addr, s
         {
             return false;
         }
+
+        if (traverse.huge)
+        {
+            i += page_table_huge_remaining(addr + i * PAGE_SIZE, amount - i) - 1;
+        }
     }
 
     return true;
@@ -375,6 +482,11 @@ static inline bool page_table_is_unmapped(page_table_t* table, void* addr, size_
         {
             return false;
         }
+
+        if (traverse.huge)
+        {
+            i += page_table_huge_remaining(addr + i * PAGE_SIZE, amount - i) - 1;
+        }
     }
 
     return true;
@@ -410,7 +522,7 @@ static inline uint64_t page_table_map(page_table_t* table, void* addr, phys_addr
             return ERR;
         }
 
-        if (traverse.entry->present)
+        if (traverse.entry->present || traverse.huge)
         {
             return ERR;
         }
@@ -457,7 +569,7 @@ static inline uint64_t page_table_map_pages(page_table_t* table, void* addr, con
             return ERR;
         }
 
-        if (traverse.entry->present)
+        if (traverse.entry->present || traverse.huge)
         {
             return ERR;
         }
@@ -473,6 +585,179 @@ static inline uint64_t page_table_map_pages(page_table_t* table, void* addr, con
     return 0;
 }
 
+/**
+ * @brief Maps a range of virtual addresses to a shared zero page, marking them as lazily allocated.
+ *
+ * The pages are mapped read-only with the `lazy` bit set, with `lazyWrite` set if `flags` contains `PML_WRITE`. They
+ * are never owned, its the responsibility of the caller to replace them with private pages when written to.
+ *
+ * If any page in the range is already mapped, the function will fail and return `ERR`.
+ *
+ * @param table The page table.
+ * @param addr The starting virtual address.
+ * @param zeroPfn The page frame number of the shared zero page.
+ * @param amount The number of pages to map.
+ * @param flags The flags the pages should have once allocated. Must include `PML_PRESENT`.
+ * @return On success, `0`. On failure, `ERR`.
+ */
+static inline uint64_t page_table_map_lazy(page_table_t* table, void* addr, pfn_t zeroPfn, size_t amount,
+    pml_flags_t flags)
+{
+    if (!(flags & PML_PRESENT))
+    {
+        return ERR;
+    }
+
+    page_table_traverse_t traverse = PAGE_TABLE_TRAVERSE_CREATE;
+
+    for (uint64_t i = 0; i < amount; i++)
+    {
+        if (page_table_traverse(table, &traverse, addr, flags) == ERR)
+        {
+            return ERR;
+        }
+
+        if (traverse.entry->present || traverse.huge)
+        {
+            return ERR;
+        }
+
+        traverse.entry->raw = flags & ~(PML_WRITE | PML_OWNED);
+        traverse.entry->pfn = zeroPfn;
+        traverse.entry->lowCallbackId = PML_CALLBACK_NONE & 1;
+        traverse.entry->highCallbackId = PML_CALLBACK_NONE >> 1;
+        traverse.entry->lazy = true;
+        traverse.entry->lazyWrite = (flags & PML_WRITE) != 0;
+
+        addr = (void*)((uintptr_t)addr + PAGE_SIZE);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Maps a huge page in the page table.
+ *
+ * If any page in the range is already mapped or a PML1 exists for the range, the function will fail and return `ERR`.
+ *
+ * @param table The page table.
+ * @param addr The virtual address, must be aligned to `PML2_SIZE`.
+ * @param pfn The page frame number of the first page of the huge page, must be aligned to `PML_HUGE_PAGES`.
+ * @param flags The flags to set for the huge page. Must include `PML_PRESENT`.
+ * @param callbackId The callback ID to associate with the huge page or `PML_CALLBACK_NONE`.
+ * @return On success, `0`. On failure, `ERR`.
+ */
+static inline uint64_t page_table_map_huge(page_table_t* table, void* addr, pfn_t pfn, pml_flags_t flags,
+    pml_callback_id_t callbackId)
+{
+    if (!(flags & PML_PRESENT) || (uintptr_t)addr % PML2_SIZE != 0 || pfn % PML_HUGE_PAGES != 0)
+    {
+        return ERR;
+    }
+
+    pml_t* pml3;
+    if (page_table_get_pml(table, table->pml4, PML_ADDR_TO_INDEX(addr, PML4),
+            (flags | PML_WRITE | PML_USER) & ~(PML_GLOBAL | PML_SIZE), &pml3) == ERR)
+    {
+        return ERR;
+    }
+
+    pml_t* pml2;
+    if (page_table_get_pml(table, pml3, PML_ADDR_TO_INDEX(addr, PML3), (flags | PML_WRITE | PML_USER) & ~PML_SIZE,
+            &pml2) == ERR)
+    {
+        return ERR;
+    }
+
+    pml_entry_t* entry = &pml2->entries[PML_ADDR_TO_INDEX(addr, PML2)];
+    if (entry->raw != 0)
+    {
+        return ERR;
+    }
+
+    entry->raw = (flags & PML_FLAGS_MASK) | PML_SIZE;
+    entry->pfn = pfn;
+    entry->lowCallbackId = callbackId & 1;
+    entry->highCallbackId = callbackId >> 1;
+    return 0;
+}
+
+/**
+ * @brief Splits the huge page containing a virtual address into a PML1 of regular pages.
+ *
+ * The new pages inherit the flags, ownership, pin state and callback ID of the huge page, meaning that the mapping
+ * itself is unchanged. If the address is not mapped by a huge page, nothing is done.
+ *
+ * Only the TLB of the current CPU is invalidated, if the page table might be in use by other CPUs the caller must also
+ * shoot down the huge page on them. Any pin depth tracked for the huge page must also be moved to the new pages, see
+ * `space_pin_split()`.
+ *
+ * @param table The page table.
+ * @param addr The virtual address.
+ * @return On success, `0`. On failure, `ERR`.
+ */
+static inline uint64_t page_table_split_huge(page_table_t* table, const void* addr)
+{
+    page_table_traverse_t traverse = PAGE_TABLE_TRAVERSE_CREATE;
+    if (page_table_traverse(table, &traverse, addr, PML_NONE) == ERR || !traverse.huge)
+    {
+        return 0;
+    }
+
+    pml_t* pml1;
+    if (pml_new(table, &pml1) == ERR)
+    {
+        return ERR;
+    }
+
+    pml_entry_t huge = *traverse.entry;
+    for (pml_index_t i = 0; i < PML_INDEX_AMOUNT; i++)
+    {
+        pml1->entries[i].raw = huge.raw & ~PML_SIZE;
+        pml1->entries[i].pfn = huge.pfn + i;
+    }
+
+    traverse.entry->raw = PML_PRESENT | PML_WRITE | PML_USER;
+    traverse.entry->pfn = VIRT_TO_PFN(pml1);
+
+    // The translation is unchanged, but the TLB must not hold both the huge and regular translations.
+    tlb_invalidate((void*)ROUND_DOWN((uintptr_t)addr, PML2_SIZE), 1);
+    return 0;
+}
+
+/**
+ * @brief Splits any huge pages that are only partially covered by a range of virtual addresses.
+ *
+ * Since the range is contiguous only the huge pages containing its first and last page can be partially covered.
+ *
+ * @param table The page table.
+ * @param addr The starting virtual address.
+ * @param amount The number of pages in the range.
+ * @return On success, `0`. On failure, `ERR`.
+ */
+static inline uint64_t page_table_split(page_table_t* table, void* addr, size_t amount)
+{
+    if (amount == 0)
+    {
+        return 0;
+    }
+
+    uintptr_t start = (uintptr_t)addr;
+    uintptr_t end = start + amount * PAGE_SIZE;
+
+    if (start % PML2_SIZE != 0 && page_table_split_huge(table, (void*)start) == ERR)
+    {
+        return ERR;
+    }
+
+    if (end % PML2_SIZE != 0 && page_table_split_huge(table, (void*)(end - PAGE_SIZE)) == ERR)
+    {
+        return ERR;
+    }
+
+    return 0;
+}
+
 /**
  * @brief Unmaps a range of virtual addresses from the page table.
  *
@@ -482,6 +767,8 @@ static inline uint64_t page_table_map_pages(page_table_t* table, void* addr, con
  * must unmap, wait for all CPUs to acknowledge the unmap, and only then free the pages. Use `page_table_clear()` to
  * free owned pages separately.
  *
+ * Any huge pages only partially covered by the range must first be split using `page_table_split()`.
+ *
  * @param table The page table.
  * @param addr The starting virtual address.
  * @param amount The number of pages to unmap.
@@ -503,6 +790,11 @@ static inline void page_table_unmap(page_table_t* table, void* addr, size_t amou
         }
 
         traverse.entry->present = 0;
+
+        if (traverse.huge)
+        {
+            i += page_table_huge_remaining(addr + i * PAGE_SIZE, amount - i) - 1;
+        }
     }
 
     tlb_invalidate(addr, amount);
@@ -592,7 +884,8 @@ static inline void page_table_clear_pml1_pml2_pml3(page_table_t* table, page_tab
  * Intended to be used in conjunction with `page_table_unmap()` to first unmap pages and then free any owned pages after
  * TLB shootdown is complete.
  *
- * Any still present or pinned entries will be skipped.
+ * Any still present or pinned entries will be skipped. Huge pages are cleared as a whole, meaning that any huge pages
+ * only partially covered by the range must first be split using `page_table_split()`.
  *
  * All unskipped entries will be fully cleared (set to 0).
  *
@@ -619,6 +912,13 @@ static inline void page_table_clear(page_table_t* table, void* addr, size_t amou
         }
         prevTraverse = traverse;
 
+        uint64_t pages = 1;
+        if (traverse.huge)
+        {
+            pages = page_table_huge_remaining(addr + i * PAGE_SIZE, amount - i);
+            i += pages - 1;
+        }
+
         if (traverse.entry->present)
         {
             continue;
@@ -626,7 +926,10 @@ static inline void page_table_clear(page_table_t* table, void* addr, size_t amou
 
         if (traverse.entry->owned)
         {
-            page_table_page_buffer_push(table, &pageBuffer, PFN_TO_VIRT(traverse.entry->pfn));
+            for (uint64_t j = 0; j < (traverse.huge ? PML_HUGE_PAGES : 1); j++)
+            {
+                page_table_page_buffer_push(table, &pageBuffer, PFN_TO_VIRT(traverse.entry->pfn + j));
+            }
         }
 
         traverse.entry->raw = 0;
@@ -660,10 +963,17 @@ static inline void page_table_collect_callbacks(page_table_t* table, void* addr,
             continue;
         }
 
+        uint64_t pages = 1;
+        if (traverse.huge)
+        {
+            pages = page_table_huge_remaining(addr + i * PAGE_SIZE, amount - i);
+            i += pages - 1;
+        }
+
         pml_callback_id_t callbackId = traverse.entry->lowCallbackId | (traverse.entry->highCallbackId << 1);
         if (callbackId != PML_CALLBACK_NONE)
         {
-            callbacks[callbackId]++;
+            callbacks[callbackId] += pages;
         }
     }
 }
@@ -671,12 +981,14 @@ static inline void page_table_collect_callbacks(page_table_t* table, void* addr,
 /**
  * @brief Sets the flags for a range of pages in the page table.
  *
- * If a page is not currently mapped, it is skipped.
+ * If a page is not currently mapped, it is skipped. Any huge pages only partially covered by the range must first be
+ * split using `page_table_split()`.
  *
  * @param table The page table.
  * @param addr The starting virtual address.
  * @param amount The number of pages to update.
- * @param flags The new flags to set. The `PML_OWNED` flag is preserved.
+ * @param flags The new flags to set. The `PML_OWNED` flag is preserved, and `PML_WRITE` only updates the `lazyWrite`
+ * bit of lazily allocated pages.
  * @return On success, `0`. On failure, `ERR`.
  */
 static inline uint64_t page_table_set_flags(page_table_t* table, void* addr, size_t amount, pml_flags_t flags)
@@ -695,13 +1007,27 @@ static inline uint64_t page_table_set_flags(page_table_t* table, void* addr, siz
             return ERR;
         }
 
+        pml_flags_t entryFlags = flags & ~PML_OWNED;
         if (traverse.entry->owned)
         {
-            flags |= PML_OWNED;
+            entryFlags |= PML_OWNED;
+        }
+
+        // Lazily allocated pages must stay read-only until they have been allocated.
+        if (traverse.entry->lazy)
+        {
+            traverse.entry->lazyWrite = (flags & PML_WRITE) != 0;
+            entryFlags &= ~PML_WRITE;
         }
 
         // Bit magic to only update the flags while preserving the address and callback ID.
-        traverse.entry->raw = (traverse.entry->raw & ~PML_FLAGS_MASK) | (flags & PML_FLAGS_MASK);
+        traverse.entry->raw = (traverse.entry->raw & ~PML_FLAGS_MASK) | (entryFlags & PML_FLAGS_MASK);
+
+        if (traverse.huge)
+        {
+            traverse.entry->size = 1;
+            i += page_table_huge_remaining(addr + i * PAGE_SIZE, amount - i) - 1;
+        }
     }
 
     tlb_invalidate(addr, amount);
@@ -928,6 +1254,13 @@ static inline uint64_t page_table_find_unmapped_region(page_table_t* table, void
             continue;
         }
 
+        if (entry2->size)
+        {
+            consecutiveUnmapped = 0;
+            currentAddr = ROUND_UP(currentAddr + 1, PML2_SIZE);
+            continue;
+        }
+
         pml_t* pml1 = PFN_TO_VIRT(entry2->pfn);
         pml_index_t idx1 = PML_ADDR_TO_INDEX(currentAddr, PML1);
 
@@ -992,6 +1325,11 @@ static inline bool page_table_is_pinned(page_table_t* table, void* addr, size_t
         {
             return true;
         }
+
+        if (traverse.huge)
+        {
+            i += page_table_huge_remaining(addr + i * PAGE_SIZE, amount - i) - 1;
+        }
     }
 
     return false;
@@ -1050,6 +1388,18 @@ static inline uint64_t page_table_count_pages_with_flags(page_table_t* table, vo
             continue;
         }
 
+        if (entry2->size)
+        {
+            uint64_t pages = page_table_huge_remaining(addr, amount);
+            if ((entry2->raw & flags) == flags)
+            {
+                count += pages;
+            }
+            addr = (void*)((uintptr_t)addr + pages * PAGE_SIZE);
+            amount -= pages;
+            continue;
+        }
+
         pml_t* pml1 = PFN_TO_VIRT(entry2->pfn);
         pml_index_t idx1 = PML_ADDR_TO_INDEX((uintptr_t)addr, PML1);
 
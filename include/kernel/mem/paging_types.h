@@ -1,6 +1,7 @@
 #pragma once
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <sys/math.h>
@@ -26,6 +27,11 @@
  * partway through and make a mess. Its simply best for performance and flexibility to have the caller ensure that the
  * operation will succeed.
  *
+ * Owned anonymous memory may be mapped using 2MiB huge pages, which are PML2 entries with the `PML_SIZE` flag set that
+ * map a naturally aligned block of physical memory directly instead of pointing to a PML1. The owned, pinned and
+ * callback metadata of a huge entry applies to every page within it. Operations on a range that only partially covers
+ * a huge page require the caller to first split it using `page_table_split()`.
+ *
  * @see [OSDev Paging](https://wiki.osdev.org/Paging)
  *
  * @{
@@ -103,7 +109,7 @@ typedef struct
             uint64_t cacheDisabled : 1; ///< If set caching is disabled for the page.
             uint64_t accessed : 1;      ///< If set the page has been accessed (read or written to).
             uint64_t dirty : 1;         ///< If set the page has been written to.
-            uint64_t size : 1;          // Unused
+            uint64_t size : 1;          ///< If set in a PML2 entry, the entry maps a 2MiB huge page.
             uint64_t global : 1;        ///< If set the page is not flushed from the TLB on a context switch.
             /**
              * If set, then when the entry is unmapped or the page table is freed, the physical page will be freed.
@@ -139,7 +145,23 @@ typedef struct
              * Check the virtual memory manager for more information. (Defined by PatchworkOS)
              */
             uint64_t highCallbackId : 7;
-            uint64_t protection : 4;
+            /**
+             * If set, the page is lazily allocated and currently maps the shared read-only zero page, a private page
+             * will be allocated the first time it is written to.
+             *
+             * Uses one of the protection key bits, which are ignored as PatchworkOS does not enable protection keys.
+             *
+             * (Defined by PatchworkOS)
+             */
+            uint64_t lazy : 1;
+            /**
+             * If set, the lazily allocated page is writable and a write will allocate its private page, otherwise the
+             * write is a protection violation. The `write` flag itself is always clear for lazily allocated pages.
+             *
+             * Uses one of the protection key bits. (Defined by PatchworkOS)
+             */
+            uint64_t lazyWrite : 1;
+            uint64_t protection : 2;
             uint64_t noExecute : 1;
         };
     };
@@ -366,6 +388,11 @@ typedef enum
  */
 #define PML2_SIZE (1ULL << (PML_INDEX_BITS + PML_ADDR_OFFSET_BITS))
 
+/**
+ * @brief Number of pages mapped by a single huge PML2 entry.
+ */
+#define PML_HUGE_PAGES (PML2_SIZE / PAGE_SIZE)
+
 /**
  * @brief Size of the region mapped by a single PML3 entry.
  */
@@ -435,6 +462,7 @@ typedef struct page_table
     pml_alloc_pages_t allocPages;
     pml_free_pages_t freePages;
     pml_t* pml4;
+    bool zeroedPages; ///< If `allocPages` is guaranteed to return zeroed pages.
 } page_table_t;
 
 /** @} */
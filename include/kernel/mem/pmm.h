@@ -1,7 +1,11 @@
 #pragma once
 
 #include <boot/boot_info.h>
+#include <kernel/config.h>
+#include <kernel/sync/lock.h>
 
+#include <stdatomic.h>
+#include <sys/list.h>
 #include <sys/proc.h>
 
 /**
@@ -11,15 +15,58 @@
  *
  * The Physical Memory Manager (PMM) is responsible for allocating and freeing physical memory pages.
  *
- * ## The Free Page Stack
+ * ## Zones
  *
- * For most allocations, the PMM uses a fast `O(1)` stack-based allocator to manage free pages, with the limitation that
- * only single pages can be allocated or freed at a time.
+ * Physical memory is divided into zones, each covering a range of PFNs and having its own lock, free lists and
+ * statistics, such that allocations from one zone never contend with allocations from another.
  *
- * ## The Bitmap Allocator
+ * - `PMM_ZONE_DMA`: All pages below `CONFIG_PMM_DMA_MAX_ADDR`, only used when an allocation requires low memory or
+ * when the other zones are exhausted.
+ * - `PMM_ZONE_DMA32`: All remaining pages below `PMM_DMA32_MAX_ADDR`, used for allocations that must be reachable with
+ * 32-bit addresses and when the normal zone is exhausted.
+ * - `PMM_ZONE_NORMAL`: All remaining pages.
  *
- * For larger, contiguous or aligned allocations, the PMM uses a bitmap allocator. This allocator is slower (`O(n)`) but
- * is usefull for more specialized allocations.
+ * Since the zones are split at the limits used by allocations that require low memory, such allocations can take the
+ * first free block of a zone entirely below their limit instead of searching the free lists for a suitable block.
+ *
+ * Nothing outside of the PMM needs to know which zone a page belongs to, so splitting the zones further, for example
+ * into one set of zones per NUMA node, only requires changes to the PMM itself.
+ *
+ * ## The Buddy Allocator
+ *
+ * Each zone manages its free pages using a buddy allocator. Free memory is stored as blocks of \f$2^{order}\f$ pages,
+ * aligned to their own size, with one free list per order up to `PMM_MAX_ORDER`.
+ *
+ * To allocate a block of a given order, we take a block from the first non-empty free list of at least that order and
+ * repeatedly split it in half, returning the unused halves to the free lists, until it has the requested order. When a
+ * block is freed, we check if its "buddy", the other half of the block it was split from, is also free and if so merge
+ * them, repeating until the buddy is not free or the maximum order is reached.
+ *
+ * This makes both single page and contiguous, aligned allocations `O(log n)`, across all of physical memory.
+ *
+ * The free lists are stored within the free blocks themselves, while the order of each free block is stored in the
+ * `page_t` of its first page.
+ *
+ * ## Per-CPU Page Caches
+ *
+ * To avoid the zone locks becoming a bottleneck, each CPU has a small cache of free pages. Single page allocations and
+ * frees of normal and DMA32 zone pages are served from this cache with only interrupts disabled, when the cache is
+ * empty it is refilled with `PMM_CPU_CACHE_BATCH` pages from the normal zone, or the DMA32 zone if the normal zone is
+ * empty, and when it is full the same amount of pages is drained back to their zones, both under a single acquisition
+ * of each zone lock.
+ *
+ * ## Pre-Zeroed Pages
+ *
+ * Many allocations, such as page tables and `VMM_ALLOC_ZERO` allocations, need zeroed pages. Instead of always zeroing
+ * these synchronously each CPU keeps a pool of up to `CONFIG_PMM_ZEROED_PAGES` free pages that have already been
+ * zeroed. Each pool is refilled by a kernel thread pinned to its CPU, which wakes up every `CONFIG_PMM_ZEROED_INTERVAL`
+ * and only zeroes pages while no other thread is runnable on the CPU, using the longest time slice such that it is the
+ * last to be picked when the CPU is busy. The pages are zeroed using non-temporal stores, such that zeroing them does
+ * not evict useful data from the cache.
+ *
+ * `pmm_alloc_zeroed()` and `pmm_alloc_pages_zeroed()` take pages from the pool of the current CPU first, only falling
+ * back to zeroing a page synchronously when the pool is empty. The pools are drained back to the zones if memory runs
+ * out.
  *
  * ## Reference Counting
  *
@@ -40,25 +87,117 @@
  */
 typedef struct
 {
-    uint16_t ref;
+    _Atomic(uint16_t) ref;
+    uint8_t order; ///< The order of the free block starting at this page, only valid if `PAGE_FREE` is set.
+    uint8_t flags; ///< Page flags, protected by the lock of the zone the page belongs to.
 } page_t;
 
 /**
- * @brief Maximum number of free pages that can be stored in a free page.
+ * @brief Page flags.
+ * @enum page_flags_t
+ */
+typedef enum
+{
+    PAGE_NONE = 0,
+    PAGE_FREE = 1 << 0, ///< The page is the first page of a free block in the free lists of its zone.
+} page_flags_t;
+
+/**
+ * @brief The maximum order of a block in the buddy allocator, a block of this order is 4 MiB.
+ */
+#define PMM_MAX_ORDER 10
+
+/**
+ * @brief The number of orders, and thus free lists, in the buddy allocator.
+ */
+#define PMM_ORDER_AMOUNT (PMM_MAX_ORDER + 1)
+
+/**
+ * @brief The address below which pages are reachable by devices using 32-bit addresses.
  */
-#define FREE_PAGE_MAX (PAGE_SIZE / sizeof(pfn_t) - 1)
+#define PMM_DMA32_MAX_ADDR 0x100000000ULL
+
+/**
+ * @brief Zone types.
+ * @enum pmm_zone_type_t
+ */
+typedef enum
+{
+    PMM_ZONE_DMA = 0, ///< Pages below `CONFIG_PMM_DMA_MAX_ADDR`.
+    PMM_ZONE_DMA32,   ///< Pages below `PMM_DMA32_MAX_ADDR`.
+    PMM_ZONE_NORMAL,  ///< All other pages.
+    PMM_ZONE_AMOUNT,
+} pmm_zone_type_t;
 
 /**
- * @brief Stored in free pages to form a stack of free pages.
- * @struct page_stack_t
+ * @brief Physical memory zone.
+ * @struct pmm_zone_t
+ *
+ * Used internally by the PMM.
  */
-typedef struct page_stack
+typedef struct
 {
-    struct page_stack* next;
-    pfn_t pages[FREE_PAGE_MAX];
-} page_stack_t;
+    const char* name;
+    pfn_t start; ///< The first PFN in the zone.
+    pfn_t end;   ///< The PFN after the last PFN in the zone.
+    lock_t lock;
+    size_t total; ///< Number of usable pages in the zone.
+    size_t avail; ///< Number of free pages in the zone, excluding pages in per-CPU caches.
+    list_t freeLists[PMM_ORDER_AMOUNT];
+} pmm_zone_t;
+
+/**
+ * @brief Maximum number of pages stored in a per-CPU page cache.
+ */
+#define PMM_CPU_CACHE_MAX 64
 
-static_assert(sizeof(page_stack_t) == PAGE_SIZE, "page_stack_t must be exactly one page in size");
+/**
+ * @brief Number of pages moved between a per-CPU page cache and its zone at once.
+ */
+#define PMM_CPU_CACHE_BATCH (PMM_CPU_CACHE_MAX / 2)
+
+/**
+ * @brief Maximum number of pages zeroed by a fill thread before it checks if another thread wants its CPU.
+ */
+#define PMM_ZEROED_FILL_BATCH 16
+
+/**
+ * @brief Pre-zeroed page statistics.
+ * @struct pmm_zeroed_stats_t
+ */
+typedef struct
+{
+    uint64_t pages;  ///< Number of pages currently in all pools.
+    uint64_t hits;   ///< Number of zeroed pages taken from the pool.
+    uint64_t misses; ///< Number of zeroed pages that had to be zeroed synchronously.
+} pmm_zeroed_stats_t;
+
+/**
+ * @brief Per-CPU page cache.
+ * @struct pmm_cpu_cache_t
+ *
+ * Must only be accessed by its own CPU with interrupts disabled.
+ */
+typedef struct ALIGNED(64)
+{
+    size_t count;
+    pfn_t pfns[PMM_CPU_CACHE_MAX];
+} pmm_cpu_cache_t;
+
+/**
+ * @brief Per-CPU pre-zeroed page pool.
+ * @struct pmm_zeroed_pool_t
+ *
+ * Only accessed by its own CPU, except when memory runs out and all pools are drained, so the lock is uncontended.
+ */
+typedef struct ALIGNED(64)
+{
+    lock_t lock;
+    size_t count;
+    uint64_t hits;   ///< Only written by the owning CPU.
+    uint64_t misses; ///< Only written by the owning CPU.
+    pfn_t pfns[CONFIG_PMM_ZEROED_PAGES];
+} pmm_zeroed_pool_t;
 
 /**
  * @brief Read the boot info memory map and initialize the PMM.
@@ -68,8 +207,8 @@ void pmm_init(void);
 /**
  * @brief Allocate a single page of physical memory.
  *
- * Will by default use the free stack allocator, but if no pages are available there, it will fall back to the bitmap
- * allocator.
+ * Will by default allocate from the normal zone, but if no pages are available there, it will fall back to the DMA32
+ * zone and then the DMA zone.
  *
  * @return On success, the PFN of the allocated page. On failure, `ERR`.
  */
@@ -78,7 +217,7 @@ pfn_t pmm_alloc(void);
 /**
  * @brief Allocate multiple pages of physical memory.
  *
- * Usefull for reducing overhead from locking when allocating many pages.
+ * Equivalent to calling `pmm_alloc()` repeatedly, but if not all pages can be allocated then none are.
  *
  * @param pfns Array to store the allocated page PFNs.
  * @param count Number of pages to allocate.
@@ -87,14 +226,63 @@ pfn_t pmm_alloc(void);
 uint64_t pmm_alloc_pages(pfn_t* pfns, size_t count);
 
 /**
- * @brief Allocate a contiguous region of physical memory using the bitmap.
+ * @brief Allocate a single zeroed page of physical memory.
+ *
+ * Takes a page from the pre-zeroed pool if possible, otherwise allocates a page using `pmm_alloc()` and zeroes it.
+ *
+ * @return On success, the PFN of the allocated page. On failure, `ERR`.
+ */
+pfn_t pmm_alloc_zeroed(void);
+
+/**
+ * @brief Allocate multiple zeroed pages of physical memory.
+ *
+ * Equivalent to calling `pmm_alloc_zeroed()` repeatedly, but if not all pages can be allocated then none are.
  *
+ * @param pfns Array to store the allocated page PFNs.
  * @param count Number of pages to allocate.
- * @param maxPfn Maximum PFN to allocate up to (exclusive).
- * @param alignPfn Alignment of the region in pages.
+ * @return On success, `0`. On failure, `ERR` and no pages are allocated.
+ */
+uint64_t pmm_alloc_pages_zeroed(pfn_t* pfns, size_t count);
+
+/**
+ * @brief Start the threads refilling the pre-zeroed page pools.
+ *
+ * Creates one thread for each CPU, so must be called once all CPUs have been started. CPUs started later have no
+ * thread and always zero pages synchronously.
+ */
+void pmm_zeroed_init(void);
+
+/**
+ * @brief Get statistics for the pre-zeroed page pool.
+ *
+ * @param stats Will be filled with the statistics.
+ */
+void pmm_zeroed_stats_get(pmm_zeroed_stats_t* stats);
+
+/**
+ * @brief Allocate a contiguous region of physical memory.
+ *
+ * The region is allocated as a block of the smallest order that fits `count` pages, with any pages after the first
+ * `count` pages immediately returned to the zone. Each page in the region is reference counted individually.
+ *
+ * @param count Number of pages to allocate, at most \f$2^{PMM\_MAX\_ORDER}\f$.
+ * @param maxPfn Maximum PFN to allocate up to (exclusive), `UINT64_MAX` for no limit.
+ * @param alignPfn Alignment of the region in pages, must be zero or a power of two.
  * @return On success, the PFN of the first page of the allocated region. On failure, `ERR`.
  */
-pfn_t pmm_alloc_bitmap(size_t count, pfn_t maxPfn, pfn_t alignPfn);
+pfn_t pmm_alloc_contiguous(size_t count, pfn_t maxPfn, pfn_t alignPfn);
+
+/**
+ * @brief Allocate a naturally aligned block of \f$2^{order}\f$ pages of physical memory.
+ *
+ * Unlike `pmm_alloc_contiguous()` failure is not logged, as callers are expected to fall back to smaller allocations,
+ * for example when a huge page can not be found due to fragmentation.
+ *
+ * @param order The order of the block, at most `PMM_MAX_ORDER`.
+ * @return On success, the PFN of the first page of the allocated block. On failure, `ERR` and `errno` is set.
+ */
+pfn_t pmm_alloc_order(uint64_t order);
 
 /**
  * @brief Free a single page of physical memory.
@@ -108,8 +296,6 @@ void pmm_free(pfn_t pfn);
 /**
  * @brief Free multiple pages of physical memory.
  *
- * Useful for reducing overhead from locking when freeing many pages.
- *
  * The pages will only be reclaimed if its reference count reaches zero.
  *
  * @param pfns Array of PFNs to free.
@@ -27,10 +27,10 @@ typedef enum
 {
     SPACE_NONE = 0,
     /**
-     * Use the PMM bitmap to allocate the page table, this is really only for the kernel page table as it
+     * Allocate the page table from memory below 4 GiB, this is really only for the kernel page table as it
      * must be within a 32 bit boundary because the smp trampoline loads it as a dword.
      */
-    SPACE_USE_PMM_BITMAP = 1 << 0,
+    SPACE_USE_LOW_MEMORY = 1 << 0,
     SPACE_MAP_KERNEL_BINARY = 1 << 1, ///< Map the kernel binary into the address space.
     SPACE_MAP_KERNEL_HEAP = 1 << 2,   ///< Map the kernel heap into the address space.
     SPACE_MAP_IDENTITY = 1 << 3,      ///< Map the identity mapped physical memory into the address space.
@@ -72,7 +72,7 @@ typedef struct
  *
  * Note that the actual pin depth, if its is greater than 1, is tracked in the `pinnedPages` map, the page table only
  * tracks if a page is pinned or not for faster access and to avoid having to access the map even when just pinning a
- * page once.
+ * page once. A huge page is pinned as a whole, with its pin depth tracked under the address of its first page.
  */
 typedef struct space
 {
@@ -91,7 +91,12 @@ typedef struct space
     uint64_t callbacksLength;                        ///< Length of the `callbacks` array.
     BITMAP_DEFINE(callbackBitmap, PML_MAX_CALLBACK); ///< Bitmap to track available callback IDs.
     BITMAP_DEFINE(cpus, CPU_MAX);                    ///< Bitmap to track which CPUs are using this space.
-    atomic_uint16_t shootdownAcks;
+    uint64_t id;                                     ///< Unique identifier, never reused, used to tag PCIDs.
+    /**
+     * Incremented by every TLB shootdown of the space. A CPU that has cached entries for the space under a PCID
+     * must flush them when loading the space if the generation has changed since it last did so.
+     */
+    atomic_uint64_t tlbGen;
     lock_t lock;
 } space_t;
 
@@ -190,6 +195,32 @@ uint64_t space_pin_terminated(space_t* space, const void* address, const void* t
  */
 void space_unpin(space_t* space, const void* address, size_t length);
 
+/**
+ * @brief Gives each regular page of a pinned huge page its own pin depth, before the huge page is split.
+ *
+ * The pin depth of a huge page is tracked under its first address, while splitting it copies the pinned bit to all of
+ * its regular pages. Without this, unpinning, protecting or overwriting only part of the range afterwards would leave
+ * the pin depths and the pinned bits out of sync.
+ *
+ * Must be called with the space lock acquired.
+ *
+ * @param space The target address space.
+ * @param address The address of the huge page, must be aligned to `PML2_SIZE`.
+ * @return On success, `0`. On failure, `ERR` and `errno` is set to:
+ * - `ENOMEM`: Not enough memory.
+ */
+uint64_t space_pin_split(space_t* space, const void* address);
+
+/**
+ * @brief Reverts `space_pin_split()`, used when splitting the huge page itself failed.
+ *
+ * Must be called with the space lock acquired.
+ *
+ * @param space The target address space.
+ * @param address The address of the huge page, must be aligned to `PML2_SIZE`.
+ */
+void space_pin_merge(space_t* space, const void* address);
+
 /**
  * @brief Checks if a virtual memory region is within the allowed address range of the space.
  *
@@ -311,12 +342,47 @@ uint64_t space_user_page_count(space_t* space);
 /**
  * @brief Translate a virtual address to a physical address in the address space.
  *
+ * If the page is lazily allocated it is first given its own physical page, such that the returned address can safely
+ * be written to, for example by a device.
+ *
  * @param space The target address space.
  * @param virtAddr The virtual address to translate.
  * @return On success, `0`. On failure, `ERR` and `errno` is set to:
  * - `EINVAL`: Invalid parameters.
  * - `EFAULT`: The virtual address is not mapped.
+ * - `ENOMEM`: Not enough memory to allocate a lazily allocated page.
  */
 phys_addr_t space_virt_to_phys(space_t* space, const void* virtAddr);
 
+/**
+ * @brief Translate a virtual address to a physical address if the page is shared with other address spaces.
+ *
+ * A page is considered shared if it is not owned by the address space, for example shared memory mapped using
+ * `vmm_map_pages()`. Lazily allocated pages are never considered shared.
+ *
+ * @param space The target address space.
+ * @param virtAddr The virtual address to translate.
+ * @param outPhysAddr Output pointer for the physical address, only set if the page is shared.
+ * @return If the page is shared, `1`. If the page is private, `0`. On failure, `ERR` and `errno` is set to:
+ * - `EINVAL`: Invalid parameters.
+ * - `EFAULT`: The virtual address is not mapped.
+ */
+uint64_t space_virt_to_shared_phys(space_t* space, const void* virtAddr, phys_addr_t* outPhysAddr);
+
+/**
+ * @brief Handles a write page fault on a present page in the address space.
+ *
+ * If the page is lazily allocated and writable, it is replaced with a newly allocated zeroed page. If the page has
+ * already been made writable, for example by another CPU handling a fault on the same page, the fault is considered
+ * handled.
+ *
+ * @param space The target address space.
+ * @param faultAddr The faulting virtual address.
+ * @return If the fault was handled, `1`. If the fault was not caused by a lazily allocated page, `0`. On failure, `ERR`
+ * and `errno` is set to:
+ * - `EINVAL`: Invalid parameters.
+ * - `ENOMEM`: Not enough memory.
+ */
+uint64_t space_lazy_fault(space_t* space, const void* faultAddr);
+
 /** @} */
@@ -22,8 +22,44 @@
  * have the old mappings in their "TLB", which is a hardware feature letting the CPUs cache page table entries. This
  * cache must be cleared when we change the mappings of a page table. This is called a TLB shootdown.
  *
+ * Shootdowns are gathered into a `vmm_shootdown_t` batch, which coalesces the ranges added to it and falls back to a
+ * full TLB flush once it covers more than `VMM_SHOOTDOWN_FLUSH_ALL_PAGES` pages or more than `VMM_SHOOTDOWN_MAX_RANGES`
+ * distinct ranges. Flushing the batch sends a single IPI to each target CPU and waits for all of them at once.
+ *
+ * Only CPUs that currently have the address space loaded are targeted. Idle CPUs run the idle thread which uses the
+ * kernel space, so they are never interrupted for user space shootdowns, and CPUs running another address space
+ * catch up when they load it again, see PCIDs below. Kernel space mappings are shared by every address space, so kernel
+ * space shootdowns always interrupt every other CPU.
+ *
+ * ## PCIDs
+ *
+ * If supported, each CPU tags its TLB entries with a Process-Context Identifier (PCID) such that switching address
+ * spaces does not flush the TLB. Each CPU has `VMM_PCID_SLOTS` PCIDs which are handed out to the address spaces it
+ * loads, evicting the least recently used address space when it runs out.
+ *
+ * Since a CPU might still have entries cached for an address space it is no longer running, every shootdown increments
+ * the generation of the address space. Each PCID slot remembers the generation of the address space when it was last
+ * flushed and if it has changed when the address space is loaded again, the PCID is flushed as part of the load.
+ * Without PCID support, every address space switch is a full flush of non-global entries, as before.
+ *
  * Details can be found in `vmm_map()`, `vmm_unmap()` and `vmm_protect()`.
  *
+ * ## Lazy Allocation
+ *
+ * A `vmm_alloc()` with `VMM_ALLOC_LAZY` does not allocate any physical memory, instead every page of the region is
+ * mapped read-only to a single shared zero page and marked as lazily allocated in the page table. The first write to
+ * such a page causes a page fault, the fault handler then uses `space_lazy_fault()` to give the page its own zeroed
+ * physical page with the originally requested flags. Reading from a page that has never been written to costs nothing
+ * but the initial mapping, making large sparsely used regions cheap.
+ *
+ * ## Huge Pages
+ *
+ * If `CONFIG_VMM_HUGE_PAGES` is enabled, any part of a `vmm_alloc()` region that is aligned to and spans at least
+ * `PML2_SIZE` is backed by 2MiB huge pages when the PMM can provide them, with the rest of the region, or all of it if
+ * the PMM is too fragmented, being backed by regular pages. This reduces TLB pressure and the amount of page table
+ * entries that must be walked and modified. When `vmm_unmap()` or `vmm_protect()` only partially covers a huge page it
+ * is first split into regular pages, the same applies to any partially overwritten huge page.
+ *
  * ## Address Space Layout
  *
  * The address space layout is split into several regions. For convenience, the regions are defined using page table
@@ -44,6 +80,11 @@
  * at `VMM_KERNEL_HEAP_MIN` and grows up towards `VMM_KERNEL_HEAP_MAX`. This section takes up 2 indices in the
  * page table and is mapped identically for all processes.
  *
+ * The start of the kernel heap, from `VMM_KERNEL_SLABS_MIN` to `VMM_KERNEL_SLABS_MAX`, is reserved for the slabs of the
+ * object caches, this lets us determine if a pointer belongs to a cache just from its address. Its placed within the
+ * same top level page table entry as the rest of the heap such that the entry is shared by all processes from the
+ * start.
+ *
  * Fourthly, we have the identity mapped physical memory. All physical memory will be
  * mapped here by simply taking the original physical address and adding `0xFFFF800000000000` to it. This means that the
  * physical address `0x123456` will be mapped to the virtual address `0xFFFF800000123456`. This section takes up all
@@ -68,6 +109,9 @@
 #define VMM_KERNEL_HEAP_MAX VMM_KERNEL_STACKS_MIN                         ///< The maximum address for the kernel heap.
 #define VMM_KERNEL_HEAP_MIN PML_INDEX_TO_ADDR(PML_INDEX_AMOUNT - 5, PML4) ///< The minimum address for the kernel heap.
 
+#define VMM_KERNEL_SLABS_MAX (VMM_KERNEL_HEAP_MIN + PML3_SIZE * 16) ///< The maximum address for cache slabs.
+#define VMM_KERNEL_SLABS_MIN VMM_KERNEL_HEAP_MIN                    ///< The minimum address for cache slabs.
+
 #define VMM_IDENTITY_MAPPED_MAX VMM_KERNEL_HEAP_MIN   ///< The maximum address for the identity mapped physical memory.
 #define VMM_IDENTITY_MAPPED_MIN PML_HIGHER_HALF_START ///< The minimum address for the identity mapped physical memory.
 
@@ -83,23 +127,62 @@
 #define VMM_IS_PAGE_ALIGNED(addr) (((uintptr_t)(addr) & (PAGE_SIZE - 1)) == 0)
 
 /**
- * @brief TLB shootdown structure.
+ * @brief Maximum number of distinct ranges a shootdown batch can hold before falling back to a full TLB flush.
+ */
+#define VMM_SHOOTDOWN_MAX_RANGES 8
+
+/**
+ * @brief Amount of pages above which a shootdown batch falls back to a full TLB flush.
+ */
+#define VMM_SHOOTDOWN_FLUSH_ALL_PAGES 64
+
+/**
+ * @brief TLB shootdown range.
+ * @struct vmm_shootdown_range_t
+ */
+typedef struct
+{
+    void* virtAddr;
+    uint64_t pageAmount;
+} vmm_shootdown_range_t;
+
+/**
+ * @brief TLB shootdown batch.
  * @struct vmm_shootdown_t
  *
- * Stored in a CPU's shootdown list and will be processed when it receives a `INTERRUPT_TLB_SHOOTDOWN` interrupt.
+ * Lives on the stack of the initiating CPU, each target CPU is handed a pointer to the batch and reads the ranges
+ * directly from it. Since the initiating CPU waits for every target with interrupts disabled, each CPU can only have
+ * one batch in flight, so each target needs at most one pending slot per initiating CPU and can never overflow.
  */
 typedef struct
 {
-    list_entry_t entry;
     space_t* space;
-    void* virtAddr;
-    uint64_t pageAmount;
+    vmm_shootdown_range_t ranges[VMM_SHOOTDOWN_MAX_RANGES];
+    uint64_t rangeCount;
+    uint64_t pageAmount; ///< Total amount of pages added to the batch, might count overlapping pages more than once.
+    bool flushAll;       ///< If set, the ranges are ignored and the entire TLB is flushed instead.
+    atomic_uint16_t acks;
 } vmm_shootdown_t;
 
 /**
- * @brief Maximum number of shootdown requests that can be queued per CPU.
+ * @brief Amount of PCIDs each CPU hands out to address spaces.
+ *
+ * PCID `0` is never handed out, it is used by the kernel space during boot.
  */
-#define VMM_MAX_SHOOTDOWN_REQUESTS 16
+#define VMM_PCID_SLOTS 8
+
+/**
+ * @brief PCID slot.
+ * @struct vmm_pcid_slot_t
+ *
+ * The PCID of a slot is its index plus one.
+ */
+typedef struct
+{
+    uint64_t spaceId;  ///< The `id` of the address space using the slot, `0` if unused.
+    uint64_t tlbGen;   ///< The `tlbGen` of the address space when the PCID was last flushed.
+    uint64_t lastUsed; ///< Used to find the least recently used slot.
+} vmm_pcid_slot_t;
 
 /**
  * @brief Per-CPU VMM context.
@@ -107,10 +190,12 @@ typedef struct
  */
 typedef struct
 {
-    vmm_shootdown_t shootdowns[VMM_MAX_SHOOTDOWN_REQUESTS];
-    uint8_t shootdownCount;
-    lock_t lock;
+    _Atomic(vmm_shootdown_t*) pending[CPU_MAX]; ///< Batches sent to this CPU, indexed by the initiating CPU.
     space_t* space; ///< Will only be accessed by the owner CPU, so no lock.
+    bool pcid;      ///< If the CPU supports PCIDs.
+    bool invpcid;   ///< If the CPU supports the `invpcid` instruction.
+    vmm_pcid_slot_t pcids[VMM_PCID_SLOTS];
+    uint64_t pcidClock;
 } vmm_cpu_t;
 
 /**
@@ -121,7 +206,8 @@ typedef enum
 {
     VMM_ALLOC_OVERWRITE = 0 << 0,      ///< If any page is already mapped, overwrite the mapping.
     VMM_ALLOC_FAIL_IF_MAPPED = 1 << 0, ///< If set and any page is already mapped, fail and set `errno` to `EEXIST`.
-    VMM_ALLOC_ZERO = 1 << 1            ///< If set, atomically zero the allocated pages.
+    VMM_ALLOC_ZERO = 1 << 1,           ///< If set, atomically zero the allocated pages.
+    VMM_ALLOC_LAZY = 1 << 2,           ///< If set, defer allocating pages until first written, implies zeroed pages.
 } vmm_alloc_flags_t;
 
 /**
@@ -154,6 +240,12 @@ pml_flags_t vmm_prot_to_flags(prot_t prot);
  *
  * The allocated memory will be backed by newly allocated physical memory pages and is not guaranteed to be zeroed.
  *
+ * If `virtAddr` is `NULL` and the region is at least `PML2_SIZE` long, the alignment is raised to `PML2_SIZE` such that
+ * the region can be backed by huge pages.
+ *
+ * If `VMM_ALLOC_LAZY` is set, the region is mapped to the shared zero page and only backed by physical memory once
+ * written to, lazy allocation is only supported for user space mappings.
+ *
  * @see `vmm_map()` for details on TLB shootdowns.
  *
  * @param space The target address space, if `NULL`, the kernel space is used.
@@ -238,6 +330,7 @@ void* vmm_map_pages(space_t* space, void* virtAddr, pfn_t* pfns, size_t amount,
  * @return On success, `virtAddr`. On failure, `NULL` and `errno` is set to:
  * - `EINVAL`: Invalid parameters.
  * - `EBUSY`: The region contains pinned pages.
+ * - `ENOMEM`: Not enough memory to split a partially unmapped huge page.
  * - Other values from `space_mapping_start()`.
  */
 void* vmm_unmap(space_t* space, void* virtAddr, size_t length);
@@ -260,6 +353,7 @@ void* vmm_unmap(space_t* space, void* virtAddr, size_t length);
  * - `EINVAL`: Invalid parameters.
  * - `EBUSY`: The region contains pinned pages.
  * - `ENOENT`: The region is unmapped, or only partially mapped.
+ * - `ENOMEM`: Not enough memory to split a partially covered huge page.
  * - Other values from `space_mapping_start()`.
  */
 void* vmm_protect(space_t* space, void* virtAddr, size_t length, pml_flags_t flags);
@@ -276,16 +370,49 @@ void* vmm_protect(space_t* space, void* virtAddr, size_t length, pml_flags_t fla
 void vmm_load(space_t* space);
 
 /**
- * @brief Performs a TLB shootdown for a region of the address space, and wait for acknowledgements.
+ * @brief Initializes a TLB shootdown batch.
+ *
+ * @param shootdown The batch to initialize.
+ * @param space The target address space.
+ */
+void vmm_shootdown_init(vmm_shootdown_t* shootdown, space_t* space);
+
+/**
+ * @brief Adds a region to a TLB shootdown batch.
+ *
+ * Regions that overlap or are adjacent to a region already in the batch are merged with it. If the batch runs out of
+ * ranges or grows larger than `VMM_SHOOTDOWN_FLUSH_ALL_PAGES` pages, it falls back to a full TLB flush.
+ *
+ * @param shootdown The batch.
+ * @param virtAddr The starting virtual address of the region.
+ * @param pageAmount The number of pages in the region.
+ */
+void vmm_shootdown_add(vmm_shootdown_t* shootdown, void* virtAddr, size_t pageAmount);
+
+/**
+ * @brief Performs all TLB shootdowns gathered in a batch, and waits for acknowledgements.
  *
  * Must be called between `space_mapping_start()` and `space_mapping_end()`.
  *
- * This will cause all CPUs that have the address space loaded to invalidate their TLB entries for the specified region.
+ * This will cause all CPUs that have the address space loaded, or all CPUs for the kernel space, to invalidate their
+ * TLB entries for the regions in the batch. Idle CPUs are not interrupted, instead they flush their TLB on their next
+ * `vmm_load()`.
  *
  * Will not affect the current CPU's TLB, that is handled by the `page_table_t` directly when modifying page table
  * entries.
  *
- * @todo Currently this does a busy wait for acknowledgements. Use a wait queue?
+ * After returning the batch is empty and can be reused.
+ *
+ * @param shootdown The batch.
+ */
+void vmm_shootdown_flush(vmm_shootdown_t* shootdown);
+
+/**
+ * @brief Performs a TLB shootdown for a single region of the address space, and wait for acknowledgements.
+ *
+ * Equivalent to flushing a batch containing only the specified region.
+ *
+ * @see `vmm_shootdown_flush()` for more details.
  *
  * @param space The target address space.
  * @param virtAddr The starting virtual address of the region.
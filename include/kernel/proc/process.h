@@ -80,13 +80,14 @@ typedef struct process
     list_entry_t zombieEntry;
     pid_t id;
     _Atomic(priority_t) priority;
+    sched_affinity_t affinity; ///< The CPUs the threads of the process are allowed to run on.
+    _Atomic(clock_t) slice;    ///< The time slice given to new threads of the process, see `sched_set_slice()`.
     process_status_t status;
     space_t space;
     namespace_t* nspace;
     lock_t nspaceLock;
     cwd_t cwd;
     file_table_t fileTable;
-    futex_ctx_t futexCtx;
     perf_process_ctx_t perf;
     ioring_ctx_t rings[CONFIG_MAX_RINGS];
     note_handler_t noteHandler;
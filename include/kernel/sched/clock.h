@@ -19,6 +19,10 @@ typedef struct cpu cpu_t;
  * estimate of its precision, the clock subsystem then chooses the two sources, one for uptime and one for unix epoch,
  * with the best precision.
  *
+ * Reading the time does not take any locks, the best sources are published atomically and unregistering a source waits
+ * for a RCU grace period before returning, so the hot paths only pay for the read of the source itself. On most modern
+ * hardware that will be the invariant TSC.
+ *
  * @{
  */
 
@@ -52,6 +56,8 @@ uint64_t clock_source_register(const clock_source_t* source);
 /**
  * @brief Unregister a system timer source.
  *
+ * Will block until no CPU can still be reading from the source.
+ *
  * @param source The timer source to unregister, or `NULL` for no-op.
  */
 void clock_source_unregister(const clock_source_t* source);
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <kernel/cpu/cpu.h>
 #include <kernel/sched/wait.h>
 #include <kernel/sync/lock.h>
 #include <kernel/utils/rbtree.h>
 #include <sys/defs.h>
 
+#include <stdatomic.h>
 #include <sys/list.h>
 #include <sys/proc.h>
 
@@ -200,7 +202,13 @@ typedef struct sched sched_t;
  * v_{di} = v_{ei} + \frac{Q}{w_i}
  * \end{equation*}
  *
- * where \f$Q\f$ is a constant time slice defined by the scheduler, in our case `CONFIG_TIME_SLICE`.
+ * where \f$Q\f$ is the time slice, or request size, of the thread. By default this is `CONFIG_TIME_SLICE`, but each
+ * thread can request its own slice, stored in `sched_client_t::slice`.
+ *
+ * Note that the slice does not change the share of CPU time a thread receives, that is only determined by its weight.
+ * Instead, a shorter slice results in an earlier virtual deadline, meaning that the thread is picked sooner but in
+ * shorter bursts. This is similar to the latency-nice value in Linux and lets latency sensitive threads, for example
+ * a compositor or a terminal, respond quickly without needing to be given a higher priority.
  *
  * @see [EEVDF](https://citeseerx.ist.psu.edu/document?repid=rep1&type=pdf&doi=805acf7726282721504c8f00575d91ebfd750564)
  * page 3.
@@ -259,7 +267,9 @@ typedef struct sched sched_t;
  *
  * If, at any point in time, a thread with an earlier virtual deadline becomes available to run (for example, when a
  * thread is unblocked), the scheduler will preempt the currently running thread and switch to the newly available
- * thread.
+ * thread. When a thread is submitted, its CPU is only interrupted if the thread would actually preempt the currently
+ * running thread or if the CPU is idle, otherwise it will be picked at the next scheduling point, at the latest when
+ * the slice of the running thread ends.
  *
  * ## Idle Thread
  *
@@ -272,17 +282,45 @@ typedef struct sched sched_t;
  * Each CPU has its own scheduler and associated runqueue, as such we need to balance the load between each CPU, ideally
  * without causing too many cache misses. Meaning we want to keep threads which have recently run on a CPU on the same
  * CPU when possible. As such, we define a thread to be "cache-cold" on a CPU if the time since it last ran on that CPU
- * is greater than `CONFIG_CACHE_HOT_THRESHOLD`, otherwise its considered "cache-hot".
+ * is greater than its migration cost, otherwise its considered "cache-hot". The migration cost is estimated from the
+ * average length of the threads recent runs, clamped between `CONFIG_MIN_MIGRATION_COST` and
+ * `CONFIG_CACHE_HOT_THRESHOLD`, as a thread that runs for longer stretches tends to have more of its working set in the
+ * cache.
+ *
+ * Not all CPUs are equal however, SMT siblings share the execution resources of a single core, CPUs sharing a last
+ * level cache (LLC) can move threads between them cheaply and crossing a package boundary is the most expensive of all.
+ * As such, each scheduler stores a hierarchy of "scheduling domains", see `sched_domain_level_t`, built from the
+ * topology stored in each `cpu_t`. Load balancing always searches the closest domains first.
+ *
+ * We use three mechanisms to balance the load between CPUs, one push mechanism and two pull mechanisms.
+ *
+ * The push mechanism is used when a thread is submitted to the scheduler, as in it was created or unblocked. If the
+ * thread is cache-hot, it will be added to the CPU it last ran on, unless that CPU is busy and an idle CPU shares its
+ * LLC, including its own SMT siblings. Otherwise, starting from the CPU it last ran on, we look for an idle core (all
+ * SMT siblings idle), then an idle CPU, first within the LLC, then the package and finally the whole system. If no CPU
+ * is idle, the thread is added to the least loaded CPU, preferring closer CPUs on ties.
+ *
+ * The pull mechanism, also called work stealing, is used when a CPU is about to become idle. The CPU will, one domain
+ * at a time starting with its SMT siblings, find the CPU with the highest weight and steal the first thread from its
+ * runqueue that is not running. Threads are only considered cache-hot when stealing across a LLC boundary, as within a
+ * LLC the cache is shared anyway. If no thread is found, it will simply run the idle thread.
+ *
+ * Neither of those help if a set of CPU-bound threads never blocks, so there is also a periodic balancer, run by
+ * whichever CPU first notices that `CONFIG_LOAD_BALANCE_INTERVAL` has passed since the last run. It moves cache-cold
+ * threads from the most loaded CPU to the least loaded CPU close to it, until at most half the difference in weight
+ * has been moved.
  *
- * We use two mechanisms to balance the load between CPUs, one push mechanism and one pull mechanism.
+ * The amount of threads that migrated to each CPU is exposed in `/dev/perf/cpu`.
  *
- * The push mechanism, also called work stealing, is used when a thread is submitted to the scheduler, as in it was
- * created or unblocked. In this case, if the thread is cache-cold then the thread will be added to the runqueue of the
- * CPU with the lowest weight. Otherwise, it will be added to the runqueue of the CPU it last ran on.
+ * ## CPU Affinity
  *
- * The pull mechanism is used when a CPU is about to become idle. The CPU will find the CPU with the highest weight and
- * steal the first cache-cold thread from its runqueue. If no cache-cold threads are found, it will simply run the idle
- * thread.
+ * Both threads and processes have an affinity mask, see `sched_affinity_t`, restricting which CPUs they may run on. A
+ * thread may only run on the CPUs in both its own mask and its process's mask, if the two do not share any CPU the
+ * thread mask is ignored. All three load balancing mechanisms only ever place a thread on an allowed CPU, and if a
+ * mask is changed such that a thread is on a CPU it is no longer allowed to run on, the thread is moved away the next
+ * time it is picked to run on that CPU.
+ *
+ * The masks can be changed using the `affinity` command in `/proc/[pid]/ctl` and read in `/proc/[pid]/affinity`.
  *
  * @note The reason we want to avoid a global runqueue is to avoid lock contention. Even a small amount of lock
  * contention in the scheduler will quickly degrade performance, as such it is only allowed to lock a single CPU's
@@ -365,6 +403,26 @@ typedef int128_t lag_t;
  */
 #define SCHED_WEIGHT_BASE 1
 
+/**
+ * @brief The amount of 64-bit words in a `sched_affinity_t`.
+ */
+#define SCHED_AFFINITY_WORDS ((CPU_MAX + 63) / 64)
+
+/**
+ * @brief CPU affinity mask.
+ * @struct sched_affinity_t
+ *
+ * The set of CPUs a thread or process is allowed to run on, bit `n` corresponds to the CPU with ID `n`.
+ *
+ * Each word is accessed atomically so that the mask can be read by the scheduler without a lock, a reader racing with
+ * a writer might see a partially updated mask, which at worst results in a thread being placed on the wrong CPU until
+ * its next scheduling point.
+ */
+typedef struct
+{
+    _Atomic(uint64_t) words[SCHED_AFFINITY_WORDS];
+} sched_affinity_t;
+
 /**
  * @brief Per-thread scheduler context.
  * @struct sched_client_t
@@ -379,12 +437,47 @@ typedef struct sched_client
      * The earliest virtual time at which the thread ought to have received its due share of CPU time.
      */
     vclock_t vdeadline;
-    vclock_t veligible;    ///< The virtual time at which the thread becomes eligible to run (lag >= 0).
-    vclock_t vminEligible; ///< The minimum virtual eligible time of the subtree in the runqueue.
-    clock_t stop;          ///< The real time when the thread previously stopped executing.
-    cpu_t* lastCpu;        ///< The last CPU the thread was scheduled on, it stoped running at `stop` time.
+    vclock_t veligible;        ///< The virtual time at which the thread becomes eligible to run (lag >= 0).
+    vclock_t vminEligible;     ///< The minimum virtual eligible time of the subtree in the runqueue.
+    clock_t start;             ///< The real time when the thread last started executing.
+    clock_t stop;              ///< The real time when the thread previously stopped executing.
+    clock_t avgRuntime;        ///< Moving average of how long the thread runs each time its scheduled.
+    cpu_t* volatile lastCpu;   ///< The last CPU the thread was scheduled on, set when it starts and stops running.
+    volatile bool yield;       ///< Set by `sched_yield()`, handled in the next `sched_do()` on the threads CPU.
+    sched_affinity_t affinity; ///< The CPUs the thread is allowed to run on, see `sched_affinity_allows()`.
+    /**
+     * The time slice, or request size, of the thread in nanoseconds, takes effect at the start of its next request.
+     */
+    _Atomic(clock_t) slice;
 } sched_client_t;
 
+/**
+ * @brief Scheduling domain levels.
+ * @enum sched_domain_level_t
+ *
+ * Each level contains all the levels below it.
+ */
+typedef enum
+{
+    SCHED_DOMAIN_SMT = 0, ///< CPUs sharing the same core.
+    SCHED_DOMAIN_LLC,     ///< CPUs sharing the same last level cache.
+    SCHED_DOMAIN_PACKAGE, ///< CPUs in the same physical package.
+    SCHED_DOMAIN_SYSTEM,  ///< All CPUs.
+    SCHED_DOMAIN_MAX,
+} sched_domain_level_t;
+
+/**
+ * @brief Scheduling domain.
+ * @struct sched_domain_t
+ *
+ * CPUs are only ever added, so the `cpus` array can be read without a lock as long as `amount` is loaded first.
+ */
+typedef struct
+{
+    _Atomic(uint16_t) amount; ///< The amount of CPUs in the domain, including the owner.
+    cpu_id_t cpus[CPU_MAX];   ///< The IDs of the CPUs in the domain.
+} sched_domain_t;
+
 /**
  * @brief Per-CPU scheduler.
  * @struct sched_t
@@ -404,6 +497,10 @@ typedef struct sched
     _Atomic(uint64_t) preemptCount; ///< If greater than zero, preemption is disabled.
     thread_t* volatile idleThread;  ///< The idle thread for this CPU.
     thread_t* volatile runThread;   ///< The currently running thread on this CPU.
+    sched_domain_t domains[SCHED_DOMAIN_MAX]; ///< The scheduling domains of this CPU, protected by a global lock.
+    bool domainsReady;                        ///< Set once the domains have been built.
+    cpu_t* cpu;                               ///< The CPU owning this scheduler.
+    _Atomic(uint64_t) migrations;             ///< The amount of threads that migrated to this CPU from another CPU.
 } sched_t;
 
 /**
@@ -413,6 +510,114 @@ typedef struct sched
  */
 void sched_client_init(sched_client_t* client);
 
+/**
+ * @brief Sets all bits in a CPU affinity mask.
+ *
+ * @param mask The mask to fill.
+ */
+static inline void sched_affinity_fill(sched_affinity_t* mask)
+{
+    for (uint64_t i = 0; i < SCHED_AFFINITY_WORDS; i++)
+    {
+        atomic_store_explicit(&mask->words[i], UINT64_MAX, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Clears all bits in a CPU affinity mask.
+ *
+ * @param mask The mask to clear.
+ */
+static inline void sched_affinity_clear(sched_affinity_t* mask)
+{
+    for (uint64_t i = 0; i < SCHED_AFFINITY_WORDS; i++)
+    {
+        atomic_store_explicit(&mask->words[i], 0, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Adds a CPU to a CPU affinity mask.
+ *
+ * @param mask The mask to add the CPU to.
+ * @param id The ID of the CPU to add.
+ */
+static inline void sched_affinity_add(sched_affinity_t* mask, cpu_id_t id)
+{
+    atomic_fetch_or_explicit(&mask->words[id / 64], 1ULL << (id % 64), memory_order_relaxed);
+}
+
+/**
+ * @brief Checks if a CPU is in a CPU affinity mask.
+ *
+ * @param mask The mask to check.
+ * @param id The ID of the CPU to check for.
+ * @return `true` if the CPU is in the mask, `false` otherwise.
+ */
+static inline bool sched_affinity_has(sched_affinity_t* mask, cpu_id_t id)
+{
+    return atomic_load_explicit(&mask->words[id / 64], memory_order_relaxed) & (1ULL << (id % 64));
+}
+
+/**
+ * @brief Copies a CPU affinity mask.
+ *
+ * Unlike `sched_affinity_set()` this will not prompt other CPUs to reschedule, use it for masks that are not yet in
+ * use.
+ *
+ * @param dest The destination mask.
+ * @param src The source mask.
+ */
+static inline void sched_affinity_copy(sched_affinity_t* dest, sched_affinity_t* src)
+{
+    for (uint64_t i = 0; i < SCHED_AFFINITY_WORDS; i++)
+    {
+        atomic_store_explicit(&dest->words[i], atomic_load_explicit(&src->words[i], memory_order_relaxed),
+            memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Checks if a CPU affinity mask contains at least one existing CPU.
+ *
+ * @param mask The mask to check.
+ * @return `true` if the mask contains a CPU with an ID less than `cpu_amount()`, `false` otherwise.
+ */
+bool sched_affinity_is_usable(sched_affinity_t* mask);
+
+/**
+ * @brief Replaces a CPU affinity mask.
+ *
+ * Will prompt all other CPUs to reschedule, such that any thread that is no longer allowed to run on its CPU is moved
+ * promptly.
+ *
+ * @param dest The mask to replace, for example a thread's or process's mask.
+ * @param src The new mask.
+ */
+void sched_affinity_set(sched_affinity_t* dest, sched_affinity_t* src);
+
+/**
+ * @brief Checks if a thread is allowed to run on a CPU.
+ *
+ * @param thread The thread to check.
+ * @param cpu The CPU to check.
+ * @return `true` if the CPU is in both the thread's and its process's affinity mask, or if the two masks do not share
+ * any CPU, only the process's mask, `false` otherwise.
+ */
+bool sched_affinity_allows(thread_t* thread, cpu_t* cpu);
+
+/**
+ * @brief Sets the time slice of a thread.
+ *
+ * The new slice takes effect at the start of the thread's next request.
+ *
+ * @param thread The thread to set the slice of.
+ * @param slice The new slice in nanoseconds.
+ * @return On success, `0`. On failure, `ERR` and `errno` is set to:
+ * - `EINVAL`: The slice is not between `CONFIG_MIN_TIME_SLICE` and `CONFIG_MAX_TIME_SLICE`.
+ */
+uint64_t sched_set_slice(thread_t* thread, clock_t slice);
+
 /**
  * @brief Starts the scheduler by jumping to the boot thread.
  *
@@ -426,7 +631,8 @@ _NORETURN void sched_start(thread_t* bootThread);
  * @brief Submits a thread to the scheduler.
  *
  * If the thread has previously ran within `CONFIG_CACHE_HOT_THRESHOLD` nanoseconds, it will be submitted to the same
- * CPU it last ran on, otherwise it will be submitted to the least loaded CPU.
+ * CPU it last ran on or an idle CPU sharing its LLC, otherwise it will be submitted to the closest idle CPU or the
+ * least loaded CPU, see the "Load Balancing" section above. Only CPUs the thread is allowed to run on are considered.
  *
  * @param thread The thread to submit.
  */
@@ -451,6 +657,17 @@ void sched_do(interrupt_frame_t* frame);
  */
 bool sched_is_idle(cpu_t* cpu);
 
+/**
+ * @brief Checks if a thread is currently running on some CPU.
+ *
+ * Does not acquire any locks, the result is only a hint that might be stale by the time it is returned. The caller must
+ * ensure that the thread is not freed, for example by being in a RCU read-side critical section.
+ *
+ * @param thread The thread to check.
+ * @return `true` if the thread is running, `false` otherwise.
+ */
+bool sched_is_running(thread_t* thread);
+
 /**
  * @brief Sleeps the current thread for a specified duration in nanoseconds.
  *
@@ -462,8 +679,9 @@ uint64_t sched_nanosleep(clock_t timeout);
 /**
  * @brief Yield the current thread's time slice to allow other threads to run.
  *
- * @note Currently just sleeps for 1ms as we cant really yield without weird lag math.
- *
+ * The thread forfeits the rest of its current request by having its virtual deadline pushed back by one full request,
+ * its eligible time and thus its lag is left unchanged. The scheduler is then invoked immediately, if no other eligible
+ * thread has an earlier deadline the thread will simply continue running.
  */
 void sched_yield(void);
 
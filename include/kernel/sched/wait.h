@@ -32,6 +32,15 @@ typedef struct wait wait_t;
  * @note Generally its preferred to use the `WAIT_BLOCK*` macros instead of directly calling the functions provided by
  * this subsystem.
  *
+ * ## Callback Entries
+ *
+ * Asynchronous operations, which have no thread to block, can instead add a callback entry to a wait queue using
+ * `wait_queue_add_func()`. Every call to `wait_unblock()` removes all callback entries from the queue and invokes their
+ * callbacks, regardless of the amount of threads to unblock, after which the owner may add the entry again.
+ *
+ * The callback is invoked with interrupts disabled and possibly while the caller of `wait_unblock()` holds arbitrary
+ * locks, as such it should do as little as possible, for example deferring the actual work to another thread.
+ *
  * @todo Replace with a more optimized system for async stuff.
  *
  * @{
@@ -138,7 +147,7 @@ typedef struct wait wait_t;
         uint64_t result = 0; \
         clock_t uptime = clock_uptime(); \
         clock_t deadline = CLOCKS_DEADLINE(timeout, uptime); \
-        while (!(condition) && result == ERR) \
+        while (!(condition) && result == 0) \
         { \
             if (deadline <= uptime) \
             { \
@@ -163,7 +172,14 @@ typedef struct wait wait_t;
     })
 
 /**
- * @brief Represents a thread waiting on a wait queue.
+ * @brief Wait queue callback type.
+ *
+ * @param entry The callback entry that was removed from its wait queue.
+ */
+typedef void (*wait_func_t)(wait_entry_t* entry);
+
+/**
+ * @brief Represents a thread, or a callback, waiting on a wait queue.
  * @struct wait_entry_t
  *
  * Since each thread can wait on multiple wait queues simultaneously, each wait queue the thread is waiting on
@@ -173,8 +189,10 @@ typedef struct wait_entry
 {
     list_entry_t queueEntry;  ///< Used in wait_queue_t->entries.
     list_entry_t threadEntry; ///< Used in wait_client_t->entries.
-    thread_t* thread;         ///< The thread that is waiting.
+    thread_t* thread;         ///< The thread that is waiting, `NULL` for a callback entry.
     wait_queue_t* queue;      ///< The wait queue the thread is waiting on.
+    wait_func_t func;         ///< The callback of a callback entry.
+    atomic_bool busy;         ///< Set while the callback of a callback entry is being invoked.
 } wait_entry_t;
 
 /**
@@ -184,7 +202,7 @@ typedef struct wait_entry
 typedef struct wait_queue
 {
     lock_t lock;
-    list_t entries; ///< List of wait entries for threads waiting on this queue.
+    list_t entries; ///< List of wait entries for threads waiting on this queue, callback entries are kept at the front.
 } wait_queue_t;
 
 /**
@@ -336,4 +354,27 @@ void wait_unblock_thread(thread_t* thread, errno_t err);
  */
 uint64_t wait_unblock(wait_queue_t* queue, uint64_t amount, errno_t err);
 
+/**
+ * @brief Add a callback entry to a wait queue.
+ *
+ * The callback will be invoked once, by the next call to `wait_unblock()` on the queue.
+ *
+ * @param queue The wait queue to add the entry to.
+ * @param entry The entry to add, owned by the caller and must not already be in a queue.
+ * @param func The callback to invoke.
+ */
+void wait_queue_add_func(wait_queue_t* queue, wait_entry_t* entry, wait_func_t func);
+
+/**
+ * @brief Remove a callback entry from its wait queue.
+ *
+ * If the callback of the entry is currently being invoked, waits for it to return. As such, this function must be
+ * called before an entry is freed, even if its callback has already been invoked, and must never be called from within
+ * its own callback.
+ *
+ * @param entry The entry to remove.
+ * @return `true` if the entry was still in the queue, `false` if its callback was invoked.
+ */
+bool wait_queue_remove_func(wait_entry_t* entry);
+
 /** @} */
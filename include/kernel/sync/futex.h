@@ -1,8 +1,9 @@
 #pragma once
 
 #include <kernel/sched/wait.h>
-#include <kernel/utils/map.h>
+#include <kernel/sync/lock.h>
 
+#include <sys/list.h>
 #include <sys/proc.h>
 
 /**
@@ -13,41 +14,66 @@
  * Patchwork uses a Futex (Fast User-space Mutex) implementation to let user space implement synchronization primitives
  * like mutexes and conditional variables efficiently.
  *
+ * ## Implementation
+ *
+ * All waiting threads are stored in a global hash table of `FUTEX_BUCKETS` buckets, each with its own lock, such that
+ * unrelated futexes rarely contend on the same lock. Each waiter is identified by a `futex_key_t` and is stored on the
+ * stack of the waiting thread, meaning no memory is allocated for a futex and nothing needs to be freed once the last
+ * waiter is woken up.
+ *
+ * A futex in a private page is keyed by its address space and virtual address, while a futex in a page shared between
+ * address spaces, for example shared memory from `/dev/shmem`, is keyed by its physical address such that processes
+ * mapping the same page at different addresses will find the same waiters.
+ *
  * @{
  */
 
 /**
- * @brief Futex structure.
- * @struct futex_t
+ * @brief The amount of buckets in the global futex hash table.
+ */
+#define FUTEX_BUCKETS 256
+
+/**
+ * @brief Futex key structure.
+ * @struct futex_key_t
  */
 typedef struct
 {
-    map_entry_t entry;
-    wait_queue_t queue;
-} futex_t;
+    uintptr_t space;   ///< The address space of a private futex, or `0` for a shared futex.
+    uintptr_t address; ///< The virtual address of a private futex, or the physical address of a shared futex.
+} futex_key_t;
 
 /**
- * @brief Per-process futex context.
- * @struct futex_ctx_t
+ * @brief Futex hash bucket structure.
+ * @struct futex_bucket_t
  */
 typedef struct
 {
-    map_t futexes;
     lock_t lock;
-} futex_ctx_t;
+    list_t waiters; ///< List of `futex_waiter_t`.
+} futex_bucket_t;
 
 /**
- * @brief Initialize a per-process futex context.
+ * @brief Futex waiter structure.
+ * @struct futex_waiter_t
  *
- * @param ctx Pointer to the futex context to initialize.
+ * Stored on the stack of the waiting thread.
  */
-void futex_ctx_init(futex_ctx_t* ctx);
+typedef struct
+{
+    list_entry_t entry;
+    futex_key_t key;
+    /**
+     * The bucket the waiter is currently in, can change due to a requeue, set to `NULL` once the waiter is woken up.
+     * Only modified while holding the lock of the bucket.
+     */
+    _Atomic(futex_bucket_t*) bucket;
+    wait_queue_t queue;
+} futex_waiter_t;
 
 /**
- * @brief Deinitialize a per-process futex context.
- * *
- * @param ctx Pointer to the futex context to deinitialize.
+ * @brief Initialize the global futex hash table.
  */
-void futex_ctx_deinit(futex_ctx_t* ctx);
+void futex_init(void);
 
 /** @} */
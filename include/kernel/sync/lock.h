@@ -1,5 +1,6 @@
 #pragma once
 
+#include <kernel/config.h>
 #include <kernel/cpu/cli.h>
 
 #ifndef NDEBUG
@@ -12,10 +13,32 @@
 #include <sys/defs.h>
 
 /**
- * @brief Ticket spinlock.
+ * @brief Queued spinlock.
  * @defgroup kernel_sync_lock Lock
  * @ingroup kernel_sync
  *
+ * A spinlock based on the MCS lock, similar to the Linux qspinlock.
+ *
+ * ## Implementation
+ *
+ * The lock is a single 32-bit word storing a locked bit and a tail, the tail identifies the last CPU waiting for the
+ * lock. Acquiring an uncontended lock is a single compare and exchange of the word from `0` to `LOCK_LOCKED`.
+ *
+ * If the lock is contended, the CPU will instead take one of its queue nodes and swap itself in as the new tail of the
+ * lock, linking itself to the previous tail, if any. Each waiter then spins on its own node, which is only written to
+ * by its predecessor once the predecessor reaches the head of the queue and takes the lock. As such, every waiter spins
+ * on its own cache line instead of all waiters spinning on the lock itself, as with a ticket lock.
+ *
+ * Only the waiter at the head of the queue spins on the lock word, waiting for the owner to release it.
+ *
+ * Each CPU has `LOCK_QNODES` queue nodes, as an exception or NMI might acquire a lock while the CPU is already waiting
+ * for another lock.
+ *
+ * ## Profiling
+ *
+ * If `CONFIG_LOCK_PROFILE` is enabled, each acquisition is recorded with the address it was made from, see
+ * `lock_profile_t` and the `/dev/perf/locks` file.
+ *
  * @{
  */
 
@@ -31,7 +54,35 @@
 #define LOCK_CANARY 0xDEADBEEF
 
 /**
- * @brief A simple ticket lock implementation.
+ * @brief The bit of a lock word that is set while the lock is held.
+ */
+#define LOCK_LOCKED (1 << 0)
+
+/**
+ * @brief The shift of the tail in a lock word.
+ *
+ * The tail is `0` if there are no waiters, otherwise it stores `(cpuId + 1) * LOCK_QNODES + index` where `index` is
+ * the queue node used by the CPU.
+ */
+#define LOCK_TAIL_SHIFT 16
+
+/**
+ * @brief The mask of the tail in a lock word.
+ */
+#define LOCK_TAIL_MASK (0xFFFFU << LOCK_TAIL_SHIFT)
+
+/**
+ * @brief The amount of queue nodes per CPU, limits how many locks a CPU can wait for at once.
+ */
+#define LOCK_QNODES 4
+
+/**
+ * @brief The maximum amount of call sites that can be recorded by the lock profiler.
+ */
+#define LOCK_PROFILE_SITES 1024
+
+/**
+ * @brief A queued spinlock.
  *
  * This lock disables interrupts when acquired, and restores the interrupt state when released.
  * It is not recursive, and attempting to acquire a lock that is already held by the same CPU will
@@ -42,14 +93,25 @@
  */
 typedef struct
 {
-    atomic_uint16_t nextTicket;
-    atomic_uint16_t nowServing;
+    atomic_uint32_t value; ///< The lock word, see `LOCK_LOCKED` and `LOCK_TAIL_SHIFT`.
 #ifndef NDEBUG
     uint32_t canary;
     uintptr_t calledFrom;
 #endif
 } lock_t;
 
+/**
+ * @brief Lock contention statistics for a single call site.
+ * @struct lock_profile_t
+ */
+typedef struct
+{
+    uintptr_t site;     ///< The return address of the function that acquired the lock.
+    uint64_t acquires;  ///< The amount of times a lock was acquired from the site.
+    uint64_t contended; ///< The amount of those acquisitions that had to wait for another CPU.
+    uint64_t cycles;    ///< The total amount of TSC cycles spent waiting.
+} lock_profile_t;
+
 /**
  * @brief Acquires a lock for the reminder of the current scope.
  *
@@ -66,9 +128,9 @@ typedef struct
  * @return A `lock_t` initializer.
  */
 #ifndef NDEBUG
-#define LOCK_CREATE() {.nextTicket = ATOMIC_VAR_INIT(0), .nowServing = ATOMIC_VAR_INIT(0), .canary = LOCK_CANARY}
+#define LOCK_CREATE() {.value = ATOMIC_VAR_INIT(0), .canary = LOCK_CANARY}
 #else
-#define LOCK_CREATE() {.nextTicket = ATOMIC_VAR_INIT(0), .nowServing = ATOMIC_VAR_INIT(0)}
+#define LOCK_CREATE() {.value = ATOMIC_VAR_INIT(0)}
 #endif
 
 /**
@@ -78,13 +140,42 @@ typedef struct
  */
 static inline void lock_init(lock_t* lock)
 {
-    atomic_init(&lock->nextTicket, 0);
-    atomic_init(&lock->nowServing, 0);
+    atomic_init(&lock->value, 0);
 #ifndef NDEBUG
     lock->canary = LOCK_CANARY;
 #endif
 }
 
+/**
+ * @brief Waits for a contended lock by queueing on a per-CPU node.
+ *
+ * Should only be called by `lock_acquire()`, with interrupts disabled.
+ *
+ * @param lock Pointer to the lock to acquire.
+ * @param site The address the lock is acquired from, used for profiling.
+ */
+void lock_acquire_slow(lock_t* lock, uintptr_t site);
+
+/**
+ * @brief Records a lock acquisition for profiling.
+ *
+ * Does nothing unless `CONFIG_LOCK_PROFILE` is enabled.
+ *
+ * @param site The address the lock was acquired from.
+ * @param contended Whether the acquisition had to wait for another CPU.
+ * @param cycles The amount of TSC cycles spent waiting.
+ */
+void lock_profile_record(uintptr_t site, bool contended, uint64_t cycles);
+
+/**
+ * @brief Retrieves the recorded lock profiling statistics.
+ *
+ * @param out Output array of statistics, one for each call site.
+ * @param amount The length of the output array.
+ * @return The amount of call sites written to `out`.
+ */
+uint64_t lock_profile_get(lock_profile_t* out, uint64_t amount);
+
 /**
  * @brief Acquires a lock, blocking until it is available.
  *
@@ -103,30 +194,22 @@ static inline void lock_acquire(lock_t* lock)
         cli_pop();
         panic(NULL, "Lock canary corrupted");
     }
-    lock->calledFrom = (uintptr_t)__builtin_return_address(0);
-    uint64_t iterations = 0;
 #endif
 
-    uint16_t ticket = atomic_fetch_add_explicit(&lock->nextTicket, 1, memory_order_relaxed);
-    while (atomic_load_explicit(&lock->nowServing, memory_order_relaxed) != ticket)
+    uint32_t expected = 0;
+    if (!atomic_compare_exchange_strong_explicit(&lock->value, &expected, LOCK_LOCKED, memory_order_acquire,
+            memory_order_relaxed))
+    {
+        lock_acquire_slow(lock, (uintptr_t)__builtin_return_address(0));
+    }
+    else if (CONFIG_LOCK_PROFILE)
     {
-        ASM("pause");
+        lock_profile_record((uintptr_t)__builtin_return_address(0), false, 0);
+    }
 
 #ifndef NDEBUG
-        if (lock->canary != LOCK_CANARY)
-        {
-            cli_pop();
-            panic(NULL, "Lock canary corrupted after %d iterations", iterations);
-        }
-        if (++iterations >= LOCK_DEADLOCK_ITERATIONS)
-        {
-            cli_pop();
-            panic(NULL, "Deadlock detected in lock last acquired from %p", (void*)lock->calledFrom);
-        }
+    lock->calledFrom = (uintptr_t)__builtin_return_address(0);
 #endif
-    }
-
-    atomic_thread_fence(memory_order_acquire);
 }
 
 /**
@@ -139,14 +222,8 @@ static inline bool lock_try_acquire(lock_t* lock)
 {
     cli_push();
 
-    uint16_t ticket = atomic_load_explicit(&lock->nextTicket, memory_order_relaxed);
-    if (atomic_load_explicit(&lock->nowServing, memory_order_acquire) != ticket)
-    {
-        cli_pop();
-        return false;
-    }
-
-    if (!atomic_compare_exchange_strong_explicit(&lock->nextTicket, &ticket, ticket + 1, memory_order_acquire,
+    uint32_t expected = 0;
+    if (!atomic_compare_exchange_strong_explicit(&lock->value, &expected, LOCK_LOCKED, memory_order_acquire,
             memory_order_relaxed))
     {
         cli_pop();
@@ -162,6 +239,11 @@ static inline bool lock_try_acquire(lock_t* lock)
     lock->calledFrom = (uintptr_t)__builtin_return_address(0);
 #endif
 
+    if (CONFIG_LOCK_PROFILE)
+    {
+        lock_profile_record((uintptr_t)__builtin_return_address(0), false, 0);
+    }
+
     return true;
 }
 
@@ -181,7 +263,7 @@ static inline void lock_release(lock_t* lock)
     }
 #endif
 
-    atomic_fetch_add_explicit(&lock->nowServing, 1, memory_order_release);
+    atomic_fetch_and_explicit(&lock->value, ~(uint32_t)LOCK_LOCKED, memory_order_release);
     cli_pop();
 }
 
@@ -12,6 +12,21 @@ typedef struct thread thread_t;
  * @defgroup kernel_sync_mutex Mutex
  * @ingroup kernel_sync
  *
+ * A sleeping lock that can be acquired recursively by its owner.
+ *
+ * ## Adaptive Spinning
+ *
+ * Before blocking, a thread will spin on the mutex for up to `CONFIG_MUTEX_MAX_SLOW_SPIN` iterations, but only for as
+ * long as the owner is running on another CPU, as the owner is then likely to release the mutex soon. If the owner is
+ * not running, spinning would just waste CPU time, so the thread blocks immediately. Only one thread spins at a time,
+ * any other threads will block, avoiding having many CPUs hammer the same cache line.
+ *
+ * ## Hand-off
+ *
+ * Since a released mutex can be taken by any thread, a woken waiter might find that a spinning or newly arriving thread
+ * has already taken it. To prevent waiters from starving, a waiter that loses such a race sets the `handoff` flag,
+ * after which the mutex can only be taken by a waiter until one of the waiters has acquired it.
+ *
  * @{
  */
 
@@ -35,6 +50,9 @@ typedef struct thread thread_t;
         .waitQueue = WAIT_QUEUE_CREATE(name.waitQueue), \
         .owner = NULL, \
         .depth = 0, \
+        .waiters = 0, \
+        .spinning = false, \
+        .handoff = false, \
         .lock = LOCK_CREATE(), \
     }
 
@@ -45,9 +63,12 @@ typedef struct thread thread_t;
 typedef struct
 {
     wait_queue_t waitQueue;
-    thread_t* owner;
-    uint32_t depth;
-    lock_t lock;
+    _Atomic(thread_t*) owner;  ///< The owning thread or `NULL`, can be read without holding the lock.
+    uint32_t depth;            ///< The recursion depth, only accessed by the owner.
+    _Atomic(uint32_t) waiters; ///< The amount of threads blocking, or about to block, on the mutex.
+    _Atomic(bool) spinning;    ///< Set while a thread is spinning on the mutex.
+    _Atomic(bool) handoff;     ///< If set, the mutex can only be taken by a waiter.
+    lock_t lock;               ///< Protects the wait queue.
 } mutex_t;
 
 /**
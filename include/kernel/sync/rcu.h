@@ -33,6 +33,16 @@ typedef struct rcu_entry rcu_entry_t;
  * disabled using `rcu_read_lock()`. Therefor, we know that once all CPUs, which were not idle, have performed a context
  * switch, they must have passed through a quiescent state and it is thus safe to free any pending resources.
  *
+ * Grace periods are tracked with a global sequence number and a counter of CPUs that have yet to report, each CPU
+ * reports by advancing its own per-CPU sequence with a compare and exchange and decrementing the counter, the CPU that
+ * decrements it to zero completes the grace period. As such, no lock is taken while reporting, and only one CPU at a
+ * time may start a new grace period. Idle CPUs are reported on behalf of when a grace period is started.
+ *
+ * Callbacks are kept in per-CPU batch, waiting and ready lists, where the waiting list remembers the grace period it is
+ * waiting for. At most `CONFIG_RCU_BATCH_MAX` callbacks are invoked per quiescent state report, if more remain a timer
+ * interrupt is scheduled to continue invoking them. Similarly, while callbacks are waiting for a grace period a timer
+ * interrupt is scheduled every `CONFIG_RCU_POLL_INTERVAL`, as an idle CPU would otherwise never check if it completed.
+ *
  * ## Using RCU
  *
  * Using RCU is fairly straightforward, any data structure that is to be protected by RCU must include a `rcu_entry_t`
@@ -111,6 +121,15 @@ void rcu_synchronize(void);
  */
 void rcu_call(rcu_entry_t* entry, rcu_callback_t func, void* arg);
 
+/**
+ * @brief Wait for all previously queued RCU callbacks to be invoked.
+ *
+ * Unlike `rcu_synchronize()`, which only waits for a grace period, this function waits until every callback queued with
+ * `rcu_call()` on any CPU before the call has finished executing. Should for example be used before unloading a module
+ * whose code might still be referenced by pending callbacks.
+ */
+void rcu_barrier(void);
+
 /**
  * @brief Called during a context switch to report a quiescent state.
  */
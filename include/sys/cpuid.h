@@ -25,7 +25,14 @@ typedef enum
 {
     CPUID_EAX_NONE = 0x00,
     CPUID_EAX_FEATURE_INFO = 0x01,
+    CPUID_EAX_CACHE_PARAMETERS = 0x04,
     CPUID_EAX_EXTENDED_FEATURE_INFO = 0x07,
+    CPUID_EAX_EXTENDED_TOPOLOGY = 0x0B,
+    CPUID_EAX_XSAVE_INFO = 0x0D,
+    CPUID_EAX_EXTENDED_MAX = 0x80000000,
+    CPUID_EAX_EXTENDED_PROCESSOR_INFO = 0x80000001,
+    CPUID_EAX_ADVANCED_POWER_INFO = 0x80000007,
+    CPUID_EAX_AMD_CACHE_PARAMETERS = 0x8000001D,
 } cpuid_input_eax_t;
 
 /**
@@ -35,6 +42,7 @@ typedef enum
 typedef enum
 {
     CPUID_ECX_NONE = 0x00,
+    CPUID_ECX_XSAVE_EXTENDED = 0x01, ///< Used with `CPUID_EAX_XSAVE_INFO` to get the XSAVE extensions.
 } cpuid_input_ecx_t;
 
 /**
@@ -233,6 +241,92 @@ static inline void cpuid_extended_feature_info(cpuid_extended_feature_info_t* in
     info->featuresEbx = (cpuid_ebx_features_t)out.ebx;
 }
 
+/**
+ * @brief XSAVE extension flags.
+ * @enum cpuid_xsave_features_t
+ *
+ * These flags are returned in the EAX register after calling the CPUID instruction with EAX=CPUID_EAX_XSAVE_INFO and
+ * ECX=CPUID_ECX_XSAVE_EXTENDED.
+ */
+typedef enum
+{
+    CPUID_XSAVE_XSAVEOPT = 1 << 0,
+    CPUID_XSAVE_XSAVEC = 1 << 1,
+    CPUID_XSAVE_XGETBV = 1 << 2,
+    CPUID_XSAVE_XSAVES = 1 << 3,
+} cpuid_xsave_features_t;
+
+/**
+ * @brief CPU XSAVE information structure.
+ * @struct cpuid_xsave_info_t
+ */
+typedef struct
+{
+    cpuid_xsave_features_t features;
+    uint32_t size;          ///< Size of the standard XSAVE area for the components currently enabled in XCR0.
+    uint32_t compactedSize; ///< Size of the compacted XSAVE area for the components currently enabled in XCR0 and XSS.
+} cpuid_xsave_info_t;
+
+/**
+ * @brief Wrapper to get CPU XSAVE information.
+ *
+ * The sizes depend on the currently enabled components, so this should be called after XCR0 has been written.
+ *
+ * @param info Output pointer.
+ */
+static inline void cpuid_xsave_info(cpuid_xsave_info_t* info)
+{
+    cpuid_output_t out;
+    cpuid(CPUID_EAX_XSAVE_INFO, CPUID_ECX_NONE, &out);
+    info->size = out.ebx;
+    cpuid(CPUID_EAX_XSAVE_INFO, CPUID_ECX_XSAVE_EXTENDED, &out);
+    info->features = (cpuid_xsave_features_t)out.eax;
+    info->compactedSize = out.ebx;
+}
+
+/**
+ * @brief TSC feature flags.
+ * @enum cpuid_tsc_features_t
+ */
+typedef enum
+{
+    CPUID_TSC_NONE = 0,
+    CPUID_TSC_RDTSCP = 1 << 0,    ///< The `rdtscp` instruction is supported.
+    CPUID_TSC_INVARIANT = 1 << 1, ///< The TSC runs at a constant rate in all ACPI P-, C- and T-states.
+} cpuid_tsc_features_t;
+
+/**
+ * @brief Helper to detect TSC features.
+ *
+ * @return The supported TSC features.
+ */
+static inline cpuid_tsc_features_t cpuid_tsc_features(void)
+{
+    cpuid_output_t out;
+    cpuid(CPUID_EAX_EXTENDED_MAX, CPUID_ECX_NONE, &out);
+    uint32_t max = out.eax;
+
+    cpuid_tsc_features_t features = CPUID_TSC_NONE;
+    if (max >= CPUID_EAX_EXTENDED_PROCESSOR_INFO)
+    {
+        cpuid(CPUID_EAX_EXTENDED_PROCESSOR_INFO, CPUID_ECX_NONE, &out);
+        if (out.edx & (1 << 27))
+        {
+            features |= CPUID_TSC_RDTSCP;
+        }
+    }
+    if (max >= CPUID_EAX_ADVANCED_POWER_INFO)
+    {
+        cpuid(CPUID_EAX_ADVANCED_POWER_INFO, CPUID_ECX_NONE, &out);
+        if (out.edx & (1 << 8))
+        {
+            features |= CPUID_TSC_INVARIANT;
+        }
+    }
+
+    return features;
+}
+
 /**
  * @brief Supported CPU instruction sets.
  * @enum cpuid_instruction_sets_t
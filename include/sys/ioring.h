@@ -75,6 +75,11 @@ typedef uint32_t sqe_flags_t; ///< Submission queue entry (SQE) flags.
  * Like `SQE_LINK` but will process the next SQE even if this one fails.
  */
 #define SQE_HARDLINK (1 << (_SQE_FLAGS + 1))
+/**
+ * Keep the operation armed after it produces a result, posting a CQE with `CQE_MORE` set for each result, only
+ * supported by `IO_OP_POLL`.
+ */
+#define SQE_MULTISHOT (1 << (_SQE_FLAGS + 2))
 
 /**
  * @brief Asynchronous submission queue entry (SQE).
@@ -133,6 +138,10 @@ static_assert(sizeof(sqe_t) == 64, "sqe_t is not 64 bytes");
         .data = (void*)(_data), \
     }
 
+typedef uint32_t cqe_flags_t; ///< Completion queue entry (CQE) flags.
+#define CQE_NONE (0)          ///< No flags.
+#define CQE_MORE (1 << 0)     ///< The SQE remains armed and further CQEs will be posted for it.
+
 /**
  * @brief Asynchronous completion queue entry (CQE).
  * @struct cqe_t
@@ -151,13 +160,22 @@ typedef struct cqe
         io_events_t events;
         uint64_t _result;
     };
-    uint64_t _padding[1];
+    cqe_flags_t flags; ///< Completion flags.
+    uint8_t _padding[4];
 } cqe_t;
 
 #ifdef static_assert
 static_assert(sizeof(cqe_t) == 32, "cqe_t is not 32 bytes");
 #endif
 
+typedef uint32_t ioring_ctrl_flags_t; ///< Shared ring control flags.
+#define IORING_CTRL_NONE (0)          ///< No flags.
+/**
+ * Completion queue entries did not fit in the completion queue and are held by the kernel, they are moved into the
+ * completion queue as space is made available by the next `ioring_enter()` call or completion.
+ */
+#define IORING_CTRL_OVERFLOW (1 << 0)
+
 /**
  * @brief Shared ring control structure.
  * @struct ioring_ctrl_t
@@ -176,7 +194,8 @@ typedef struct ALIGNED(64) ioring_ctrl
     atomic_uint32_t chead; ///< Completion head index, updated by userspace.
     uint8_t _padding1[64 - sizeof(atomic_uint32_t) * 2];
     atomic_uint64_t regs[SQE_REGS_MAX] ALIGNED(64); ///< General purpose registers.
-    uint8_t _reserved[8];
+    atomic_uint32_t flags;    ///< Ring flags, updated by the kernel.
+    atomic_uint32_t cdropped; ///< Amount of CQEs that were dropped as the kernel could not hold them, never resets.
 } ioring_ctrl_t;
 
 /**
@@ -237,9 +256,15 @@ uint64_t ioring_teardown(ioring_id_t id);
 /**
  * @brief System call to notify the kernel of new submission queue entries (SQEs).
  *
+ * Fewer than `amount` SQEs will be processed if the completion queue could not hold the result of every operation in
+ * flight, the remaining SQEs are left in the submission queue until CQEs are popped.
+ *
+ * Will also move any overflowed CQEs into the completion queue, see `IORING_CTRL_OVERFLOW`.
+ *
  * @param id The ID of the I/O ring to notify.
  * @param amount The number of SQEs that the kernel should process.
- * @param wait The minimum number of completion queue entries (CQEs) to wait for.
+ * @param wait The minimum number of completion queue entries (CQEs) to wait for, at most the size of the completion
+ * queue.
  * @return On success, the number of SQEs successfully processed. On failure, `ERR` and `errno` is set.
  */
 uint64_t ioring_enter(ioring_id_t id, size_t amount, size_t wait);
@@ -191,6 +191,41 @@ typedef enum
      * If `val` is `FUTEX_ALL`, all waiting threads are woken up.
      */
     FUTEX_WAKE,
+    /**
+     * @brief Spin while the owner of the futex is running.
+     *
+     * The value at the futex address and `val` must be owner words, see `FUTEX_LOCKED`. Spins in the kernel for as
+     * long as the value at the futex address is equal to `val` and the thread owning it is running on another CPU, the
+     * owner is only visible to the kernel so user space can not make this decision itself.
+     *
+     * Returns `0` once the value changes, as the caller should then retry to acquire the lock. If the owner is not
+     * running or the spin limit is reached, the call fails with `EBUSY` and the caller should use `FUTEX_WAIT` instead.
+     * The timeout is ignored.
+     */
+    FUTEX_SPIN,
+    /**
+     * @brief Wake up threads waiting on the futex and move the remaining waiters to another futex.
+     *
+     * Wakes up a maximum of `wake` threads waiting on `addr` and moves a maximum of `requeue` of the remaining waiters
+     * to `addr2` without waking them, used to avoid waking many threads that would then just contend on `addr2`.
+     * Returns the amount of threads woken. See `futex_requeue()`.
+     */
+    FUTEX_REQUEUE,
+    /**
+     * @brief Same as `FUTEX_REQUEUE` but first checks the futex value.
+     *
+     * If the value at `addr` is not equal to `cmp`, the call fails with `EAGAIN` without waking or moving any threads.
+     * Returns the amount of threads woken and moved. See `futex_requeue()`.
+     */
+    FUTEX_CMP_REQUEUE,
+    /**
+     * @brief Modify a second futex and wake up threads waiting on both futexes.
+     *
+     * Atomically modifies the value at `addr2` as specified by the `FUTEX_OP()` encoded `wakeOp`, then wakes up a
+     * maximum of `wake` threads waiting on `addr`, and if the old value at `addr2` passes the comparison in `wakeOp` a
+     * maximum of `wake2` threads waiting on `addr2`. Returns the total amount of threads woken. See `futex_wake_op()`.
+     */
+    FUTEX_WAKE_OP,
 } futex_op_t;
 
 /**
@@ -202,6 +237,58 @@ typedef enum
  */
 #define FUTEX_ALL UINT64_MAX
 
+/**
+ * @brief Futex owner word locked bit.
+ *
+ * A futex owner word is `0` when the lock it represents is unlocked, otherwise it stores the id of the owning thread in
+ * the bits of `FUTEX_TID_MASK` or'd with `FUTEX_LOCKED` and, if there are threads waiting, `FUTEX_WAITERS`.
+ *
+ */
+#define FUTEX_LOCKED (1ULL << 62)
+
+/**
+ * @brief Futex owner word waiters bit.
+ *
+ * Set in a futex owner word when threads might be waiting on it, see `FUTEX_LOCKED`.
+ *
+ */
+#define FUTEX_WAITERS (1ULL << 63)
+
+/**
+ * @brief Futex owner word thread id mask.
+ *
+ * The bits of a futex owner word that store the id of the owning thread, see `FUTEX_LOCKED`.
+ *
+ */
+#define FUTEX_TID_MASK (FUTEX_LOCKED - 1)
+
+#define FUTEX_OP_SET 0  ///< `FUTEX_WAKE_OP` operation, `*addr2 = oparg`.
+#define FUTEX_OP_ADD 1  ///< `FUTEX_WAKE_OP` operation, `*addr2 += oparg`.
+#define FUTEX_OP_OR 2   ///< `FUTEX_WAKE_OP` operation, `*addr2 |= oparg`.
+#define FUTEX_OP_ANDN 3 ///< `FUTEX_WAKE_OP` operation, `*addr2 &= ~oparg`.
+#define FUTEX_OP_XOR 4  ///< `FUTEX_WAKE_OP` operation, `*addr2 ^= oparg`.
+
+#define FUTEX_OP_CMP_EQ 0 ///< `FUTEX_WAKE_OP` comparison, `old == cmparg`.
+#define FUTEX_OP_CMP_NE 1 ///< `FUTEX_WAKE_OP` comparison, `old != cmparg`.
+#define FUTEX_OP_CMP_LT 2 ///< `FUTEX_WAKE_OP` comparison, `old < cmparg`.
+#define FUTEX_OP_CMP_LE 3 ///< `FUTEX_WAKE_OP` comparison, `old <= cmparg`.
+#define FUTEX_OP_CMP_GT 4 ///< `FUTEX_WAKE_OP` comparison, `old > cmparg`.
+#define FUTEX_OP_CMP_GE 5 ///< `FUTEX_WAKE_OP` comparison, `old >= cmparg`.
+
+/**
+ * @brief Encode a `FUTEX_WAKE_OP` operation.
+ *
+ * The `oparg` and `cmparg` arguments are truncated to 28 bits.
+ *
+ * @param op The operation to perform on the value at `addr2`, for example `FUTEX_OP_ADD`.
+ * @param oparg The argument of the operation.
+ * @param cmp The comparison to perform on the old value at `addr2`, for example `FUTEX_OP_CMP_GT`.
+ * @param cmparg The argument of the comparison.
+ */
+#define FUTEX_OP(op, oparg, cmp, cmparg) \
+    (((uint64_t)(op) << 60) | ((uint64_t)(cmp) << 56) | (((uint64_t)(oparg) & 0xFFFFFFF) << 28) | \
+        ((uint64_t)(cmparg) & 0xFFFFFFF))
+
 /**
  * @brief System call for fast user space mutual exclusion.
  *
@@ -216,6 +303,32 @@ typedef enum
  */
 uint64_t futex(atomic_uint64_t* addr, uint64_t val, futex_op_t op, clock_t timeout);
 
+/**
+ * @brief Wrapper for the `FUTEX_REQUEUE` and `FUTEX_CMP_REQUEUE` futex operations.
+ *
+ * @param addr The futex to wake up threads from.
+ * @param wake The maximum amount of threads to wake up.
+ * @param addr2 The futex to move the remaining threads to.
+ * @param requeue The maximum amount of threads to move, or `FUTEX_ALL`.
+ * @param op Either `FUTEX_REQUEUE` or `FUTEX_CMP_REQUEUE`.
+ * @param cmp The expected value at `addr`, ignored for `FUTEX_REQUEUE`.
+ * @return On success, depends on the operation. On failure, `ERR` and errno is set.
+ */
+uint64_t futex_requeue(atomic_uint64_t* addr, uint64_t wake, atomic_uint64_t* addr2, uint64_t requeue, futex_op_t op,
+    uint64_t cmp);
+
+/**
+ * @brief Wrapper for the `FUTEX_WAKE_OP` futex operation.
+ *
+ * @param addr The first futex to wake up threads from.
+ * @param wake The maximum amount of threads to wake up from `addr`.
+ * @param addr2 The second futex, which is modified.
+ * @param wake2 The maximum amount of threads to wake up from `addr2` if the comparison passes.
+ * @param wakeOp The operation and comparison, encoded using `FUTEX_OP()`.
+ * @return On success, the total amount of threads woken. On failure, `ERR` and errno is set.
+ */
+uint64_t futex_wake_op(atomic_uint64_t* addr, uint64_t wake, atomic_uint64_t* addr2, uint64_t wake2, uint64_t wakeOp);
+
 /**
  * @brief System call for retreving the time since boot.
  *
@@ -27,11 +27,12 @@ extern "C"
 
 #define TSS_DTOR_ITERATIONS 4
 
-/// @todo Implement user space `cnd_t` and `tss_t`.
+/// @todo Implement user space `cnd_timedwait()` and `tss_t`.
 
 typedef struct
 {
-    char todo;
+    atomic_uint64_t seq; ///< Futex incremented by every signal and broadcast.
+    _Atomic(void*) mtx;  ///< The mutex of the most recent waiter, waiters are requeued onto it by a broadcast.
 } cnd_t;
 
 typedef struct
@@ -44,15 +45,11 @@ typedef struct
     char todo;
 } tss_t;
 
-#define _MTX_UNLOCKED 0
-#define _MTX_LOCKED 1
-#define _MTX_CONTESTED 2
-
 typedef struct
 {
-    atomic_uint64_t state;
-    tid_t owner;
+    atomic_uint64_t state; ///< Futex owner word storing the id of the owning thread.
     uint64_t depth;
+    atomic_bool handoff; ///< Set by a starved waiter, the mutex can then only be taken by a waiter.
 } mtx_t;
 
 typedef void (*tss_dtor_t)(void*);
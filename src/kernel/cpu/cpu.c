@@ -19,11 +19,107 @@
 
 #include <stdatomic.h>
 #include <stdint.h>
+#include <sys/cpuid.h>
 #include <sys/list.h>
 
 cpu_t* _cpus[CPU_MAX] = {0};
 uint16_t _cpuAmount = 0;
 
+static uint32_t cpu_topology_shift(uint32_t count)
+{
+    uint32_t shift = 0;
+    while ((1U << shift) < count)
+    {
+        shift++;
+    }
+    return shift;
+}
+
+static uint32_t cpu_topology_llc_shift(cpuid_input_eax_t leaf)
+{
+    uint32_t bestLevel = 0;
+    uint32_t shift = UINT32_MAX;
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        cpuid_output_t out;
+        cpuid(leaf, (cpuid_input_ecx_t)i, &out);
+
+        uint32_t type = out.eax & 0x1F;
+        if (type == 0) // No more caches
+        {
+            break;
+        }
+
+        uint32_t level = (out.eax >> 5) & 0x7;
+        if (level >= bestLevel)
+        {
+            bestLevel = level;
+            shift = cpu_topology_shift(((out.eax >> 14) & 0xFFF) + 1);
+        }
+    }
+    return shift;
+}
+
+static void cpu_topology_detect(cpu_topology_t* topology)
+{
+    cpuid_output_t out;
+    cpuid(CPUID_EAX_NONE, CPUID_ECX_NONE, &out);
+    uint32_t maxLeaf = out.eax;
+    cpuid(CPUID_EAX_EXTENDED_MAX, CPUID_ECX_NONE, &out);
+    uint32_t maxExtendedLeaf = out.eax;
+
+    cpuid_feature_info_t info;
+    cpuid_feature_info(&info);
+    topology->apicId = info.brandClflushApicid >> 24;
+
+    uint32_t smtShift = 0;
+    uint32_t packageShift = 0;
+    cpuid(CPUID_EAX_EXTENDED_TOPOLOGY, CPUID_ECX_NONE, &out);
+    if (maxLeaf >= CPUID_EAX_EXTENDED_TOPOLOGY && out.ebx != 0)
+    {
+        topology->apicId = out.edx;
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            cpuid(CPUID_EAX_EXTENDED_TOPOLOGY, (cpuid_input_ecx_t)i, &out);
+
+            uint32_t type = (out.ecx >> 8) & 0xFF;
+            if (type == 0) // No more levels
+            {
+                break;
+            }
+
+            if (type == 1) // SMT level
+            {
+                smtShift = out.eax & 0x1F;
+            }
+            packageShift = out.eax & 0x1F;
+        }
+    }
+    else if (info.featuresEdx & CPUID_EDX_HTT)
+    {
+        // We cant tell siblings and cores apart here, so just treat every logical CPU as its own core.
+        packageShift = cpu_topology_shift((info.brandClflushApicid >> 16) & 0xFF);
+    }
+
+    uint32_t llcShift = UINT32_MAX;
+    if (maxLeaf >= CPUID_EAX_CACHE_PARAMETERS)
+    {
+        llcShift = cpu_topology_llc_shift(CPUID_EAX_CACHE_PARAMETERS);
+    }
+    if (llcShift == UINT32_MAX && maxExtendedLeaf >= CPUID_EAX_AMD_CACHE_PARAMETERS)
+    {
+        llcShift = cpu_topology_llc_shift(CPUID_EAX_AMD_CACHE_PARAMETERS);
+    }
+    if (llcShift == UINT32_MAX || llcShift > packageShift)
+    {
+        llcShift = packageShift;
+    }
+
+    topology->coreId = topology->apicId >> smtShift;
+    topology->llcId = topology->apicId >> llcShift;
+    topology->packageId = topology->apicId >> packageShift;
+}
+
 void cpu_init(cpu_t* cpu)
 {
     cpu_id_t id = _cpuAmount++;
@@ -35,6 +131,7 @@ void cpu_init(cpu_t* cpu)
     cpu->syscallRsp = 0;
     cpu->userRsp = 0;
     cpu->inInterrupt = false;
+    cpu_topology_detect(&cpu->topology);
 
     gdt_cpu_load();
     idt_cpu_load();
@@ -1,5 +1,6 @@
 #include <kernel/cpu/interrupt.h>
 
+#include <kernel/config.h>
 #include <kernel/cpu/cpu.h>
 #include <kernel/cpu/gdt.h>
 #include <kernel/cpu/ipi.h>
@@ -62,6 +63,21 @@ static void exception_kernel_page_fault_handler(interrupt_frame_t* frame)
 
     if (frame->errorCode & PAGE_FAULT_PRESENT)
     {
+        // The kernel might write to a lazily allocated user page, for example when completing a system call.
+        if ((frame->errorCode & PAGE_FAULT_WRITE) && faultAddr < VMM_USER_SPACE_MAX)
+        {
+            uint64_t result = space_lazy_fault(&process->space, (void*)faultAddr);
+            if (result == ERR)
+            {
+                panic(frame, "failed to allocate lazy page for page fault at address 0x%llx", faultAddr);
+            }
+
+            if (result == 1)
+            {
+                return;
+            }
+        }
+
         panic(frame, "page fault on present page at address 0x%llx", faultAddr);
     }
 
@@ -104,6 +120,22 @@ static void exception_user_page_fault_handler(interrupt_frame_t* frame)
 
     if (frame->errorCode & PAGE_FAULT_PRESENT)
     {
+        if (frame->errorCode & PAGE_FAULT_WRITE)
+        {
+            uint64_t result = space_lazy_fault(&process->space, (void*)faultAddr);
+            if (result == ERR)
+            {
+                exception_handle_user(frame,
+                    F("pagefault at 0x%llx failed to allocate lazy page at 0x%llx", frame->rip, faultAddr));
+                return;
+            }
+
+            if (result == 1)
+            {
+                return;
+            }
+        }
+
         exception_handle_user(frame,
             F("pagefault at 0x%llx when %s present page at 0x%llx", frame->rip,
                 (frame->errorCode & PAGE_FAULT_WRITE) ? "writing to" : "reading from", faultAddr));
@@ -154,6 +186,13 @@ static void exception_handler(interrupt_frame_t* frame)
         }
         exception_handle_user(frame, F("illegal instruction at 0x%llx", frame->rip));
         break;
+    case VECTOR_DEVICE_NOT_AVAILABLE:
+        if (!CONFIG_SIMD_LAZY || !INTERRUPT_FRAME_IN_USER_SPACE(frame))
+        {
+            panic(frame, "device not available");
+        }
+        simd_device_not_available(&thread_current_unsafe()->simd);
+        break;
     case VECTOR_DOUBLE_FAULT:
         panic(frame, "double fault");
         break;
@@ -1,8 +1,10 @@
+#include <kernel/config.h>
 #include <kernel/cpu/cpu.h>
 #include <kernel/cpu/percpu.h>
 #include <kernel/cpu/regs.h>
 #include <kernel/cpu/simd.h>
 #include <kernel/log/log.h>
+#include <kernel/log/panic.h>
 #include <kernel/mem/pmm.h>
 
 #include <sys/defs.h>
@@ -11,15 +13,34 @@
 #include <string.h>
 #include <sys/cpuid.h>
 
+/**
+ * @brief Per-CPU SIMD context.
+ * @struct simd_cpu_t
+ */
+typedef struct
+{
+    simd_ctx_t* owner; ///< The context whose state was last restored on this CPU, only used for lazy switching.
+} simd_cpu_t;
+
 static uint8_t initCtx[PAGE_SIZE] ALIGNED(64);
 
+// Detected once at boot such that we dont need to execute `cpuid` on every context switch.
+static simd_save_t saveMode = SIMD_SAVE_FXSAVE;
+static uint64_t xcr0 = 0;
+
+static const char* saveModeNames[] = {
+    [SIMD_SAVE_FXSAVE] = "fxsave",
+    [SIMD_SAVE_XSAVE] = "xsave",
+    [SIMD_SAVE_XSAVEC] = "xsavec",
+    [SIMD_SAVE_XSAVEOPT] = "xsaveopt",
+    [SIMD_SAVE_XSAVES] = "xsaves",
+};
+
 static void simd_xsave_init(void)
 {
     cr4_write(cr4_read() | CR4_XSAVE_ENABLE);
 
-    uint64_t xcr0 = 0;
-
-    xcr0 = xcr0 | XCR0_XSAVE_SAVE_X87 | XCR0_XSAVE_SAVE_SSE;
+    xcr0 = XCR0_XSAVE_SAVE_X87 | XCR0_XSAVE_SAVE_SSE;
 
     cpuid_feature_info_t info;
     cpuid_feature_info(&info);
@@ -38,11 +59,89 @@ static void simd_xsave_init(void)
     }
 
     xcr0_write(0, xcr0);
+
+    cpuid_xsave_info_t xsaveInfo;
+    cpuid_xsave_info(&xsaveInfo);
+
+    if (xsaveInfo.features & CPUID_XSAVE_XSAVES)
+    {
+        // We dont use any supervisor state components.
+        msr_write(MSR_XSS, 0);
+        saveMode = SIMD_SAVE_XSAVES;
+    }
+    else if (xsaveInfo.features & CPUID_XSAVE_XSAVEOPT)
+    {
+        saveMode = SIMD_SAVE_XSAVEOPT;
+    }
+    else if (xsaveInfo.features & CPUID_XSAVE_XSAVEC)
+    {
+        saveMode = SIMD_SAVE_XSAVEC;
+    }
+    else
+    {
+        saveMode = SIMD_SAVE_XSAVE;
+    }
+
+    uint32_t size = saveMode == SIMD_SAVE_XSAVES || saveMode == SIMD_SAVE_XSAVEC ? xsaveInfo.compactedSize
+                                                                                : xsaveInfo.size;
+    if (size > PAGE_SIZE)
+    {
+        panic(NULL, "SIMD state of %u bytes does not fit in a page", size);
+    }
+}
+
+static inline void simd_save(uint8_t* buffer)
+{
+    uint32_t low = (uint32_t)xcr0;
+    uint32_t high = (uint32_t)(xcr0 >> 32);
+
+    switch (saveMode)
+    {
+    case SIMD_SAVE_XSAVES:
+        ASM("xsaves %0" : : "m"(*buffer), "a"(low), "d"(high) : "memory");
+        break;
+    case SIMD_SAVE_XSAVEOPT:
+        ASM("xsaveopt %0" : : "m"(*buffer), "a"(low), "d"(high) : "memory");
+        break;
+    case SIMD_SAVE_XSAVEC:
+        ASM("xsavec %0" : : "m"(*buffer), "a"(low), "d"(high) : "memory");
+        break;
+    case SIMD_SAVE_XSAVE:
+        ASM("xsave %0" : : "m"(*buffer), "a"(low), "d"(high) : "memory");
+        break;
+    default:
+        ASM("fxsave (%0)" : : "r"(buffer) : "memory");
+        break;
+    }
+}
+
+static inline void simd_restore(uint8_t* buffer)
+{
+    uint32_t low = (uint32_t)xcr0;
+    uint32_t high = (uint32_t)(xcr0 >> 32);
+
+    switch (saveMode)
+    {
+    case SIMD_SAVE_XSAVES:
+        ASM("xrstors %0" : : "m"(*buffer), "a"(low), "d"(high) : "memory");
+        break;
+    case SIMD_SAVE_XSAVEOPT:
+    case SIMD_SAVE_XSAVEC:
+    case SIMD_SAVE_XSAVE:
+        ASM("xrstor %0" : : "m"(*buffer), "a"(low), "d"(high) : "memory");
+        break;
+    default:
+        ASM("fxrstor (%0)" : : "r"(buffer) : "memory");
+        break;
+    }
 }
 
-PERCPU_DEFINE_CTOR(static void, pcpu_simd)
+PERCPU_DEFINE_CTOR(static simd_cpu_t, pcpu_simd)
 {
-    cr0_write(cr0_read() & ~((uint64_t)CR0_EMULATION));
+    simd_cpu_t* simd = SELF_PTR(pcpu_simd);
+    simd->owner = NULL;
+
+    cr0_write(cr0_read() & ~((uint64_t)(CR0_EMULATION | CR0_TASK_SWITCHED)));
     cr0_write(cr0_read() | CR0_MONITOR_CO_PROCESSOR | CR0_NUMERIC_ERROR_ENABLE);
 
     cr4_write(cr4_read() | CR4_FXSR_ENABLE | CR4_SIMD_EXCEPTION);
@@ -50,22 +149,20 @@ PERCPU_DEFINE_CTOR(static void, pcpu_simd)
     cpuid_feature_info_t info;
     cpuid_feature_info(&info);
 
-    cpuid_extended_feature_info_t extInfo;
-    cpuid_extended_feature_info(&extInfo);
-
     if (info.featuresEcx & CPUID_ECX_OSXSAVE)
     {
         simd_xsave_init();
     }
 
     ASM("fninit");
-    if (info.featuresEcx & CPUID_ECX_OSXSAVE)
+    if (SELF->id == CPU_ID_BOOTSTRAP)
     {
-        ASM("xsave %0" : : "m"(*initCtx), "a"(UINT64_MAX), "d"(UINT64_MAX) : "memory");
+        simd_save(initCtx);
     }
-    else
+
+    if (CONFIG_SIMD_LAZY)
     {
-        ASM("fxsave (%0)" : : "r"(initCtx));
+        cr0_write(cr0_read() | CR0_TASK_SWITCHED);
     }
 
     if (SELF->id != CPU_ID_BOOTSTRAP) // Only log for bootstrap CPU
@@ -73,11 +170,7 @@ PERCPU_DEFINE_CTOR(static void, pcpu_simd)
         return;
     }
 
-    LOG_INFO("simd ");
-    if (info.featuresEcx & CPUID_ECX_OSXSAVE)
-    {
-        LOG_INFO("xsave ");
-    }
+    LOG_INFO("simd %s%s ", saveModeNames[saveMode], CONFIG_SIMD_LAZY ? " lazy" : "");
 
     cpuid_instruction_sets_t sets = cpuid_detect_instruction_sets();
     if (sets & CPUID_INSTRUCTION_SET_SSE)
@@ -128,6 +221,7 @@ uint64_t simd_ctx_init(simd_ctx_t* ctx)
         return ERR;
     }
     ctx->buffer = PFN_TO_VIRT(pfn);
+    ctx->cpu = CPU_ID_INVALID;
     memcpy(ctx->buffer, initCtx, PAGE_SIZE);
 
     return 0;
@@ -141,30 +235,42 @@ void simd_ctx_deinit(simd_ctx_t* ctx)
 
 void simd_ctx_save(simd_ctx_t* ctx)
 {
-    cpuid_feature_info_t info;
-    cpuid_feature_info(&info);
-
-    if (info.featuresEcx & CPUID_ECX_OSXSAVE)
-    {
-        ASM("xsave %0" : : "m"(*ctx->buffer), "a"(UINT64_MAX), "d"(UINT64_MAX) : "memory");
-    }
-    else
+    // With lazy switching the state is only live, and thus possibly modified, if it was restored during this time
+    // slice.
+    if (CONFIG_SIMD_LAZY && (cr0_read() & CR0_TASK_SWITCHED))
     {
-        ASM("fxsave (%0)" : : "r"(ctx->buffer));
+        return;
     }
+
+    simd_save(ctx->buffer);
 }
 
 void simd_ctx_load(simd_ctx_t* ctx)
 {
-    cpuid_feature_info_t info;
-    cpuid_feature_info(&info);
-
-    if (info.featuresEcx & CPUID_ECX_OSXSAVE)
+    if (!CONFIG_SIMD_LAZY)
     {
-        ASM("xrstor %0" : : "m"(*ctx->buffer), "a"(UINT64_MAX), "d"(UINT64_MAX) : "memory");
+        simd_restore(ctx->buffer);
+        return;
     }
-    else
+
+    // The owner pointer is never dereferenced, so it does not matter if the owner has since been freed, a new context
+    // at the same address will not have `cpu` set to this CPU until it has been restored here.
+    simd_cpu_t* simd = SELF_PTR(pcpu_simd);
+    if (simd->owner == ctx && ctx->cpu == SELF->id)
     {
-        ASM("fxrstor (%0)" : : "r"(ctx->buffer));
+        ASM("clts");
+        return;
     }
+
+    cr0_write(cr0_read() | CR0_TASK_SWITCHED);
+}
+
+void simd_device_not_available(simd_ctx_t* ctx)
+{
+    ASM("clts");
+    simd_restore(ctx->buffer);
+
+    simd_cpu_t* simd = SELF_PTR(pcpu_simd);
+    simd->owner = ctx;
+    ctx->cpu = SELF->id;
 }
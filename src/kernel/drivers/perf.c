@@ -7,7 +7,9 @@
 #include <kernel/fs/vfs.h>
 #include <kernel/log/log.h>
 #include <kernel/log/panic.h>
+#include <kernel/mem/cache.h>
 #include <kernel/mem/pmm.h>
+#include <kernel/module/symbol.h>
 #include <kernel/sched/clock.h>
 #include <kernel/sched/sched.h>
 #include <kernel/sched/timer.h>
@@ -24,6 +26,10 @@
 static dentry_t* perfDir = NULL;
 static dentry_t* cpuFile = NULL;
 static dentry_t* memFile = NULL;
+static dentry_t* cacheFile = NULL;
+static dentry_t* schedFile = NULL;
+static dentry_t* latencyFile = NULL;
+static dentry_t* locksFile = NULL;
 
 typedef struct
 {
@@ -33,8 +39,27 @@ typedef struct
     clock_t interruptBegin;
     clock_t interruptEnd;
     lock_t lock;
+    perf_sched_t sched; ///< Only modified by the owning CPU, does not need the lock.
 } perf_cpu_t;
 
+static void perf_hist_init(perf_hist_t* hist)
+{
+    for (uint64_t i = 0; i < PERF_HIST_BUCKETS; i++)
+    {
+        atomic_init(&hist->buckets[i], 0);
+    }
+}
+
+static void perf_sched_init(perf_sched_t* sched)
+{
+    atomic_init(&sched->switches, 0);
+    atomic_init(&sched->involuntary, 0);
+    atomic_init(&sched->wakeups, 0);
+    atomic_init(&sched->migrations, 0);
+    perf_hist_init(&sched->runqueue);
+    perf_hist_init(&sched->wakeup);
+}
+
 PERCPU_DEFINE_CTOR(static perf_cpu_t, pcpu_perf)
 {
     perf_cpu_t* perf = SELF_PTR(pcpu_perf);
@@ -45,6 +70,7 @@ PERCPU_DEFINE_CTOR(static perf_cpu_t, pcpu_perf)
     perf->interruptBegin = 0;
     perf->interruptEnd = 0;
     lock_init(&perf->lock);
+    perf_sched_init(&perf->sched);
 }
 
 static size_t perf_cpu_read(file_t* file, void* buffer, size_t count, size_t* offset)
@@ -58,7 +84,7 @@ static size_t perf_cpu_read(file_t* file, void* buffer, size_t count, size_t* of
         return ERR;
     }
 
-    strcpy(string, "cpu idle_clocks active_clocks interrupt_clocks");
+    strcpy(string, "cpu idle_clocks active_clocks interrupt_clocks migrations");
 
     cpu_t* cpu;
     CPU_FOR_EACH(cpu)
@@ -85,8 +111,11 @@ static size_t perf_cpu_read(file_t* file, void* buffer, size_t count, size_t* of
         clock_t volatile idleClocks = perf->idleClocks;
         lock_release(&perf->lock);
 
-        int length =
-            sprintf(string + strlen(string), "%lu %lu %lu %lu", cpu->id, idleClocks, activeClocks, interruptClocks);
+        sched_t* sched = CPU_PTR(cpu->id, _pcpu_sched);
+        uint64_t migrations = atomic_load(&sched->migrations);
+
+        int length = sprintf(string + strlen(string), "%lu %lu %lu %lu %lu", cpu->id, idleClocks, activeClocks,
+            interruptClocks, migrations);
         if (length < 0)
         {
             free(string);
@@ -105,6 +134,119 @@ static file_ops_t cpuOps = {
     .read = perf_cpu_read,
 };
 
+static size_t perf_sched_read(file_t* file, void* buffer, size_t count, size_t* offset)
+{
+    UNUSED(file);
+
+    char* string = malloc(256 * (cpu_amount() + 1));
+    if (string == NULL)
+    {
+        errno = ENOMEM;
+        return ERR;
+    }
+
+    strcpy(string, "cpu switches involuntary wakeups migrations");
+
+    cpu_t* cpu;
+    CPU_FOR_EACH(cpu)
+    {
+        perf_cpu_t* perf = CPU_PTR(cpu->id, pcpu_perf);
+        sched_t* sched = CPU_PTR(cpu->id, _pcpu_sched);
+
+        int length = sprintf(string + strlen(string), "\n%lu %lu %lu %lu %lu", cpu->id,
+            atomic_load(&perf->sched.switches), atomic_load(&perf->sched.involuntary),
+            atomic_load(&perf->sched.wakeups), atomic_load(&sched->migrations));
+        if (length < 0)
+        {
+            free(string);
+            errno = EIO;
+            return ERR;
+        }
+    }
+
+    size_t length = strlen(string);
+    size_t readCount = BUFFER_READ(buffer, count, offset, string, length);
+    free(string);
+    return readCount;
+}
+
+static file_ops_t schedOps = {
+    .read = perf_sched_read,
+};
+
+static int perf_hist_print(char* string, uint64_t id, const char* name, perf_hist_t* hist)
+{
+    int total = sprintf(string, "\n%lu %s", id, name);
+    if (total < 0)
+    {
+        return -1;
+    }
+
+    for (uint64_t i = 0; i < PERF_HIST_BUCKETS; i++)
+    {
+        int length = sprintf(string + total, " %lu", atomic_load(&hist->buckets[i]));
+        if (length < 0)
+        {
+            return -1;
+        }
+        total += length;
+    }
+
+    return total;
+}
+
+static size_t perf_latency_read(file_t* file, void* buffer, size_t count, size_t* offset)
+{
+    UNUSED(file);
+
+    // Two lines per CPU, each bucket takes at most 21 characters.
+    uint64_t lineSize = 64 + PERF_HIST_BUCKETS * 21;
+    char* string = malloc(lineSize * (cpu_amount() * 2 + 1));
+    if (string == NULL)
+    {
+        errno = ENOMEM;
+        return ERR;
+    }
+
+    size_t length = sprintf(string, "cpu latency");
+    for (uint64_t i = 0; i < PERF_HIST_BUCKETS; i++)
+    {
+        length += sprintf(string + length, " %lu", i);
+    }
+
+    cpu_t* cpu;
+    CPU_FOR_EACH(cpu)
+    {
+        perf_cpu_t* perf = CPU_PTR(cpu->id, pcpu_perf);
+
+        int runqueueLength = perf_hist_print(string + length, cpu->id, "runqueue", &perf->sched.runqueue);
+        if (runqueueLength < 0)
+        {
+            free(string);
+            errno = EIO;
+            return ERR;
+        }
+        length += runqueueLength;
+
+        int wakeupLength = perf_hist_print(string + length, cpu->id, "wakeup", &perf->sched.wakeup);
+        if (wakeupLength < 0)
+        {
+            free(string);
+            errno = EIO;
+            return ERR;
+        }
+        length += wakeupLength;
+    }
+
+    size_t readCount = BUFFER_READ(buffer, count, offset, string, length);
+    free(string);
+    return readCount;
+}
+
+static file_ops_t latencyOps = {
+    .read = perf_latency_read,
+};
+
 static size_t perf_mem_read(file_t* file, void* buffer, size_t count, size_t* offset)
 {
     UNUSED(file);
@@ -116,8 +258,12 @@ static size_t perf_mem_read(file_t* file, void* buffer, size_t count, size_t* of
         return ERR;
     }
 
-    int length = sprintf(string, "total_pages %lu\nfree_pages %lu\nused_pages %lu", pmm_total_pages(),
-        pmm_avail_pages(), pmm_used_pages());
+    pmm_zeroed_stats_t zeroed;
+    pmm_zeroed_stats_get(&zeroed);
+
+    int length = sprintf(string,
+        "total_pages %lu\nfree_pages %lu\nused_pages %lu\nzeroed_pages %lu\nzeroed_hits %lu\nzeroed_misses %lu",
+        pmm_total_pages(), pmm_avail_pages(), pmm_used_pages(), zeroed.pages, zeroed.hits, zeroed.misses);
     if (length < 0)
     {
         free(string);
@@ -134,17 +280,125 @@ static file_ops_t memOps = {
     .read = perf_mem_read,
 };
 
+static size_t perf_cache_read(file_t* file, void* buffer, size_t count, size_t* offset)
+{
+    UNUSED(file);
+
+    char* string = malloc(256 * (CACHE_SIZE_CLASS_AMOUNT + 1));
+    if (string == NULL)
+    {
+        errno = ENOMEM;
+        return ERR;
+    }
+
+    strcpy(string, "cache allocs hits objects slabs capacity");
+
+    for (uint64_t i = 0; i < CACHE_SIZE_CLASS_AMOUNT; i++)
+    {
+        cache_t* cache = cache_size_class_get(i);
+
+        cache_stats_t stats;
+        cache_stats_get(cache, &stats);
+
+        int length = sprintf(string + strlen(string), "\n%s %lu %lu %lu %lu %lu", cache->name, stats.allocs,
+            stats.hits, stats.objects, stats.slabs, stats.capacity);
+        if (length < 0)
+        {
+            free(string);
+            errno = EIO;
+            return ERR;
+        }
+    }
+
+    size_t length = strlen(string);
+    size_t readCount = BUFFER_READ(buffer, count, offset, string, length);
+    free(string);
+    return readCount;
+}
+
+static file_ops_t cacheOps = {
+    .read = perf_cache_read,
+};
+
+static int perf_lock_profile_compare(const void* a, const void* b)
+{
+    const lock_profile_t* first = a;
+    const lock_profile_t* second = b;
+    if (first->cycles != second->cycles)
+    {
+        return first->cycles < second->cycles ? 1 : -1;
+    }
+    return first->acquires < second->acquires ? 1 : (first->acquires > second->acquires ? -1 : 0);
+}
+
+static size_t perf_locks_read(file_t* file, void* buffer, size_t count, size_t* offset)
+{
+    UNUSED(file);
+
+    lock_profile_t* profiles = malloc(sizeof(lock_profile_t) * LOCK_PROFILE_SITES);
+    if (profiles == NULL)
+    {
+        errno = ENOMEM;
+        return ERR;
+    }
+
+    uint64_t amount = lock_profile_get(profiles, LOCK_PROFILE_SITES);
+    qsort(profiles, amount, sizeof(lock_profile_t), perf_lock_profile_compare);
+
+    char* string = malloc((128 + SYMBOL_MAX_NAME) * (amount + 1));
+    if (string == NULL)
+    {
+        free(profiles);
+        errno = ENOMEM;
+        return ERR;
+    }
+
+    strcpy(string, "site symbol acquires contended cycles");
+
+    for (uint64_t i = 0; i < amount; i++)
+    {
+        symbol_info_t symbol;
+        if (symbol_resolve_addr(&symbol, (void*)profiles[i].site) == ERR)
+        {
+            strcpy(symbol.name, "unknown");
+        }
+
+        int length = sprintf(string + strlen(string), "\n%p %s %lu %lu %lu", (void*)profiles[i].site, symbol.name,
+            profiles[i].acquires, profiles[i].contended, profiles[i].cycles);
+        if (length < 0)
+        {
+            free(profiles);
+            free(string);
+            errno = EIO;
+            return ERR;
+        }
+    }
+
+    size_t length = strlen(string);
+    size_t readCount = BUFFER_READ(buffer, count, offset, string, length);
+    free(profiles);
+    free(string);
+    return readCount;
+}
+
+static file_ops_t locksOps = {
+    .read = perf_locks_read,
+};
+
 void perf_process_ctx_init(perf_process_ctx_t* ctx)
 {
     atomic_init(&ctx->userClocks, 0);
     atomic_init(&ctx->kernelClocks, 0);
     ctx->startTime = clock_uptime();
+    perf_sched_init(&ctx->sched);
 }
 
 void perf_thread_ctx_init(perf_thread_ctx_t* ctx)
 {
     ctx->syscallBegin = 0;
     ctx->syscallEnd = 0;
+    ctx->readyTime = 0;
+    ctx->wakeTime = 0;
 }
 
 void perf_init(void)
@@ -165,6 +419,30 @@ void perf_init(void)
     {
         panic(NULL, "Failed to create memory performance file");
     }
+    cacheFile = devfs_file_new(perfDir, "cache", NULL, &cacheOps, NULL);
+    if (cacheFile == NULL)
+    {
+        panic(NULL, "Failed to create cache performance file");
+    }
+    schedFile = devfs_file_new(perfDir, "sched", NULL, &schedOps, NULL);
+    if (schedFile == NULL)
+    {
+        panic(NULL, "Failed to create scheduler performance file");
+    }
+    latencyFile = devfs_file_new(perfDir, "latency", NULL, &latencyOps, NULL);
+    if (latencyFile == NULL)
+    {
+        panic(NULL, "Failed to create scheduler latency file");
+    }
+
+    if (CONFIG_LOCK_PROFILE)
+    {
+        locksFile = devfs_file_new(perfDir, "locks", NULL, &locksOps, NULL);
+        if (locksFile == NULL)
+        {
+            panic(NULL, "Failed to create lock contention file");
+        }
+    }
 }
 
 void perf_interrupt_begin(void)
@@ -258,3 +536,63 @@ void perf_syscall_end(void)
 
     atomic_fetch_add(&process->perf.kernelClocks, delta);
 }
+
+void perf_hist_add(perf_hist_t* hist, clock_t latency)
+{
+    uint64_t bucket = latency == 0 ? 0 : 63 - __builtin_clzll(latency);
+    if (bucket >= PERF_HIST_BUCKETS)
+    {
+        bucket = PERF_HIST_BUCKETS - 1;
+    }
+
+    atomic_fetch_add_explicit(&hist->buckets[bucket], 1, memory_order_relaxed);
+}
+
+void perf_sched_wakeup(thread_t* thread)
+{
+    thread->perf.wakeTime = clock_uptime();
+}
+
+void perf_sched_submit(thread_t* thread, clock_t uptime)
+{
+    thread->perf.readyTime = uptime;
+}
+
+void perf_sched_switch(thread_t* prev, thread_t* next, thread_t* idle, bool preempted, clock_t uptime)
+{
+    perf_cpu_t* perf = SELF_PTR(pcpu_perf);
+
+    if (prev != idle)
+    {
+        perf_sched_t* processSched = &prev->process->perf.sched;
+        atomic_fetch_add_explicit(&perf->sched.switches, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&processSched->switches, 1, memory_order_relaxed);
+        if (preempted)
+        {
+            atomic_fetch_add_explicit(&perf->sched.involuntary, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&processSched->involuntary, 1, memory_order_relaxed);
+            prev->perf.readyTime = uptime;
+        }
+    }
+
+    if (next == idle)
+    {
+        return;
+    }
+
+    perf_sched_t* processSched = &next->process->perf.sched;
+
+    clock_t runqueueDelay = uptime > next->perf.readyTime ? uptime - next->perf.readyTime : 0;
+    perf_hist_add(&perf->sched.runqueue, runqueueDelay);
+    perf_hist_add(&processSched->runqueue, runqueueDelay);
+
+    if (next->perf.wakeTime != 0)
+    {
+        clock_t wakeupLatency = uptime > next->perf.wakeTime ? uptime - next->perf.wakeTime : 0;
+        perf_hist_add(&perf->sched.wakeup, wakeupLatency);
+        perf_hist_add(&processSched->wakeup, wakeupLatency);
+        atomic_fetch_add_explicit(&perf->sched.wakeups, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&processSched->wakeups, 1, memory_order_relaxed);
+        next->perf.wakeTime = 0;
+    }
+}
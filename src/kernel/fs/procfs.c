@@ -1,6 +1,7 @@
 #include <_libstd/MAX_NAME.h>
 #include <kernel/fs/procfs.h>
 
+#include <kernel/config.h>
 #include <kernel/fs/ctl.h>
 #include <kernel/fs/dentry.h>
 #include <kernel/fs/file.h>
@@ -411,6 +412,242 @@ static file_ops_t perfOps = {
     .read = procfs_perf_read,
 };
 
+static size_t procfs_sched_hist_print(char* string, size_t size, const char* name, perf_hist_t* hist)
+{
+    size_t length = snprintf(string, size, "\n%s", name);
+    for (uint64_t i = 0; i < PERF_HIST_BUCKETS && length < size; i++)
+    {
+        length += snprintf(string + length, size - length, " %llu", atomic_load(&hist->buckets[i]));
+    }
+    return length;
+}
+
+static size_t procfs_sched_read(file_t* file, void* buffer, size_t count, size_t* offset)
+{
+    process_t* process = file->vnode->data;
+    perf_sched_t* sched = &process->perf.sched;
+
+    // Each histogram bucket takes at most 21 characters, so this is always large enough.
+    char statStr[MAX_PATH * 8];
+    size_t length = snprintf(statStr, sizeof(statStr), "switches %llu\ninvoluntary %llu\nwakeups %llu\nmigrations %llu",
+        atomic_load(&sched->switches), atomic_load(&sched->involuntary), atomic_load(&sched->wakeups),
+        atomic_load(&sched->migrations));
+    length += procfs_sched_hist_print(statStr + length, sizeof(statStr) - length, "runqueue", &sched->runqueue);
+    length += procfs_sched_hist_print(statStr + length, sizeof(statStr) - length, "wakeup", &sched->wakeup);
+    if (length >= sizeof(statStr))
+    {
+        errno = EIO;
+        return ERR;
+    }
+
+    return BUFFER_READ(buffer, count, offset, statStr, length);
+}
+
+static file_ops_t schedOps = {
+    .read = procfs_sched_read,
+};
+
+/**
+ * The maximum length of a formatted CPU list, such as `0-3,6`, including the null terminator.
+ */
+#define PROCFS_AFFINITY_MAX 1024
+
+static size_t procfs_affinity_format(sched_affinity_t* mask, char* buffer, size_t size)
+{
+    size_t length = 0;
+    buffer[0] = '\0';
+
+    uint16_t amount = cpu_amount();
+    for (uint16_t id = 0; id < amount; id++)
+    {
+        if (!sched_affinity_has(mask, id))
+        {
+            continue;
+        }
+
+        uint16_t end = id;
+        while (end + 1 < amount && sched_affinity_has(mask, end + 1))
+        {
+            end++;
+        }
+
+        int written;
+        if (end == id)
+        {
+            written = snprintf(buffer + length, size - length, "%s%u", length == 0 ? "" : ",", id);
+        }
+        else
+        {
+            written = snprintf(buffer + length, size - length, "%s%u-%u", length == 0 ? "" : ",", id, end);
+        }
+        if (written < 0 || (size_t)written >= size - length)
+        {
+            break;
+        }
+
+        length += written;
+        id = end;
+    }
+
+    return length;
+}
+
+// Parses either `all` or a comma separated list of CPU IDs and ranges, for example `0-3,6`.
+static uint64_t procfs_affinity_parse(sched_affinity_t* mask, const char* str)
+{
+    if (strcmp(str, "all") == 0)
+    {
+        sched_affinity_fill(mask);
+        return 0;
+    }
+
+    sched_affinity_clear(mask);
+
+    const char* ptr = str;
+    while (true)
+    {
+        char* end;
+        unsigned long first = strtoul(ptr, &end, 10);
+        if (end == ptr)
+        {
+            errno = EINVAL;
+            return ERR;
+        }
+
+        unsigned long last = first;
+        ptr = end;
+        if (*ptr == '-')
+        {
+            ptr++;
+            last = strtoul(ptr, &end, 10);
+            if (end == ptr)
+            {
+                errno = EINVAL;
+                return ERR;
+            }
+            ptr = end;
+        }
+
+        if (first > last || last >= CPU_MAX)
+        {
+            errno = EINVAL;
+            return ERR;
+        }
+
+        for (unsigned long id = first; id <= last; id++)
+        {
+            sched_affinity_add(mask, (cpu_id_t)id);
+        }
+
+        if (*ptr == '\0')
+        {
+            break;
+        }
+        if (*ptr != ',')
+        {
+            errno = EINVAL;
+            return ERR;
+        }
+        ptr++;
+    }
+
+    if (!sched_affinity_is_usable(mask))
+    {
+        errno = EINVAL;
+        return ERR;
+    }
+
+    return 0;
+}
+
+static size_t procfs_affinity_read(file_t* file, void* buffer, size_t count, size_t* offset)
+{
+    process_t* process = file->vnode->data;
+
+    rcu_read_lock();
+    uint64_t threadCount = process_rcu_thread_count(process);
+    rcu_read_unlock();
+
+    // One line for the process and one for each thread, threads created in between are ignored.
+    size_t size = (threadCount + 1) * (PROCFS_AFFINITY_MAX + MAX_NAME);
+    char* str = malloc(size);
+    if (str == NULL)
+    {
+        errno = ENOMEM;
+        return ERR;
+    }
+
+    char list[PROCFS_AFFINITY_MAX];
+    procfs_affinity_format(&process->affinity, list, sizeof(list));
+    size_t length = snprintf(str, size, "process %s\n", list);
+
+    RCU_READ_SCOPE();
+
+    uint64_t i = 0;
+    thread_t* thread;
+    PROCESS_RCU_THREAD_FOR_EACH(thread, process)
+    {
+        if (i++ >= threadCount)
+        {
+            break;
+        }
+
+        procfs_affinity_format(&thread->sched.affinity, list, sizeof(list));
+        length += snprintf(str + length, size - length, "thread %llu %s\n", thread->id, list);
+    }
+
+    size_t result = BUFFER_READ(buffer, count, offset, str, length);
+    free(str);
+    return result;
+}
+
+static file_ops_t affinityOps = {
+    .read = procfs_affinity_read,
+};
+
+static size_t procfs_slice_read(file_t* file, void* buffer, size_t count, size_t* offset)
+{
+    process_t* process = file->vnode->data;
+
+    rcu_read_lock();
+    uint64_t threadCount = process_rcu_thread_count(process);
+    rcu_read_unlock();
+
+    // One line for the process and one for each thread, threads created in between are ignored.
+    size_t size = (threadCount + 1) * MAX_NAME;
+    char* str = malloc(size);
+    if (str == NULL)
+    {
+        errno = ENOMEM;
+        return ERR;
+    }
+
+    size_t length = snprintf(str, size, "process %llu\n", atomic_load(&process->slice));
+
+    RCU_READ_SCOPE();
+
+    uint64_t i = 0;
+    thread_t* thread;
+    PROCESS_RCU_THREAD_FOR_EACH(thread, process)
+    {
+        if (i++ >= threadCount)
+        {
+            break;
+        }
+
+        length += snprintf(str + length, size - length, "thread %llu %llu\n", thread->id,
+            atomic_load(&thread->sched.slice));
+    }
+
+    size_t result = BUFFER_READ(buffer, count, offset, str, length);
+    free(str);
+    return result;
+}
+
+static file_ops_t sliceOps = {
+    .read = procfs_slice_read,
+};
+
 static uint64_t procfs_ns_open(file_t* file)
 {
     process_t* process = file->vnode->data;
@@ -733,6 +970,104 @@ static uint64_t procfs_ctl_setns(file_t* file, uint64_t argc, const char** argv)
     return 0;
 }
 
+static uint64_t procfs_ctl_affinity(file_t* file, uint64_t argc, const char** argv)
+{
+    if (argc != 2 && argc != 3)
+    {
+        errno = EINVAL;
+        return ERR;
+    }
+
+    process_t* process = file->vnode->data;
+
+    sched_affinity_t mask;
+    if (procfs_affinity_parse(&mask, argv[1]) == ERR)
+    {
+        return ERR;
+    }
+
+    if (argc == 2)
+    {
+        sched_affinity_set(&process->affinity, &mask);
+        return 0;
+    }
+
+    tid_t tid;
+    if (sscanf(argv[2], "%llu", &tid) != 1)
+    {
+        errno = EINVAL;
+        return ERR;
+    }
+
+    RCU_READ_SCOPE();
+
+    thread_t* thread;
+    PROCESS_RCU_THREAD_FOR_EACH(thread, process)
+    {
+        if (thread->id == tid)
+        {
+            sched_affinity_set(&thread->sched.affinity, &mask);
+            return 0;
+        }
+    }
+
+    errno = ESRCH;
+    return ERR;
+}
+
+static uint64_t procfs_ctl_slice(file_t* file, uint64_t argc, const char** argv)
+{
+    if (argc != 2 && argc != 3)
+    {
+        errno = EINVAL;
+        return ERR;
+    }
+
+    process_t* process = file->vnode->data;
+
+    clock_t slice;
+    if (sscanf(argv[1], "%llu", &slice) != 1 || slice < CONFIG_MIN_TIME_SLICE || slice > CONFIG_MAX_TIME_SLICE)
+    {
+        errno = EINVAL;
+        return ERR;
+    }
+
+    tid_t tid = 0;
+    if (argc == 3 && sscanf(argv[2], "%llu", &tid) != 1)
+    {
+        errno = EINVAL;
+        return ERR;
+    }
+
+    RCU_READ_SCOPE();
+
+    if (argc == 2)
+    {
+        atomic_store(&process->slice, slice);
+    }
+
+    thread_t* thread;
+    PROCESS_RCU_THREAD_FOR_EACH(thread, process)
+    {
+        if (argc == 2)
+        {
+            sched_set_slice(thread, slice);
+        }
+        else if (thread->id == tid)
+        {
+            return sched_set_slice(thread, slice);
+        }
+    }
+
+    if (argc == 3)
+    {
+        errno = ESRCH;
+        return ERR;
+    }
+
+    return 0;
+}
+
 static uint64_t procfs_ctl_setgroup(file_t* file, uint64_t argc, const char** argv)
 {
     if (argc != 2)
@@ -785,6 +1120,8 @@ CTL_STANDARD_OPS_DEFINE(ctlOps,
         {"kill", procfs_ctl_kill, 1, 2},
         {"setns", procfs_ctl_setns, 2, 2},
         {"setgroup", procfs_ctl_setgroup, 2, 2},
+        {"affinity", procfs_ctl_affinity, 2, 3},
+        {"slice", procfs_ctl_slice, 2, 3},
         {0},
     })
 
@@ -1014,6 +1351,21 @@ static const procfs_entry_t pidEntries[] = {
         .type = VREG,
         .fileOps = &perfOps,
     },
+    {
+        .name = "sched",
+        .type = VREG,
+        .fileOps = &schedOps,
+    },
+    {
+        .name = "affinity",
+        .type = VREG,
+        .fileOps = &affinityOps,
+    },
+    {
+        .name = "slice",
+        .type = VREG,
+        .fileOps = &sliceOps,
+    },
     {
         .name = "ns",
         .type = VREG,
@@ -10,6 +10,7 @@
 #include <kernel/fs/vfs.h>
 #include <kernel/fs/vnode.h>
 #include <kernel/init/boot_info.h>
+#include <kernel/io/irp.h>
 #include <kernel/log/log.h>
 #include <kernel/log/panic.h>
 #include <kernel/sched/sched.h>
@@ -19,6 +20,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/fs.h>
@@ -89,6 +91,64 @@ static file_ops_t fileOps = {
     .seek = file_generic_seek,
 };
 
+static void tmpfs_irp_read(irp_t* irp)
+{
+    irp_frame_t* frame = irp_current(irp);
+    vnode_t* vnode = frame->vnode;
+
+    uint64_t count = 0;
+    mutex_acquire(&vnode->mutex);
+    if (vnode->data != NULL && frame->read.off < vnode->size)
+    {
+        count = MIN(frame->read.len, vnode->size - frame->read.off);
+        mdl_write(frame->read.buffer, vnode->data + frame->read.off, count, 0);
+    }
+    mutex_release(&vnode->mutex);
+
+    frame->read.off += count;
+    irp->res.read = count;
+    irp_complete(irp);
+}
+
+static void tmpfs_irp_write(irp_t* irp)
+{
+    irp_frame_t* frame = irp_current(irp);
+    vnode_t* vnode = frame->vnode;
+
+    if (frame->write.off > SIZE_MAX - frame->write.len)
+    {
+        irp_error(irp, EFBIG);
+        return;
+    }
+
+    mutex_acquire(&vnode->mutex);
+    uint64_t requiredSize = frame->write.off + frame->write.len;
+    if (requiredSize > vnode->size)
+    {
+        void* newData = realloc(vnode->data, requiredSize);
+        if (newData == NULL)
+        {
+            mutex_release(&vnode->mutex);
+            irp_error(irp, ENOMEM);
+            return;
+        }
+        memset(newData + vnode->size, 0, requiredSize - vnode->size);
+        vnode->data = newData;
+        vnode->size = requiredSize;
+    }
+    mdl_read(frame->write.buffer, vnode->data + frame->write.off, frame->write.len, 0);
+    mutex_release(&vnode->mutex);
+
+    frame->write.off += frame->write.len;
+    irp->res.write = frame->write.len;
+    irp_complete(irp);
+}
+
+static irp_vtable_t vtable = {
+    .funcs[IRP_MJ_READ] = tmpfs_irp_read,
+    .funcs[IRP_MJ_WRITE] = tmpfs_irp_write,
+};
+
 static uint64_t tmpfs_create(vnode_t* dir, dentry_t* target, mode_t mode)
 {
     MUTEX_SCOPE(&dir->mutex);
@@ -295,6 +355,7 @@ static dentry_t* tmpfs_mount(filesystem_t* fs, const char* options, void* data)
 
     superblock->blockSize = 0;
     superblock->maxFileSize = UINT64_MAX;
+    superblock->vtable = &vtable;
 
     tmpfs_superblock_data_t* tmpfsData = malloc(sizeof(tmpfs_superblock_data_t));
     if (tmpfsData == NULL)
@@ -16,9 +16,11 @@
 #include <kernel/fs/tmpfs.h>
 #include <kernel/fs/vfs.h>
 #include <kernel/init/boot_info.h>
+#include <kernel/io/ring.h>
 #include <kernel/log/log.h>
 #include <kernel/log/panic.h>
 #include <kernel/log/screen.h>
+#include <kernel/mem/cache.h>
 #include <kernel/mem/pmm.h>
 #include <kernel/mem/vmm.h>
 #include <kernel/module/module.h>
@@ -31,6 +33,7 @@
 #include <kernel/sched/thread.h>
 #include <kernel/sched/timer.h>
 #include <kernel/sched/wait.h>
+#include <kernel/sync/futex.h>
 
 #include <boot/boot_info.h>
 
@@ -64,6 +67,7 @@ void init_early(void)
     vmm_kernel_space_load();
 
     syscall_table_init();
+    futex_init();
 
     _std_init();
 
@@ -103,6 +107,8 @@ static void init_finalize(void)
     log_expose();
 
     reaper_init();
+    cache_reclaim_init();
+    ioring_workers_init();
 
     perf_init();
 
@@ -152,6 +158,8 @@ static void init_finalize(void)
         panic(NULL, "No IPI chip registered, most likely no IPI chips with a provided driver was found");
     }
 
+    pmm_zeroed_init();
+
     LOG_INFO("kernel initalized using %llu kb of memory\n", pmm_used_pages() * PAGE_SIZE / 1024);
 }
 
@@ -1,4 +1,5 @@
 #include <kernel/cpu/cpu.h>
+#include <kernel/fs/file.h>
 #include <kernel/fs/namespace.h>
 #include <kernel/io/irp.h>
 #include <kernel/log/log.h>
@@ -148,6 +149,12 @@ static void irp_perform_completion(irp_t* irp)
     mdl_deinit(&irp->mdl);
     mdl_free_chain(next, free);
 
+    if (irp->file != NULL)
+    {
+        UNREF(irp->file);
+        irp->file = NULL;
+    }
+
     irp_pool_t* pool = irp_get_pool(irp);
     pool_free(&pool->pool, irp->index);
 
@@ -195,6 +202,8 @@ void irp_timeouts_check(void)
         {
             irp->err = ETIMEDOUT;
             handler(irp);
+            // The owner has let go of the IRP, the remaining frames are completed normally.
+            atomic_store(&irp->cancel, NULL);
             irp_perform_completion(irp);
         }
         else
@@ -235,6 +244,7 @@ irp_t* irp_new(irp_pool_t* pool)
     irp->cpu = CPU_ID_INVALID;
     irp->err = EOK;
     irp->frame = IRP_FRAME_MAX;
+    irp->file = NULL;
     return irp;
 }
 
@@ -348,6 +358,7 @@ uint64_t irp_cancel(irp_t* irp)
 
     irp->err = ECANCELED;
     uint64_t result = handler(irp);
+    atomic_store(&irp->cancel, NULL);
     irp_perform_completion(irp);
     return result;
 }
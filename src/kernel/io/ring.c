@@ -1,21 +1,57 @@
 #include <kernel/cpu/syscall.h>
+#include <kernel/fs/file.h>
 #include <kernel/fs/file_table.h>
 #include <kernel/fs/path.h>
+#include <kernel/fs/vnode.h>
 #include <kernel/io/ring.h>
 #include <kernel/io/irp.h>
 #include <kernel/log/log.h>
 #include <kernel/log/panic.h>
+#include <kernel/mem/cache.h>
 #include <kernel/mem/paging_types.h>
 #include <kernel/mem/pmm.h>
 #include <kernel/mem/vmm.h>
 #include <kernel/proc/process.h>
 #include <kernel/sched/clock.h>
+#include <kernel/sched/thread.h>
 
 #include <errno.h>
+#include <stdlib.h>
 #include <sys/ioring.h>
 #include <sys/list.h>
+#include <sys/math.h>
 #include <time.h>
 
+static list_t workerIrps = LIST_CREATE(workerIrps);
+static lock_t workerLock = LOCK_CREATE();
+static wait_queue_t workerQueue = WAIT_QUEUE_CREATE(workerQueue);
+
+static list_t pollIrps = LIST_CREATE(pollIrps); ///< Protected by `workerLock`.
+static wait_queue_t pollQueue = WAIT_QUEUE_CREATE(pollQueue);
+
+/**
+ * @brief State of a pending `IO_OP_POLL`.
+ */
+typedef struct
+{
+    wait_entry_t entry; ///< Callback entry in the wait queue of the polled file.
+    irp_t* irp;
+} ioring_poll_t;
+
+static cache_t pollCache = CACHE_CREATE(pollCache, "ioring_poll", sizeof(ioring_poll_t), CACHE_LINE, NULL, NULL);
+
+/**
+ * @brief A CQE that did not fit in the completion queue.
+ */
+typedef struct
+{
+    list_entry_t entry;
+    cqe_t cqe;
+} ioring_overflow_t;
+
+static cache_t overflowCache =
+    CACHE_CREATE(overflowCache, "ioring_overflow", sizeof(ioring_overflow_t), CACHE_LINE, NULL, NULL);
+
 static inline uint64_t ioring_ctx_acquire(ioring_ctx_t* ctx)
 {
     ioring_ctx_flags_t expected = atomic_load(&ctx->flags);
@@ -63,7 +99,8 @@ static inline uint64_t ioring_ctx_map(ioring_ctx_t* ctx, process_t* process, ior
     }
 
     // PML_OWNED means that the pages will be freed when unmapped.
-    void* kernelAddr = vmm_map_pages(NULL, NULL, pages, pageAmount, PML_WRITE | PML_PRESENT | PML_OWNED, NULL, NULL);
+    void* kernelAddr =
+        vmm_map_pages(NULL, NULL, pages, pageAmount, PML_WRITE | PML_GLOBAL | PML_PRESENT | PML_OWNED, NULL, NULL);
     if (kernelAddr == NULL)
     {
         pmm_free_pages(pages, pageAmount);
@@ -131,6 +168,12 @@ static inline uint64_t ioring_ctx_unmap(ioring_ctx_t* ctx)
     irp_pool_free(ctx->irps);
     ctx->irps = NULL;
 
+    while (!list_is_empty(&ctx->overflow))
+    {
+        cache_free(CONTAINER_OF(list_pop_front(&ctx->overflow), ioring_overflow_t, entry));
+    }
+    ctx->overflowAmount = 0;
+
     atomic_fetch_and(&ctx->flags, ~IORING_CTX_MAPPED);
     return 0;
 }
@@ -156,6 +199,10 @@ void ioring_ctx_init(ioring_ctx_t* ctx)
     ctx->kernelAddr = NULL;
     ctx->pageAmount = 0;
     wait_queue_init(&ctx->waitQueue);
+    lock_init(&ctx->cqLock);
+    list_init(&ctx->overflow);
+    ctx->overflowAmount = 0;
+    ctx->workers = 0;
     atomic_init(&ctx->flags, IORING_CTX_NONE);
 }
 
@@ -185,10 +232,45 @@ void ioring_ctx_deinit(ioring_ctx_t* ctx)
 
 static void ioring_ctx_dispatch(irp_t* irp);
 
-static void ioring_ctx_complete(irp_t* irp, void* _ptr)
+static void ioring_ctx_push(ioring_ctx_t* ctx, const cqe_t* cqe)
 {
-    UNUSED(_ptr);
+    ioring_t* ring = &ctx->ring;
+
+    uint32_t tail = atomic_load_explicit(&ring->ctrl->ctail, memory_order_relaxed);
+    ring->cqueue[tail & ring->cmask] = *cqe;
+    atomic_store_explicit(&ring->ctrl->ctail, tail + 1, memory_order_release);
+}
 
+/**
+ * Moves as many overflowed CQEs as possible into the completion queue, must be called with `cqLock` held.
+ */
+static void ioring_ctx_flush(ioring_ctx_t* ctx)
+{
+    ioring_t* ring = &ctx->ring;
+
+    while (!list_is_empty(&ctx->overflow) && ioring_ctx_avail_cqes(ctx) < ring->centries)
+    {
+        ioring_overflow_t* overflow = CONTAINER_OF(list_pop_front(&ctx->overflow), ioring_overflow_t, entry);
+        ctx->overflowAmount--;
+        ioring_ctx_push(ctx, &overflow->cqe);
+        cache_free(overflow);
+    }
+
+    if (list_is_empty(&ctx->overflow))
+    {
+        atomic_fetch_and_explicit(&ring->ctrl->flags, ~IORING_CTRL_OVERFLOW, memory_order_release);
+    }
+}
+
+static uint64_t ioring_ctx_ready_cqes(ioring_ctx_t* ctx)
+{
+    LOCK_SCOPE(&ctx->cqLock);
+    ioring_ctx_flush(ctx);
+    return ioring_ctx_avail_cqes(ctx);
+}
+
+static void ioring_ctx_post(irp_t* irp, cqe_flags_t flags)
+{
     ioring_ctx_t* ctx = irp_get_ctx(irp);
     ioring_t* ring = &ctx->ring;
 
@@ -198,23 +280,48 @@ static void ioring_ctx_complete(irp_t* irp, void* _ptr)
         atomic_store_explicit(&ring->ctrl->regs[reg], irp->res._raw, memory_order_release);
     }
 
-    uint32_t tail = atomic_load_explicit(&ring->ctrl->ctail, memory_order_relaxed);
-    uint32_t head = atomic_load_explicit(&ring->ctrl->chead, memory_order_acquire);
+    cqe_t cqe = {
+        .op = irp->sqe.op,
+        .error = irp->err,
+        .data = irp->sqe.data,
+        ._result = irp->res._raw,
+        .flags = flags,
+    };
+
+    lock_acquire(&ctx->cqLock);
+    ioring_ctx_flush(ctx);
 
-    if ((tail - head) >= ring->centries)
+    // The overflow list must be empty before we can push to the completion queue to keep the CQEs in order.
+    if (list_is_empty(&ctx->overflow) && ioring_ctx_avail_cqes(ctx) < ring->centries)
     {
-        /// @todo Handle overflow properly.
-        panic(NULL, "Async completion queue overflow");
+        ioring_ctx_push(ctx, &cqe);
     }
+    else
+    {
+        ioring_overflow_t* overflow = ctx->overflowAmount < ring->centries ? cache_alloc(&overflowCache) : NULL;
+        if (overflow == NULL)
+        {
+            atomic_fetch_add_explicit(&ring->ctrl->cdropped, 1, memory_order_relaxed);
+        }
+        else
+        {
+            list_entry_init(&overflow->entry);
+            overflow->cqe = cqe;
+            list_push_back(&ctx->overflow, &overflow->entry);
+            ctx->overflowAmount++;
+            atomic_fetch_or_explicit(&ring->ctrl->flags, IORING_CTRL_OVERFLOW, memory_order_release);
+        }
+    }
+    lock_release(&ctx->cqLock);
 
-    cqe_t* cqe = &ring->cqueue[tail & ring->cmask];
-    cqe->op = irp->sqe.op;
-    cqe->error = irp->err;
-    cqe->data = irp->sqe.data;
-    cqe->_result = irp->res._raw;
-
-    atomic_store_explicit(&ring->ctrl->ctail, tail + 1, memory_order_release);
     wait_unblock(&ctx->waitQueue, WAIT_ALL, EOK);
+}
+
+static void ioring_ctx_complete(irp_t* irp, void* _ptr)
+{
+    UNUSED(_ptr);
+
+    ioring_ctx_post(irp, CQE_NONE);
 
     if (irp->err != EOK && !(irp->sqe.flags & SQE_HARDLINK))
     {
@@ -242,6 +349,482 @@ static void ioring_ctx_complete(irp_t* irp, void* _ptr)
     irp_complete(irp);
 }
 
+static uint64_t ioring_worker_cancel(irp_t* irp)
+{
+    LOCK_SCOPE(&workerLock);
+
+    // If the IRP is no longer queued a worker has popped it, the worker will then fail to claim it and leave it alone.
+    if (list_entry_in_list(&irp->entry))
+    {
+        list_remove(&irp->entry);
+    }
+    return 0;
+}
+
+static void ioring_worker_queue(irp_t* irp)
+{
+    lock_acquire(&workerLock);
+    list_push_back(&workerIrps, &irp->entry);
+    irp_set_cancel(irp, ioring_worker_cancel);
+    lock_release(&workerLock);
+
+    wait_unblock(&workerQueue, 1, EOK);
+}
+
+// Polls are rechecked by their own thread, such that blocking operations occupying the workers can not delay them.
+static void ioring_poll_queue(irp_t* irp)
+{
+    lock_acquire(&workerLock);
+    list_push_back(&pollIrps, &irp->entry);
+    irp_set_cancel(irp, ioring_worker_cancel);
+    lock_release(&workerLock);
+
+    wait_unblock(&pollQueue, 1, EOK);
+}
+
+// Pops the first queued IRP whose process has not reached its share of the workers, must be called with the worker
+// lock acquired. The IRPs of a process at its limit stay queued and can therefore still be cancelled or time out.
+static irp_t* ioring_worker_pop(void)
+{
+    irp_t* irp;
+    LIST_FOR_EACH(irp, &workerIrps, entry)
+    {
+        process_t* process = irp_get_process(irp);
+
+        uint64_t busy = 0;
+        for (uint64_t i = 0; i < CONFIG_MAX_RINGS; i++)
+        {
+            busy += process->rings[i].workers;
+        }
+
+        if (busy < CONFIG_IORING_PROCESS_WORKERS)
+        {
+            list_remove(&irp->entry);
+            return irp;
+        }
+    }
+
+    return NULL;
+}
+
+// Must be called before the IRP is completed, as completing it might free the ring.
+static void ioring_worker_release(irp_t* irp)
+{
+    ioring_ctx_t* ctx = irp_get_ctx(irp);
+
+    lock_acquire(&workerLock);
+    ctx->workers--;
+    bool isPending = !list_is_empty(&workerIrps);
+    lock_release(&workerLock);
+
+    // Operations of the same process might have been skipped while it was at its limit.
+    if (isPending)
+    {
+        wait_unblock(&workerQueue, 1, EOK);
+    }
+}
+
+// Checks if the next chunk of a worker operation can be transferred without blocking, a file without a poll handler is
+// assumed to never block.
+static bool ioring_worker_ready(file_t* file, irp_major_t major)
+{
+    if (file->ops->poll == NULL)
+    {
+        return true;
+    }
+
+    poll_events_t revents = POLLNONE;
+    if (file->ops->poll(file, &revents) == NULL)
+    {
+        return false;
+    }
+
+    return revents & (major == IRP_MJ_READ ? POLLIN : POLLOUT);
+}
+
+static void ioring_worker_rw(irp_t* irp)
+{
+    irp_frame_t* frame = irp_current(irp);
+    file_t* file = irp->file;
+
+    // The read and write frames share the same layout. The length is chosen by user space, so instead of allocating a
+    // buffer for all of it the data is moved one page at a time.
+    size_t length = frame->read.len;
+    void* buffer = malloc(MIN(length, PAGE_SIZE));
+    if (buffer == NULL)
+    {
+        ioring_worker_release(irp);
+        irp_error(irp, ENOMEM);
+        return;
+    }
+
+    size_t offset = frame->read.off;
+    size_t total = 0;
+    errno_t err = EOK;
+    while (total < length)
+    {
+        // Only the first chunk may block, otherwise a stream that just filled a chunk would hold the worker until more
+        // data arrives while we already have something to report.
+        if (total != 0 && !ioring_worker_ready(file, frame->major))
+        {
+            break;
+        }
+
+        size_t chunk = MIN(length - total, PAGE_SIZE);
+        size_t result;
+        if (frame->major == IRP_MJ_READ)
+        {
+            result = file->ops->read(file, buffer, chunk, &offset);
+            if (result != ERR)
+            {
+                mdl_write(frame->read.buffer, buffer, result, total);
+            }
+        }
+        else
+        {
+            mdl_read(frame->write.buffer, buffer, chunk, total);
+            result = file->ops->write(file, buffer, chunk, &offset);
+        }
+
+        if (result == ERR)
+        {
+            err = errno;
+            break;
+        }
+
+        total += result;
+        if (result < chunk)
+        {
+            break;
+        }
+    }
+    free(buffer);
+    frame->read.off = offset;
+    ioring_worker_release(irp);
+
+    // Like a single call, an error is only reported if nothing was transferred.
+    if (err != EOK && total == 0)
+    {
+        irp_error(irp, err);
+        return;
+    }
+
+    irp->res._raw = total;
+    irp_complete(irp);
+}
+
+static uint64_t ioring_poll_cancel(irp_t* irp)
+{
+    ioring_poll_t* poll = irp_current(irp)->ctx;
+
+    // Waits for a concurrent `ioring_poll_wake()`, which will fail to claim the IRP.
+    wait_queue_remove_func(&poll->entry);
+    return 0;
+}
+
+static void ioring_poll_wake(wait_entry_t* entry)
+{
+    ioring_poll_t* poll = CONTAINER_OF(entry, ioring_poll_t, entry);
+    irp_t* irp = poll->irp;
+
+    // If the claim fails the IRP is either being cancelled or was claimed by `ioring_poll_arm()` after a recheck.
+    if (irp_set_cancel(irp, NULL) != ioring_poll_cancel)
+    {
+        return;
+    }
+
+    // We might be called while the file is locked, so the events are rechecked by the poll thread.
+    ioring_poll_queue(irp);
+}
+
+static void ioring_poll_arm(irp_t* irp)
+{
+    ioring_poll_t* poll = irp_current(irp)->ctx;
+    file_t* file = irp->file;
+    io_events_t events = irp->sqe.events | IO_POLL_ERROR | IO_POLL_HUP | IO_POLL_NVAL;
+
+    while (true)
+    {
+        // The values of `poll_events_t` match their `io_events_t` equivalents.
+        poll_events_t revents = POLLNONE;
+        wait_queue_t* queue = file->ops->poll(file, &revents);
+        if (queue == NULL)
+        {
+            irp_error(irp, errno);
+            return;
+        }
+
+        io_events_t ready = (io_events_t)revents & events;
+        if (ready != 0)
+        {
+            irp->res._raw = ready;
+            if (!(irp->sqe.flags & SQE_MULTISHOT) || (ready & IO_POLL_HUP))
+            {
+                irp_complete(irp);
+                return;
+            }
+
+            // Stay armed but only report again once the file signals its queue, otherwise a level that stays ready
+            // would flood the completion queue.
+            ioring_ctx_post(irp, CQE_MORE);
+            irp_set_cancel(irp, ioring_poll_cancel);
+            wait_queue_add_func(queue, &poll->entry, ioring_poll_wake);
+            return;
+        }
+
+        irp_set_cancel(irp, ioring_poll_cancel);
+        wait_queue_add_func(queue, &poll->entry, ioring_poll_wake);
+
+        // The events might have occurred before the entry was added.
+        revents = POLLNONE;
+        queue = file->ops->poll(file, &revents);
+        if (queue != NULL && ((io_events_t)revents & events) == 0)
+        {
+            return;
+        }
+
+        if (irp_set_cancel(irp, NULL) != ioring_poll_cancel)
+        {
+            return;
+        }
+        wait_queue_remove_func(&poll->entry);
+    }
+}
+
+static void ioring_poll_complete(irp_t* irp, void* ctx)
+{
+    ioring_poll_t* poll = ctx;
+
+    wait_queue_remove_func(&poll->entry);
+    cache_free(poll);
+
+    irp_complete(irp);
+}
+
+static void ioring_worker_thread(void* arg)
+{
+    UNUSED(arg);
+
+    while (true)
+    {
+        lock_acquire(&workerLock);
+        irp_t* irp = NULL;
+        if (WAIT_BLOCK_LOCK(&workerQueue, &workerLock, (irp = ioring_worker_pop()) != NULL) == ERR)
+        {
+            lock_release(&workerLock);
+            continue;
+        }
+
+        // Must be claimed while holding the lock, see `ioring_worker_cancel()`.
+        bool isClaimed = irp_set_cancel(irp, NULL) != IRP_CANCELLED;
+        if (isClaimed)
+        {
+            ioring_ctx_t* ctx = irp_get_ctx(irp);
+            ctx->workers++;
+        }
+        lock_release(&workerLock);
+
+        if (isClaimed)
+        {
+            ioring_worker_rw(irp);
+        }
+    }
+}
+
+static void ioring_poll_thread(void* arg)
+{
+    UNUSED(arg);
+
+    while (true)
+    {
+        lock_acquire(&workerLock);
+        if (WAIT_BLOCK_LOCK(&pollQueue, &workerLock, !list_is_empty(&pollIrps)) == ERR)
+        {
+            lock_release(&workerLock);
+            continue;
+        }
+
+        // Must be claimed while holding the lock, see `ioring_worker_cancel()`.
+        irp_t* irp = CONTAINER_OF(list_pop_front(&pollIrps), irp_t, entry);
+        bool isClaimed = irp_set_cancel(irp, NULL) != IRP_CANCELLED;
+        lock_release(&workerLock);
+
+        if (isClaimed)
+        {
+            ioring_poll_arm(irp);
+        }
+    }
+}
+
+void ioring_workers_init(void)
+{
+    for (uint64_t i = 0; i < CONFIG_IORING_WORKERS; i++)
+    {
+        if (thread_kernel_create(ioring_worker_thread, NULL) == ERR)
+        {
+            panic(NULL, "Failed to create I/O ring worker thread");
+        }
+    }
+
+    if (thread_kernel_create(ioring_poll_thread, NULL) == ERR)
+    {
+        panic(NULL, "Failed to create I/O ring poll thread");
+    }
+}
+
+static void ioring_ctx_rw_complete(irp_t* irp, void* _ptr)
+{
+    UNUSED(_ptr);
+
+    // The frame of the completed operation is still intact below the current frame.
+    irp_frame_t* frame = irp_next(irp);
+    if (irp->err == EOK && irp->sqe.offset == IO_OFF_CUR)
+    {
+        irp->file->pos = frame->read.off;
+    }
+
+    irp_complete(irp);
+}
+
+static void ioring_ctx_rw(irp_t* irp, irp_major_t major)
+{
+    process_t* process = irp_get_process(irp);
+
+    file_t* file = file_table_get(&process->fileTable, irp->sqe.fd);
+    if (file == NULL)
+    {
+        irp_error(irp, errno);
+        return;
+    }
+    irp->file = file; // Released once the IRP is finished.
+
+    if (file->vnode->type == VDIR)
+    {
+        irp_error(irp, EISDIR);
+        return;
+    }
+
+    if (!(file->mode & (major == IRP_MJ_READ ? MODE_READ : MODE_WRITE)))
+    {
+        irp_error(irp, EBADF);
+        return;
+    }
+
+    // Even if the vnode has a handler we might need to fall back to the workers.
+    if (file->ops == NULL || (major == IRP_MJ_READ ? file->ops->read == NULL : file->ops->write == NULL))
+    {
+        irp_error(irp, EINVAL);
+        return;
+    }
+
+    uintptr_t start = (uintptr_t)irp->sqe.buffer;
+    if (irp->sqe.count > UINT32_MAX || start < VMM_USER_SPACE_MIN || start + irp->sqe.count > VMM_USER_SPACE_MAX ||
+        start + irp->sqe.count < start)
+    {
+        irp_error(irp, EFAULT);
+        return;
+    }
+
+    if (irp->sqe.offset < 0 && irp->sqe.offset != IO_OFF_CUR)
+    {
+        irp_error(irp, EINVAL);
+        return;
+    }
+
+    if (irp->sqe.count == 0)
+    {
+        irp->res._raw = 0;
+        irp_complete(irp);
+        return;
+    }
+
+    mdl_t* mdl = irp_get_mdl(irp, irp->sqe.buffer, irp->sqe.count);
+    if (mdl == NULL)
+    {
+        irp_error(irp, errno);
+        return;
+    }
+
+    uint64_t offset = irp->sqe.offset == IO_OFF_CUR ? file->pos : (uint64_t)irp->sqe.offset;
+    if (major == IRP_MJ_WRITE && (file->mode & MODE_APPEND) && file->ops != NULL && file->ops->seek != NULL)
+    {
+        offset = file->ops->seek(file, 0, SEEK_END);
+        if (offset == ERR)
+        {
+            irp_error(irp, errno);
+            return;
+        }
+    }
+
+    irp_set_complete(irp, ioring_ctx_rw_complete, NULL);
+    if (major == IRP_MJ_READ)
+    {
+        irp_prepare_read(irp, mdl, NULL, offset, irp->sqe.count, file->mode);
+    }
+    else
+    {
+        irp_prepare_write(irp, mdl, NULL, offset, irp->sqe.count, file->mode);
+    }
+    irp_timeout_add(irp, irp->sqe.timeout);
+
+    // Handlers may acquire mutexes, so we can only call them directly from a thread context, for example when a linked
+    // SQE is dispatched from a timeout we defer to the workers.
+    const irp_vtable_t* vtable = file->vnode->vtable;
+    if (vtable != NULL && vtable->funcs[major] != NULL && (rflags_read() & RFLAGS_INTERRUPT_ENABLE))
+    {
+        irp_call(irp, file->vnode);
+        return;
+    }
+
+    irp_call_direct(irp, ioring_worker_queue);
+}
+
+static void ioring_ctx_poll(irp_t* irp)
+{
+    process_t* process = irp_get_process(irp);
+
+    file_t* file = file_table_get(&process->fileTable, irp->sqe.fd);
+    if (file == NULL)
+    {
+        irp_error(irp, errno);
+        return;
+    }
+    irp->file = file; // Released once the IRP is finished.
+
+    if (file->vnode->type == VDIR)
+    {
+        irp_error(irp, EISDIR);
+        return;
+    }
+
+    if (file->ops == NULL || file->ops->poll == NULL)
+    {
+        irp_error(irp, ENOSYS);
+        return;
+    }
+
+    ioring_poll_t* poll = cache_alloc(&pollCache);
+    if (poll == NULL)
+    {
+        irp_error(irp, ENOMEM);
+        return;
+    }
+    poll->entry.queue = NULL;
+    poll->irp = irp;
+
+    irp_set_complete(irp, ioring_poll_complete, poll);
+    irp_timeout_add(irp, irp->sqe.timeout);
+
+    // Poll handlers may acquire mutexes, see `ioring_ctx_rw()`.
+    if (rflags_read() & RFLAGS_INTERRUPT_ENABLE)
+    {
+        irp_call_direct(irp, ioring_poll_arm);
+        return;
+    }
+
+    irp_call_direct(irp, ioring_poll_queue);
+}
+
 static uint64_t nop_cancel(irp_t* irp)
 {
     irp_complete(irp);
@@ -285,12 +868,27 @@ static void ioring_ctx_dispatch(irp_t* irp)
         irp->sqe.arg4 = atomic_load_explicit(&ring->ctrl->regs[reg], memory_order_acquire);
     }
 
+    if ((irp->sqe.flags & SQE_MULTISHOT) && irp->sqe.op != IO_OP_POLL)
+    {
+        irp_error(irp, EINVAL);
+        return;
+    }
+
     switch (irp->sqe.op)
     {
     case IO_OP_NOP:
         irp_set_cancel(irp, nop_cancel);
         irp_timeout_add(irp, irp->sqe.timeout);
         break;
+    case IO_OP_READ:
+        ioring_ctx_rw(irp, IRP_MJ_READ);
+        break;
+    case IO_OP_WRITE:
+        ioring_ctx_rw(irp, IRP_MJ_WRITE);
+        break;
+    case IO_OP_POLL:
+        ioring_ctx_poll(irp);
+        break;
     default:
         irp_error(irp, EINVAL);
         break;
@@ -316,6 +914,16 @@ static uint64_t ioring_ctx_sqe_pop(ioring_ctx_t* ctx, ioring_ctx_notify_ctx_t* n
         return ERR;
     }
 
+    // Every IRP in flight will post at least one CQE, so only accept new SQEs while their CQEs are guaranteed to fit.
+    lock_acquire(&ctx->cqLock);
+    uint64_t pending = atomic_load(&ctx->irps->active) + ioring_ctx_avail_cqes(ctx) + ctx->overflowAmount;
+    lock_release(&ctx->cqLock);
+    if (pending >= ring->centries)
+    {
+        errno = EBUSY;
+        return ERR;
+    }
+
     irp_t* irp = irp_new(ctx->irps);
     if (irp == NULL)
     {
@@ -345,18 +953,13 @@ static uint64_t ioring_ctx_sqe_pop(ioring_ctx_t* ctx, ioring_ctx_notify_ctx_t* n
 
 uint64_t ioring_ctx_notify(ioring_ctx_t* ctx, size_t amount, size_t wait)
 {
-    if (amount == 0)
-    {
-        return 0;
-    }
-
     if (ioring_ctx_acquire(ctx) == ERR)
     {
         errno = EBUSY;
         return ERR;
     }
 
-    if (!(atomic_load(&ctx->flags) & IORING_CTX_MAPPED))
+    if (!(atomic_load(&ctx->flags) & IORING_CTX_MAPPED) || wait > ctx->ring.centries)
     {
         ioring_ctx_release(ctx);
         errno = EINVAL;
@@ -388,11 +991,12 @@ uint64_t ioring_ctx_notify(ioring_ctx_t* ctx, size_t amount, size_t wait)
 
     if (wait == 0)
     {
+        ioring_ctx_ready_cqes(ctx);
         ioring_ctx_release(ctx);
         return processed;
     }
 
-    if (WAIT_BLOCK(&ctx->waitQueue, ioring_ctx_avail_cqes(ctx) >= wait) == ERR)
+    if (WAIT_BLOCK(&ctx->waitQueue, ioring_ctx_ready_cqes(ctx) >= wait) == ERR)
     {
         ioring_ctx_release(ctx);
         return processed > 0 ? processed : ERR;
@@ -1,5 +1,7 @@
 #include <kernel/fs/devfs.h>
 #include <kernel/fs/file.h>
+#include <kernel/fs/vnode.h>
+#include <kernel/io/irp.h>
 #include <kernel/log/log.h>
 
 #include <kernel/cpu/cpu.h>
@@ -80,6 +82,31 @@ static file_ops_t klogOps = {
     .write = klog_write,
 };
 
+static void klog_irp_read(irp_t* irp)
+{
+    irp_frame_t* frame = irp_current(irp);
+
+    lock_acquire(&lock);
+    uint64_t count = frame->read.off < klogHead ? MIN(frame->read.len, klogHead - frame->read.off) : 0;
+    uint64_t read = 0;
+    while (read < count)
+    {
+        uint64_t start = (frame->read.off + read) % CONFIG_KLOG_SIZE;
+        uint64_t chunk = MIN(count - read, CONFIG_KLOG_SIZE - start);
+        mdl_write(frame->read.buffer, klogBuffer + start, chunk, read);
+        read += chunk;
+    }
+    lock_release(&lock);
+
+    frame->read.off += read;
+    irp->res.read = read;
+    irp_complete(irp);
+}
+
+static irp_vtable_t klogVtable = {
+    .funcs[IRP_MJ_READ] = klog_irp_read,
+};
+
 static void log_splash(void)
 {
 #ifdef NDEBUG
@@ -123,6 +150,7 @@ void log_expose(void)
     {
         return;
     }
+    klog->vnode->vtable = &klogVtable;
 }
 
 static void log_write(const char* string, uint64_t length)
@@ -431,6 +431,10 @@ void panic(const interrupt_frame_t* frame, const char* format, ...)
             {
                 LOG_PANIC("                    (Faulting address is in kernel binary region)\n");
             }
+            else if (cr2 >= VMM_KERNEL_SLABS_MIN && cr2 < VMM_KERNEL_SLABS_MAX)
+            {
+                LOG_PANIC("                    (Faulting address is in cache slabs region)\n");
+            }
             else if (cr2 >= VMM_KERNEL_HEAP_MIN && cr2 < VMM_KERNEL_HEAP_MAX)
             {
                 LOG_PANIC("                    (Faulting address is in kernel heap region)\n");
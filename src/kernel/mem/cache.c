@@ -1,24 +1,91 @@
 #include <kernel/cpu/cpu.h>
 #include <kernel/cpu/interrupt.h>
 #include <kernel/log/log.h>
+#include <kernel/log/panic.h>
 #include <kernel/mem/cache.h>
 #include <kernel/mem/pmm.h>
+#include <kernel/sched/sched.h>
+#include <kernel/sched/thread.h>
 
 #include <errno.h>
 #include <kernel/mem/vmm.h>
 #include <kernel/sync/lock.h>
 #include <stdlib.h>
+#include <sys/bitmap.h>
 #include <sys/list.h>
 #include <sys/math.h>
 
+#define CACHE_SLAB_SLOTS ((VMM_KERNEL_SLABS_MAX - VMM_KERNEL_SLABS_MIN) / CACHE_SLAB_SIZE)
+
+static BITMAP_CREATE_ZERO(slabSlots, CACHE_SLAB_SLOTS);
+static lock_t slabSlotsLock = LOCK_CREATE();
+
+#define CACHE_SIZE_CLASS_CREATE(_index, _size) \
+    [_index] = CACHE_CREATE(sizeClasses[_index], "size-" #_size, _size, MIN(_size, CACHE_LINE), NULL, NULL)
+
+static cache_t sizeClasses[CACHE_SIZE_CLASS_AMOUNT] = {
+    CACHE_SIZE_CLASS_CREATE(0, 16),
+    CACHE_SIZE_CLASS_CREATE(1, 32),
+    CACHE_SIZE_CLASS_CREATE(2, 64),
+    CACHE_SIZE_CLASS_CREATE(3, 128),
+    CACHE_SIZE_CLASS_CREATE(4, 256),
+    CACHE_SIZE_CLASS_CREATE(5, 512),
+    CACHE_SIZE_CLASS_CREATE(6, 1024),
+    CACHE_SIZE_CLASS_CREATE(7, 2048),
+    CACHE_SIZE_CLASS_CREATE(8, 4096),
+};
+
+static cache_t magazineCache =
+    CACHE_CREATE(magazineCache, "magazine", sizeof(cache_magazine_t), CACHE_LINE, NULL, NULL);
+
+// Caches are never destroyed, so entries are only ever added.
+static list_t caches = LIST_CREATE(caches);
+static lock_t cachesLock = LOCK_CREATE();
+
+static_assert(CACHE_SIZE_CLASS_MIN << (CACHE_SIZE_CLASS_AMOUNT - 1) == CACHE_SIZE_CLASS_MAX,
+    "size classes do not cover CACHE_SIZE_CLASS_MIN to CACHE_SIZE_CLASS_MAX");
+
+static void* cache_slot_alloc(void)
+{
+    lock_acquire(&slabSlotsLock);
+    uint64_t slot = bitmap_find_first_clear(&slabSlots, 0, CACHE_SLAB_SLOTS);
+    if (slot >= CACHE_SLAB_SLOTS)
+    {
+        lock_release(&slabSlotsLock);
+        errno = ENOMEM;
+        return NULL;
+    }
+    bitmap_set(&slabSlots, slot);
+    lock_release(&slabSlotsLock);
+
+    void* addr = (void*)(VMM_KERNEL_SLABS_MIN + slot * CACHE_SLAB_SIZE);
+    if (vmm_alloc(NULL, addr, CACHE_SLAB_SIZE, CACHE_SLAB_SIZE, PML_PRESENT | PML_WRITE | PML_GLOBAL,
+            VMM_ALLOC_FAIL_IF_MAPPED) == NULL)
+    {
+        LOCK_SCOPE(&slabSlotsLock);
+        bitmap_clear(&slabSlots, slot);
+        return NULL;
+    }
+
+    return addr;
+}
+
+static void cache_slot_free(void* addr)
+{
+    vmm_unmap(NULL, addr, CACHE_SLAB_SIZE);
+
+    LOCK_SCOPE(&slabSlotsLock);
+    bitmap_clear(&slabSlots, ((uintptr_t)addr - VMM_KERNEL_SLABS_MIN) / CACHE_SLAB_SIZE);
+}
+
 static cache_slab_t* cache_slab_new(cache_t* cache)
 {
-    cache_slab_t* slab = vmm_alloc(NULL, NULL, CACHE_SLAB_PAGES * PAGE_SIZE, CACHE_SLAB_PAGES * PAGE_SIZE,
-        PML_PRESENT | PML_WRITE | PML_GLOBAL, VMM_ALLOC_FAIL_IF_MAPPED);
+    cache_slab_t* slab = cache_slot_alloc();
     if (slab == NULL)
     {
         return NULL;
     }
+    cache->slabCount++;
     list_entry_init(&slab->entry);
     slab->owner = CPU_ID_INVALID;
     slab->freeCount = cache->layout.amount;
@@ -44,6 +111,9 @@ static cache_slab_t* cache_slab_new(cache_t* cache)
     return slab;
 }
 
+/**
+ * The caller must remove the slab from its cache and decrement the slab count with the cache lock acquired.
+ */
 static void cache_slab_destroy(cache_slab_t* slab)
 {
     if (slab->cache->dtor != NULL)
@@ -53,7 +123,7 @@ static void cache_slab_destroy(cache_slab_t* slab)
             slab->cache->dtor((void*)((uintptr_t)slab->objects + (i * slab->cache->layout.step)));
         }
     }
-    vmm_unmap(NULL, slab, CACHE_SLAB_PAGES * PAGE_SIZE);
+    cache_slot_free(slab);
 }
 
 static inline void* cache_slab_alloc(cache_slab_t* slab)
@@ -106,18 +176,13 @@ static inline void cache_precalc_layout(cache_t* cache)
     assert(cache->layout.amount != 0);
 }
 
-void* cache_alloc(cache_t* cache)
+static void* cache_slab_get(cache_t* cache)
 {
-    if (cache == NULL)
-    {
-        return NULL;
-    }
+    cache_cpu_t* cpu = &cache->cpus[SELF->id];
 
-    CLI_SCOPE();
-
-    if (cache->cpus[SELF->id].active != NULL)
+    if (cpu->active != NULL)
     {
-        cache_slab_t* active = cache->cpus[SELF->id].active;
+        cache_slab_t* active = cpu->active;
         lock_acquire(&active->lock);
 
         void* result = cache_slab_alloc(active);
@@ -140,7 +205,7 @@ void* cache_alloc(cache_t* cache)
         }
 
         active->owner = CPU_ID_INVALID;
-        cache->cpus[SELF->id].active = NULL;
+        cpu->active = NULL;
         list_remove(&active->entry);
         list_push_back(&cache->full, &active->entry);
         lock_release(&active->lock);
@@ -165,7 +230,7 @@ allocate:
             list_remove(&slab->entry);
             list_push_back(&cache->partial, &slab->entry);
             slab->owner = SELF->id;
-            cache->cpus[SELF->id].active = slab;
+            cpu->active = slab;
             lock_release(&cache->lock);
 
             LOCK_SCOPE(&slab->lock);
@@ -177,9 +242,10 @@ allocate:
     {
         slab = CONTAINER_OF(list_pop_front(&cache->free), cache_slab_t, entry);
         cache->freeCount--;
+        cache->freeMin = MIN(cache->freeMin, cache->freeCount);
         list_push_back(&cache->partial, &slab->entry);
         slab->owner = SELF->id;
-        cache->cpus[SELF->id].active = slab;
+        cpu->active = slab;
         lock_release(&cache->lock);
 
         LOCK_SCOPE(&slab->lock);
@@ -195,21 +261,16 @@ allocate:
 
     list_push_back(&cache->partial, &slab->entry);
     slab->owner = SELF->id;
-    cache->cpus[SELF->id].active = slab;
+    cpu->active = slab;
     lock_release(&cache->lock);
 
     LOCK_SCOPE(&slab->lock);
     return cache_slab_alloc(slab);
 }
 
-void cache_free(void* ptr)
+static void cache_slab_put(void* ptr)
 {
-    if (ptr == NULL)
-    {
-        return;
-    }
-
-    cache_slab_t* slab = (cache_slab_t*)ROUND_DOWN((uintptr_t)ptr, CACHE_SLAB_PAGES * PAGE_SIZE);
+    cache_slab_t* slab = (cache_slab_t*)ROUND_DOWN((uintptr_t)ptr, CACHE_SLAB_SIZE);
     cache_t* cache = slab->cache;
 
     lock_acquire(&slab->lock);
@@ -237,6 +298,8 @@ void cache_free(void* ptr)
             {
                 cache_slab_t* freeSlab = CONTAINER_OF(list_pop_front(&cache->free), cache_slab_t, entry);
                 cache->freeCount--;
+                cache->freeMin = MIN(cache->freeMin, cache->freeCount);
+                cache->slabCount--;
                 cache_slab_destroy(freeSlab);
             }
         }
@@ -245,6 +308,315 @@ void cache_free(void* ptr)
     }
 }
 
+/**
+ * Returns a magazine that is no longer needed by a CPU to the depot, or if the depot is full, returns its objects to
+ * the slabs and the magazine itself to the magazine cache.
+ *
+ * Must be called without the cache lock acquired.
+ */
+static void cache_magazine_put(cache_t* cache, cache_magazine_t* magazine)
+{
+    lock_acquire(&cache->lock);
+    if (magazine->count == 0 && cache->emptyMagazineCount < CACHE_DEPOT_LIMIT)
+    {
+        list_push_back(&cache->emptyMagazines, &magazine->entry);
+        cache->emptyMagazineCount++;
+        lock_release(&cache->lock);
+        return;
+    }
+    if (magazine->count != 0 && cache->fullMagazineCount < CACHE_DEPOT_LIMIT)
+    {
+        list_push_back(&cache->fullMagazines, &magazine->entry);
+        cache->fullMagazineCount++;
+        lock_release(&cache->lock);
+        return;
+    }
+    lock_release(&cache->lock);
+
+    for (uint64_t i = 0; i < magazine->count; i++)
+    {
+        cache_slab_put(magazine->rounds[i]);
+    }
+    cache_free(magazine);
+}
+
+static void* cache_magazine_alloc(cache_t* cache, cache_cpu_t* cpu)
+{
+    if (cpu->loaded != NULL && cpu->loaded->count > 0)
+    {
+        cpu->hits++;
+        return cpu->loaded->rounds[--cpu->loaded->count];
+    }
+
+    if (cpu->previous != NULL && cpu->previous->count > 0)
+    {
+        cache_magazine_t* temp = cpu->loaded;
+        cpu->loaded = cpu->previous;
+        cpu->previous = temp;
+
+        cpu->hits++;
+        return cpu->loaded->rounds[--cpu->loaded->count];
+    }
+
+    lock_acquire(&cache->lock);
+    if (list_is_empty(&cache->fullMagazines))
+    {
+        lock_release(&cache->lock);
+        return NULL;
+    }
+    cache_magazine_t* full = CONTAINER_OF(list_pop_front(&cache->fullMagazines), cache_magazine_t, entry);
+    cache->fullMagazineCount--;
+    cache->fullMagazineMin = MIN(cache->fullMagazineMin, cache->fullMagazineCount);
+    lock_release(&cache->lock);
+
+    // Both magazines are empty, keep one around for frees and give the other back to the depot.
+    if (cpu->previous != NULL)
+    {
+        cache_magazine_put(cache, cpu->previous);
+    }
+    cpu->previous = cpu->loaded;
+    cpu->loaded = full;
+
+    return cpu->loaded->rounds[--cpu->loaded->count];
+}
+
+static bool cache_magazine_free(cache_t* cache, cache_cpu_t* cpu, void* ptr)
+{
+    if (cpu->loaded != NULL && cpu->loaded->count < CACHE_MAGAZINE_SIZE)
+    {
+        cpu->loaded->rounds[cpu->loaded->count++] = ptr;
+        return true;
+    }
+
+    if (cpu->previous != NULL && cpu->previous->count < CACHE_MAGAZINE_SIZE)
+    {
+        cache_magazine_t* temp = cpu->loaded;
+        cpu->loaded = cpu->previous;
+        cpu->previous = temp;
+
+        cpu->loaded->rounds[cpu->loaded->count++] = ptr;
+        return true;
+    }
+
+    cache_magazine_t* empty = NULL;
+    lock_acquire(&cache->lock);
+    if (!list_is_empty(&cache->emptyMagazines))
+    {
+        empty = CONTAINER_OF(list_pop_front(&cache->emptyMagazines), cache_magazine_t, entry);
+        cache->emptyMagazineCount--;
+        cache->emptyMagazineMin = MIN(cache->emptyMagazineMin, cache->emptyMagazineCount);
+    }
+    lock_release(&cache->lock);
+
+    if (empty == NULL)
+    {
+        empty = cache_alloc(&magazineCache);
+        if (empty == NULL)
+        {
+            return false;
+        }
+        list_entry_init(&empty->entry);
+        empty->count = 0;
+    }
+
+    // Both magazines are full, keep one around for allocations and give the other back to the depot.
+    if (cpu->previous != NULL)
+    {
+        cache_magazine_put(cache, cpu->previous);
+    }
+    cpu->previous = cpu->loaded;
+    cpu->loaded = empty;
+
+    cpu->loaded->rounds[cpu->loaded->count++] = ptr;
+    return true;
+}
+
+static void cache_register(cache_t* cache)
+{
+    LOCK_SCOPE(&cachesLock);
+    if (cache->isRegistered)
+    {
+        return;
+    }
+    list_push_back(&caches, &cache->entry);
+    cache->isRegistered = true;
+}
+
+void* cache_alloc(cache_t* cache)
+{
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+
+    CLI_SCOPE();
+
+    cache_cpu_t* cpu = &cache->cpus[SELF->id];
+    cpu->allocs++;
+
+    // The magazine cache can not use magazines itself.
+    void* result = NULL;
+    if (cache != &magazineCache)
+    {
+        result = cache_magazine_alloc(cache, cpu);
+    }
+
+    if (result == NULL)
+    {
+        result = cache_slab_get(cache);
+        if (result == NULL)
+        {
+            cpu->allocs--;
+        }
+        else if (!cache->isRegistered)
+        {
+            cache_register(cache);
+        }
+    }
+    return result;
+}
+
+void cache_free(void* ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    cache_slab_t* slab = (cache_slab_t*)ROUND_DOWN((uintptr_t)ptr, CACHE_SLAB_SIZE);
+    cache_t* cache = slab->cache;
+
+    CLI_SCOPE();
+
+    cache_cpu_t* cpu = &cache->cpus[SELF->id];
+    cpu->frees++;
+
+    if (cache != &magazineCache && cache_magazine_free(cache, cpu, ptr))
+    {
+        return;
+    }
+
+    cache_slab_put(ptr);
+}
+
+bool cache_is_object(const void* ptr)
+{
+    return (uintptr_t)ptr >= VMM_KERNEL_SLABS_MIN && (uintptr_t)ptr < VMM_KERNEL_SLABS_MAX;
+}
+
+size_t cache_object_size(const void* obj)
+{
+    cache_slab_t* slab = (cache_slab_t*)ROUND_DOWN((uintptr_t)obj, CACHE_SLAB_SIZE);
+    return slab->cache->size;
+}
+
+void* cache_alloc_size(size_t size)
+{
+    if (size == 0 || size > CACHE_SIZE_CLASS_MAX)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    uint64_t index = size <= CACHE_SIZE_CLASS_MIN ? 0 : (64 - __builtin_clzll(size - 1)) - 4;
+    return cache_alloc(&sizeClasses[index]);
+}
+
+cache_t* cache_size_class_get(uint64_t index)
+{
+    if (index >= CACHE_SIZE_CLASS_AMOUNT)
+    {
+        return NULL;
+    }
+
+    return &sizeClasses[index];
+}
+
+/**
+ * Moves all but the lowest amount of entries seen since the last reclaim from a cache list to another list.
+ */
+static uint64_t cache_reclaim_list(list_t* from, list_t* to, uint64_t* count, uint64_t* min)
+{
+    uint64_t reclaimed = *min;
+    for (uint64_t i = 0; i < reclaimed; i++)
+    {
+        list_push_back(to, list_pop_front(from));
+    }
+    *count -= reclaimed;
+    *min = *count;
+    return reclaimed;
+}
+
+void cache_reclaim(void)
+{
+    list_t magazines = LIST_CREATE(magazines);
+    list_t slabs = LIST_CREATE(slabs);
+
+    // Only collect what to reclaim while holding the locks, returning it might need to acquire the cache locks again.
+    lock_acquire(&cachesLock);
+    cache_t* cache;
+    LIST_FOR_EACH(cache, &caches, entry)
+    {
+        LOCK_SCOPE(&cache->lock);
+        cache_reclaim_list(&cache->fullMagazines, &magazines, &cache->fullMagazineCount, &cache->fullMagazineMin);
+        cache_reclaim_list(&cache->emptyMagazines, &magazines, &cache->emptyMagazineCount, &cache->emptyMagazineMin);
+        cache->slabCount -= cache_reclaim_list(&cache->free, &slabs, &cache->freeCount, &cache->freeMin);
+    }
+    lock_release(&cachesLock);
+
+    while (!list_is_empty(&magazines))
+    {
+        cache_magazine_t* magazine = CONTAINER_OF(list_pop_front(&magazines), cache_magazine_t, entry);
+        for (uint64_t i = 0; i < magazine->count; i++)
+        {
+            cache_slab_put(magazine->rounds[i]);
+        }
+        cache_free(magazine);
+    }
+
+    while (!list_is_empty(&slabs))
+    {
+        cache_slab_destroy(CONTAINER_OF(list_pop_front(&slabs), cache_slab_t, entry));
+    }
+}
+
+static void cache_reclaim_thread(void* arg)
+{
+    UNUSED(arg);
+
+    while (true)
+    {
+        sched_nanosleep(CONFIG_CACHE_RECLAIM_INTERVAL);
+        cache_reclaim();
+    }
+}
+
+void cache_reclaim_init(void)
+{
+    if (thread_kernel_create(cache_reclaim_thread, NULL) == ERR)
+    {
+        panic(NULL, "Failed to create cache reclaim thread");
+    }
+}
+
+void cache_stats_get(cache_t* cache, cache_stats_t* stats)
+{
+    uint64_t frees = 0;
+    stats->allocs = 0;
+    stats->hits = 0;
+    for (uint64_t i = 0; i < CPU_MAX; i++)
+    {
+        stats->allocs += cache->cpus[i].allocs;
+        stats->hits += cache->cpus[i].hits;
+        frees += cache->cpus[i].frees;
+    }
+    stats->objects = stats->allocs >= frees ? stats->allocs - frees : 0;
+
+    LOCK_SCOPE(&cache->lock);
+    stats->slabs = cache->slabCount;
+    stats->capacity = cache->slabCount * cache->layout.amount;
+}
+
 #ifdef _TESTING_
 
 #include <kernel/sched/clock.h>
@@ -265,6 +637,42 @@ TEST_DEFINE(cache)
     cache_free(ptr1);
     cache_free(ptr2);
 
+    // Enough objects to overflow the magazines of a CPU and reach the depot.
+    void* ptrs[CACHE_MAGAZINE_SIZE * 4];
+    for (uint64_t i = 0; i < ARRAY_SIZE(ptrs); i++)
+    {
+        ptrs[i] = cache_alloc(&testCache);
+        TEST_ASSERT(ptrs[i] != NULL);
+    }
+    for (uint64_t i = 0; i < ARRAY_SIZE(ptrs); i++)
+    {
+        cache_free(ptrs[i]);
+    }
+    for (uint64_t i = 0; i < ARRAY_SIZE(ptrs); i++)
+    {
+        ptrs[i] = cache_alloc(&testCache);
+        TEST_ASSERT(ptrs[i] != NULL);
+        for (uint64_t j = 0; j < i; j++)
+        {
+            TEST_ASSERT(ptrs[i] != ptrs[j]);
+        }
+    }
+    for (uint64_t i = 0; i < ARRAY_SIZE(ptrs); i++)
+    {
+        cache_free(ptrs[i]);
+    }
+
+    for (size_t size = 1; size <= CACHE_SIZE_CLASS_MAX; size = size * 2 + 1)
+    {
+        void* ptr = cache_alloc_size(size);
+        TEST_ASSERT(ptr != NULL);
+        TEST_ASSERT(cache_is_object(ptr));
+        TEST_ASSERT(cache_object_size(ptr) >= size);
+        TEST_ASSERT(cache_object_size(ptr) < size * 2 || cache_object_size(ptr) == CACHE_SIZE_CLASS_MIN);
+        cache_free(ptr);
+    }
+    TEST_ASSERT(cache_alloc_size(CACHE_SIZE_CLASS_MAX + 1) == NULL);
+
     return 0;
 }
 
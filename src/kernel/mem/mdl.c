@@ -226,4 +226,41 @@ uint64_t mdl_write(mdl_t* mdl, const void* buffer, size_t count, size_t offset)
     }
 
     return count - remaining;
-}
\ No newline at end of file
+}
+
+uint64_t mdl_set(mdl_t* mdl, uint8_t value, size_t count, size_t offset)
+{
+    if (mdl == NULL)
+    {
+        return 0;
+    }
+
+    size_t start = 0;
+    size_t i = 0;
+    for (; i < mdl->amount; i++)
+    {
+        mdl_seg_t* seg = &mdl->segments[i];
+        if (start + seg->size > offset)
+        {
+            break;
+        }
+        start += seg->size;
+    }
+
+    size_t remaining = count;
+
+    size_t segOffset = offset - start;
+    while (remaining > 0 && i < mdl->amount)
+    {
+        mdl_seg_t* seg = &mdl->segments[i];
+        size_t toSet = MIN(remaining, seg->size - segOffset);
+        void* addr = PFN_TO_VIRT(seg->pfn) + seg->offset + segOffset;
+        memset(addr, value, toSet);
+
+        remaining -= toSet;
+        segOffset = 0;
+        i++;
+    }
+
+    return count - remaining;
+}
@@ -2,15 +2,19 @@
 #include <kernel/mem/pmm.h>
 
 #include <kernel/config.h>
+#include <kernel/cpu/cli.h>
+#include <kernel/cpu/cpu.h>
 #include <kernel/init/boot_info.h>
 #include <kernel/log/log.h>
 #include <kernel/log/panic.h>
+#include <kernel/sched/sched.h>
+#include <kernel/sched/thread.h>
 #include <kernel/sync/lock.h>
 
 #include <boot/boot_info.h>
 #include <stddef.h>
 #include <stdint.h>
-#include <sys/bitmap.h>
+#include <sys/list.h>
 
 #include <errno.h>
 #include <string.h>
@@ -37,16 +41,50 @@ static const char* efiMemTypeToString[] = {
 
 static page_t* pages = NULL;
 
-static page_stack_t* stack = NULL;
-static size_t location = FREE_PAGE_MAX;
-
-BITMAP_CREATE_ONE(bitmap, CONFIG_PMM_BITMAP_MAX_ADDR / PAGE_SIZE);
-
 static pfn_t highest = 0;
 static size_t total = 0;
-static size_t avail = 0;
 
-static lock_t lock = LOCK_CREATE();
+static pmm_zone_t zones[PMM_ZONE_AMOUNT] = {
+    [PMM_ZONE_DMA] =
+        {
+            .name = "dma",
+            .start = 0,
+            .end = CONFIG_PMM_DMA_MAX_ADDR / PAGE_SIZE, // Clamped in `pmm_detect_memory()`.
+            .lock = LOCK_CREATE(),
+            .total = 0,
+            .avail = 0,
+        },
+    [PMM_ZONE_DMA32] =
+        {
+            .name = "dma32",
+            .start = CONFIG_PMM_DMA_MAX_ADDR / PAGE_SIZE,
+            .end = PMM_DMA32_MAX_ADDR / PAGE_SIZE, // Clamped in `pmm_detect_memory()`.
+            .lock = LOCK_CREATE(),
+            .total = 0,
+            .avail = 0,
+        },
+    [PMM_ZONE_NORMAL] =
+        {
+            .name = "normal",
+            .start = PMM_DMA32_MAX_ADDR / PAGE_SIZE,
+            .end = PMM_DMA32_MAX_ADDR / PAGE_SIZE, // Set in `pmm_detect_memory()`.
+            .lock = LOCK_CREATE(),
+            .total = 0,
+            .avail = 0,
+        },
+};
+
+static pmm_cpu_cache_t cpuCaches[CPU_MAX];
+
+static pmm_zeroed_pool_t zeroedPools[CPU_MAX];
+
+/**
+ * Stored in the first page of each free block.
+ */
+typedef struct
+{
+    list_entry_t entry;
+} pmm_block_t;
 
 static bool pmm_is_mem_avail(EFI_MEMORY_TYPE type)
 {
@@ -68,84 +106,291 @@ static bool pmm_is_mem_avail(EFI_MEMORY_TYPE type)
     }
 }
 
-static inline void pmm_stack_push(pfn_t pfn)
+static inline pmm_zone_t* pmm_zone_of(pfn_t pfn)
 {
-    if (stack == NULL || location == 0)
+    if (pfn < zones[PMM_ZONE_DMA].end)
     {
-        page_stack_t* page = PFN_TO_VIRT(pfn);
-        page->next = stack;
-        stack = page;
-        location = FREE_PAGE_MAX;
+        return &zones[PMM_ZONE_DMA];
+    }
+    return pfn < zones[PMM_ZONE_DMA32].end ? &zones[PMM_ZONE_DMA32] : &zones[PMM_ZONE_NORMAL];
+}
 
-        return;
+static inline void pmm_block_push(pmm_zone_t* zone, pfn_t pfn, uint64_t order)
+{
+    pages[pfn].order = order;
+    pages[pfn].flags |= PAGE_FREE;
+
+    pmm_block_t* block = PFN_TO_VIRT(pfn);
+    list_entry_init(&block->entry);
+    list_push_front(&zone->freeLists[order], &block->entry);
+}
+
+static inline void pmm_block_remove(pfn_t pfn)
+{
+    pages[pfn].flags &= ~PAGE_FREE;
+
+    pmm_block_t* block = PFN_TO_VIRT(pfn);
+    list_remove(&block->entry);
+}
+
+/**
+ * Allocates a block of the given order whose first `count` pages are below `maxPfn`.
+ *
+ * The free lists are only searched if the zone extends past `maxPfn`, which the zone boundaries avoid for the common
+ * limits, otherwise the first block is taken.
+ *
+ * Must be called with the zone lock acquired.
+ */
+static pfn_t pmm_buddy_alloc(pmm_zone_t* zone, uint64_t order, size_t count, pfn_t maxPfn)
+{
+    for (uint64_t current = order; current < PMM_ORDER_AMOUNT; current++)
+    {
+        pmm_block_t* block;
+        LIST_FOR_EACH(block, &zone->freeLists[current], entry)
+        {
+            pfn_t pfn = VIRT_TO_PFN(block);
+            if (pfn + count > maxPfn)
+            {
+                continue;
+            }
+
+            pmm_block_remove(pfn);
+
+            // Split the block, keeping the lower half, until it has the requested order.
+            while (current > order)
+            {
+                current--;
+                pmm_block_push(zone, pfn + (1ULL << current), current);
+            }
+
+            zone->avail -= 1ULL << order;
+            return pfn;
+        }
     }
 
-    stack->pages[--location] = pfn;
+    return ERR;
 }
 
-static inline pfn_t pmm_stack_pop(void)
+/**
+ * Frees a block of the given order, merging it with its buddies.
+ *
+ * Must be called with the zone lock acquired.
+ */
+static void pmm_buddy_free(pmm_zone_t* zone, pfn_t pfn, uint64_t order)
 {
-    if (location == FREE_PAGE_MAX)
+    zone->avail += 1ULL << order;
+
+    while (order < PMM_MAX_ORDER)
     {
-        if (stack == NULL)
+        pfn_t buddy = pfn ^ (1ULL << order);
+        if (buddy < zone->start || buddy + (1ULL << order) > zone->end)
         {
-            return ERR;
+            break;
         }
 
-        page_stack_t* page = stack;
-        stack = stack->next;
-        location = (stack == NULL) ? FREE_PAGE_MAX : 0;
-        return VIRT_TO_PFN(page);
+        if (!(pages[buddy].flags & PAGE_FREE) || pages[buddy].order != order)
+        {
+            break;
+        }
+
+        pmm_block_remove(buddy);
+        pfn = MIN(pfn, buddy);
+        order++;
     }
 
-    return stack->pages[location++];
+    pmm_block_push(zone, pfn, order);
 }
 
-static inline pfn_t pmm_bitmap_set(size_t count, pfn_t maxPfn, pfn_t alignPfn)
+/**
+ * Frees a range of pages by splitting it into the largest possible aligned blocks.
+ *
+ * Must be called with the zone lock acquired.
+ */
+static void pmm_buddy_free_range(pmm_zone_t* zone, pfn_t pfn, size_t count)
 {
-    alignPfn = MAX(alignPfn, 1);
-    maxPfn = MIN(maxPfn, CONFIG_PMM_BITMAP_MAX_ADDR / PAGE_SIZE);
+    while (count > 0)
+    {
+        uint64_t order = pfn == 0 ? PMM_MAX_ORDER : MIN(__builtin_ctzll(pfn), PMM_MAX_ORDER);
+        while ((1ULL << order) > count)
+        {
+            order--;
+        }
+
+        pmm_buddy_free(zone, pfn, order);
+        pfn += 1ULL << order;
+        count -= 1ULL << order;
+    }
+}
+
+static void pmm_cpu_cache_refill(pmm_cpu_cache_t* cache, pmm_zone_t* zone)
+{
+    LOCK_SCOPE(&zone->lock);
+
+    while (cache->count < PMM_CPU_CACHE_BATCH)
+    {
+        pfn_t pfn = pmm_buddy_alloc(zone, 0, 1, zone->end);
+        if (pfn == ERR)
+        {
+            break;
+        }
+        cache->pfns[cache->count++] = pfn;
+    }
+}
+
+static pfn_t pmm_cpu_cache_pop(void)
+{
+    CLI_SCOPE();
 
-    size_t index = bitmap_find_clear_region_and_set(&bitmap, 0, maxPfn, count, alignPfn);
-    if (index == bitmap.length)
+    pmm_cpu_cache_t* cache = &cpuCaches[SELF->id];
+    if (cache->count == 0)
+    {
+        // Prefer the normal zone to preserve memory below 4 GiB for allocations that require it.
+        pmm_cpu_cache_refill(cache, &zones[PMM_ZONE_NORMAL]);
+        if (cache->count == 0)
+        {
+            pmm_cpu_cache_refill(cache, &zones[PMM_ZONE_DMA32]);
+        }
+
+        if (cache->count == 0)
+        {
+            return ERR;
+        }
+    }
+
+    return cache->pfns[--cache->count];
+}
+
+/**
+ * Frees the oldest `PMM_CPU_CACHE_BATCH` pages in the cache that belong to the zone.
+ */
+static void pmm_cpu_cache_drain(pmm_cpu_cache_t* cache, pmm_zone_t* zone)
+{
+    LOCK_SCOPE(&zone->lock);
+
+    for (size_t i = 0; i < PMM_CPU_CACHE_BATCH; i++)
+    {
+        if (pmm_zone_of(cache->pfns[i]) == zone)
+        {
+            pmm_buddy_free(zone, cache->pfns[i], 0);
+        }
+    }
+}
+
+static void pmm_cpu_cache_push(pfn_t pfn)
+{
+    CLI_SCOPE();
+
+    pmm_cpu_cache_t* cache = &cpuCaches[SELF->id];
+    if (cache->count == PMM_CPU_CACHE_MAX)
+    {
+        // Drain the oldest pages, the most recently freed pages are the most likely to still be cache hot.
+        pmm_cpu_cache_drain(cache, &zones[PMM_ZONE_NORMAL]);
+        pmm_cpu_cache_drain(cache, &zones[PMM_ZONE_DMA32]);
+        memmove(&cache->pfns[0], &cache->pfns[PMM_CPU_CACHE_BATCH],
+            (PMM_CPU_CACHE_MAX - PMM_CPU_CACHE_BATCH) * sizeof(pfn_t));
+        cache->count -= PMM_CPU_CACHE_BATCH;
+    }
+
+    cache->pfns[cache->count++] = pfn;
+}
+
+static pfn_t pmm_zeroed_pop(pmm_zeroed_pool_t* pool)
+{
+    LOCK_SCOPE(&pool->lock);
+    if (pool->count == 0)
     {
         return ERR;
     }
+    return pool->pfns[--pool->count];
+}
 
-    return (pfn_t)index;
+/**
+ * Takes a page from the zeroed pool of the current CPU, if `isAlloc` is set the hit and miss statistics are updated.
+ */
+static pfn_t pmm_zeroed_pop_local(bool isAlloc)
+{
+    CLI_SCOPE();
+
+    pmm_zeroed_pool_t* pool = &zeroedPools[SELF->id];
+    pfn_t pfn = pmm_zeroed_pop(pool);
+    if (isAlloc)
+    {
+        if (pfn != ERR)
+        {
+            pool->hits++;
+        }
+        else
+        {
+            pool->misses++;
+        }
+    }
+    return pfn;
 }
 
-static inline void pmm_bitmap_clear(pfn_t pfn, size_t pageAmount)
+/**
+ * Returns all pages in the zeroed pools to their zones, used when memory runs out.
+ */
+static void pmm_zeroed_drain(void)
 {
-    bitmap_clear_range(&bitmap, pfn, pfn + pageAmount);
+    for (cpu_id_t id = 0; id < CPU_MAX; id++)
+    {
+        pfn_t pfn;
+        while ((pfn = pmm_zeroed_pop(&zeroedPools[id])) != ERR)
+        {
+            pmm_zone_t* zone = pmm_zone_of(pfn);
+            LOCK_SCOPE(&zone->lock);
+            pmm_buddy_free(zone, pfn, 0);
+        }
+    }
 }
 
-static void pmm_free_unlocked(pfn_t pfn)
+static pfn_t pmm_alloc_page(void)
 {
-    page_t* page = &pages[pfn];
-    assert(page->ref > 0);
-    if (--page->ref > 0)
+    pfn_t pfn = pmm_cpu_cache_pop();
+    if (pfn == ERR)
     {
-        return;
+        pmm_zone_t* zone = &zones[PMM_ZONE_DMA];
+        lock_acquire(&zone->lock);
+        pfn = pmm_buddy_alloc(zone, 0, 1, zone->end);
+        lock_release(&zone->lock);
     }
 
-    if (pfn >= CONFIG_PMM_BITMAP_MAX_ADDR / PAGE_SIZE)
+    // As a last resort, use a page from the zeroed pool.
+    if (pfn == ERR)
     {
-        pmm_stack_push(pfn);
+        pfn = pmm_zeroed_pop_local(false);
+        if (pfn == ERR)
+        {
+            return ERR;
+        }
     }
-    else
+
+    uint16_t ref = atomic_exchange(&pages[pfn].ref, 1);
+    assert(ref == 0);
+    UNUSED(ref);
+    return pfn;
+}
+
+static void pmm_release_page(pfn_t pfn)
+{
+    pmm_zone_t* zone = pmm_zone_of(pfn);
+    if (zone != &zones[PMM_ZONE_DMA])
     {
-        pmm_bitmap_clear(pfn, 1);
+        pmm_cpu_cache_push(pfn);
+        return;
     }
 
-    avail++;
+    LOCK_SCOPE(&zone->lock);
+    pmm_buddy_free(zone, pfn, 0);
 }
 
-static void pmm_free_region_unlocked(pfn_t pfn, size_t count)
+static void pmm_free_page(pfn_t pfn)
 {
-    for (size_t i = 0; i < count; i++)
+    uint16_t ref = atomic_fetch_sub(&pages[pfn].ref, 1);
+    assert(ref > 0);
+    if (ref == 1)
     {
-        pmm_free_unlocked(pfn + i);
+        pmm_release_page(pfn);
     }
 }
 
@@ -166,6 +411,17 @@ static void pmm_detect_memory(const boot_memory_map_t* map)
         highest = MAX(highest, endPfn);
     }
 
+    zones[PMM_ZONE_DMA].end = MIN(highest, zones[PMM_ZONE_DMA].end);
+    zones[PMM_ZONE_DMA32].end = MAX(MIN(highest, zones[PMM_ZONE_DMA32].end), zones[PMM_ZONE_DMA32].start);
+    zones[PMM_ZONE_NORMAL].end = MAX(highest, zones[PMM_ZONE_NORMAL].start);
+    for (pmm_zone_type_t type = 0; type < PMM_ZONE_AMOUNT; type++)
+    {
+        for (uint64_t order = 0; order < PMM_ORDER_AMOUNT; order++)
+        {
+            list_init(&zones[type].freeLists[order]);
+        }
+    }
+
     LOG_INFO("page amount %llu\n", total);
 }
 
@@ -178,6 +434,7 @@ static void pmm_init_refs(const boot_memory_map_t* map)
         if (desc->Type == EfiConventionalMemory && desc->NumberOfPages >= BYTES_TO_PAGES(size))
         {
             pages = (page_t*)desc->VirtualStart;
+            memset(pages, 0, size);
             LOG_INFO("pages   [%p-%p]\n", pages, (uintptr_t)pages + size);
             return;
         }
@@ -213,18 +470,26 @@ static void pmm_load_memory(const boot_memory_map_t* map)
 #endif
             for (size_t j = 0; j < amount; j++)
             {
-                page_t* page = &pages[pfn + j];
-                page->ref = 1;
+                atomic_init(&pages[pfn + j].ref, 0);
+                pages[pfn + j].flags = PAGE_NONE;
             }
 
-            pmm_free_region_unlocked(pfn, amount);
+            while (amount > 0)
+            {
+                pmm_zone_t* zone = pmm_zone_of(pfn);
+                size_t count = MIN(amount, zone->end - pfn);
+                zone->total += count;
+                pmm_buddy_free_range(zone, pfn, count);
+                pfn += count;
+                amount -= count;
+            }
         }
         else
         {
             for (size_t j = 0; j < amount; j++)
             {
-                page_t* page = &pages[pfn + j];
-                page->ref = UINT16_MAX;
+                atomic_init(&pages[pfn + j].ref, UINT16_MAX);
+                pages[pfn + j].flags = PAGE_NONE;
             }
 
             LOG_INFO("reserve [%p-%p] pages=%d type=%s\n", PFN_TO_VIRT(pfn), PFN_TO_VIRT(pfn + amount), amount,
@@ -234,6 +499,11 @@ static void pmm_load_memory(const boot_memory_map_t* map)
 
     LOG_INFO("memory %llu MB (usable %llu MB reserved %llu MB)\n", (total * PAGE_SIZE) / 1000000,
         (pmm_avail_pages() * PAGE_SIZE) / 1000000, ((total - pmm_avail_pages()) * PAGE_SIZE) / 1000000);
+    for (pmm_zone_type_t type = 0; type < PMM_ZONE_AMOUNT; type++)
+    {
+        LOG_INFO("zone %s [%p-%p] usable %llu MB\n", zones[type].name, PFN_TO_VIRT(zones[type].start),
+            PFN_TO_VIRT(zones[type].end), (zones[type].total * PAGE_SIZE) / 1000000);
+    }
 }
 
 void pmm_init(void)
@@ -244,166 +514,412 @@ void pmm_init(void)
     pmm_detect_memory(map);
     pmm_init_refs(map);
     pmm_load_memory(map);
+
+    for (cpu_id_t id = 0; id < CPU_MAX; id++)
+    {
+        lock_init(&zeroedPools[id].lock);
+    }
 }
 
 pfn_t pmm_alloc(void)
 {
-    lock_acquire(&lock);
-    pfn_t pfn = pmm_stack_pop();
+    pfn_t pfn = pmm_alloc_page();
     if (pfn == ERR)
     {
-        pfn = pmm_bitmap_set(1, CONFIG_PMM_BITMAP_MAX_ADDR / PAGE_SIZE, 1);
+        LOG_WARN("out of memory in pmm_alloc()\n");
     }
 
+    return pfn;
+}
+
+uint64_t pmm_alloc_pages(pfn_t* pfns, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        pfns[i] = pmm_alloc_page();
+        if (pfns[i] == ERR)
+        {
+            LOG_WARN("out of memory in pmm_alloc_pages()\n");
+            for (size_t j = 0; j < i; j++)
+            {
+                pmm_free_page(pfns[j]);
+            }
+            return ERR;
+        }
+    }
+
+    return 0;
+}
+
+pfn_t pmm_alloc_zeroed(void)
+{
+    pfn_t pfn = pmm_zeroed_pop_local(true);
     if (pfn != ERR)
     {
-        page_t* page = &pages[pfn];
-        assert(page->ref == 0);
-        page->ref = 1;
-        avail--;
+        uint16_t ref = atomic_exchange(&pages[pfn].ref, 1);
+        assert(ref == 0);
+        UNUSED(ref);
+        return pfn;
     }
-    lock_release(&lock);
 
+    pfn = pmm_alloc_page();
     if (pfn == ERR)
     {
-        LOG_WARN("out of memory in pmm_alloc()\n");
+        LOG_WARN("out of memory in pmm_alloc_zeroed()\n");
+        return ERR;
     }
 
+    memset(PFN_TO_VIRT(pfn), 0, PAGE_SIZE);
     return pfn;
 }
 
-uint64_t pmm_alloc_pages(pfn_t* pfns, size_t count)
+uint64_t pmm_alloc_pages_zeroed(pfn_t* pfns, size_t count)
 {
-    lock_acquire(&lock);
     for (size_t i = 0; i < count; i++)
     {
-        pfns[i] = pmm_stack_pop();
-        if (pfns[i] == ERR)
-        {
-            pfns[i] = pmm_bitmap_set(1, CONFIG_PMM_BITMAP_MAX_ADDR / PAGE_SIZE, 1);
-        }
-
+        pfns[i] = pmm_alloc_zeroed();
         if (pfns[i] == ERR)
         {
-            LOG_WARN("out of memory in pmm_alloc_pages()\n");
             for (size_t j = 0; j < i; j++)
             {
-                if (pfns[j] >= CONFIG_PMM_BITMAP_MAX_ADDR / PAGE_SIZE)
-                {
-                    pmm_stack_push(pfns[j]);
-                }
-                else
-                {
-                    pmm_bitmap_clear(pfns[j], 1);
-                }
+                pmm_free_page(pfns[j]);
             }
-            lock_release(&lock);
             return ERR;
         }
     }
 
-    for (size_t i = 0; i < count; i++)
+    return 0;
+}
+
+/**
+ * Zeroes a page using non-temporal stores, which bypass the cache.
+ */
+static void pmm_zero_page_nt(void* page)
+{
+    uint64_t* ptr = page;
+    for (uint64_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i += 8)
     {
-        page_t* page = &pages[pfns[i]];
-        assert(page->ref == 0);
-        page->ref = 1;
+        ASM("movnti %1, 0(%0)\n"
+            "movnti %1, 8(%0)\n"
+            "movnti %1, 16(%0)\n"
+            "movnti %1, 24(%0)\n"
+            "movnti %1, 32(%0)\n"
+            "movnti %1, 40(%0)\n"
+            "movnti %1, 48(%0)\n"
+            "movnti %1, 56(%0)\n" ::"r"(&ptr[i]),
+            "r"(0ULL)
+            : "memory");
     }
+}
 
-    avail -= count;
-    lock_release(&lock);
+/**
+ * Adds a zeroed page to the pool of the current CPU.
+ */
+static uint64_t pmm_zeroed_push(pfn_t pfn)
+{
+    CLI_SCOPE();
+
+    pmm_zeroed_pool_t* pool = &zeroedPools[SELF->id];
+    LOCK_SCOPE(&pool->lock);
+    if (pool->count >= CONFIG_PMM_ZEROED_PAGES)
+    {
+        return ERR;
+    }
+    pool->pfns[pool->count++] = pfn;
     return 0;
 }
 
-pfn_t pmm_alloc_bitmap(size_t count, pfn_t maxPfn, pfn_t alignPfn)
+/**
+ * Zeroes at most `PMM_ZEROED_FILL_BATCH` free pages and adds them to the pool of the current CPU.
+ *
+ * Returns the amount of pages added to the pool.
+ */
+static uint64_t pmm_zeroed_fill(pmm_zeroed_pool_t* pool)
 {
-    lock_acquire(&lock);
-    pfn_t pfn = pmm_bitmap_set(count, maxPfn, alignPfn);
-    if (pfn != ERR)
+    uint64_t filled = 0;
+    while (filled < PMM_ZEROED_FILL_BATCH && pool->count < CONFIG_PMM_ZEROED_PAGES)
+    {
+        // Only take pages through the per-CPU cache, the DMA zone should be left for allocations that require it.
+        pfn_t pfn = pmm_cpu_cache_pop();
+        if (pfn == ERR)
+        {
+            break;
+        }
+
+        pmm_zero_page_nt(PFN_TO_VIRT(pfn));
+        // Non-temporal stores are weakly ordered, they must be visible before the page can be handed out.
+        ASM("sfence" ::: "memory");
+
+        if (pmm_zeroed_push(pfn) == ERR)
+        {
+            pmm_cpu_cache_push(pfn);
+            break;
+        }
+        filled++;
+    }
+
+    return filled;
+}
+
+/**
+ * Checks if the current thread is running on the given CPU without any other runnable threads.
+ */
+static bool pmm_zeroed_is_alone(cpu_id_t id)
+{
+    CLI_SCOPE();
+
+    if (SELF->id != id)
+    {
+        return false;
+    }
+
+    // The runqueue includes the running thread.
+    sched_t* sched = SELF_PTR(_pcpu_sched);
+    return atomic_load(&sched->totalWeight) <= sched->runThread->sched.weight;
+}
+
+static void pmm_zeroed_thread(void* arg)
+{
+    cpu_id_t id = (cpu_id_t)(uintptr_t)arg;
+    pmm_zeroed_pool_t* pool = &zeroedPools[id];
+
+    thread_t* thread = thread_current();
+
+    sched_affinity_t affinity;
+    sched_affinity_clear(&affinity);
+    sched_affinity_add(&affinity, id);
+    sched_affinity_set(&thread->sched.affinity, &affinity);
+
+    // The longest slice gives us the latest deadlines, such that any other runnable thread is picked before us.
+    sched_set_slice(thread, CONFIG_MAX_TIME_SLICE);
+
+    while (true)
+    {
+        sched_nanosleep(CONFIG_PMM_ZEROED_INTERVAL);
+
+        while (pmm_zeroed_is_alone(id))
+        {
+            if (pmm_zeroed_fill(pool) == 0)
+            {
+                break;
+            }
+        }
+    }
+}
+
+void pmm_zeroed_init(void)
+{
+    cpu_t* cpu;
+    CPU_FOR_EACH(cpu)
+    {
+        if (thread_kernel_create(pmm_zeroed_thread, (void*)(uintptr_t)cpu->id) == ERR)
+        {
+            panic(NULL, "Failed to create zeroed page thread for cpu %u", cpu->id);
+        }
+    }
+}
+
+void pmm_zeroed_stats_get(pmm_zeroed_stats_t* stats)
+{
+    // The pools are read without synchronization, so the result might be slightly out of date.
+    stats->pages = 0;
+    stats->hits = 0;
+    stats->misses = 0;
+    for (cpu_id_t id = 0; id < CPU_MAX; id++)
+    {
+        stats->pages += zeroedPools[id].count;
+        stats->hits += zeroedPools[id].hits;
+        stats->misses += zeroedPools[id].misses;
+    }
+}
+
+static pfn_t pmm_alloc_block(size_t count, pfn_t maxPfn, pfn_t alignPfn)
+{
+    // Blocks are aligned to their own size, so the alignment is satisfied by allocating a large enough block.
+    uint64_t order = 0;
+    while ((1ULL << order) < MAX(count, alignPfn))
+    {
+        order++;
+    }
+
+    // Prefer the normal zone to preserve low memory for allocations that require it.
+    for (int64_t type = PMM_ZONE_AMOUNT - 1; type >= 0; type--)
     {
+        pmm_zone_t* zone = &zones[type];
+        if (zone->start >= maxPfn)
+        {
+            continue;
+        }
+
+        lock_acquire(&zone->lock);
+        pfn_t pfn = pmm_buddy_alloc(zone, order, count, maxPfn);
+        if (pfn == ERR)
+        {
+            lock_release(&zone->lock);
+            continue;
+        }
+        pmm_buddy_free_range(zone, pfn + count, (1ULL << order) - count);
+        lock_release(&zone->lock);
+
         for (size_t i = 0; i < count; i++)
         {
-            page_t* page = &pages[pfn + i];
-            assert(page->ref == 0);
-            page->ref = 1;
+            uint16_t ref = atomic_exchange(&pages[pfn + i].ref, 1);
+            assert(ref == 0);
+            UNUSED(ref);
         }
-        avail -= count;
+        return pfn;
+    }
+
+    return ERR;
+}
+
+pfn_t pmm_alloc_contiguous(size_t count, pfn_t maxPfn, pfn_t alignPfn)
+{
+    alignPfn = MAX(alignPfn, 1);
+    if (count == 0 || count > (1ULL << PMM_MAX_ORDER) || !IS_POW2(alignPfn) || alignPfn > (1ULL << PMM_MAX_ORDER))
+    {
+        errno = EINVAL;
+        return ERR;
+    }
+
+    pfn_t pfn = pmm_alloc_block(count, maxPfn, alignPfn);
+    if (pfn == ERR)
+    {
+        // The zeroed pool might be fragmenting the zones.
+        pmm_zeroed_drain();
+        pfn = pmm_alloc_block(count, maxPfn, alignPfn);
+    }
+
+    if (pfn == ERR)
+    {
+        LOG_WARN("out of memory in pmm_alloc_contiguous()\n");
+        errno = ENOMEM;
+        return ERR;
+    }
+    return pfn;
+}
+
+pfn_t pmm_alloc_order(uint64_t order)
+{
+    if (order > PMM_MAX_ORDER)
+    {
+        errno = EINVAL;
+        return ERR;
     }
-    lock_release(&lock);
 
+    pfn_t pfn = pmm_alloc_block(1ULL << order, UINT64_MAX, 1ULL << order);
     if (pfn == ERR)
     {
-        LOG_WARN("out of memory in pmm_alloc_bitmap()\n");
+        pmm_zeroed_drain();
+        pfn = pmm_alloc_block(1ULL << order, UINT64_MAX, 1ULL << order);
     }
 
+    if (pfn == ERR)
+    {
+        errno = ENOMEM;
+        return ERR;
+    }
     return pfn;
 }
 
 void pmm_free(pfn_t pfn)
 {
-    lock_acquire(&lock);
-    pmm_free_unlocked(pfn);
-    lock_release(&lock);
+    pmm_free_page(pfn);
 }
 
 void pmm_free_pages(pfn_t* pfns, size_t count)
 {
-    lock_acquire(&lock);
     for (size_t i = 0; i < count; i++)
     {
-        pmm_free_unlocked(pfns[i]);
+        pmm_free_page(pfns[i]);
     }
-    lock_release(&lock);
 }
 
 void pmm_free_region(pfn_t pfn, size_t count)
 {
-    lock_acquire(&lock);
-    pmm_free_region_unlocked(pfn, count);
-    lock_release(&lock);
+    for (size_t i = 0; i < count; i++)
+    {
+        pmm_free_page(pfn + i);
+    }
 }
 
 uint64_t pmm_ref_inc(pfn_t pfn, size_t count)
 {
-    lock_acquire(&lock);
     for (size_t i = 0; i < count; i++)
     {
         page_t* page = &pages[pfn + i];
-        if (page->ref == 0 || page->ref == UINT16_MAX)
+        uint16_t ref = atomic_load(&page->ref);
+        do
         {
-            for (size_t j = 0; j < i; j++)
+            if (ref == 0 || ref == UINT16_MAX)
             {
-                pages[pfn + j].ref--;
+                for (size_t j = 0; j < i; j++)
+                {
+                    atomic_fetch_sub(&pages[pfn + j].ref, 1);
+                }
+                return ERR;
             }
-            lock_release(&lock);
-            return ERR;
-        }
-        page->ref++;
+        } while (!atomic_compare_exchange_weak(&page->ref, &ref, ref + 1));
     }
-    uint64_t ret = pages[pfn].ref;
-    lock_release(&lock);
-    return ret;
+
+    return atomic_load(&pages[pfn].ref);
 }
 
 size_t pmm_total_pages(void)
 {
-    lock_acquire(&lock);
-    size_t ret = total;
-    lock_release(&lock);
-    return ret;
+    return total;
 }
 
 size_t pmm_avail_pages(void)
 {
-    lock_acquire(&lock);
-    size_t ret = avail;
-    lock_release(&lock);
+    size_t ret = 0;
+    for (pmm_zone_type_t type = 0; type < PMM_ZONE_AMOUNT; type++)
+    {
+        lock_acquire(&zones[type].lock);
+        ret += zones[type].avail;
+        lock_release(&zones[type].lock);
+    }
+
+    // The per-CPU caches are read without synchronization, so the result might be slightly out of date.
+    for (cpu_id_t id = 0; id < CPU_MAX; id++)
+    {
+        ret += cpuCaches[id].count + zeroedPools[id].count;
+    }
+
     return ret;
 }
 
 size_t pmm_used_pages(void)
 {
-    lock_acquire(&lock);
-    size_t ret = total - avail;
-    lock_release(&lock);
-    return ret;
-}
\ No newline at end of file
+    return total - pmm_avail_pages();
+}
+
+#ifdef _TESTING_
+
+#include <kernel/utils/test.h>
+
+TEST_DEFINE(pmm)
+{
+    pfn_t huge = pmm_alloc_order(9);
+    TEST_ASSERT(huge != ERR);
+    TEST_ASSERT(huge % 512 == 0);
+    pmm_free_region(huge, 512);
+
+    pfn_t low = pmm_alloc_contiguous(3, CONFIG_PMM_DMA_MAX_ADDR / PAGE_SIZE, 4);
+    TEST_ASSERT(low != ERR);
+    TEST_ASSERT(low % 4 == 0);
+    TEST_ASSERT(low + 3 <= CONFIG_PMM_DMA_MAX_ADDR / PAGE_SIZE);
+    pmm_free_region(low, 3);
+
+    pfn_t dma32 = pmm_alloc_contiguous(1, PMM_DMA32_MAX_ADDR / PAGE_SIZE, 0);
+    TEST_ASSERT(dma32 != ERR);
+    TEST_ASSERT(dma32 < PMM_DMA32_MAX_ADDR / PAGE_SIZE);
+    pmm_free(dma32);
+
+    TEST_ASSERT(pmm_alloc_contiguous(0, UINT64_MAX, 0) == ERR);
+    TEST_ASSERT(pmm_alloc_contiguous(1, UINT64_MAX, 3) == ERR);
+
+    return 0;
+}
+
+#endif
@@ -17,11 +17,14 @@
 #include <sys/math.h>
 #include <sys/proc.h>
 
-static uint64_t space_pmm_bitmap_alloc_pages(pfn_t* pfns, size_t pageAmount)
+// Zero is reserved for unused PCID slots.
+static atomic_uint64_t nextSpaceId = ATOMIC_VAR_INIT(1);
+
+static uint64_t space_pmm_low_alloc_pages(pfn_t* pfns, size_t pageAmount)
 {
     for (size_t i = 0; i < pageAmount; i++)
     {
-        pfn_t pfn = pmm_alloc_bitmap(1, UINT32_MAX, 0);
+        pfn_t pfn = pmm_alloc_contiguous(1, PMM_DMA32_MAX_ADDR / PAGE_SIZE, 0);
         if (pfn == ERR)
         {
             for (size_t j = 0; j < i; j++)
@@ -69,25 +72,27 @@ uint64_t space_init(space_t* space, uintptr_t startAddress, uintptr_t endAddress
         return ERR;
     }
 
-    if (flags & SPACE_USE_PMM_BITMAP)
+    if (flags & SPACE_USE_LOW_MEMORY)
     {
-        if (page_table_init(&space->pageTable, space_pmm_bitmap_alloc_pages, pmm_free_pages) == ERR)
+        if (page_table_init(&space->pageTable, space_pmm_low_alloc_pages, pmm_free_pages) == ERR)
         {
             errno = ENOMEM;
             return ERR;
         }
-        // We only use the bitmap pmm allocator for the page table itself, not for mappings.
-        space->pageTable.allocPages = pmm_alloc_pages;
     }
     else
     {
-        if (page_table_init(&space->pageTable, pmm_alloc_pages, pmm_free_pages) == ERR)
+        if (page_table_init(&space->pageTable, pmm_alloc_pages_zeroed, pmm_free_pages) == ERR)
         {
             errno = ENOMEM;
             return ERR;
         }
     }
 
+    // We only use low memory for the PML4 itself, the rest of the page table levels are taken from the zeroed pool.
+    space->pageTable.allocPages = pmm_alloc_pages_zeroed;
+    space->pageTable.zeroedPages = true;
+
     map_init(&space->pinnedPages);
     space->startAddress = startAddress;
     space->endAddress = endAddress;
@@ -97,7 +102,8 @@ uint64_t space_init(space_t* space, uintptr_t startAddress, uintptr_t endAddress
     space->callbacksLength = 0;
     BITMAP_DEFINE_INIT(space->callbackBitmap, PML_MAX_CALLBACK);
     BITMAP_DEFINE_INIT(space->cpus, CPU_MAX);
-    atomic_init(&space->shootdownAcks, 0);
+    space->id = atomic_fetch_add(&nextSpaceId, 1);
+    atomic_init(&space->tlbGen, 0);
     lock_init(&space->lock);
 
     if (flags & SPACE_MAP_KERNEL_BINARY)
@@ -202,6 +208,12 @@ static void space_pin_depth_dec(space_t* space, const void* address, uint64_t am
             continue;
         }
 
+        if (traverse.huge)
+        {
+            i += page_table_huge_remaining(addr, amount - i) - 1;
+            addr = (void*)ROUND_DOWN((uintptr_t)addr, PML2_SIZE);
+        }
+
         if (!traverse.entry->present || !traverse.entry->pinned)
         {
             continue;
@@ -239,6 +251,12 @@ static inline uint64_t space_pin_depth_inc(space_t* space, const void* address,
             continue;
         }
 
+        if (traverse.huge)
+        {
+            i += page_table_huge_remaining(addr, amount - i) - 1;
+            addr = (void*)ROUND_DOWN((uintptr_t)addr, PML2_SIZE);
+        }
+
         if (!traverse.entry->present)
         {
             continue;
@@ -278,6 +296,62 @@ static inline uint64_t space_pin_depth_inc(space_t* space, const void* address,
     return 0;
 }
 
+static void space_pin_merge_pages(space_t* space, const void* address, uint64_t amount)
+{
+    for (uint64_t i = 1; i < amount; i++)
+    {
+        map_key_t key = map_key_uint64((uintptr_t)address + i * PAGE_SIZE);
+        map_entry_t* entry = map_get(&space->pinnedPages, &key);
+        if (entry == NULL)
+        {
+            continue;
+        }
+
+        map_remove(&space->pinnedPages, entry);
+        free(CONTAINER_OF(entry, space_pinned_page_t, mapEntry));
+    }
+}
+
+uint64_t space_pin_split(space_t* space, const void* address)
+{
+    map_key_t key = map_key_uint64((uintptr_t)address);
+    map_entry_t* entry = map_get(&space->pinnedPages, &key);
+    if (entry == NULL) // Not pinned more than once, the pinned bit alone is enough
+    {
+        return 0;
+    }
+
+    uint64_t pinCount = CONTAINER_OF(entry, space_pinned_page_t, mapEntry)->pinCount;
+    for (uint64_t i = 1; i < PML_INDEX_AMOUNT; i++)
+    {
+        space_pinned_page_t* pinnedPage = malloc(sizeof(space_pinned_page_t));
+        if (pinnedPage == NULL)
+        {
+            space_pin_merge_pages(space, address, i);
+            errno = ENOMEM;
+            return ERR;
+        }
+        map_entry_init(&pinnedPage->mapEntry);
+        pinnedPage->pinCount = pinCount;
+
+        key = map_key_uint64((uintptr_t)address + i * PAGE_SIZE);
+        if (map_insert(&space->pinnedPages, &key, &pinnedPage->mapEntry) == ERR)
+        {
+            free(pinnedPage);
+            space_pin_merge_pages(space, address, i);
+            errno = ENOMEM;
+            return ERR;
+        }
+    }
+
+    return 0;
+}
+
+void space_pin_merge(space_t* space, const void* address)
+{
+    space_pin_merge_pages(space, address, PML_INDEX_AMOUNT);
+}
+
 uint64_t space_pin(space_t* space, const void* buffer, size_t length, stack_pointer_t* userStack)
 {
     if (space == NULL || (buffer == NULL && length != 0))
@@ -667,6 +741,29 @@ uint64_t space_user_page_count(space_t* space)
         BYTES_TO_PAGES(VMM_USER_SPACE_MAX - VMM_USER_SPACE_MIN), PML_PRESENT | PML_USER | PML_OWNED);
 }
 
+static uint64_t space_lazy_populate(space_t* space, pml_entry_t* entry, const void* addr)
+{
+    pfn_t pfn = pmm_alloc_zeroed();
+    if (pfn == ERR)
+    {
+        return ERR;
+    }
+
+    pml_entry_t newEntry = *entry;
+    newEntry.pfn = pfn;
+    newEntry.owned = true;
+    newEntry.write = entry->lazyWrite;
+    newEntry.lazy = false;
+    newEntry.lazyWrite = false;
+    entry->raw = newEntry.raw;
+
+    // Other CPUs could still have the zero page cached.
+    void* page = (void*)ROUND_DOWN((uintptr_t)addr, PAGE_SIZE);
+    tlb_invalidate(page, 1);
+    vmm_tlb_shootdown(space, page, 1);
+    return 0;
+}
+
 phys_addr_t space_virt_to_phys(space_t* space, const void* virtAddr)
 {
     if (space == NULL)
@@ -675,8 +772,20 @@ phys_addr_t space_virt_to_phys(space_t* space, const void* virtAddr)
         return ERR;
     }
 
-    phys_addr_t physAddr;
     LOCK_SCOPE(&space->lock);
+
+    page_table_traverse_t traverse = PAGE_TABLE_TRAVERSE_CREATE;
+    if (page_table_traverse(&space->pageTable, &traverse, virtAddr, PML_NONE) != ERR && traverse.entry->present &&
+        !traverse.huge && traverse.entry->lazy)
+    {
+        if (space_lazy_populate(space, traverse.entry, virtAddr) == ERR)
+        {
+            errno = ENOMEM;
+            return ERR;
+        }
+    }
+
+    phys_addr_t physAddr;
     if (page_table_get_phys_addr(&space->pageTable, (void*)virtAddr, &physAddr) == ERR)
     {
         errno = EFAULT;
@@ -684,4 +793,77 @@ phys_addr_t space_virt_to_phys(space_t* space, const void* virtAddr)
     }
 
     return physAddr;
-}
\ No newline at end of file
+}
+
+uint64_t space_virt_to_shared_phys(space_t* space, const void* virtAddr, phys_addr_t* outPhysAddr)
+{
+    if (space == NULL || outPhysAddr == NULL)
+    {
+        errno = EINVAL;
+        return ERR;
+    }
+
+    LOCK_SCOPE(&space->lock);
+
+    page_table_traverse_t traverse = PAGE_TABLE_TRAVERSE_CREATE;
+    if (page_table_traverse(&space->pageTable, &traverse, virtAddr, PML_NONE) == ERR || !traverse.entry->present)
+    {
+        errno = EFAULT;
+        return ERR;
+    }
+
+    if (traverse.entry->owned || traverse.entry->lazy)
+    {
+        return 0;
+    }
+
+    if (page_table_get_phys_addr(&space->pageTable, (void*)virtAddr, outPhysAddr) == ERR)
+    {
+        errno = EFAULT;
+        return ERR;
+    }
+
+    return 1;
+}
+
+uint64_t space_lazy_fault(space_t* space, const void* faultAddr)
+{
+    if (space == NULL)
+    {
+        errno = EINVAL;
+        return ERR;
+    }
+
+    LOCK_SCOPE(&space->lock);
+
+    page_table_traverse_t traverse = PAGE_TABLE_TRAVERSE_CREATE;
+    if (page_table_traverse(&space->pageTable, &traverse, faultAddr, PML_NONE) == ERR || !traverse.entry->present ||
+        traverse.huge)
+    {
+        return 0;
+    }
+
+    if (!traverse.entry->lazy)
+    {
+        // Another CPU allocated the page while we were waiting for the lock.
+        if (traverse.entry->write && traverse.entry->user)
+        {
+            tlb_invalidate((void*)ROUND_DOWN((uintptr_t)faultAddr, PAGE_SIZE), 1);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!traverse.entry->lazyWrite)
+    {
+        return 0;
+    }
+
+    if (space_lazy_populate(space, traverse.entry, faultAddr) == ERR)
+    {
+        errno = ENOMEM;
+        return ERR;
+    }
+
+    return 1;
+}
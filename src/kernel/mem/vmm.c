@@ -1,5 +1,6 @@
 #include <kernel/mem/vmm.h>
 
+#include <kernel/config.h>
 #include <kernel/cpu/cpu.h>
 #include <kernel/cpu/ipi.h>
 #include <kernel/cpu/regs.h>
@@ -20,19 +21,40 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <string.h>
+#include <sys/cpuid.h>
 #include <sys/math.h>
 #include <sys/proc.h>
 
 static space_t kernelSpace;
 
+static pfn_t zeroPage = ERR;
+
 static void vmm_cpu_init(vmm_cpu_t* ctx)
 {
     cr4_write(cr4_read() | CR4_PAGE_GLOBAL_ENABLE);
 
-    ctx->shootdownCount = 0;
-    lock_init(&ctx->lock);
+    for (cpu_id_t id = 0; id < CPU_MAX; id++)
+    {
+        atomic_init(&ctx->pending[id], NULL);
+    }
+
+    cpuid_feature_info_t info;
+    cpuid_feature_info(&info);
+    cpuid_extended_feature_info_t extInfo;
+    cpuid_extended_feature_info(&extInfo);
 
+    ctx->pcid = info.featuresEcx & CPUID_ECX_PCID;
+    ctx->invpcid = ctx->pcid && (extInfo.featuresEbx & CPUID_EBX_INVPCID);
+    memset(ctx->pcids, 0, sizeof(ctx->pcids));
+    ctx->pcidClock = 0;
+
+    // PCIDs can only be enabled while the PCID in CR3 is zero, which the kernel space always uses.
     cr3_write(PML_ENSURE_LOWER_HALF(kernelSpace.pageTable.pml4));
+    if (ctx->pcid)
+    {
+        cr4_write(cr4_read() | CR4_PCID_ENABLE);
+    }
     ctx->space = &kernelSpace;
     lock_acquire(&kernelSpace.lock);
     bitmap_set(&kernelSpace.cpus, SELF->id);
@@ -51,7 +73,7 @@ void vmm_init(void)
     const boot_gop_t* gop = &bootInfo->gop;
     const boot_kernel_t* kernel = &bootInfo->kernel;
 
-    if (space_init(&kernelSpace, VMM_KERNEL_HEAP_MIN, VMM_KERNEL_HEAP_MAX, SPACE_USE_PMM_BITMAP) == ERR)
+    if (space_init(&kernelSpace, VMM_KERNEL_SLABS_MAX, VMM_KERNEL_HEAP_MAX, SPACE_USE_LOW_MEMORY) == ERR)
     {
         panic(NULL, "Failed to initialize kernel address space");
     }
@@ -60,11 +82,19 @@ void vmm_init(void)
     LOG_DEBUG("  kernel binary:    %p-%p\n", VMM_KERNEL_BINARY_MIN, VMM_KERNEL_BINARY_MAX);
     LOG_DEBUG("  kernel stacks:    %p-%p\n", VMM_KERNEL_STACKS_MIN, VMM_KERNEL_STACKS_MAX);
     LOG_DEBUG("  kernel heap:      %p-%p\n", VMM_KERNEL_HEAP_MIN, VMM_KERNEL_HEAP_MAX);
+    LOG_DEBUG("  cache slabs:      %p-%p\n", VMM_KERNEL_SLABS_MIN, VMM_KERNEL_SLABS_MAX);
     LOG_DEBUG("  identity map:     %p-%p\n", VMM_IDENTITY_MAPPED_MIN, VMM_IDENTITY_MAPPED_MAX);
     LOG_DEBUG("  user space:       %p-%p\n", VMM_USER_SPACE_MIN, VMM_USER_SPACE_MAX);
 
     LOG_INFO("kernel pml4 allocated at 0x%lx\n", kernelSpace.pageTable.pml4);
 
+    zeroPage = pmm_alloc();
+    if (zeroPage == ERR)
+    {
+        panic(NULL, "Failed to allocate zero page");
+    }
+    memset(PFN_TO_VIRT(zeroPage), 0, PAGE_SIZE);
+
     // Keep using the bootloaders memory mappings during initialization.
     for (pml_index_t i = PML_INDEX_LOWER_HALF_MIN; i < PML_INDEX_LOWER_HALF_MAX; i++)
     {
@@ -140,20 +170,116 @@ pml_flags_t vmm_prot_to_flags(prot_t prot)
     }
 }
 
+// Splits the huge page containing the address, should be called with the spaces lock acquired. Other CPUs might still
+// hold the huge translation in their TLBs, so the huge page is added to the shootdown, and its pin depth is moved to
+// each of the regular pages.
+static inline uint64_t vmm_page_table_split_huge(space_t* space, void* addr, vmm_shootdown_t* shootdown)
+{
+    page_table_traverse_t traverse = PAGE_TABLE_TRAVERSE_CREATE;
+    if (page_table_traverse(&space->pageTable, &traverse, addr, PML_NONE) == ERR || !traverse.huge)
+    {
+        return 0;
+    }
+
+    void* base = (void*)ROUND_DOWN((uintptr_t)addr, PML2_SIZE);
+    bool isPinned = traverse.entry->present && traverse.entry->pinned;
+    if (isPinned && space_pin_split(space, base) == ERR)
+    {
+        return ERR;
+    }
+
+    if (page_table_split_huge(&space->pageTable, addr) == ERR)
+    {
+        if (isPinned)
+        {
+            space_pin_merge(space, base);
+        }
+        return ERR;
+    }
+
+    // Invalidating any address within the huge page drops the whole huge translation.
+    vmm_shootdown_add(shootdown, base, 1);
+    return 0;
+}
+
+// Same as `page_table_split()` but using `vmm_page_table_split_huge()`.
+static inline uint64_t vmm_page_table_split(space_t* space, void* virtAddr, uint64_t pageAmount,
+    vmm_shootdown_t* shootdown)
+{
+    if (pageAmount == 0)
+    {
+        return 0;
+    }
+
+    uintptr_t start = (uintptr_t)virtAddr;
+    uintptr_t end = start + pageAmount * PAGE_SIZE;
+
+    if (start % PML2_SIZE != 0 && vmm_page_table_split_huge(space, (void*)start, shootdown) == ERR)
+    {
+        return ERR;
+    }
+
+    if (end % PML2_SIZE != 0 && vmm_page_table_split_huge(space, (void*)(end - PAGE_SIZE), shootdown) == ERR)
+    {
+        return ERR;
+    }
+
+    return 0;
+}
+
 // Handles the logic of unmapping with a shootdown, should be called with the spaces lock acquired.
-// We need to make sure that any underlying physical pages owned by the page table are freed after every CPU
-// has invalidated their TLBs.
-static inline void vmm_page_table_unmap_with_shootdown(space_t* space, void* virtAddr, uint64_t pageAmount)
+// Every invalidation needed by the unmap, including those caused by splitting huge pages, is gathered into a single
+// batch such that the whole operation costs one IPI round trip. We need to make sure that any underlying physical pages
+// owned by the page table are freed after every CPU has invalidated their TLBs.
+static inline uint64_t vmm_page_table_unmap_with_shootdown(space_t* space, void* virtAddr, uint64_t pageAmount)
 {
+    vmm_shootdown_t shootdown;
+    vmm_shootdown_init(&shootdown, space);
+
+    // A failed split might still have split the first huge page.
+    if (vmm_page_table_split(space, virtAddr, pageAmount, &shootdown) == ERR)
+    {
+        vmm_shootdown_flush(&shootdown);
+        return ERR;
+    }
+
     page_table_unmap(&space->pageTable, virtAddr, pageAmount);
-    vmm_tlb_shootdown(space, virtAddr, pageAmount);
+    vmm_shootdown_add(&shootdown, virtAddr, pageAmount);
+
+    vmm_shootdown_flush(&shootdown);
     page_table_clear(&space->pageTable, virtAddr, pageAmount);
+    return 0;
+}
+
+static inline uint64_t vmm_alloc_huge(space_t* space, void* virtAddr, pml_flags_t flags, vmm_alloc_flags_t allocFlags)
+{
+    pfn_t pfn = pmm_alloc_order(PML_INDEX_BITS);
+    if (pfn == ERR)
+    {
+        return ERR;
+    }
+
+    if (allocFlags & VMM_ALLOC_ZERO)
+    {
+        memset(PFN_TO_VIRT(pfn), 0, PML2_SIZE);
+    }
+
+    if (page_table_map_huge(&space->pageTable, virtAddr, pfn, flags, PML_CALLBACK_NONE) == ERR)
+    {
+        for (uint64_t i = 0; i < PML_HUGE_PAGES; i++)
+        {
+            pmm_free(pfn + i);
+        }
+        return ERR;
+    }
+
+    return 0;
 }
 
 void* vmm_alloc(space_t* space, void* virtAddr, size_t length, size_t alignment, pml_flags_t pmlFlags,
     vmm_alloc_flags_t allocFlags)
 {
-    if (length == 0 || !(pmlFlags & PML_PRESENT))
+    if (length == 0 || !(pmlFlags & PML_PRESENT) || ((allocFlags & VMM_ALLOC_LAZY) && !(pmlFlags & PML_USER)))
     {
         errno = EINVAL;
         return NULL;
@@ -164,6 +290,13 @@ void* vmm_alloc(space_t* space, void* virtAddr, size_t length, size_t alignment,
         space = vmm_kernel_space_get();
     }
 
+    // Let large regions be placed such that they can be backed by huge pages.
+    if (CONFIG_VMM_HUGE_PAGES && !(allocFlags & VMM_ALLOC_LAZY) && virtAddr == NULL && length >= PML2_SIZE &&
+        alignment < PML2_SIZE && PML2_SIZE % alignment == 0)
+    {
+        alignment = PML2_SIZE;
+    }
+
     space_mapping_t mapping;
     if (space_mapping_start(space, &mapping, virtAddr, PHYS_ADDR_INVALID, length, alignment, pmlFlags | PML_OWNED) ==
         ERR)
@@ -183,32 +316,54 @@ void* vmm_alloc(space_t* space, void* virtAddr, size_t length, size_t alignment,
             return space_mapping_end(space, &mapping, EEXIST);
         }
 
-        vmm_page_table_unmap_with_shootdown(space, mapping.virtAddr, mapping.pageAmount);
+        if (vmm_page_table_unmap_with_shootdown(space, mapping.virtAddr, mapping.pageAmount) == ERR)
+        {
+            return space_mapping_end(space, &mapping, ENOMEM);
+        }
+    }
+
+    if (allocFlags & VMM_ALLOC_LAZY)
+    {
+        if (page_table_map_lazy(&space->pageTable, mapping.virtAddr, zeroPage, mapping.pageAmount, mapping.flags) ==
+            ERR)
+        {
+            vmm_page_table_unmap_with_shootdown(space, mapping.virtAddr, mapping.pageAmount);
+            return space_mapping_end(space, &mapping, ENOMEM);
+        }
+
+        return space_mapping_end(space, &mapping, EOK);
     }
 
     const uint64_t maxBatchSize = 64;
+    bool huge = CONFIG_VMM_HUGE_PAGES;
     uint64_t remainingPages = mapping.pageAmount;
     while (remainingPages != 0)
     {
         void* currentVirtAddr = mapping.virtAddr + (mapping.pageAmount - remainingPages) * PAGE_SIZE;
 
+        // Stop trying to use huge pages after the first failure, as its most likely caused by fragmentation.
+        if (huge && (uintptr_t)currentVirtAddr % PML2_SIZE == 0 && remainingPages >= PML_HUGE_PAGES)
+        {
+            if (vmm_alloc_huge(space, currentVirtAddr, mapping.flags, allocFlags) != ERR)
+            {
+                remainingPages -= PML_HUGE_PAGES;
+                continue;
+            }
+            huge = false;
+        }
+
         pfn_t pages[maxBatchSize];
         uint64_t batchSize = MIN(remainingPages, maxBatchSize);
-        if (pmm_alloc_pages(pages, batchSize) == ERR)
+        batchSize = MIN(batchSize, (PML2_SIZE - (uintptr_t)currentVirtAddr % PML2_SIZE) / PAGE_SIZE);
+        uint64_t result = (allocFlags & VMM_ALLOC_ZERO) ? pmm_alloc_pages_zeroed(pages, batchSize)
+                                                        : pmm_alloc_pages(pages, batchSize);
+        if (result == ERR)
         {
             // Page table will free the previously allocated pages as they are owned by the Page table.
             vmm_page_table_unmap_with_shootdown(space, mapping.virtAddr, mapping.pageAmount - remainingPages);
             return space_mapping_end(space, &mapping, ENOMEM);
         }
 
-        if (allocFlags & VMM_ALLOC_ZERO)
-        {
-            for (uint64_t i = 0; i < batchSize; i++)
-            {
-                memset(PFN_TO_VIRT(pages[i]), 0, PAGE_SIZE);
-            }
-        }
-
         if (page_table_map_pages(&space->pageTable, currentVirtAddr, pages, batchSize, mapping.flags,
                 PML_CALLBACK_NONE) == ERR)
         {
@@ -258,9 +413,14 @@ void* vmm_map(space_t* space, void* virtAddr, phys_addr_t physAddr, size_t lengt
         }
     }
 
-    if (!page_table_is_unmapped(&space->pageTable, mapping.virtAddr, mapping.pageAmount))
+    if (!page_table_is_unmapped(&space->pageTable, mapping.virtAddr, mapping.pageAmount) &&
+        vmm_page_table_unmap_with_shootdown(space, mapping.virtAddr, mapping.pageAmount) == ERR)
     {
-        vmm_page_table_unmap_with_shootdown(space, mapping.virtAddr, mapping.pageAmount);
+        if (callbackId != PML_CALLBACK_NONE)
+        {
+            space_free_callback(space, callbackId);
+        }
+        return space_mapping_end(space, &mapping, ENOMEM);
     }
 
     if (page_table_map(&space->pageTable, mapping.virtAddr, mapping.physAddr, mapping.pageAmount, flags, callbackId) ==
@@ -313,9 +473,14 @@ void* vmm_map_pages(space_t* space, void* virtAddr, pfn_t* pfns, size_t amount,
         }
     }
 
-    if (!page_table_is_unmapped(&space->pageTable, mapping.virtAddr, mapping.pageAmount))
+    if (!page_table_is_unmapped(&space->pageTable, mapping.virtAddr, mapping.pageAmount) &&
+        vmm_page_table_unmap_with_shootdown(space, mapping.virtAddr, mapping.pageAmount) == ERR)
     {
-        vmm_page_table_unmap_with_shootdown(space, mapping.virtAddr, mapping.pageAmount);
+        if (callbackId != PML_CALLBACK_NONE)
+        {
+            space_free_callback(space, callbackId);
+        }
+        return space_mapping_end(space, &mapping, ENOMEM);
     }
 
     if (page_table_map_pages(&space->pageTable, mapping.virtAddr, pfns, mapping.pageAmount, mapping.flags,
@@ -361,7 +526,10 @@ void* vmm_unmap(space_t* space, void* virtAddr, size_t length)
     uint64_t callbacks[PML_MAX_CALLBACK] = {0};
     page_table_collect_callbacks(&space->pageTable, mapping.virtAddr, mapping.pageAmount, callbacks);
 
-    vmm_page_table_unmap_with_shootdown(space, mapping.virtAddr, mapping.pageAmount);
+    if (vmm_page_table_unmap_with_shootdown(space, mapping.virtAddr, mapping.pageAmount) == ERR)
+    {
+        return space_mapping_end(space, &mapping, ENOMEM);
+    }
 
     uint64_t index;
     BITMAP_FOR_EACH_SET(&index, &space->callbackBitmap)
@@ -429,16 +597,135 @@ void* vmm_protect(space_t* space, void* virtAddr, size_t length, pml_flags_t fla
         return space_mapping_end(space, &mapping, ENOENT);
     }
 
-    if (page_table_set_flags(&space->pageTable, mapping.virtAddr, mapping.pageAmount, mapping.flags) == ERR)
+    vmm_shootdown_t shootdown;
+    vmm_shootdown_init(&shootdown, space);
+
+    if (vmm_page_table_split(space, mapping.virtAddr, mapping.pageAmount, &shootdown) == ERR)
     {
-        return space_mapping_end(space, &mapping, EINVAL);
+        vmm_shootdown_flush(&shootdown);
+        return space_mapping_end(space, &mapping, ENOMEM);
     }
 
-    vmm_tlb_shootdown(space, mapping.virtAddr, mapping.pageAmount);
+    // Some entries might already have been changed if this fails, so they must still be invalidated.
+    uint64_t result = page_table_set_flags(&space->pageTable, mapping.virtAddr, mapping.pageAmount, mapping.flags);
+    vmm_shootdown_add(&shootdown, mapping.virtAddr, mapping.pageAmount);
+    vmm_shootdown_flush(&shootdown);
+
+    if (result == ERR)
+    {
+        return space_mapping_end(space, &mapping, EINVAL);
+    }
 
     return space_mapping_end(space, &mapping, EOK);
 }
 
+static void vmm_shootdown_invalidate(vmm_cpu_t* vmm, const vmm_shootdown_t* shootdown)
+{
+    bool isKernel = shootdown->space == &kernelSpace;
+
+    // We might have switched address spaces since the shootdown was sent, in which case the entries of the space are
+    // tagged with a PCID that is not loaded and `invlpg` would invalidate the wrong entries. Since the shootdown
+    // incremented the spaces generation, its PCID will be flushed when the space is loaded again.
+    if (!isKernel && shootdown->space != vmm->space)
+    {
+        return;
+    }
+
+    if (shootdown->flushAll)
+    {
+        if (isKernel && vmm->invpcid)
+        {
+            tlb_invpcid(INVPCID_ALL_GLOBAL, 0, NULL);
+            return;
+        }
+
+        tlb_flush(isKernel);
+        return;
+    }
+
+    for (uint64_t i = 0; i < shootdown->rangeCount; i++)
+    {
+        tlb_invalidate(shootdown->ranges[i].virtAddr, shootdown->ranges[i].pageAmount);
+    }
+}
+
+static void vmm_shootdown_handle_pending(void)
+{
+    vmm_cpu_t* vmm = SELF_PTR(pcpu_vmm);
+    for (cpu_id_t id = 0; id < cpu_amount(); id++)
+    {
+        vmm_shootdown_t* shootdown = (vmm_shootdown_t*)atomic_exchange(&vmm->pending[id], NULL);
+        if (shootdown == NULL)
+        {
+            continue;
+        }
+
+        vmm_shootdown_invalidate(vmm, shootdown);
+        // The batch might be gone as soon as its acknowledged.
+        atomic_fetch_add(&shootdown->acks, 1);
+    }
+}
+
+static void vmm_shootdown_ipi(ipi_func_data_t* data)
+{
+    UNUSED(data);
+
+    vmm_shootdown_handle_pending();
+}
+
+static void vmm_pcid_load(vmm_cpu_t* vmm, space_t* space)
+{
+    if (!vmm->pcid)
+    {
+        page_table_load(&space->pageTable);
+        return;
+    }
+
+    uint64_t cr3 = PML_ENSURE_LOWER_HALF(space->pageTable.pml4);
+    uint64_t gen = atomic_load(&space->tlbGen);
+    vmm->pcidClock++;
+
+    vmm_pcid_slot_t* victim = &vmm->pcids[0];
+    for (uint64_t i = 0; i < VMM_PCID_SLOTS; i++)
+    {
+        vmm_pcid_slot_t* slot = &vmm->pcids[i];
+        if (slot->spaceId == space->id)
+        {
+            slot->lastUsed = vmm->pcidClock;
+            if (slot->tlbGen == gen)
+            {
+                cr3_write(cr3 | (i + 1) | CR3_NO_FLUSH);
+                return;
+            }
+
+            slot->tlbGen = gen;
+            cr3_write(cr3 | (i + 1));
+            return;
+        }
+
+        if (slot->lastUsed < victim->lastUsed)
+        {
+            victim = slot;
+        }
+    }
+
+    // The victim might still have entries cached for the space that used it before, so we must flush it.
+    victim->spaceId = space->id;
+    victim->tlbGen = gen;
+    victim->lastUsed = vmm->pcidClock;
+    cr3_write(cr3 | (uint64_t)(victim - vmm->pcids + 1));
+}
+
+// The owner of the lock might be waiting for us to acknowledge a shootdown, so we cant just spin on the lock.
+static void vmm_space_lock(space_t* space)
+{
+    while (!lock_try_acquire(&space->lock))
+    {
+        vmm_shootdown_handle_pending();
+        ASM("pause");
+    }
+}
+
 void vmm_load(space_t* space)
 {
     if (space == NULL)
@@ -457,101 +744,171 @@ void vmm_load(space_t* space)
     space_t* oldSpace = pcpu_vmm->space;
     pcpu_vmm->space = NULL;
 
-    lock_acquire(&oldSpace->lock);
+    vmm_space_lock(oldSpace);
     bitmap_clear(&oldSpace->cpus, SELF->id);
     lock_release(&oldSpace->lock);
 
-    lock_acquire(&space->lock);
+    vmm_space_lock(space);
     bitmap_set(&space->cpus, SELF->id);
     lock_release(&space->lock);
+
+    // Any shootdown after this point will target us, so the generation must be read after setting our bit.
+    vmm_pcid_load(SELF_PTR(pcpu_vmm), space);
     pcpu_vmm->space = space;
+}
+
+void vmm_shootdown_init(vmm_shootdown_t* shootdown, space_t* space)
+{
+    assert(shootdown != NULL);
 
-    page_table_load(&space->pageTable);
+    shootdown->space = space;
+    shootdown->rangeCount = 0;
+    shootdown->pageAmount = 0;
+    shootdown->flushAll = false;
+    atomic_init(&shootdown->acks, 0);
 }
 
-static void vmm_tlb_shootdown_ipi(ipi_func_data_t* data)
+void vmm_shootdown_add(vmm_shootdown_t* shootdown, void* virtAddr, size_t pageAmount)
 {
-    UNUSED(data);
+    assert(shootdown != NULL);
 
-    vmm_cpu_t* vmm = SELF_PTR(pcpu_vmm);
-    while (true)
+    if (pageAmount == 0)
+    {
+        return;
+    }
+
+    shootdown->pageAmount += pageAmount;
+    if (shootdown->flushAll || shootdown->pageAmount > VMM_SHOOTDOWN_FLUSH_ALL_PAGES)
     {
-        lock_acquire(&vmm->lock);
-        if (vmm->shootdownCount == 0)
+        shootdown->flushAll = true;
+        return;
+    }
+
+    uintptr_t start = (uintptr_t)virtAddr;
+    uintptr_t end = start + pageAmount * PAGE_SIZE;
+    for (uint64_t i = 0; i < shootdown->rangeCount; i++)
+    {
+        vmm_shootdown_range_t* range = &shootdown->ranges[i];
+        uintptr_t rangeStart = (uintptr_t)range->virtAddr;
+        uintptr_t rangeEnd = rangeStart + range->pageAmount * PAGE_SIZE;
+        if (start > rangeEnd || end < rangeStart)
         {
-            lock_release(&vmm->lock);
-            break;
+            continue;
         }
 
-        vmm_shootdown_t shootdown = vmm->shootdowns[vmm->shootdownCount - 1];
-        vmm->shootdownCount--;
-        lock_release(&vmm->lock);
-
-        assert(shootdown.space != NULL);
-        assert(shootdown.pageAmount != 0);
-        assert(shootdown.virtAddr != NULL);
+        range->virtAddr = (void*)MIN(start, rangeStart);
+        range->pageAmount = (MAX(end, rangeEnd) - (uintptr_t)range->virtAddr) / PAGE_SIZE;
+        return;
+    }
 
-        tlb_invalidate(shootdown.virtAddr, shootdown.pageAmount);
-        atomic_fetch_add(&shootdown.space->shootdownAcks, 1);
+    if (shootdown->rangeCount == VMM_SHOOTDOWN_MAX_RANGES)
+    {
+        shootdown->flushAll = true;
+        return;
     }
+
+    shootdown->ranges[shootdown->rangeCount].virtAddr = virtAddr;
+    shootdown->ranges[shootdown->rangeCount].pageAmount = pageAmount;
+    shootdown->rangeCount++;
 }
 
-void vmm_tlb_shootdown(space_t* space, void* virtAddr, size_t pageAmount)
+void vmm_shootdown_flush(vmm_shootdown_t* shootdown)
 {
-    if (space == NULL)
+    assert(shootdown != NULL);
+
+    space_t* space = shootdown->space;
+    if (space == NULL || (shootdown->rangeCount == 0 && !shootdown->flushAll))
     {
+        vmm_shootdown_init(shootdown, space);
         return;
     }
 
+    // Kernel space mappings are shared by all address spaces, so every CPU might have them cached, not just those that
+    // have the kernel space itself loaded.
+    bool isKernel = space == &kernelSpace;
+
+    // Any CPU, including this one, that has entries for the space cached under a PCID it is not currently using must
+    // flush them the next time it loads the space.
+    if (!isKernel)
+    {
+        atomic_fetch_add(&space->tlbGen, 1);
+    }
+
     if (cpu_amount() <= 1)
     {
+        vmm_shootdown_init(shootdown, space);
         return;
     }
 
-    uint16_t expectedAcks = 0;
-    atomic_store(&space->shootdownAcks, 0);
+    CLI_SCOPE();
+
+    BITMAP_DEFINE(targets, CPU_MAX);
+    BITMAP_DEFINE_INIT(targets, CPU_MAX);
 
     cpu_id_t id;
-    BITMAP_FOR_EACH_SET(&id, &space->cpus)
+    if (isKernel)
     {
-        if (id == SELF->id)
+        for (id = 0; id < cpu_amount(); id++)
         {
-            continue;
+            bitmap_set(&targets, id);
         }
+    }
+    else
+    {
+        BITMAP_FOR_EACH_SET(&id, &space->cpus)
+        {
+            bitmap_set(&targets, id);
+        }
+    }
+    bitmap_clear(&targets, SELF->id);
 
+    uint16_t expectedAcks = 0;
+    BITMAP_FOR_EACH_SET(&id, &targets)
+    {
         vmm_cpu_t* cpu = CPU_PTR(id, pcpu_vmm);
+        vmm_shootdown_t* previous = (vmm_shootdown_t*)atomic_exchange(&cpu->pending[SELF->id], shootdown);
+        assert(previous == NULL);
+        UNUSED(previous);
+        expectedAcks++;
+    }
 
-        lock_acquire(&cpu->lock);
-        if (cpu->shootdownCount >= VMM_MAX_SHOOTDOWN_REQUESTS)
+    clock_t startTime = clock_uptime();
+    while (true)
+    {
+        // If the IPI queue of a target is full, retry until it is not.
+        BITMAP_FOR_EACH_SET(&id, &targets)
         {
-            lock_release(&cpu->lock);
-            panic(NULL, "CPU %d shootdown buffer overflow", id);
+            if (ipi_send(cpu_get_by_id(id), IPI_SINGLE, vmm_shootdown_ipi, NULL) != ERR)
+            {
+                bitmap_clear(&targets, id);
+            }
         }
 
-        vmm_shootdown_t* shootdown = &cpu->shootdowns[cpu->shootdownCount++];
-        shootdown->space = space;
-        shootdown->virtAddr = virtAddr;
-        shootdown->pageAmount = pageAmount;
-        lock_release(&cpu->lock);
-
-        if (ipi_send(cpu_get_by_id(id), IPI_SINGLE, vmm_tlb_shootdown_ipi, NULL) == ERR)
+        if (atomic_load(&shootdown->acks) >= expectedAcks)
         {
-            panic(NULL, "Failed to send TLB shootdown IPI to CPU %d", id);
+            break;
         }
-        expectedAcks++;
-    }
 
-    clock_t startTime = clock_uptime();
-    while (atomic_load(&space->shootdownAcks) < expectedAcks)
-    {
         if (clock_uptime() - startTime > SPACE_TLB_SHOOTDOWN_TIMEOUT)
         {
-            panic(NULL, "TLB shootdown timeout in space %p for region %p - %p", space, virtAddr,
-                (void*)((uintptr_t)virtAddr + pageAmount * PAGE_SIZE));
+            panic(NULL, "TLB shootdown timeout in space %p for %lu pages in %lu ranges", space, shootdown->pageAmount,
+                shootdown->rangeCount);
         }
 
+        // Another CPU might be waiting for us with interrupts disabled.
+        vmm_shootdown_handle_pending();
         ASM("pause");
     }
+
+    vmm_shootdown_init(shootdown, space);
+}
+
+void vmm_tlb_shootdown(space_t* space, void* virtAddr, size_t pageAmount)
+{
+    vmm_shootdown_t shootdown;
+    vmm_shootdown_init(&shootdown, space);
+    vmm_shootdown_add(&shootdown, virtAddr, pageAmount);
+    vmm_shootdown_flush(&shootdown);
 }
 
 SYSCALL_DEFINE(SYS_MPROTECT, void*, void* address, size_t length, prot_t prot)
@@ -11,6 +11,7 @@
 #include <kernel/proc/process.h>
 #include <kernel/sched/sched.h>
 #include <kernel/sync/lock.h>
+#include <kernel/sync/rcu.h>
 #include <kernel/utils/map.h>
 #include <kernel/version.h>
 
@@ -120,6 +121,8 @@ static void module_free(module_t* module)
 
     if (module->baseAddr != NULL)
     {
+        // Callbacks queued by the module might still point into its code or data.
+        rcu_barrier();
         vmm_unmap(NULL, module->baseAddr, module->size);
     }
 
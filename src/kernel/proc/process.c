@@ -63,7 +63,6 @@ static void process_ctor(void* ptr)
     lock_init(&process->nspaceLock);
     process->cwd = (cwd_t){0};
     process->fileTable = (file_table_t){0};
-    process->futexCtx = (futex_ctx_t){0};
     process->perf = (perf_process_ctx_t){0};
     process->noteHandler = (note_handler_t){0};
     process->suspendQueue = (wait_queue_t){0};
@@ -110,7 +109,6 @@ static void process_free(process_t* process)
         UNREF(process->nspace);
     }
     space_deinit(&process->space);
-    futex_ctx_deinit(&process->futexCtx);
     for (uint64_t i = 0; i < ARRAY_SIZE(process->rings); i++)
     {
         ioring_ctx_deinit(&process->rings[i]);
@@ -140,6 +138,8 @@ process_t* process_new(priority_t priority, group_member_t* group, namespace_t*
     ref_init(&process->ref, process_free);
     process->id = atomic_fetch_add_explicit(&newPid, 1, memory_order_relaxed);
     atomic_store(&process->priority, priority);
+    sched_affinity_fill(&process->affinity);
+    atomic_store(&process->slice, CONFIG_TIME_SLICE);
     process->status.buffer[0] = '\0';
 
     if (space_init(&process->space, VMM_USER_SPACE_MIN, VMM_USER_SPACE_MAX,
@@ -152,7 +152,6 @@ process_t* process_new(priority_t priority, group_member_t* group, namespace_t*
     process->nspace = REF(ns);
     cwd_init(&process->cwd);
     file_table_init(&process->fileTable);
-    futex_ctx_init(&process->futexCtx);
     perf_process_ctx_init(&process->perf);
     for (uint64_t i = 0; i < ARRAY_SIZE(process->rings); i++)
     {
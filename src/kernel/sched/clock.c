@@ -1,5 +1,6 @@
 #include <kernel/sched/clock.h>
 
+#include <kernel/cpu/cli.h>
 #include <kernel/cpu/cpu.h>
 #include <kernel/cpu/interrupt.h>
 #include <kernel/cpu/syscall.h>
@@ -8,6 +9,7 @@
 #include <kernel/module/symbol.h>
 #include <kernel/sched/thread.h>
 #include <kernel/sched/timer.h>
+#include <kernel/sync/rcu.h>
 
 #include <kernel/sync/rwlock.h>
 #include <stdatomic.h>
@@ -17,8 +19,9 @@
 
 static const clock_source_t* sources[CLOCK_MAX_SOURCES] = {0};
 static uint32_t sourceCount = 0;
-static const clock_source_t* bestNsSource = NULL;
-static const clock_source_t* bestEpochSource = NULL;
+// Read without taking `sourcesLock` such that reading the time only costs whatever the source itself costs.
+static _Atomic(const clock_source_t*) bestNsSource = ATOMIC_VAR_INIT(NULL);
+static _Atomic(const clock_source_t*) bestEpochSource = ATOMIC_VAR_INIT(NULL);
 static rwlock_t sourcesLock = RWLOCK_CREATE();
 
 #ifdef DEBUG
@@ -27,21 +30,24 @@ static _Atomic(clock_t) lastNsTime = ATOMIC_VAR_INIT(0);
 
 static void clock_update_best_sources(void)
 {
-    bestNsSource = NULL;
-    bestEpochSource = NULL;
+    const clock_source_t* bestNs = NULL;
+    const clock_source_t* bestEpoch = NULL;
 
     for (uint32_t i = 0; i < sourceCount; i++)
     {
         const clock_source_t* source = sources[i];
-        if (source->read_ns != NULL && (bestNsSource == NULL || source->precision < bestNsSource->precision))
+        if (source->read_ns != NULL && (bestNs == NULL || source->precision < bestNs->precision))
         {
-            bestNsSource = source;
+            bestNs = source;
         }
-        if (source->read_epoch != NULL && (bestEpochSource == NULL || source->precision < bestEpochSource->precision))
+        if (source->read_epoch != NULL && (bestEpoch == NULL || source->precision < bestEpoch->precision))
         {
-            bestEpochSource = source;
+            bestEpoch = source;
         }
     }
+
+    atomic_store(&bestNsSource, bestNs);
+    atomic_store(&bestEpochSource, bestEpoch);
 }
 
 uint64_t clock_source_register(const clock_source_t* source)
@@ -89,6 +95,9 @@ void clock_source_unregister(const clock_source_t* source)
 
         clock_update_best_sources();
         rwlock_write_release(&sourcesLock);
+
+        // Readers hold interrupts disabled while using a source, so after a grace period no CPU can still be using it.
+        rcu_synchronize();
         return;
     }
 
@@ -98,24 +107,28 @@ void clock_source_unregister(const clock_source_t* source)
 
 clock_t clock_uptime(void)
 {
-    RWLOCK_READ_SCOPE(&sourcesLock);
-    if (bestNsSource == NULL)
+    CLI_SCOPE();
+
+    const clock_source_t* source = (const clock_source_t*)atomic_load(&bestNsSource);
+    if (source == NULL)
     {
         return 0;
     }
 
-    return bestNsSource->read_ns();
+    return source->read_ns();
 }
 
 time_t clock_epoch(void)
 {
-    RWLOCK_READ_SCOPE(&sourcesLock);
-    if (bestEpochSource == NULL)
+    CLI_SCOPE();
+
+    const clock_source_t* source = (const clock_source_t*)atomic_load(&bestEpochSource);
+    if (source == NULL)
     {
         return 0;
     }
 
-    return bestEpochSource->read_epoch();
+    return source->read_epoch();
 }
 
 void clock_wait(clock_t nanoseconds)
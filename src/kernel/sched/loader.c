@@ -225,6 +225,8 @@ SYSCALL_DEFINE(SYS_SPAWN, pid_t, const char** argv, spawn_flags_t flags)
         return ERR;
     }
     UNREF_DEFER(child);
+    sched_affinity_copy(&child->affinity, &process->affinity);
+    atomic_store(&child->slice, atomic_load(&process->slice));
 
     thread_t* childThread = thread_new(child);
     if (childThread == NULL)
@@ -7,6 +7,7 @@
 #include <kernel/cpu/gdt.h>
 #include <kernel/cpu/interrupt.h>
 #include <kernel/cpu/syscall.h>
+#include <kernel/drivers/perf.h>
 #include <kernel/log/log.h>
 #include <kernel/log/panic.h>
 #include <kernel/proc/process.h>
@@ -18,6 +19,7 @@
 #include <kernel/utils/rbtree.h>
 
 #include <assert.h>
+#include <errno.h>
 #include <stdatomic.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -31,6 +33,8 @@ static wait_queue_t sleepQueue = WAIT_QUEUE_CREATE(sleepQueue);
 
 static _Atomic(clock_t) lastLoadBalance = ATOMIC_VAR_INIT(0);
 
+static lock_t domainsLock = LOCK_CREATE();
+
 static inline int64_t sched_fixed_cmp(int128_t a, int128_t b)
 {
     int128_t diff = SCHED_FIXED_FROM(a - b);
@@ -97,6 +101,65 @@ static void sched_node_update(rbnode_t* node)
     client->vminEligible = minEligible;
 }
 
+static bool sched_domain_contains(cpu_t* a, cpu_t* b, sched_domain_level_t level)
+{
+    switch (level)
+    {
+    case SCHED_DOMAIN_SMT:
+        return a->topology.coreId == b->topology.coreId;
+    case SCHED_DOMAIN_LLC:
+        return a->topology.llcId == b->topology.llcId;
+    case SCHED_DOMAIN_PACKAGE:
+        return a->topology.packageId == b->topology.packageId;
+    default:
+        return true;
+    }
+}
+
+static void sched_domain_add(sched_domain_t* domain, cpu_id_t id)
+{
+    uint16_t amount = atomic_load(&domain->amount);
+    domain->cpus[amount] = id;
+    atomic_store(&domain->amount, amount + 1);
+}
+
+static void sched_domains_init(sched_t* sched)
+{
+    LOCK_SCOPE(&domainsLock);
+
+    for (sched_domain_level_t level = 0; level < SCHED_DOMAIN_MAX; level++)
+    {
+        atomic_init(&sched->domains[level].amount, 0);
+    }
+
+    cpu_t* self = SELF->self;
+    cpu_t* cpu;
+    CPU_FOR_EACH(cpu)
+    {
+        sched_t* other = CPU_PTR(cpu->id, _pcpu_sched);
+        if (cpu != self && !other->domainsReady)
+        {
+            continue; // Will add us once it builds its own domains.
+        }
+
+        for (sched_domain_level_t level = 0; level < SCHED_DOMAIN_MAX; level++)
+        {
+            if (!sched_domain_contains(self, cpu, level))
+            {
+                continue;
+            }
+
+            sched_domain_add(&sched->domains[level], cpu->id);
+            if (cpu != self)
+            {
+                sched_domain_add(&other->domains[level], self->id);
+            }
+        }
+    }
+
+    sched->domainsReady = true;
+}
+
 PERCPU_DEFINE_CTOR(sched_t, _pcpu_sched)
 {
     sched_t* sched = SELF_PTR(_pcpu_sched);
@@ -107,6 +170,8 @@ PERCPU_DEFINE_CTOR(sched_t, _pcpu_sched)
     sched->lastUpdate = 0;
     lock_init(&sched->lock);
     atomic_init(&sched->preemptCount, 0);
+    sched->cpu = SELF->self;
+    atomic_init(&sched->migrations, 0);
 
     sched->idleThread = thread_new(process_get_kernel());
     if (sched->idleThread == NULL)
@@ -122,11 +187,18 @@ PERCPU_DEFINE_CTOR(sched_t, _pcpu_sched)
 
     sched->runThread = sched->idleThread;
     atomic_store(&sched->runThread->state, THREAD_ACTIVE);
+
+    sched_domains_init(sched);
+}
+
+static clock_t sched_migration_cost(thread_t* thread)
+{
+    return CLAMP(thread->sched.avgRuntime, CONFIG_MIN_MIGRATION_COST, CONFIG_CACHE_HOT_THRESHOLD);
 }
 
 static bool sched_is_cache_hot(thread_t* thread, clock_t uptime)
 {
-    return thread->sched.stop + CONFIG_CACHE_HOT_THRESHOLD > uptime;
+    return thread->sched.stop + sched_migration_cost(thread) > uptime;
 }
 
 void sched_client_init(sched_client_t* client)
@@ -138,8 +210,97 @@ void sched_client_init(sched_client_t* client)
     client->vdeadline = SCHED_FIXED_ZERO;
     client->veligible = SCHED_FIXED_ZERO;
     client->vminEligible = SCHED_FIXED_ZERO;
+    client->start = 0;
     client->stop = 0;
+    client->avgRuntime = 0;
     client->lastCpu = NULL;
+    client->yield = false;
+    sched_affinity_fill(&client->affinity);
+    atomic_init(&client->slice, CONFIG_TIME_SLICE);
+}
+
+uint64_t sched_set_slice(thread_t* thread, clock_t slice)
+{
+    assert(thread != NULL);
+
+    if (slice < CONFIG_MIN_TIME_SLICE || slice > CONFIG_MAX_TIME_SLICE)
+    {
+        errno = EINVAL;
+        return ERR;
+    }
+
+    atomic_store(&thread->sched.slice, slice);
+    return 0;
+}
+
+static inline uint64_t sched_affinity_online_word(uint64_t index)
+{
+    uint64_t amount = cpu_amount();
+    if (amount >= (index + 1) * 64)
+    {
+        return UINT64_MAX;
+    }
+    if (amount <= index * 64)
+    {
+        return 0;
+    }
+    return (1ULL << (amount - index * 64)) - 1;
+}
+
+bool sched_affinity_is_usable(sched_affinity_t* mask)
+{
+    assert(mask != NULL);
+
+    for (uint64_t i = 0; i < SCHED_AFFINITY_WORDS; i++)
+    {
+        if (atomic_load_explicit(&mask->words[i], memory_order_relaxed) & sched_affinity_online_word(i))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void sched_affinity_set(sched_affinity_t* dest, sched_affinity_t* src)
+{
+    assert(dest != NULL);
+    assert(src != NULL);
+
+    sched_affinity_copy(dest, src);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    // Any thread that is no longer allowed on its CPU will be moved the next time that CPU reschedules.
+    ipi_wake_up(NULL, IPI_BROADCAST);
+}
+
+bool sched_affinity_allows(thread_t* thread, cpu_t* cpu)
+{
+    assert(thread != NULL);
+    assert(cpu != NULL);
+
+    sched_affinity_t* processMask = &thread->process->affinity;
+    if (!sched_affinity_has(processMask, cpu->id))
+    {
+        return false;
+    }
+
+    sched_affinity_t* threadMask = &thread->sched.affinity;
+    if (sched_affinity_has(threadMask, cpu->id))
+    {
+        return true;
+    }
+
+    // The thread mask is ignored if it does not share any CPU with the process mask.
+    for (uint64_t i = 0; i < SCHED_AFFINITY_WORDS; i++)
+    {
+        uint64_t shared = atomic_load_explicit(&threadMask->words[i], memory_order_relaxed) &
+            atomic_load_explicit(&processMask->words[i], memory_order_relaxed);
+        if (shared & sched_affinity_online_word(i))
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
 void sched_client_update_veligible(sched_client_t* client, vclock_t newVeligible)
@@ -148,7 +309,7 @@ void sched_client_update_veligible(sched_client_t* client, vclock_t newVeligible
 
     client->veligible = newVeligible;
     client->vminEligible = newVeligible;
-    client->vdeadline = newVeligible + SCHED_FIXED_TO(CONFIG_TIME_SLICE) / client->weight;
+    client->vdeadline = newVeligible + SCHED_FIXED_TO(atomic_load(&client->slice)) / client->weight;
 }
 
 // Must be called with the scheduler lock held.
@@ -200,6 +361,12 @@ static void sched_enter(sched_t* sched, thread_t* thread, clock_t uptime)
 
     rbtree_insert(&sched->runqueue, &client->node);
     atomic_store(&thread->state, THREAD_ACTIVE);
+
+    if (client->lastCpu != NULL && client->lastCpu != sched->cpu)
+    {
+        atomic_fetch_add(&sched->migrations, 1);
+        atomic_fetch_add_explicit(&thread->process->perf.sched.migrations, 1, memory_order_relaxed);
+    }
 }
 
 // Should be called with sched lock held.
@@ -226,76 +393,309 @@ static void sched_leave(sched_t* sched, thread_t* thread, clock_t uptime)
     sched->vtime += lag / totalWeight;
 }
 
-static cpu_t* sched_get_least_loaded(void)
+static inline uint64_t sched_load(cpu_t* cpu)
+{
+    sched_t* sched = CPU_PTR(cpu->id, _pcpu_sched);
+    return atomic_load(&sched->totalWeight);
+}
+
+/**
+ * Iterates over the CPUs in the domain of `origin` at `level`, skipping the CPUs that are also in the level below, as
+ * those have already been visited when searching from the closest domain outwards.
+ */
+#define SCHED_DOMAIN_FOR_EACH(cpu, origin, level) \
+    for (sched_domain_t* _domain = &((sched_t*)CPU_PTR((origin)->id, _pcpu_sched))->domains[level]; _domain != NULL; \
+        _domain = NULL) \
+        for (uint16_t _i = 0, _amount = atomic_load(&_domain->amount); _i < _amount; _i++) \
+            for (cpu = cpu_get_by_id(_domain->cpus[_i]); \
+                cpu != NULL && !((level) > 0 && sched_domain_contains((origin), cpu, (level) - 1)); cpu = NULL)
+
+static bool sched_core_is_idle(cpu_t* cpu)
+{
+    cpu_t* sibling;
+    SCHED_DOMAIN_FOR_EACH(sibling, cpu, SCHED_DOMAIN_SMT)
+    {
+        if (sched_load(sibling) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Searches the domains of `origin` from `minLevel` outwards up to and including `maxLevel`, a CPU whose entire core is
+// idle is preferred over the closest idle CPU, which might be an SMT sibling of a busy CPU.
+static cpu_t* sched_find_idle(cpu_t* origin, sched_domain_level_t minLevel, sched_domain_level_t maxLevel,
+    thread_t* thread)
+{
+    cpu_t* idleCpu = NULL;
+
+    for (sched_domain_level_t level = minLevel; level <= maxLevel; level++)
+    {
+        cpu_t* cpu;
+        SCHED_DOMAIN_FOR_EACH(cpu, origin, level)
+        {
+            if (sched_load(cpu) != 0 || !sched_affinity_allows(thread, cpu))
+            {
+                continue;
+            }
+
+            if (sched_core_is_idle(cpu))
+            {
+                return cpu;
+            }
+
+            if (idleCpu == NULL)
+            {
+                idleCpu = cpu;
+            }
+        }
+    }
+
+    return idleCpu;
+}
+
+// If `thread` is not `NULL`, only CPUs it is allowed to run on are considered, falls back to `origin` if there are
+// none.
+static cpu_t* sched_get_least_loaded(cpu_t* origin, thread_t* thread)
 {
     cpu_t* leastLoaded = NULL;
     uint64_t leastLoad = UINT64_MAX;
+    if (thread == NULL || sched_affinity_allows(thread, origin))
+    {
+        leastLoaded = origin;
+        leastLoad = sched_load(origin);
+    }
 
-    cpu_t* cpu;
-    CPU_FOR_EACH(cpu)
+    for (sched_domain_level_t level = SCHED_DOMAIN_SMT; level < SCHED_DOMAIN_MAX; level++)
+    {
+        cpu_t* cpu;
+        SCHED_DOMAIN_FOR_EACH(cpu, origin, level)
+        {
+            if (thread != NULL && !sched_affinity_allows(thread, cpu))
+            {
+                continue;
+            }
+
+            uint64_t load = sched_load(cpu);
+            if (load < leastLoad) // Strictly less, so closer CPUs win ties.
+            {
+                leastLoad = load;
+                leastLoaded = cpu;
+            }
+        }
+    }
+
+    return leastLoaded != NULL ? leastLoaded : origin;
+}
+
+static cpu_t* sched_select_cpu(thread_t* thread)
+{
+    cpu_t* lastCpu = thread->sched.lastCpu;
+    if (lastCpu != NULL && sched_affinity_allows(thread, lastCpu) && sched_is_cache_hot(thread, clock_uptime()))
     {
-        sched_t* sched = CPU_PTR(cpu->id, _pcpu_sched);
+        if (sched_load(lastCpu) == 0)
+        {
+            return lastCpu;
+        }
 
-        uint64_t load = atomic_load(&sched->totalWeight);
+        cpu_t* idle = sched_find_idle(lastCpu, SCHED_DOMAIN_SMT, SCHED_DOMAIN_LLC, thread);
+        return idle != NULL ? idle : lastCpu;
+    }
+
+    cpu_t* origin = lastCpu != NULL ? lastCpu : SELF->self;
+    if (sched_affinity_allows(thread, origin) && sched_load(origin) == 0 && sched_core_is_idle(origin))
+    {
+        return origin;
+    }
+
+    // Within the last level cache an idle core beats an idle SMT sibling, further out the closest idle CPU wins.
+    cpu_t* idle = sched_find_idle(origin, SCHED_DOMAIN_SMT, SCHED_DOMAIN_LLC, thread);
+    if (idle != NULL)
+    {
+        return idle;
+    }
 
-        if (load < leastLoad)
+    for (sched_domain_level_t level = SCHED_DOMAIN_PACKAGE; level < SCHED_DOMAIN_MAX; level++)
+    {
+        idle = sched_find_idle(origin, level, level, thread);
+        if (idle != NULL)
         {
-            leastLoad = load;
-            leastLoaded = cpu;
+            return idle;
         }
     }
 
-    assert(leastLoaded != NULL);
-    return leastLoaded;
+    return sched_get_least_loaded(origin, thread);
+}
+
+static thread_t* sched_steal_from(sched_t* victim, cpu_t* self, bool crossLlc)
+{
+    // We already hold our own lock, so never wait for another to avoid lock ordering issues.
+    if (!lock_try_acquire(&victim->lock))
+    {
+        return NULL;
+    }
+
+    clock_t uptime = clock_uptime();
+
+    thread_t* thread;
+    RBTREE_FOR_EACH(thread, &victim->runqueue, sched.node)
+    {
+        if (thread == victim->runThread || (crossLlc && sched_is_cache_hot(thread, uptime)) ||
+            !sched_affinity_allows(thread, self))
+        {
+            continue;
+        }
+
+        sched_leave(victim, thread, uptime);
+        lock_release(&victim->lock);
+        return thread;
+    }
+
+    lock_release(&victim->lock);
+    return NULL;
 }
 
 static thread_t* sched_steal(void)
 {
-    sched_t* mostLoaded = NULL;
-    uint64_t mostLoad = 0;
+    cpu_t* self = SELF->self;
 
-    cpu_t* cpu;
-    CPU_FOR_EACH(cpu)
+    for (sched_domain_level_t level = SCHED_DOMAIN_SMT; level < SCHED_DOMAIN_MAX; level++)
     {
-        if (cpu->id == SELF->id)
+        sched_t* mostLoaded = NULL;
+        uint64_t mostLoad = 0;
+
+        cpu_t* cpu;
+        SCHED_DOMAIN_FOR_EACH(cpu, self, level)
+        {
+            if (cpu == self)
+            {
+                continue;
+            }
+
+            sched_t* sched = CPU_PTR(cpu->id, _pcpu_sched);
+            uint64_t load = atomic_load(&sched->totalWeight);
+            if (load > mostLoad)
+            {
+                mostLoad = load;
+                mostLoaded = sched;
+            }
+        }
+
+        if (mostLoaded == NULL)
         {
             continue;
         }
 
-        sched_t* sched = CPU_PTR(cpu->id, _pcpu_sched);
-        uint64_t load = atomic_load(&sched->totalWeight);
+        thread_t* thread = sched_steal_from(mostLoaded, self, level > SCHED_DOMAIN_LLC);
+        if (thread != NULL)
+        {
+            return thread;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * The maximum amount of threads moved by a single run of the periodic balancer.
+ */
+#define SCHED_BALANCE_MAX_MOVE 8
 
-        if (load > mostLoad)
+/**
+ * The maximum amount of threads moved away from a CPU due to their affinity by a single call to `sched_do()`.
+ */
+#define SCHED_EVICT_MAX 8
+
+// Must be called without holding any scheduler lock.
+static void sched_balance(void)
+{
+    clock_t uptime = clock_uptime();
+    clock_t last = atomic_load(&lastLoadBalance);
+    if (uptime < last + CONFIG_LOAD_BALANCE_INTERVAL ||
+        !atomic_compare_exchange_strong(&lastLoadBalance, &last, uptime))
+    {
+        return;
+    }
+
+    cpu_t* busiest = NULL;
+    uint64_t busiestLoad = 0;
+    cpu_t* cpu;
+    CPU_FOR_EACH(cpu)
+    {
+        uint64_t load = sched_load(cpu);
+        if (load > busiestLoad)
         {
-            mostLoad = load;
-            mostLoaded = sched;
+            busiestLoad = load;
+            busiest = cpu;
         }
     }
 
-    if (mostLoaded == NULL)
+    if (busiest == NULL)
     {
-        return NULL;
+        return;
+    }
+
+    cpu_t* target = sched_get_least_loaded(busiest, NULL);
+    uint64_t targetLoad = sched_load(target);
+    if (target == busiest || busiestLoad <= targetLoad)
+    {
+        return;
     }
 
-    lock_acquire(&mostLoaded->lock);
+    // Moving a thread of weight w reduces the difference by 2w, so never move more than half of it.
+    int64_t imbalance = (int64_t)(busiestLoad - targetLoad) / 2;
 
-    clock_t uptime = clock_uptime();
+    sched_t* source = CPU_PTR(busiest->id, _pcpu_sched);
+    if (!lock_try_acquire(&source->lock))
+    {
+        return;
+    }
+
+    thread_t* moved[SCHED_BALANCE_MAX_MOVE];
+    uint64_t movedAmount = 0;
 
     thread_t* thread;
-    RBTREE_FOR_EACH(thread, &mostLoaded->runqueue, sched.node)
+    RBTREE_FOR_EACH(thread, &source->runqueue, sched.node)
     {
-        if (thread == mostLoaded->runThread || sched_is_cache_hot(thread, uptime))
+        if (movedAmount >= SCHED_BALANCE_MAX_MOVE)
+        {
+            break;
+        }
+
+        if (thread == source->runThread || thread->sched.weight > imbalance || sched_is_cache_hot(thread, uptime) ||
+            !sched_affinity_allows(thread, target))
         {
             continue;
         }
 
-        sched_leave(mostLoaded, thread, uptime);
-        lock_release(&mostLoaded->lock);
-        return thread;
+        imbalance -= thread->sched.weight;
+        moved[movedAmount++] = thread;
     }
 
-    lock_release(&mostLoaded->lock);
-    return NULL;
+    for (uint64_t i = 0; i < movedAmount; i++)
+    {
+        sched_leave(source, moved[i], uptime);
+    }
+    lock_release(&source->lock);
+
+    if (movedAmount == 0)
+    {
+        return;
+    }
+
+    sched_t* dest = CPU_PTR(target->id, _pcpu_sched);
+    lock_acquire(&dest->lock);
+    for (uint64_t i = 0; i < movedAmount; i++)
+    {
+        sched_enter(dest, moved[i], uptime);
+    }
+    lock_release(&dest->lock);
+
+    if (target != SELF->self)
+    {
+        ipi_wake_up(target, IPI_SINGLE);
+    }
 }
 
 // Should be called with scheduler lock held.
@@ -375,34 +775,42 @@ void sched_start(thread_t* bootThread)
     thread_jump(bootThread);
 }
 
-void sched_submit(thread_t* thread)
+// Should be called with the scheduler lock held, after the thread has entered the scheduler.
+static bool sched_wakeup_preempts(sched_t* sched, thread_t* thread)
 {
-    assert(thread != NULL);
-
-    cli_push();
-    sched_t* self = SELF_PTR(_pcpu_sched);
-
-    cpu_t* target;
-    if (thread->sched.lastCpu != NULL && sched_is_cache_hot(thread, clock_uptime()))
-    {
-        target = thread->sched.lastCpu;
-    }
-    else if (atomic_load(&self->totalWeight) == 0)
+    thread_t* runThread = sched->runThread;
+    if (runThread == sched->idleThread || atomic_load(&runThread->state) != THREAD_ACTIVE)
     {
-        target = SELF->self;
+        return true;
     }
-    else
+
+    if (sched_fixed_cmp(thread->sched.veligible, sched->vtime) > 0)
     {
-        target = sched_get_least_loaded();
+        return false;
     }
 
+    return sched_fixed_cmp(thread->sched.vdeadline, runThread->sched.vdeadline) < 0;
+}
+
+void sched_submit(thread_t* thread)
+{
+    assert(thread != NULL);
+
+    cli_push();
+
+    cpu_t* target = sched_select_cpu(thread);
     sched_t* sched = CPU_PTR(target->id, _pcpu_sched);
 
+    clock_t uptime = clock_uptime();
+    perf_sched_submit(thread, uptime);
+
     lock_acquire(&sched->lock);
-    sched_enter(sched, thread, clock_uptime());
+    sched_enter(sched, thread, uptime);
+    bool preempts = sched_wakeup_preempts(sched, thread);
     lock_release(&sched->lock);
 
-    bool shouldWake = SELF->id != target->id || !SELF->inInterrupt;
+    // If the thread does not preempt the running thread, it will be picked at the next scheduling point anyway.
+    bool shouldWake = preempts && (SELF->id != target->id || !SELF->inInterrupt);
     cli_pop();
 
     if (shouldWake)
@@ -528,6 +936,8 @@ void sched_do(interrupt_frame_t* frame)
 {
     assert(frame != NULL);
 
+    sched_balance();
+
     sched_t* sched = SELF_PTR(_pcpu_sched);
     lock_acquire(&sched->lock);
 
@@ -586,13 +996,46 @@ void sched_do(interrupt_frame_t* frame)
         panic(NULL, "Thread in invalid state in sched_do() state=%d", state);
     }
 
+    sched_client_t* runClient = &sched->runThread->sched;
+    if (runClient->yield && sched->runThread != sched->idleThread)
+    {
+        runClient->yield = false;
+        if (atomic_load(&sched->runThread->state) == THREAD_ACTIVE)
+        {
+            runClient->vdeadline += SCHED_FIXED_TO(atomic_load(&runClient->slice)) / runClient->weight;
+            rbtree_fix(&sched->runqueue, &runClient->node);
+        }
+    }
+
+    // Move away any thread that is no longer allowed to run on this CPU, they are submitted again once the lock is
+    // released.
+    thread_t* evicted[SCHED_EVICT_MAX];
+    uint64_t evictedAmount = 0;
+
     thread_t* next = sched_first_eligible(sched);
     assert(next != NULL);
+    while (next != sched->idleThread && evictedAmount < SCHED_EVICT_MAX && !sched_affinity_allows(next, sched->cpu))
+    {
+        sched_leave(sched, next, uptime);
+        evicted[evictedAmount++] = next;
+
+        next = sched_first_eligible(sched);
+        assert(next != NULL);
+    }
 
     if (next != sched->runThread)
     {
-        sched->runThread->sched.lastCpu = SELF->self;
-        sched->runThread->sched.stop = uptime;
+        sched_client_t* client = &sched->runThread->sched;
+        if (sched->runThread != sched->idleThread)
+        {
+            client->avgRuntime = (client->avgRuntime * 7 + (uptime - client->start)) / 8;
+        }
+        client->lastCpu = SELF->self;
+        client->stop = uptime;
+        next->sched.start = uptime;
+        next->sched.lastCpu = SELF->self;
+        perf_sched_switch(sched->runThread, next, sched->idleThread,
+            atomic_load(&sched->runThread->state) == THREAD_ACTIVE, uptime);
         thread_save(sched->runThread, frame);
         assert(atomic_load(&next->state) == THREAD_ACTIVE);
         thread_load(next, frame);
@@ -601,9 +1044,14 @@ void sched_do(interrupt_frame_t* frame)
 
     lock_release(&sched->lock);
 
+    for (uint64_t i = 0; i < evictedAmount; i++)
+    {
+        sched_submit(evicted[i]);
+    }
+
     if (sched->runThread != sched->idleThread)
     {
-        timer_set(uptime, uptime + CONFIG_TIME_SLICE);
+        timer_set(uptime, uptime + atomic_load(&sched->runThread->sched.slice));
     }
 
     if (threadToFree != NULL)
@@ -625,6 +1073,20 @@ bool sched_is_idle(cpu_t* cpu)
     return sched->runThread == sched->idleThread;
 }
 
+bool sched_is_running(thread_t* thread)
+{
+    assert(thread != NULL);
+
+    cpu_t* cpu = thread->sched.lastCpu;
+    if (cpu == NULL)
+    {
+        return false;
+    }
+
+    sched_t* sched = CPU_PTR(cpu->id, _pcpu_sched);
+    return sched->runThread == thread;
+}
+
 uint64_t sched_nanosleep(clock_t timeout)
 {
     return WAIT_BLOCK_TIMEOUT(&sleepQueue, false, timeout);
@@ -632,7 +1094,8 @@ uint64_t sched_nanosleep(clock_t timeout)
 
 void sched_yield(void)
 {
-    sched_nanosleep(CLOCKS_PER_MS);
+    thread_current()->sched.yield = true;
+    ipi_invoke();
 }
 
 void sched_disable(void)
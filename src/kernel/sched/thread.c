@@ -72,6 +72,7 @@ thread_t* thread_new(process_t* process)
     thread->process = process;
     thread->id = atomic_fetch_add_explicit(&process->threads.newTid, 1, memory_order_relaxed);
     sched_client_init(&thread->sched);
+    atomic_store(&thread->sched.slice, atomic_load(&process->slice));
     atomic_store(&thread->state, THREAD_PARKED);
     thread->error = 0;
     if (stack_pointer_init(&thread->kernelStack,
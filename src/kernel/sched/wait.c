@@ -4,6 +4,7 @@
 
 #include <kernel/cpu/cpu.h>
 #include <kernel/cpu/ipi.h>
+#include <kernel/drivers/perf.h>
 #include <kernel/log/log.h>
 #include <kernel/log/panic.h>
 #include <kernel/sched/clock.h>
@@ -104,6 +105,7 @@ void wait_check_timeouts(interrupt_frame_t* frame)
         }
 
         wait_remove_wait_entries(thread, ETIMEDOUT);
+        perf_sched_wakeup(thread);
         sched_submit(thread);
     }
 }
@@ -155,6 +157,7 @@ uint64_t wait_block_prepare(wait_queue_t** waitQueues, uint64_t amount, clock_t
         list_entry_init(&entry->threadEntry);
         entry->queue = waitQueues[i];
         entry->thread = thread;
+        entry->func = NULL;
 
         list_push_back(&thread->wait.entries, &entry->threadEntry);
         list_push_back(&entry->queue->entries, &entry->queueEntry);
@@ -301,13 +304,35 @@ void wait_unblock_thread(thread_t* thread, errno_t err)
     wait_remove_wait_entries(thread, err);
     lock_release(&thread->wait.owner->lock);
 
+    perf_sched_wakeup(thread);
     sched_submit(thread);
 }
 
+static void wait_invoke_funcs(list_t* funcs)
+{
+    while (true)
+    {
+        wait_entry_t* entry = CONTAINER_OF_SAFE(list_pop_front(funcs), wait_entry_t, queueEntry);
+        if (entry == NULL)
+        {
+            break;
+        }
+
+        entry->func(entry);
+        atomic_store(&entry->busy, false);
+    }
+}
+
 uint64_t wait_unblock(wait_queue_t* queue, uint64_t amount, errno_t err)
 {
     uint64_t amountUnblocked = 0;
 
+    // Prevents a `wait_queue_remove_func()` on this CPU from spinning on a callback that we interrupted.
+    CLI_SCOPE();
+
+    list_t funcs = LIST_CREATE(funcs);
+    bool isFirstBatch = true;
+
     const uint64_t threadsPerBatch = 64;
     while (1)
     {
@@ -319,6 +344,20 @@ uint64_t wait_unblock(wait_queue_t* queue, uint64_t amount, errno_t err)
 
         lock_acquire(&queue->lock);
 
+        while (isFirstBatch)
+        {
+            wait_entry_t* entry = CONTAINER_OF_SAFE(list_first(&queue->entries), wait_entry_t, queueEntry);
+            if (entry == NULL || entry->func == NULL)
+            {
+                break;
+            }
+
+            list_remove(&entry->queueEntry);
+            atomic_store(&entry->busy, true);
+            list_push_back(&funcs, &entry->queueEntry);
+        }
+        isFirstBatch = false;
+
         wait_entry_t* temp;
         wait_entry_t* waitEntry;
         uint64_t collected = 0;
@@ -343,6 +382,8 @@ uint64_t wait_unblock(wait_queue_t* queue, uint64_t amount, errno_t err)
 
         lock_release(&queue->lock);
 
+        wait_invoke_funcs(&funcs);
+
         if (collected == 0)
         {
             break;
@@ -355,10 +396,54 @@ uint64_t wait_unblock(wait_queue_t* queue, uint64_t amount, errno_t err)
             wait_remove_wait_entries(threads[i], err);
             lock_release(&threads[i]->wait.owner->lock);
 
+            perf_sched_wakeup(threads[i]);
             sched_submit(threads[i]);
             amountUnblocked++;
         }
     }
 
     return amountUnblocked;
-}
\ No newline at end of file
+}
+void wait_queue_add_func(wait_queue_t* queue, wait_entry_t* entry, wait_func_t func)
+{
+    list_entry_init(&entry->queueEntry);
+    list_entry_init(&entry->threadEntry);
+    entry->thread = NULL;
+    entry->queue = queue;
+    entry->func = func;
+    atomic_init(&entry->busy, false);
+
+    LOCK_SCOPE(&queue->lock);
+    list_push_front(&queue->entries, &entry->queueEntry);
+}
+
+bool wait_queue_remove_func(wait_entry_t* entry)
+{
+    wait_queue_t* queue = entry->queue;
+    if (queue == NULL)
+    {
+        return false;
+    }
+
+    while (true)
+    {
+        // While the callback is being invoked the entry is stored in a list local to `wait_unblock()`.
+        lock_acquire(&queue->lock);
+        if (!atomic_load(&entry->busy))
+        {
+            bool isQueued = list_entry_in_list(&entry->queueEntry);
+            if (isQueued)
+            {
+                list_remove(&entry->queueEntry);
+            }
+            lock_release(&queue->lock);
+            return isQueued;
+        }
+        lock_release(&queue->lock);
+
+        while (atomic_load(&entry->busy))
+        {
+            ASM("pause");
+        }
+    }
+}
@@ -1,5 +1,7 @@
+#include <kernel/config.h>
 #include <kernel/cpu/syscall.h>
 #include <kernel/log/log.h>
+#include <kernel/mem/space.h>
 #include <kernel/proc/process.h>
 #include <kernel/sched/clock.h>
 #include <kernel/sched/sched.h>
@@ -8,110 +10,441 @@
 #include <kernel/sched/wait.h>
 #include <kernel/sync/futex.h>
 #include <kernel/sync/lock.h>
-#include <kernel/utils/map.h>
+#include <kernel/sync/rcu.h>
 
 #include <errno.h>
 #include <stdlib.h>
 
-void futex_ctx_init(futex_ctx_t* ctx)
+static futex_bucket_t buckets[FUTEX_BUCKETS];
+
+void futex_init(void)
 {
-    map_init(&ctx->futexes);
-    lock_init(&ctx->lock);
+    for (uint64_t i = 0; i < FUTEX_BUCKETS; i++)
+    {
+        lock_init(&buckets[i].lock);
+        list_init(&buckets[i].waiters);
+    }
 }
 
-void futex_ctx_deinit(futex_ctx_t* ctx)
+static uint64_t futex_key_get(thread_t* thread, atomic_uint64_t* addr, futex_key_t* key)
 {
-    for (uint64_t i = 0; i < ctx->futexes.capacity; i++)
+    if ((uintptr_t)addr % sizeof(atomic_uint64_t) != 0)
+    {
+        errno = EINVAL;
+        return ERR;
+    }
+
+    space_t* space = &thread->process->space;
+    if (space_pin(space, addr, sizeof(atomic_uint64_t), &thread->userStack) == ERR)
+    {
+        return ERR;
+    }
+
+    phys_addr_t physAddr;
+    uint64_t isShared = space_virt_to_shared_phys(space, addr, &physAddr);
+    space_unpin(space, addr, sizeof(atomic_uint64_t));
+    if (isShared == ERR)
+    {
+        return ERR;
+    }
+
+    if (isShared)
+    {
+        key->space = 0;
+        key->address = physAddr;
+    }
+    else
     {
-        map_entry_t* entry = ctx->futexes.entries[i];
-        if (!MAP_ENTRY_PTR_IS_VALID(entry))
+        key->space = (uintptr_t)space;
+        key->address = (uintptr_t)addr;
+    }
+    return 0;
+}
+
+static inline bool futex_key_equal(const futex_key_t* a, const futex_key_t* b)
+{
+    return a->space == b->space && a->address == b->address;
+}
+
+static futex_bucket_t* futex_bucket_get(const futex_key_t* key)
+{
+    uint64_t hash = (key->space ^ (key->address >> 3)) * 0x9E3779B97F4A7C15ULL;
+    return &buckets[(hash >> 32) % FUTEX_BUCKETS];
+}
+
+static void futex_buckets_lock(futex_bucket_t* first, futex_bucket_t* second)
+{
+    if (first == second)
+    {
+        lock_acquire(&first->lock);
+        return;
+    }
+
+    // Always lock in the same order to avoid deadlocks.
+    if (first > second)
+    {
+        futex_bucket_t* temp = first;
+        first = second;
+        second = temp;
+    }
+    lock_acquire(&first->lock);
+    lock_acquire(&second->lock);
+}
+
+static void futex_buckets_unlock(futex_bucket_t* first, futex_bucket_t* second)
+{
+    if (first != second)
+    {
+        lock_release(&second->lock);
+    }
+    lock_release(&first->lock);
+}
+
+static void futex_waiter_remove(futex_waiter_t* waiter)
+{
+    // The bucket can change under us due to a requeue, so retry until we hold the lock of the bucket the waiter is in.
+    while (true)
+    {
+        futex_bucket_t* bucket = (futex_bucket_t*)atomic_load(&waiter->bucket);
+        if (bucket == NULL)
         {
-            continue;
+            return;
         }
 
-        futex_t* futex = CONTAINER_OF(entry, futex_t, entry);
-        wait_queue_deinit(&futex->queue);
-        free(futex);
+        lock_acquire(&bucket->lock);
+        if (atomic_load(&waiter->bucket) == bucket)
+        {
+            list_remove(&waiter->entry);
+            atomic_store(&waiter->bucket, NULL);
+            lock_release(&bucket->lock);
+            return;
+        }
+        lock_release(&bucket->lock);
     }
-    map_deinit(&ctx->futexes);
 }
 
-static futex_t* futex_ctx_get(futex_ctx_t* ctx, void* addr)
+static uint64_t futex_bucket_wake(futex_bucket_t* bucket, const futex_key_t* key, uint64_t amount)
 {
-    LOCK_SCOPE(&ctx->lock);
+    uint64_t woken = 0;
 
-    map_key_t key = map_key_uint64((uint64_t)addr);
-    futex_t* futex = CONTAINER_OF_SAFE(map_get(&ctx->futexes, &key), futex_t, entry);
-    if (futex != NULL)
+    futex_waiter_t* waiter;
+    futex_waiter_t* temp;
+    LIST_FOR_EACH_SAFE(waiter, temp, &bucket->waiters, entry)
     {
-        return futex;
+        if (woken >= amount)
+        {
+            break;
+        }
+
+        if (!futex_key_equal(&waiter->key, key))
+        {
+            continue;
+        }
+
+        list_remove(&waiter->entry);
+        uint64_t unblocked = wait_unblock(&waiter->queue, WAIT_ALL, EOK);
+        // Must be the last access to the waiter, as it might be on the stack of a thread that is no longer waiting.
+        atomic_store(&waiter->bucket, NULL);
+        if (unblocked != ERR && unblocked > 0)
+        {
+            woken++;
+        }
     }
 
-    futex = malloc(sizeof(futex_t));
-    if (futex == NULL)
+    return woken;
+}
+
+static uint64_t futex_bucket_requeue(futex_bucket_t* bucket, const futex_key_t* key, futex_bucket_t* dest,
+    const futex_key_t* destKey, uint64_t amount)
+{
+    uint64_t requeued = 0;
+
+    futex_waiter_t* waiter;
+    futex_waiter_t* temp;
+    LIST_FOR_EACH_SAFE(waiter, temp, &bucket->waiters, entry)
     {
-        return NULL;
+        if (requeued >= amount)
+        {
+            break;
+        }
+
+        if (!futex_key_equal(&waiter->key, key))
+        {
+            continue;
+        }
+
+        list_remove(&waiter->entry);
+        waiter->key = *destKey;
+        list_push_back(&dest->waiters, &waiter->entry);
+        atomic_store(&waiter->bucket, dest);
+        requeued++;
     }
-    map_entry_init(&futex->entry);
-    wait_queue_init(&futex->queue);
 
-    map_insert(&ctx->futexes, &key, &futex->entry);
-    return futex;
+    return requeued;
 }
 
-SYSCALL_DEFINE(SYS_FUTEX, uint64_t, atomic_uint64_t* addr, uint64_t val, futex_op_t op, clock_t timeout)
+static uint64_t futex_wait(thread_t* thread, atomic_uint64_t* addr, const futex_key_t* key, uint64_t val,
+    clock_t timeout)
 {
-    thread_t* thread = thread_current();
-    process_t* process = thread->process;
-    futex_ctx_t* ctx = &process->futexCtx;
+    futex_waiter_t waiter;
+    list_entry_init(&waiter.entry);
+    waiter.key = *key;
+    atomic_init(&waiter.bucket, NULL);
+    wait_queue_init(&waiter.queue);
 
-    futex_t* futex = futex_ctx_get(ctx, addr);
-    if (futex == NULL)
+    wait_queue_t* queue = &waiter.queue;
+    if (wait_block_prepare(&queue, 1, timeout) == ERR)
     {
+        wait_queue_deinit(&waiter.queue);
         return ERR;
     }
 
-    switch (op)
+    futex_bucket_t* bucket = futex_bucket_get(key);
+    lock_acquire(&bucket->lock);
+    list_push_back(&bucket->waiters, &waiter.entry);
+    atomic_store(&waiter.bucket, bucket);
+    lock_release(&bucket->lock);
+
+    uint64_t result = 0;
+    uint64_t loadedVal;
+    if (thread_load_atomic_from_user(thread, addr, &loadedVal) == ERR)
     {
-    case FUTEX_WAIT:
+        wait_block_cancel();
+        result = ERR;
+    }
+    else if (loadedVal != val)
     {
-        wait_queue_t* queue = &futex->queue;
-        if (wait_block_prepare(&queue, 1, timeout) == ERR)
-        {
-            return ERR;
-        }
+        wait_block_cancel();
+        errno = EAGAIN;
+        result = ERR;
+    }
+    else
+    {
+        result = wait_block_commit();
+    }
 
+    futex_waiter_remove(&waiter);
+    wait_queue_deinit(&waiter.queue);
+    return result;
+}
+
+static uint64_t futex_wake(const futex_key_t* key, uint64_t amount)
+{
+    futex_bucket_t* bucket = futex_bucket_get(key);
+    LOCK_SCOPE(&bucket->lock);
+    return futex_bucket_wake(bucket, key, amount);
+}
+
+static uint64_t futex_do_requeue(thread_t* thread, atomic_uint64_t* addr, const futex_key_t* key, uint64_t wake,
+    atomic_uint64_t* addr2, uint64_t requeue, bool shouldCompare, uint64_t cmp)
+{
+    futex_key_t key2;
+    if (futex_key_get(thread, addr2, &key2) == ERR)
+    {
+        return ERR;
+    }
+
+    futex_bucket_t* bucket = futex_bucket_get(key);
+    futex_bucket_t* bucket2 = futex_bucket_get(&key2);
+    futex_buckets_lock(bucket, bucket2);
+
+    if (shouldCompare)
+    {
         uint64_t loadedVal;
         if (thread_load_atomic_from_user(thread, addr, &loadedVal) == ERR)
         {
-            wait_block_cancel();
+            futex_buckets_unlock(bucket, bucket2);
             return ERR;
         }
 
-        if (loadedVal != val)
+        if (loadedVal != cmp)
         {
-            wait_block_cancel();
+            futex_buckets_unlock(bucket, bucket2);
             errno = EAGAIN;
             return ERR;
         }
+    }
+
+    uint64_t woken = futex_bucket_wake(bucket, key, wake);
+    uint64_t requeued = futex_bucket_requeue(bucket, key, bucket2, &key2, requeue);
+    futex_buckets_unlock(bucket, bucket2);
+
+    return shouldCompare ? woken + requeued : woken;
+}
 
-        if (wait_block_commit() == ERR)
+static bool futex_op_compare(uint64_t wakeOp, uint64_t old)
+{
+    uint64_t cmparg = wakeOp & 0xFFFFFFF;
+    switch ((wakeOp >> 56) & 0xF)
+    {
+    case FUTEX_OP_CMP_EQ:
+        return old == cmparg;
+    case FUTEX_OP_CMP_NE:
+        return old != cmparg;
+    case FUTEX_OP_CMP_LT:
+        return old < cmparg;
+    case FUTEX_OP_CMP_LE:
+        return old <= cmparg;
+    case FUTEX_OP_CMP_GT:
+        return old > cmparg;
+    case FUTEX_OP_CMP_GE:
+        return old >= cmparg;
+    default:
+        return false;
+    }
+}
+
+static uint64_t futex_op_apply(thread_t* thread, atomic_uint64_t* addr, uint64_t wakeOp, uint64_t* outOld)
+{
+    uint64_t op = (wakeOp >> 60) & 0xF;
+    uint64_t oparg = (wakeOp >> 28) & 0xFFFFFFF;
+    if (op > FUTEX_OP_XOR || ((wakeOp >> 56) & 0xF) > FUTEX_OP_CMP_GE)
+    {
+        errno = EINVAL;
+        return ERR;
+    }
+
+    space_t* space = &thread->process->space;
+    if (space_pin(space, addr, sizeof(atomic_uint64_t), &thread->userStack) == ERR)
+    {
+        return ERR;
+    }
+
+    uint64_t old = atomic_load(addr);
+    uint64_t new;
+    do
+    {
+        switch (op)
         {
-            return ERR;
+        case FUTEX_OP_SET:
+            new = oparg;
+            break;
+        case FUTEX_OP_ADD:
+            new = old + oparg;
+            break;
+        case FUTEX_OP_OR:
+            new = old | oparg;
+            break;
+        case FUTEX_OP_ANDN:
+            new = old & ~oparg;
+            break;
+        default:
+            new = old ^ oparg;
+            break;
         }
+    } while (!atomic_compare_exchange_weak(addr, &old, new));
 
-        return 0;
+    space_unpin(space, addr, sizeof(atomic_uint64_t));
+    *outOld = old;
+    return 0;
+}
+
+static uint64_t futex_do_wake_op(thread_t* thread, const futex_key_t* key, uint64_t wake, atomic_uint64_t* addr2,
+    uint64_t wake2, uint64_t wakeOp)
+{
+    futex_key_t key2;
+    if (futex_key_get(thread, addr2, &key2) == ERR)
+    {
+        return ERR;
     }
+
+    uint64_t old;
+    if (futex_op_apply(thread, addr2, wakeOp, &old) == ERR)
+    {
+        return ERR;
+    }
+
+    futex_bucket_t* bucket = futex_bucket_get(key);
+    futex_bucket_t* bucket2 = futex_bucket_get(&key2);
+    futex_buckets_lock(bucket, bucket2);
+
+    uint64_t woken = futex_bucket_wake(bucket, key, wake);
+    if (futex_op_compare(wakeOp, old))
+    {
+        woken += futex_bucket_wake(bucket2, &key2, wake2);
+    }
+
+    futex_buckets_unlock(bucket, bucket2);
+    return woken;
+}
+
+static bool futex_owner_is_running(process_t* process, tid_t owner)
+{
+    RCU_READ_SCOPE();
+
+    thread_t* thread;
+    PROCESS_RCU_THREAD_FOR_EACH(thread, process)
+    {
+        if (thread->id == owner)
+        {
+            return sched_is_running(thread);
+        }
+    }
+
+    return false;
+}
+
+/**
+ * For the requeue and wake-op operations, the `timeout` argument is instead used as a second value, the amount of
+ * threads to requeue or to wake up on `addr2`.
+ */
+SYSCALL_DEFINE(SYS_FUTEX, uint64_t, atomic_uint64_t* addr, uint64_t val, futex_op_t op, clock_t timeout,
+    atomic_uint64_t* addr2, uint64_t val3)
+{
+    thread_t* thread = thread_current();
+    process_t* process = thread->process;
+
+    futex_key_t key;
+    if (futex_key_get(thread, addr, &key) == ERR)
+    {
+        return ERR;
+    }
+
+    switch (op)
+    {
+    case FUTEX_WAIT:
+        return futex_wait(thread, addr, &key, val, timeout);
     case FUTEX_WAKE:
+        return futex_wake(&key, val);
+    case FUTEX_SPIN:
     {
-        uint64_t amount = wait_unblock(&futex->queue, val, EOK);
-        if (amount == ERR)
+        if (!(val & FUTEX_LOCKED))
         {
+            errno = EINVAL;
             return ERR;
         }
 
-        return amount;
+        tid_t owner = val & FUTEX_TID_MASK;
+        for (uint64_t spin = 0; spin < CONFIG_MUTEX_MAX_SLOW_SPIN && owner != thread->id; spin++)
+        {
+            uint64_t loadedVal;
+            if (thread_load_atomic_from_user(thread, addr, &loadedVal) == ERR)
+            {
+                return ERR;
+            }
+
+            if (loadedVal != val)
+            {
+                return 0;
+            }
+
+            if (!futex_owner_is_running(process, owner))
+            {
+                break;
+            }
+
+            ASM("pause");
+        }
+
+        errno = EBUSY;
+        return ERR;
     }
+    case FUTEX_REQUEUE:
+        return futex_do_requeue(thread, addr, &key, val, addr2, timeout, false, 0);
+    case FUTEX_CMP_REQUEUE:
+        return futex_do_requeue(thread, addr, &key, val, addr2, timeout, true, val3);
+    case FUTEX_WAKE_OP:
+        return futex_do_wake_op(thread, &key, val, addr2, timeout, val3);
     default:
     {
         errno = EINVAL;
@@ -0,0 +1,212 @@
+#include <kernel/sync/lock.h>
+
+#include <kernel/cpu/cpu.h>
+#include <kernel/cpu/regs.h>
+#include <kernel/log/panic.h>
+#include <kernel/mem/cache.h>
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+typedef struct lock_qnode
+{
+    _Atomic(struct lock_qnode*) next; ///< The waiter queued after us.
+    atomic_bool isHead;               ///< Set by the previous waiter once we are at the head of the queue.
+} ALIGNED(CACHE_LINE) lock_qnode_t;
+
+typedef struct
+{
+    lock_qnode_t nodes[LOCK_QNODES];
+    uint64_t count; ///< The amount of nodes in use, only accessed by the owning CPU with interrupts disabled.
+} lock_qnodes_t;
+
+typedef struct
+{
+    _Atomic(uintptr_t) site;
+    atomic_uint64_t acquires;
+    atomic_uint64_t contended;
+    atomic_uint64_t cycles;
+} lock_profile_entry_t;
+
+// Not stored in per-CPU data as locks are used before per-CPU data is initialized.
+static lock_qnodes_t qnodes[CPU_MAX];
+
+static lock_profile_entry_t profile[CONFIG_LOCK_PROFILE ? LOCK_PROFILE_SITES : 1];
+
+static inline uint32_t lock_tail_encode(cpu_id_t id, uint64_t index)
+{
+    return (uint32_t)(((id + 1) * LOCK_QNODES + index) << LOCK_TAIL_SHIFT);
+}
+
+static inline lock_qnode_t* lock_tail_decode(uint32_t tail)
+{
+    uint32_t value = (tail & LOCK_TAIL_MASK) >> LOCK_TAIL_SHIFT;
+    if (value == 0)
+    {
+        return NULL;
+    }
+
+    return &qnodes[value / LOCK_QNODES - 1].nodes[value % LOCK_QNODES];
+}
+
+#ifndef NDEBUG
+static inline void lock_spin_check(lock_t* lock, uint64_t* iterations)
+{
+    if (lock->canary != LOCK_CANARY)
+    {
+        panic(NULL, "Lock canary corrupted after %d iterations", *iterations);
+    }
+    if (++(*iterations) >= LOCK_DEADLOCK_ITERATIONS)
+    {
+        panic(NULL, "Deadlock detected in lock last acquired from %p", (void*)lock->calledFrom);
+    }
+}
+#endif
+
+void lock_acquire_slow(lock_t* lock, uintptr_t site)
+{
+    uint64_t start = CONFIG_LOCK_PROFILE ? tsc_read() : 0;
+#ifndef NDEBUG
+    uint64_t iterations = 0;
+#endif
+
+    lock_qnodes_t* self = &qnodes[SELF->id];
+    uint64_t index = self->count++;
+    if (index >= LOCK_QNODES)
+    {
+        panic(NULL, "Lock queue nodes exhausted");
+    }
+
+    lock_qnode_t* node = &self->nodes[index];
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&node->isHead, false, memory_order_relaxed);
+    uint32_t tail = lock_tail_encode(SELF->id, index);
+
+    // Swap ourself in as the new tail, unless the lock was released in the meantime.
+    uint32_t old = atomic_load_explicit(&lock->value, memory_order_relaxed);
+    while (true)
+    {
+        if (old == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&lock->value, &old, LOCK_LOCKED, memory_order_acquire,
+                    memory_order_relaxed))
+            {
+                goto acquired;
+            }
+            continue;
+        }
+
+        if (atomic_compare_exchange_weak_explicit(&lock->value, &old, (old & LOCK_LOCKED) | tail,
+                memory_order_acq_rel, memory_order_relaxed))
+        {
+            break;
+        }
+    }
+
+    lock_qnode_t* prev = lock_tail_decode(old);
+    if (prev != NULL)
+    {
+        atomic_store_explicit(&prev->next, node, memory_order_release);
+        while (!atomic_load_explicit(&node->isHead, memory_order_acquire))
+        {
+            ASM("pause");
+#ifndef NDEBUG
+            lock_spin_check(lock, &iterations);
+#endif
+        }
+    }
+
+    // We are the head of the queue, wait for the owner to release the lock.
+    uint32_t value;
+    while ((value = atomic_load_explicit(&lock->value, memory_order_acquire)) & LOCK_LOCKED)
+    {
+        ASM("pause");
+#ifndef NDEBUG
+        lock_spin_check(lock, &iterations);
+#endif
+    }
+
+    // No one else can set the locked bit while the tail is set, so if we are not the last waiter we can just set it.
+    if ((value & LOCK_TAIL_MASK) != tail ||
+        !atomic_compare_exchange_strong_explicit(&lock->value, &value, LOCK_LOCKED, memory_order_acquire,
+            memory_order_relaxed))
+    {
+        atomic_fetch_or_explicit(&lock->value, LOCK_LOCKED, memory_order_acquire);
+
+        lock_qnode_t* next;
+        while ((next = (lock_qnode_t*)atomic_load_explicit(&node->next, memory_order_acquire)) == NULL)
+        {
+            ASM("pause");
+        }
+        atomic_store_explicit(&next->isHead, true, memory_order_release);
+    }
+
+acquired:
+    self->count--;
+
+    if (CONFIG_LOCK_PROFILE)
+    {
+        lock_profile_record(site, true, tsc_read() - start);
+    }
+}
+
+void lock_profile_record(uintptr_t site, bool contended, uint64_t cycles)
+{
+    if (!CONFIG_LOCK_PROFILE)
+    {
+        return;
+    }
+
+    uint64_t hash = (site >> 4) * 0x9E3779B97F4A7C15ULL;
+    for (uint64_t i = 0; i < ARRAY_SIZE(profile); i++)
+    {
+        lock_profile_entry_t* entry = &profile[(hash + i) % ARRAY_SIZE(profile)];
+
+        uintptr_t current = atomic_load_explicit(&entry->site, memory_order_relaxed);
+        if (current == 0 && atomic_compare_exchange_strong(&entry->site, &current, site))
+        {
+            current = site;
+        }
+
+        if (current != site)
+        {
+            continue;
+        }
+
+        atomic_fetch_add_explicit(&entry->acquires, 1, memory_order_relaxed);
+        if (contended)
+        {
+            atomic_fetch_add_explicit(&entry->contended, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&entry->cycles, cycles, memory_order_relaxed);
+        }
+        return;
+    }
+}
+
+uint64_t lock_profile_get(lock_profile_t* out, uint64_t amount)
+{
+    if (!CONFIG_LOCK_PROFILE || out == NULL)
+    {
+        return 0;
+    }
+
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < ARRAY_SIZE(profile) && count < amount; i++)
+    {
+        lock_profile_entry_t* entry = &profile[i];
+
+        uintptr_t site = atomic_load_explicit(&entry->site, memory_order_relaxed);
+        if (site == 0)
+        {
+            continue;
+        }
+
+        out[count].site = site;
+        out[count].acquires = atomic_load_explicit(&entry->acquires, memory_order_relaxed);
+        out[count].contended = atomic_load_explicit(&entry->contended, memory_order_relaxed);
+        out[count].cycles = atomic_load_explicit(&entry->cycles, memory_order_relaxed);
+        count++;
+    }
+
+    return count;
+}
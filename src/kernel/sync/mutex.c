@@ -8,20 +8,24 @@
 #include <kernel/sched/timer.h>
 #include <kernel/sched/wait.h>
 #include <kernel/sync/lock.h>
+#include <kernel/sync/rcu.h>
 
 #include <assert.h>
 
 void mutex_init(mutex_t* mtx)
 {
     wait_queue_init(&mtx->waitQueue);
-    mtx->owner = NULL;
+    atomic_init(&mtx->owner, NULL);
     mtx->depth = 0;
+    atomic_init(&mtx->waiters, 0);
+    atomic_init(&mtx->spinning, false);
+    atomic_init(&mtx->handoff, false);
     lock_init(&mtx->lock);
 }
 
 void mutex_deinit(mutex_t* mtx)
 {
-    assert(mtx->owner == NULL);
+    assert(atomic_load(&mtx->owner) == NULL);
     wait_queue_deinit(&mtx->waitQueue);
 }
 
@@ -32,31 +36,95 @@ void mutex_acquire(mutex_t* mtx)
     UNUSED(isAcquired);
 }
 
+static bool mutex_try_take(mutex_t* mtx, thread_t* self, bool isWaiter)
+{
+    if (!isWaiter && atomic_load(&mtx->handoff))
+    {
+        return false;
+    }
+
+    thread_t* expected = NULL;
+    if (!atomic_compare_exchange_strong(&mtx->owner, &expected, self))
+    {
+        return false;
+    }
+
+    mtx->depth = 1;
+    return true;
+}
+
+static bool mutex_spin(mutex_t* mtx, thread_t* self)
+{
+    bool expected = false;
+    if (!atomic_compare_exchange_strong(&mtx->spinning, &expected, true))
+    {
+        return false;
+    }
+
+    bool isAcquired = false;
+    for (uint64_t spin = 0; spin < CONFIG_MUTEX_MAX_SLOW_SPIN; spin++)
+    {
+        if (mutex_try_take(mtx, self, false))
+        {
+            isAcquired = true;
+            break;
+        }
+
+        if (atomic_load(&mtx->handoff))
+        {
+            break;
+        }
+
+        // The owner can only be freed after a grace period, so it stays valid while we check if its running.
+        rcu_read_lock();
+        thread_t* owner = (thread_t*)atomic_load(&mtx->owner);
+        bool isRunning = owner == NULL || sched_is_running(owner);
+        rcu_read_unlock();
+
+        if (!isRunning)
+        {
+            break;
+        }
+
+        ASM("pause");
+    }
+
+    atomic_store(&mtx->spinning, false);
+    return isAcquired;
+}
+
+static bool mutex_wait_take(mutex_t* mtx, thread_t* self, uint64_t* attempts)
+{
+    // The first attempt is made before blocking, so until then we are a newly arriving thread and must respect the
+    // hand-off to the waiters that have already been woken up.
+    if (mutex_try_take(mtx, self, *attempts > 0))
+    {
+        return true;
+    }
+
+    // Every attempt after the first is made after being woken up, meaning someone else took the mutex before us.
+    if ((*attempts)++ > 0)
+    {
+        atomic_store(&mtx->handoff, true);
+    }
+    return false;
+}
+
 bool mutex_acquire_timeout(mutex_t* mtx, clock_t timeout)
 {
     assert(mtx != NULL);
     thread_t* self = thread_current();
     assert(self != NULL);
 
-    if (mtx->owner == self)
+    if (atomic_load(&mtx->owner) == self)
     {
         mtx->depth++;
         return true;
     }
 
-    uint64_t spin = 0;
-    while (spin < CONFIG_MUTEX_MAX_SLOW_SPIN)
+    if (mutex_try_take(mtx, self, false) || mutex_spin(mtx, self))
     {
-        lock_acquire(&mtx->lock);
-        if (mtx->owner == NULL)
-        {
-            mtx->owner = self;
-            mtx->depth = 1;
-            lock_release(&mtx->lock);
-            return true;
-        }
-        lock_release(&mtx->lock);
-        spin++;
+        return true;
     }
 
     if (timeout == 0)
@@ -64,55 +132,56 @@ bool mutex_acquire_timeout(mutex_t* mtx, clock_t timeout)
         return false;
     }
 
+    uint64_t attempts = 0;
+    lock_acquire(&mtx->lock);
+    atomic_fetch_add(&mtx->waiters, 1);
+
     if (timeout == CLOCKS_NEVER)
     {
-        lock_acquire(&mtx->lock);
-        while (WAIT_BLOCK_LOCK(&mtx->waitQueue, &mtx->lock, mtx->owner == NULL) == ERR)
+        while (WAIT_BLOCK_LOCK(&mtx->waitQueue, &mtx->lock, mutex_wait_take(mtx, self, &attempts)) == ERR)
         {
         }
-
-        mtx->owner = self;
-        mtx->depth = 1;
-        lock_release(&mtx->lock);
-        return true;
     }
-
-    lock_acquire(&mtx->lock);
-    clock_t end = clock_uptime() + timeout;
-    while (true)
+    else if (WAIT_BLOCK_LOCK_TIMEOUT(&mtx->waitQueue, &mtx->lock, mutex_wait_take(mtx, self, &attempts), timeout) ==
+        ERR)
     {
-        clock_t now = clock_uptime();
-        if (now >= end)
+        if (atomic_fetch_sub(&mtx->waiters, 1) == 1)
         {
-            lock_release(&mtx->lock);
-            return false;
+            atomic_store(&mtx->handoff, false);
         }
-
-        clock_t waitTime = end - now;
-        if (WAIT_BLOCK_LOCK_TIMEOUT(&mtx->waitQueue, &mtx->lock, mtx->owner == NULL, waitTime) == ERR)
+        else if (atomic_load(&mtx->owner) == NULL)
         {
-            lock_release(&mtx->lock);
-            return false;
+            // We might have consumed the wake up meant for another waiter.
+            wait_unblock(&mtx->waitQueue, 1, EOK);
         }
-
-        mtx->owner = self;
-        mtx->depth = 1;
         lock_release(&mtx->lock);
-        return true;
+        return false;
     }
+
+    atomic_fetch_sub(&mtx->waiters, 1);
+    atomic_store(&mtx->handoff, false);
+    lock_release(&mtx->lock);
+    return true;
 }
 
 void mutex_release(mutex_t* mtx)
 {
     assert(mtx != NULL);
-    LOCK_SCOPE(&mtx->lock);
-
-    assert(mtx->owner == thread_current_unsafe());
+    assert(atomic_load(&mtx->owner) == thread_current_unsafe());
 
     mtx->depth--;
-    if (mtx->depth == 0)
+    if (mtx->depth > 0)
     {
-        mtx->owner = NULL;
-        wait_unblock(&mtx->waitQueue, 1, EOK);
+        return;
     }
+
+    // Pairs with the increment of `waiters` before a waiter tests the owner, one of us will see the other.
+    atomic_store(&mtx->owner, NULL);
+    if (atomic_load(&mtx->waiters) == 0)
+    {
+        return;
+    }
+
+    LOCK_SCOPE(&mtx->lock);
+    wait_unblock(&mtx->waitQueue, 1, EOK);
 }
@@ -1,32 +1,40 @@
+#include <kernel/config.h>
 #include <kernel/cpu/cpu.h>
 #include <kernel/cpu/ipi.h>
 #include <kernel/log/log.h>
+#include <kernel/log/panic.h>
 #include <kernel/mem/cache.h>
+#include <kernel/sched/clock.h>
+#include <kernel/sched/timer.h>
 #include <kernel/sync/lock.h>
+#include <kernel/sync/mutex.h>
 #include <kernel/sync/rcu.h>
 
+#include <errno.h>
 #include <stdlib.h>
-#include <sys/bitmap.h>
 
-static BITMAP_CREATE_ZERO(ack, CPU_MAX);
-static uint64_t grace = 0;
-static bool active = false;
-static lock_t lock = LOCK_CREATE();
+static _Atomic(uint64_t) gpSeq = ATOMIC_VAR_INIT(0);       ///< The most recently started grace period.
+static _Atomic(uint64_t) gpCompleted = ATOMIC_VAR_INIT(0); ///< The most recently completed grace period.
+static _Atomic(uint64_t) gpPending = ATOMIC_VAR_INIT(0);   ///< CPUs that have yet to report for `gpSeq`.
+static _Atomic(uint16_t) gpCpus = ATOMIC_VAR_INIT(0);      ///< The amount of CPUs participating in `gpSeq`.
+static lock_t startLock = LOCK_CREATE();                   ///< Only used to elect a single CPU to start a period.
 
 typedef struct rcu
 {
-    uint64_t grace;  ///< The last grace period observed by this CPU.
-    list_t* batch;   ///< Callbacks queued during the current grace period.
-    list_t* waiting; ///< Callbacks waiting for the current grace period to end.
-    list_t* ready;   ///< Callbacks whose grace period has ended.
-    list_t lists[3]; //< Buffer storing three lists such that we can rotate them.
+    _Atomic(uint64_t) qsGp; ///< The last grace period this CPU reported a quiescent state for, zeroed on boot.
+    uint64_t waitingGp;     ///< The grace period that must complete before `waiting` can be invoked.
+    list_t* batch;          ///< Callbacks queued since `waiting` was filled.
+    list_t* waiting;        ///< Callbacks waiting for `waitingGp` to complete.
+    list_t* ready;          ///< Callbacks whose grace period has ended.
+    list_t lists[3];        ///< Buffer storing three lists such that we can rotate them.
+    rcu_entry_t barrier;    ///< Entry queued by `rcu_barrier()`.
 } rcu_t;
 
 PERCPU_DEFINE_CTOR(static rcu_t, pcpu_rcu)
 {
     rcu_t* rcu = SELF_PTR(pcpu_rcu);
 
-    rcu->grace = 0;
+    rcu->waitingGp = 0;
     rcu->batch = &rcu->lists[0];
     rcu->waiting = &rcu->lists[1];
     rcu->ready = &rcu->lists[2];
@@ -85,104 +93,208 @@ void rcu_call(rcu_entry_t* entry, rcu_callback_t func, void* arg)
     list_push_back(pcpu_rcu->batch, &entry->entry);
 }
 
-static bool rcu_check_quiescent(void)
+typedef struct
+{
+    _Atomic(uint64_t) remaining;
+    wait_queue_t wait;
+} rcu_barrier_t;
+
+static mutex_t barrierMutex = MUTEX_CREATE(barrierMutex);
+
+static void rcu_barrier_callback(void* arg)
 {
-    lock_acquire(&lock);
-    if (active && bitmap_is_set(&ack, SELF->id))
+    rcu_barrier_t* barrier = (rcu_barrier_t*)arg;
+    if (atomic_fetch_sub(&barrier->remaining, 1) == 1)
     {
-        bitmap_clear(&ack, SELF->id);
+        wait_unblock(&barrier->wait, WAIT_ALL, EOK);
+    }
+}
+
+static void rcu_barrier_queue(rcu_barrier_t* barrier)
+{
+    rcu_t* rcu = SELF_PTR(pcpu_rcu);
+    rcu_call(&rcu->barrier, rcu_barrier_callback, barrier);
+}
+
+static void rcu_barrier_ipi(ipi_func_data_t* data)
+{
+    rcu_barrier_queue((rcu_barrier_t*)data->data);
+}
+
+void rcu_barrier(void)
+{
+    MUTEX_SCOPE(&barrierMutex);
+
+    rcu_barrier_t barrier;
+    atomic_init(&barrier.remaining, cpu_amount() + 1);
+    wait_queue_init(&barrier.wait);
 
-        if (bitmap_is_empty(&ack))
+    cpu_t* cpu;
+    CPU_FOR_EACH(cpu)
+    {
+        if (cpu == SELF->self)
         {
-            active = false;
+            continue;
         }
-    }
 
-    bool wake = false;
-    if (!list_is_empty(pcpu_rcu->waiting))
-    {
-        if (grace > pcpu_rcu->grace || (grace == pcpu_rcu->grace && !active))
+        while (ipi_send(cpu, IPI_SINGLE, rcu_barrier_ipi, &barrier) == ERR)
         {
-            wake = true;
+            if (errno != EBUSY)
+            {
+                panic(NULL, "Failed to queue rcu barrier on cpu %u\n", cpu->id);
+            }
+            sched_yield();
         }
     }
-    lock_release(&lock);
-    return wake;
+
+    cli_push();
+    rcu_barrier_queue(&barrier);
+    cli_pop();
+
+    rcu_barrier_callback(&barrier);
+    WAIT_BLOCK(&barrier.wait, atomic_load(&barrier.remaining) == 0);
+
+    wait_queue_deinit(&barrier.wait);
 }
 
-static void rcu_advance(bool wake)
+/**
+ * Reports a quiescent state for `rcu` in the current grace period, exactly one report per CPU will decrement the
+ * pending counter as the `qsGp` compare and exchange can only succeed once per period.
+ *
+ * The sequence is loaded before the amount of participating CPUs, which is stored before the sequence in
+ * `rcu_start_grace()`, such that we never see a new sequence with a stale CPU amount.
+ */
+static void rcu_report(rcu_t* rcu, cpu_id_t id)
 {
-    if (wake)
+    uint64_t gp = atomic_load(&gpSeq);
+    uint16_t cpus = atomic_load(&gpCpus);
+    if (gp == atomic_load(&gpCompleted) || id >= cpus)
     {
-        list_t* temp = pcpu_rcu->ready;
-        pcpu_rcu->ready = pcpu_rcu->waiting;
-        pcpu_rcu->waiting = temp;
+        return;
     }
 
-    if (list_is_empty(pcpu_rcu->waiting) && !list_is_empty(pcpu_rcu->batch))
+    uint64_t qs = atomic_load(&rcu->qsGp);
+    while (qs < gp)
     {
-        list_t* temp = pcpu_rcu->waiting;
-        pcpu_rcu->waiting = pcpu_rcu->batch;
-        pcpu_rcu->batch = temp;
-
-        lock_acquire(&lock);
-        pcpu_rcu->grace = grace + 1;
-        lock_release(&lock);
-        pcpu_rcu->grace = active ? grace : grace + 1;
+        if (atomic_compare_exchange_weak(&rcu->qsGp, &qs, gp))
+        {
+            if (atomic_fetch_sub(&gpPending, 1) == 1)
+            {
+                atomic_store(&gpCompleted, gp);
+            }
+            return;
+        }
     }
 }
 
 static void rcu_start_grace(void)
 {
-    if (list_is_empty(pcpu_rcu->waiting))
+    if (atomic_load(&gpSeq) != atomic_load(&gpCompleted) || !lock_try_acquire(&startLock))
     {
         return;
     }
 
-    LOCK_SCOPE(&lock);
-    if (active)
+    uint64_t gp = atomic_load(&gpSeq);
+    if (gp != atomic_load(&gpCompleted))
     {
+        lock_release(&startLock);
         return;
     }
 
-    active = true;
-    grace++;
+    // The extra pending reference prevents the period from completing before we have reported for the idle CPUs.
+    uint16_t cpus = cpu_amount();
+    atomic_store(&gpPending, (uint64_t)cpus + 1);
+    atomic_store(&gpCpus, cpus);
+    atomic_store(&gpSeq, gp + 1);
+    lock_release(&startLock);
 
-    bitmap_set_range(&ack, 0, cpu_amount());
     cpu_t* cpu;
     CPU_FOR_EACH(cpu)
     {
-        if (!sched_is_idle(cpu))
+        if (cpu->id >= cpus || (cpu != SELF->self && !sched_is_idle(cpu)))
         {
             continue;
         }
 
-        bitmap_clear(&ack, cpu->id);
+        rcu_report(CPU_PTR(cpu->id, pcpu_rcu), cpu->id);
+    }
+
+    if (atomic_fetch_sub(&gpPending, 1) == 1)
+    {
+        atomic_store(&gpCompleted, gp + 1);
     }
 }
 
-static void rcu_invoke_callbacks(void)
+static void rcu_advance(rcu_t* rcu)
 {
-    while (!list_is_empty(pcpu_rcu->ready))
+    if (list_is_empty(rcu->ready) && !list_is_empty(rcu->waiting) && atomic_load(&gpCompleted) >= rcu->waitingGp)
+    {
+        list_t* temp = rcu->ready;
+        rcu->ready = rcu->waiting;
+        rcu->waiting = temp;
+    }
+
+    if (list_is_empty(rcu->waiting) && !list_is_empty(rcu->batch))
     {
-        rcu_entry_t* entry = CONTAINER_OF(list_pop_front(pcpu_rcu->ready), rcu_entry_t, entry);
+        list_t* temp = rcu->waiting;
+        rcu->waiting = rcu->batch;
+        rcu->batch = temp;
+
+        // Callbacks queued now may predate the reads of an already running grace period, so wait for the next one.
+        rcu->waitingGp = atomic_load(&gpSeq) + 1;
+    }
+}
+
+static bool rcu_invoke_callbacks(rcu_t* rcu, uint64_t* budget)
+{
+    while (!list_is_empty(rcu->ready))
+    {
+        if (*budget == 0)
+        {
+            return false;
+        }
+        (*budget)--;
+
+        rcu_entry_t* entry = CONTAINER_OF(list_pop_front(rcu->ready), rcu_entry_t, entry);
         entry->func(entry->arg);
     }
+
+    return true;
 }
 
 void rcu_report_quiescent(void)
 {
     assert(!(rflags_read() & RFLAGS_INTERRUPT_ENABLE));
 
-    bool wake = rcu_check_quiescent();
-
-    rcu_invoke_callbacks();
+    rcu_t* rcu = SELF_PTR(pcpu_rcu);
+    rcu_report(rcu, SELF->id);
 
-    rcu_advance(wake);
+    uint64_t budget = CONFIG_RCU_BATCH_MAX;
+    if (rcu_invoke_callbacks(rcu, &budget))
+    {
+        rcu_advance(rcu);
+        if (rcu_invoke_callbacks(rcu, &budget))
+        {
+            rcu_advance(rcu);
+        }
+    }
 
-    rcu_invoke_callbacks();
+    if (!list_is_empty(rcu->ready))
+    {
+        clock_t uptime = clock_uptime();
+        timer_set(uptime, uptime + CONFIG_MIN_TIMER_TIMEOUT);
+    }
+    else if (!list_is_empty(rcu->waiting))
+    {
+        // A CPU without a periodic tick might otherwise never notice that the grace period has completed.
+        clock_t uptime = clock_uptime();
+        timer_set(uptime, uptime + CONFIG_RCU_POLL_INTERVAL);
+    }
 
-    rcu_start_grace();
+    if (!list_is_empty(rcu->waiting) && atomic_load(&gpCompleted) < rcu->waitingGp)
+    {
+        rcu_start_grace();
+    }
 }
 
 void rcu_call_free(void* arg)
@@ -193,4 +305,4 @@ void rcu_call_free(void* arg)
 void rcu_call_cache_free(void* arg)
 {
     cache_free(arg);
-}
\ No newline at end of file
+}
@@ -32,11 +32,40 @@ void _heap_unmap_memory(void* addr, uint64_t size)
 
 #else
 
+#include "user/common/threading.h"
+
 #include <stdlib.h>
 #include <threads.h>
 
 mtx_t _heapLock;
 
+static _heap_cache_t* _heap_cache_begin(void)
+{
+    _thread_t* thread = _THREAD_SELF->self;
+    if (thread->heapCache != NULL)
+    {
+        return thread->heapCache;
+    }
+
+    // The cache of an exiting thread has already been flushed, dont allocate a new one.
+    if (thread->isExiting)
+    {
+        return NULL;
+    }
+
+    _heap_acquire();
+    _heap_header_t* block = _heap_alloc(sizeof(_heap_cache_t));
+    _heap_release();
+    if (block == NULL)
+    {
+        return NULL;
+    }
+
+    memset(block->data, 0, sizeof(_heap_cache_t));
+    thread->heapCache = (_heap_cache_t*)block->data;
+    return thread->heapCache;
+}
+
 static fd_t zeroDev = ERR;
 
 void* _heap_map_memory(uint64_t size)
@@ -311,3 +340,108 @@ void _heap_free(_heap_header_t* block)
 
     _heap_add_to_free_list(block);
 }
+
+#ifndef _KERNEL_
+
+_heap_header_t* _heap_cache_alloc(uint64_t size)
+{
+    if (size == 0 || size > _HEAP_CACHE_MAX_SIZE)
+    {
+        return NULL;
+    }
+
+    size = ROUND_UP(size, _HEAP_ALIGNMENT);
+
+    _heap_cache_t* cache = _heap_cache_begin();
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+
+    _heap_magazine_t* magazine = &cache->magazines[_heap_get_bin_index(size)];
+    if (magazine->count == 0)
+    {
+        _heap_acquire();
+        while (magazine->count < _HEAP_MAGAZINE_BATCH)
+        {
+            _heap_header_t* block = _heap_alloc(size);
+            if (block == NULL)
+            {
+                break;
+            }
+            block->flags |= _HEAP_CACHED;
+            magazine->rounds[magazine->count++] = block;
+        }
+        _heap_release();
+
+        if (magazine->count == 0)
+        {
+            return NULL;
+        }
+    }
+
+    _heap_header_t* block = magazine->rounds[--magazine->count];
+    block->flags &= ~_HEAP_CACHED;
+    return block;
+}
+
+static void _heap_magazine_flush(_heap_magazine_t* magazine, uint64_t amount)
+{
+    // The oldest blocks are at the bottom of the magazine, flush those first to keep the most recently used (and most
+    // likely cache hot) blocks in the magazine.
+    for (uint64_t i = 0; i < amount; i++)
+    {
+        magazine->rounds[i]->flags &= ~_HEAP_CACHED;
+        _heap_free(magazine->rounds[i]);
+    }
+
+    memmove(&magazine->rounds[0], &magazine->rounds[amount], (magazine->count - amount) * sizeof(_heap_header_t*));
+    magazine->count -= amount;
+}
+
+bool _heap_cache_free(_heap_header_t* block)
+{
+    if ((block->flags & _HEAP_MAPPED) || block->size > _HEAP_CACHE_MAX_SIZE)
+    {
+        return false;
+    }
+
+    _heap_cache_t* cache = _heap_cache_begin();
+    if (cache == NULL)
+    {
+        return false;
+    }
+
+    _heap_magazine_t* magazine = &cache->magazines[_heap_get_bin_index(block->size)];
+    if (magazine->count == _HEAP_MAGAZINE_SIZE)
+    {
+        _heap_acquire();
+        _heap_magazine_flush(magazine, _HEAP_MAGAZINE_BATCH);
+        _heap_release();
+    }
+
+    block->flags |= _HEAP_CACHED;
+    magazine->rounds[magazine->count++] = block;
+    return true;
+}
+
+void _heap_cache_flush(void)
+{
+    _heap_cache_t* cache = _THREAD_SELF->self->heapCache;
+    if (cache == NULL)
+    {
+        return;
+    }
+
+    _heap_acquire();
+    for (uint64_t i = 0; i < _HEAP_CACHE_BINS; i++)
+    {
+        _heap_magazine_flush(&cache->magazines[i], cache->magazines[i].count);
+    }
+
+    _THREAD_SELF->self->heapCache = NULL;
+    _heap_free(CONTAINER_OF(cache, _heap_header_t, data));
+    _heap_release();
+}
+
+#endif
@@ -28,7 +28,23 @@
  * Included is the internal heap allocation, the functions that the kernel and user space should use are the expected
  * `malloc()`, `free()`, `realloc()`, etc functions.
  *
- * @todo Implement a slab allocator.
+ * ## Magazines
+ *
+ * To avoid the heap lock becoming a global serialization point, in user space small blocks (up to
+ * `_HEAP_CACHE_MAX_SIZE`) are cached in "magazines", small LIFO stacks of free blocks, one per small bin. Each thread
+ * has its own set of magazines.
+ *
+ * Allocations and frees are served from the magazines without taking the heap lock, only when a magazine is empty
+ * (refill) or full (flush) do we acquire the heap lock to move a batch of blocks to or from the global free lists.
+ *
+ * Blocks in a magazine remain marked as `_HEAP_ALLOCATED` from the perspective of the global heap, so they will not be
+ * coalesced, and are additionally marked as `_HEAP_CACHED` to allow for double free detection.
+ *
+ * ## Kernel Size Classes
+ *
+ * In the kernel, allocations up to `CACHE_SIZE_CLASS_MAX` bytes never reach the heap, instead they are served by the
+ * size class caches of the slab allocator, see `cache_alloc_size()`. Such allocations have no header, `free()` and
+ * `realloc()` identify them by their address using `cache_is_object()`.
  *
  * @{
  */
@@ -63,6 +79,7 @@ typedef enum
     _HEAP_ALLOCATED = 1 << 0, ///< Block is allocated.
     _HEAP_MAPPED = 1 << 1,    ///< Block is not on the heap, but mapped directly, used for large allocations.
     _HEAP_ZEROED = 1 << 2,    ///< Block is zeroed.
+    _HEAP_CACHED = 1 << 3,    ///< Block is free but stored in a magazine.
 } _heap_flags_t;
 
 /**
@@ -85,6 +102,47 @@ typedef struct ALIGNED(_HEAP_ALIGNMENT) _heap_header
 
 static_assert(sizeof(_heap_header_t) % _HEAP_ALIGNMENT == 0, "_heap_header_t size must be multiple of 64");
 
+/**
+ * The maximum block size, in bytes, that will be cached in magazines.
+ */
+#define _HEAP_CACHE_MAX_SIZE 1024
+
+/**
+ * The number of bins that have magazines, the first `_HEAP_CACHE_BINS` bins of the global heap.
+ */
+#define _HEAP_CACHE_BINS (_HEAP_CACHE_MAX_SIZE / _HEAP_ALIGNMENT)
+
+/**
+ * The maximum number of blocks stored in a single magazine.
+ */
+#define _HEAP_MAGAZINE_SIZE 16
+
+/**
+ * The number of blocks moved between a magazine and the global heap during a refill or flush.
+ */
+#define _HEAP_MAGAZINE_BATCH (_HEAP_MAGAZINE_SIZE / 2)
+
+/**
+ * @brief A magazine of free blocks of a single bin.
+ * @struct _heap_magazine_t
+ */
+typedef struct
+{
+    uint64_t count;
+    _heap_header_t* rounds[_HEAP_MAGAZINE_SIZE];
+} _heap_magazine_t;
+
+/**
+ * @brief A set of magazines, one per small bin.
+ * @struct _heap_cache_t
+ *
+ * There is one cache per thread.
+ */
+typedef struct _heap_cache
+{
+    _heap_magazine_t magazines[_HEAP_CACHE_BINS];
+} _heap_cache_t;
+
 /**
  * @brief A list of all blocks sorted by address.
  */
@@ -202,6 +260,40 @@ _heap_header_t* _heap_alloc(uint64_t size);
  */
 void _heap_free(_heap_header_t* block);
 
+#ifndef _KERNEL_
+
+/**
+ * @brief Allocates a block from the magazine of the current thread.
+ *
+ * Must be called without the heap acquired, the heap will be acquired if the magazine needs to be refilled.
+ *
+ * @param size The size of memory to allocate, in bytes.
+ * @return On success, pointer to the allocated heap block header. On failure, or if `size` is too large to be cached,
+ * `NULL`.
+ */
+_heap_header_t* _heap_cache_alloc(uint64_t size);
+
+/**
+ * @brief Frees a block to the magazine of the current thread.
+ *
+ * Must be called without the heap acquired, the heap will be acquired if the magazine needs to be flushed.
+ *
+ * @param block The block to free.
+ * @return `true` if the block was stored in a magazine, `false` if it should be freed using `_heap_free()`.
+ */
+bool _heap_cache_free(_heap_header_t* block);
+
+/**
+ * @brief Flushes all magazines of the current thread back to the global heap and frees the cache itself.
+ *
+ * Intended to be called when a thread exits.
+ *
+ * Must be called without the heap acquired.
+ */
+void _heap_cache_flush(void);
+
+#endif
+
 /**
  * @brief Directly maps memory of the given size.
  *
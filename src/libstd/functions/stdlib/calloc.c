@@ -3,6 +3,10 @@
 
 #include "common/heap.h"
 
+#ifdef _KERNEL_
+#include <kernel/mem/cache.h>
+#endif
+
 void* calloc(size_t nmemb, size_t size)
 {
     size_t totalSize = nmemb * size;
@@ -11,6 +15,30 @@ void* calloc(size_t nmemb, size_t size)
         return NULL;
     }
 
+#ifdef _KERNEL_
+    if (totalSize != 0 && totalSize <= CACHE_SIZE_CLASS_MAX)
+    {
+        void* ptr = cache_alloc_size(totalSize);
+        if (ptr == NULL)
+        {
+            return NULL;
+        }
+        memset(ptr, 0, totalSize);
+        return ptr;
+    }
+#else
+    _heap_header_t* cached = _heap_cache_alloc(totalSize);
+    if (cached != NULL)
+    {
+        if (!(cached->flags & _HEAP_ZEROED))
+        {
+            memset(cached->data, 0, totalSize);
+        }
+        cached->flags &= ~_HEAP_ZEROED;
+        return cached->data;
+    }
+#endif
+
     _heap_acquire();
 
     _heap_header_t* block = _heap_alloc(totalSize);
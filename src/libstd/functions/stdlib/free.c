@@ -4,6 +4,7 @@
 
 #ifdef _KERNEL_
 #include <kernel/log/panic.h>
+#include <kernel/mem/cache.h>
 #else
 #include <stdio.h>
 #endif
@@ -15,7 +16,13 @@ void free(void* ptr)
         return;
     }
 
-    _heap_acquire();
+#ifdef _KERNEL_
+    if (cache_is_object(ptr))
+    {
+        cache_free(ptr);
+        return;
+    }
+#endif
 
     _heap_header_t* block = CONTAINER_OF(ptr, _heap_header_t, data);
 
@@ -29,7 +36,7 @@ void free(void* ptr)
 #endif
     }
 
-    if (!(block->flags & _HEAP_ALLOCATED))
+    if (!(block->flags & _HEAP_ALLOCATED) || (block->flags & _HEAP_CACHED))
     {
 #ifdef _KERNEL_
         panic(NULL, "double free detected in free()");
@@ -39,6 +46,14 @@ void free(void* ptr)
 #endif
     }
 
+#ifndef _KERNEL_
+    if (_heap_cache_free(block))
+    {
+        return;
+    }
+#endif
+
+    _heap_acquire();
     _heap_free(block);
     _heap_release();
 }
@@ -2,8 +2,26 @@
 
 #include "common/heap.h"
 
+#ifdef _KERNEL_
+#include <kernel/mem/cache.h>
+#endif
+
 void* malloc(size_t size)
 {
+#ifdef _KERNEL_
+    if (size != 0 && size <= CACHE_SIZE_CLASS_MAX)
+    {
+        return cache_alloc_size(size);
+    }
+#else
+    _heap_header_t* cached = _heap_cache_alloc(size);
+    if (cached != NULL)
+    {
+        cached->flags &= ~_HEAP_ZEROED;
+        return cached->data;
+    }
+#endif
+
     _heap_acquire();
 
     _heap_header_t* block = _heap_alloc(size);
@@ -6,6 +6,7 @@
 
 #ifdef _KERNEL_
 #include <kernel/log/panic.h>
+#include <kernel/mem/cache.h>
 #else
 #include <stdio.h>
 #endif
@@ -23,6 +24,26 @@ void* realloc(void* ptr, size_t size)
         return NULL;
     }
 
+#ifdef _KERNEL_
+    if (cache_is_object(ptr))
+    {
+        size_t objectSize = cache_object_size(ptr);
+        if (size <= objectSize)
+        {
+            return ptr;
+        }
+
+        void* newPtr = malloc(size);
+        if (newPtr == NULL)
+        {
+            return NULL;
+        }
+        memcpy(newPtr, ptr, objectSize);
+        cache_free(ptr);
+        return newPtr;
+    }
+#endif
+
     _heap_acquire();
 
     _heap_header_t* block = CONTAINER_OF(ptr, _heap_header_t, data);
@@ -36,7 +57,7 @@ void* realloc(void* ptr, size_t size)
 #endif
     }
 
-    if (!(block->flags & _HEAP_ALLOCATED))
+    if (!(block->flags & _HEAP_ALLOCATED) || (block->flags & _HEAP_CACHED))
     {
 #ifdef _KERNEL_
         panic(NULL, "double free detected in free()");
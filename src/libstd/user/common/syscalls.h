@@ -214,9 +214,11 @@ static inline fd_t _syscall_dup2(fd_t oldFd, fd_t newFd)
     return _SYSCALL2(fd_t, SYS_DUP2, fd_t, oldFd, fd_t, newFd);
 }
 
-static inline uint64_t _syscall_futex(atomic_uint64_t* addr, uint64_t val, futex_op_t op, clock_t timeout)
+static inline uint64_t _syscall_futex(atomic_uint64_t* addr, uint64_t val, futex_op_t op, clock_t timeout,
+    atomic_uint64_t* addr2, uint64_t val3)
 {
-    return _SYSCALL4(uint64_t, SYS_FUTEX, atomic_uint64_t*, addr, uint64_t, val, futex_op_t, op, clock_t, timeout);
+    return _SYSCALL6(uint64_t, SYS_FUTEX, atomic_uint64_t*, addr, uint64_t, val, futex_op_t, op, clock_t, timeout,
+        atomic_uint64_t*, addr2, uint64_t, val3);
 }
 
 static inline uint64_t _syscall_remove(const char* path)
@@ -58,6 +58,8 @@ static void _thread_init(_thread_t* thread)
     thread->err = EOK;
     thread->func = NULL;
     thread->arg = NULL;
+    thread->heapCache = NULL;
+    thread->isExiting = false;
 }
 
 void _threading_init(void)
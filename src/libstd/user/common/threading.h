@@ -20,10 +20,28 @@
 
 #define _MTX_SPIN_COUNT 100
 
+#define _MTX_UNLOCKED 0
+#define _MTX_LOCKED FUTEX_LOCKED
+#define _MTX_CONTESTED FUTEX_WAITERS
+#define _MTX_OWNER(state) ((state) & FUTEX_TID_MASK)
+
+/**
+ * @brief Acquire a mutex by waiting on its futex, without first spinning.
+ *
+ * Always leaves the mutex contested, used by `mtx_lock()` once spinning failed and by `cnd_wait()` as a thread woken
+ * by `cnd_broadcast()` might have been requeued onto the futex of the mutex.
+ *
+ * If `isWoken` is set the caller was woken from a futex wait, such a thread might have been woken by `mtx_unlock()`
+ * after being requeued, so it may take the mutex while it is being handed off.
+ */
+int _mtx_lock_contended(mtx_t* mutex, tid_t self, bool isWoken);
+
 #define _THREADS_MAX 2048
 
 typedef struct _thread _thread_t;
 
+typedef struct _heap_cache _heap_cache_t;
+
 typedef void (*_thread_entry_t)(_thread_t*);
 
 #define _THREAD_ATTACHED 1
@@ -40,6 +58,8 @@ typedef struct _thread
     errno_t err;
     thrd_start_t func;
     void* arg;
+    _heap_cache_t* heapCache; ///< Per-thread heap magazines, allocated on first use.
+    bool isExiting;           ///< Set before the heap cache is flushed on exit, stops it from being allocated again.
 } _thread_t;
 
 void _threading_init(void);
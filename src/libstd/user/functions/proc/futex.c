@@ -5,7 +5,7 @@
 
 uint64_t futex(atomic_uint64_t* addr, uint64_t val, futex_op_t op, clock_t timeout)
 {
-    uint64_t result = _syscall_futex(addr, val, op, timeout);
+    uint64_t result = _syscall_futex(addr, val, op, timeout, NULL, 0);
     if (result == ERR)
     {
         errno = _syscall_errno();
@@ -0,0 +1,21 @@
+#include <stdio.h>
+#include <sys/fs.h>
+
+#include "user/common/syscalls.h"
+
+uint64_t futex_requeue(atomic_uint64_t* addr, uint64_t wake, atomic_uint64_t* addr2, uint64_t requeue, futex_op_t op,
+    uint64_t cmp)
+{
+    if (op != FUTEX_REQUEUE && op != FUTEX_CMP_REQUEUE)
+    {
+        errno = EINVAL;
+        return ERR;
+    }
+
+    uint64_t result = _syscall_futex(addr, wake, op, requeue, addr2, cmp);
+    if (result == ERR)
+    {
+        errno = _syscall_errno();
+    }
+    return result;
+}
@@ -0,0 +1,14 @@
+#include <stdio.h>
+#include <sys/fs.h>
+
+#include "user/common/syscalls.h"
+
+uint64_t futex_wake_op(atomic_uint64_t* addr, uint64_t wake, atomic_uint64_t* addr2, uint64_t wake2, uint64_t wakeOp)
+{
+    uint64_t result = _syscall_futex(addr, wake, FUTEX_WAKE_OP, wake2, addr2, wakeOp);
+    if (result == ERR)
+    {
+        errno = _syscall_errno();
+    }
+    return result;
+}
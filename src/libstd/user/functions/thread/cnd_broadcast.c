@@ -0,0 +1,28 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/proc.h>
+#include <threads.h>
+
+#include "user/common/syscalls.h"
+#include "user/common/threading.h"
+
+int cnd_broadcast(cnd_t* cond)
+{
+    uint64_t seq = atomic_fetch_add(&cond->seq, 1) + 1;
+    mtx_t* mutex = (mtx_t*)atomic_load(&cond->mtx);
+
+    // Wake a single waiter and move the rest onto the mutex, they would otherwise all just contend on it. The woken
+    // waiter leaves the mutex contested, so each unlock wakes the next requeued waiter.
+    if (mutex != NULL && futex_requeue(&cond->seq, 1, &mutex->state, FUTEX_ALL, FUTEX_CMP_REQUEUE, seq) != ERR)
+    {
+        return thrd_success;
+    }
+
+    // Either no thread has waited yet or the sequence changed under us, in both cases just wake everyone.
+    if (futex(&cond->seq, FUTEX_ALL, FUTEX_WAKE, CLOCKS_NEVER) == ERR)
+    {
+        return thrd_error;
+    }
+    return thrd_success;
+}
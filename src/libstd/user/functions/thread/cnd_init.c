@@ -0,0 +1,16 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/proc.h>
+#include <threads.h>
+
+#include "user/common/syscalls.h"
+#include "user/common/threading.h"
+
+int cnd_init(cnd_t* cond)
+{
+    atomic_init(&cond->seq, 0);
+    atomic_init(&cond->mtx, NULL);
+
+    return thrd_success;
+}
@@ -0,0 +1,18 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/proc.h>
+#include <threads.h>
+
+#include "user/common/syscalls.h"
+#include "user/common/threading.h"
+
+int cnd_signal(cnd_t* cond)
+{
+    atomic_fetch_add(&cond->seq, 1);
+    if (futex(&cond->seq, 1, FUTEX_WAKE, CLOCKS_NEVER) == ERR)
+    {
+        return thrd_error;
+    }
+    return thrd_success;
+}
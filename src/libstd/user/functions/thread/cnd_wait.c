@@ -0,0 +1,34 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/proc.h>
+#include <threads.h>
+
+#include "user/common/syscalls.h"
+#include "user/common/threading.h"
+
+int cnd_wait(cnd_t* cond, mtx_t* mutex)
+{
+    tid_t self = gettid();
+    uint64_t state = atomic_load(&(mutex->state));
+    if (state == _MTX_UNLOCKED || _MTX_OWNER(state) != self)
+    {
+        return thrd_error;
+    }
+
+    uint64_t seq = atomic_load(&cond->seq);
+    atomic_store(&cond->mtx, mutex);
+
+    uint64_t depth = mutex->depth;
+    mutex->depth = 1;
+    mtx_unlock(mutex);
+
+    // Fails with EAGAIN if we were signaled before we could start waiting, which is fine.
+    bool isWoken = futex(&cond->seq, seq, FUTEX_WAIT, CLOCKS_NEVER) != ERR;
+
+    // We might have been requeued onto the mutex by cnd_broadcast() and then woken by mtx_unlock(), in which case the
+    // wake was meant for a waiter of the mutex, so we must be allowed to take it even while it is being handed off.
+    _mtx_lock_contended(mutex, self, isWoken);
+    mutex->depth = depth;
+    return thrd_success;
+}
@@ -14,8 +14,8 @@ int mtx_init(mtx_t* mutex, int type)
                   // just say that it works.
 
     atomic_init(&mutex->state, _MTX_UNLOCKED);
-    mutex->owner = ERR;
     mutex->depth = 0;
+    atomic_init(&mutex->handoff, false);
 
     return thrd_success;
 }
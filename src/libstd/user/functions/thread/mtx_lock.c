@@ -11,38 +11,84 @@
 int mtx_lock(mtx_t* mutex)
 {
     tid_t self = gettid();
-    if (mutex->owner == self)
+    uint64_t state = atomic_load(&(mutex->state));
+    if (state != _MTX_UNLOCKED && _MTX_OWNER(state) == self)
     {
         mutex->depth++;
         return thrd_success;
     }
 
+    // Only the kernel knows if the owner is running, so let it decide how long to spin.
     for (uint64_t i = 0; i < _MTX_SPIN_COUNT; i++)
     {
-        uint64_t expected = _MTX_UNLOCKED;
-        if (atomic_compare_exchange_strong(&(mutex->state), &expected, _MTX_LOCKED))
+        state = atomic_load(&(mutex->state));
+        if (state == _MTX_UNLOCKED)
         {
-            mutex->owner = self;
-            mutex->depth = 1;
-            return thrd_success;
+            if (atomic_load(&(mutex->handoff)))
+            {
+                break;
+            }
+
+            if (atomic_compare_exchange_strong(&(mutex->state), &state, _MTX_LOCKED | self))
+            {
+                mutex->depth = 1;
+                return thrd_success;
+            }
+            continue;
+        }
+
+        if (futex(&(mutex->state), state, FUTEX_SPIN, CLOCKS_NEVER) == ERR)
+        {
+            break;
         }
-        ASM("pause");
     }
 
-    do
+    return _mtx_lock_contended(mutex, self, false);
+}
+
+int _mtx_lock_contended(mtx_t* mutex, tid_t self, bool isWoken)
+{
+    while (1)
     {
+        // While the mutex is being handed off, only a waiter that has already been woken may take it.
+        bool isHandoff = !isWoken && atomic_load(&(mutex->handoff));
+
+        // Other waiters might still be sleeping, so a waiter always leaves the mutex contested.
         uint64_t expected = _MTX_UNLOCKED;
-        if (atomic_compare_exchange_strong(&(mutex->state), &expected, _MTX_LOCKED))
+        if (!isHandoff &&
+            atomic_compare_exchange_strong(&(mutex->state), &expected, _MTX_LOCKED | _MTX_CONTESTED | self))
         {
-            mutex->owner = self;
             mutex->depth = 1;
+            atomic_store(&(mutex->handoff), false);
             return thrd_success;
         }
 
-        if (expected == _MTX_LOCKED)
+        if (isHandoff)
         {
-            atomic_compare_exchange_strong(&(mutex->state), &expected, _MTX_CONTESTED);
+            // Sleeping on the unlocked state would leave us queued without the mutex being marked as contested, such
+            // that a later release might never wake us, so let the woken waiter run instead.
+            expected = atomic_load(&(mutex->state));
+            if (expected == _MTX_UNLOCKED)
+            {
+                thrd_yield();
+                continue;
+            }
         }
-        futex(&(mutex->state), _MTX_CONTESTED, FUTEX_WAIT, CLOCKS_NEVER);
-    } while (1);
+
+        if (isWoken)
+        {
+            atomic_store(&(mutex->handoff), true);
+        }
+
+        if (!(expected & _MTX_CONTESTED) &&
+            !atomic_compare_exchange_strong(&(mutex->state), &expected, expected | _MTX_CONTESTED))
+        {
+            continue;
+        }
+
+        if (futex(&(mutex->state), expected | _MTX_CONTESTED, FUTEX_WAIT, CLOCKS_NEVER) != ERR)
+        {
+            isWoken = true;
+        }
+    }
 }
@@ -10,7 +10,8 @@
 int mtx_unlock(mtx_t* mutex)
 {
     tid_t self = gettid();
-    if (mutex->owner != self)
+    uint64_t state = atomic_load(&(mutex->state));
+    if (state == _MTX_UNLOCKED || _MTX_OWNER(state) != self)
     {
         return thrd_error;
     }
@@ -20,9 +21,8 @@ int mtx_unlock(mtx_t* mutex)
     {
         return thrd_success;
     }
-    mutex->owner = ERR;
 
-    if (atomic_exchange(&(mutex->state), _MTX_UNLOCKED) == _MTX_CONTESTED)
+    if (atomic_exchange(&(mutex->state), _MTX_UNLOCKED) & _MTX_CONTESTED)
     {
         futex(&(mutex->state), 1, FUTEX_WAKE, CLOCKS_NEVER);
     }
@@ -5,6 +5,7 @@
 #include <sys/proc.h>
 #include <threads.h>
 
+#include "common/heap.h"
 #include "user/common/syscalls.h"
 #include "user/common/threading.h"
 
@@ -19,6 +20,11 @@ void thrd_exit(int res)
 
     thread->result = res;
 
+    // Must be done before the thread is marked as exited, as a joining thread might free it. The cache can't be
+    // allocated again once we are exiting, so nothing is left in it.
+    thread->isExiting = true;
+    _heap_cache_flush();
+
     uint64_t state = atomic_exchange(&thread->state, _THREAD_EXITED);
     if (state == _THREAD_DETACHED)
     {
@@ -26,7 +32,7 @@ void thrd_exit(int res)
     }
     else
     {
-        futex(&thread->state, FUTEX_ALL, FUTEX_WAKE, CLOCKS_NEVER);
+        futex(&thread->state, 1, FUTEX_WAKE, CLOCKS_NEVER);
     }
 
     _syscall_thread_exit();
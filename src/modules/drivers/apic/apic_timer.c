@@ -1,14 +1,17 @@
 #include <kernel/drivers/apic/apic_timer.h>
 #include <kernel/drivers/apic/lapic.h>
+#include <kernel/drivers/tsc.h>
 
 #include <kernel/cpu/cpu.h>
 #include <kernel/cpu/irq.h>
+#include <kernel/cpu/regs.h>
 #include <kernel/log/log.h>
 #include <kernel/sched/clock.h>
 #include <kernel/sched/timer.h>
 #include <kernel/utils/utils.h>
 
 #include <stdint.h>
+#include <sys/cpuid.h>
 #include <sys/defs.h>
 
 static uint64_t apic_timer_ticks_per_ms(void)
@@ -64,6 +67,37 @@ static void apic_timer_set(irq_virt_t virt, clock_t uptime, clock_t timeout)
     lapic_write(LAPIC_REG_TIMER_INITIAL_COUNT, ticks);
 }
 
+static void apic_timer_tsc_deadline_set(irq_virt_t virt, clock_t uptime, clock_t timeout)
+{
+    // The TSC module calibrates the TSC once it initializes, which might be after the timer is first used.
+    uint64_t perMs = tsc_ticks_per_ms();
+    if (perMs == 0)
+    {
+        apic_timer_set(virt, uptime, timeout);
+        return;
+    }
+
+    CLI_SCOPE();
+
+    lapic_write(LAPIC_REG_LVT_TIMER, ((uint32_t)virt) | APIC_TIMER_TSC_DEADLINE);
+    // The LVT write must be ordered before the MSR write, otherwise the deadline might be ignored.
+    ASM("mfence" ::: "memory");
+
+    if (timeout == CLOCKS_NEVER)
+    {
+        msr_write(MSR_TSC_DEADLINE, 0);
+        return;
+    }
+
+    uint64_t ticks = (timeout / CLOCKS_PER_MS) * perMs + ((timeout % CLOCKS_PER_MS) * perMs) / CLOCKS_PER_MS;
+    if (ticks == 0)
+    {
+        ticks = 1;
+    }
+
+    msr_write(MSR_TSC_DEADLINE, tsc_read() + ticks);
+}
+
 static void apic_timer_eoi(void)
 {
     lapic_write(LAPIC_REG_EOI, 0);
@@ -81,6 +115,14 @@ static timer_source_t apicTimer = {
     .eoi = apic_timer_eoi,
 };
 
+static timer_source_t apicTscDeadlineTimer = {
+    .name = "APIC TSC-Deadline Timer",
+    .precision = 100,
+    .set = apic_timer_tsc_deadline_set,
+    .ack = NULL,
+    .eoi = apic_timer_eoi,
+};
+
 uint64_t apic_timer_init(void)
 {
     if (timer_source_register(&apicTimer) == ERR)
@@ -89,5 +131,19 @@ uint64_t apic_timer_init(void)
         return ERR;
     }
 
+    // Without an invariant TSC the deadline could be missed if the TSC stops while the CPU is halted.
+    cpuid_feature_info_t info;
+    cpuid_feature_info(&info);
+    if (!(info.featuresEcx & CPUID_ECX_TSC_DEADLINE) || !(cpuid_tsc_features() & CPUID_TSC_INVARIANT))
+    {
+        return 0;
+    }
+
+    if (timer_source_register(&apicTscDeadlineTimer) == ERR)
+    {
+        LOG_ERR("failed to register apic tsc-deadline timer source\n");
+        return ERR;
+    }
+
     return 0;
 }
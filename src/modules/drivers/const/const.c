@@ -1,5 +1,6 @@
 #include <kernel/fs/devfs.h>
 #include <kernel/fs/vfs.h>
+#include <kernel/io/irp.h>
 #include <kernel/log/log.h>
 #include <kernel/log/panic.h>
 #include <kernel/mem/vmm.h>
@@ -60,6 +61,19 @@ static file_ops_t oneOps = {
     .mmap = const_one_mmap,
 };
 
+static void const_one_irp_read(irp_t* irp)
+{
+    irp_frame_t* frame = irp_current(irp);
+
+    irp->res.read = mdl_set(frame->read.buffer, 0xFF, frame->read.len, 0);
+    frame->read.off += frame->read.len;
+    irp_complete(irp);
+}
+
+static irp_vtable_t oneVtable = {
+    .funcs[IRP_MJ_READ] = const_one_irp_read,
+};
+
 static uint64_t const_zero_read(file_t* file, void* buffer, size_t count, size_t* offset)
 {
     UNUSED(file);
@@ -74,14 +88,8 @@ static void* const_zero_mmap(file_t* file, void* addr, size_t length, size_t* of
     UNUSED(file); // Unused
     UNUSED(offset);
 
-    addr = vmm_alloc(&process_current()->space, addr, length, PAGE_SIZE, flags, VMM_ALLOC_OVERWRITE);
-    if (addr == NULL)
-    {
-        return NULL;
-    }
-
-    memset(addr, 0, length);
-    return addr;
+    // Pages are only allocated once written to, until then they read as zero.
+    return vmm_alloc(&process_current()->space, addr, length, PAGE_SIZE, flags, VMM_ALLOC_OVERWRITE | VMM_ALLOC_LAZY);
 }
 
 static file_ops_t zeroOps = {
@@ -89,12 +97,26 @@ static file_ops_t zeroOps = {
     .mmap = const_zero_mmap,
 };
 
+static void const_zero_irp_read(irp_t* irp)
+{
+    irp_frame_t* frame = irp_current(irp);
+
+    irp->res.read = mdl_set(frame->read.buffer, 0, frame->read.len, 0);
+    frame->read.off += frame->read.len;
+    irp_complete(irp);
+}
+
+static irp_vtable_t zeroVtable = {
+    .funcs[IRP_MJ_READ] = const_zero_irp_read,
+};
+
 static uint64_t const_null_read(file_t* file, void* buffer, size_t count, size_t* offset)
 {
     UNUSED(file); // Unused
     UNUSED(buffer);
+    UNUSED(count);
+    UNUSED(offset);
 
-    *offset += count;
     return 0;
 }
 
@@ -112,6 +134,27 @@ static file_ops_t nullOps = {
     .write = const_null_write,
 };
 
+static void const_null_irp_read(irp_t* irp)
+{
+    // Nothing is read, so the offset stays where it is.
+    irp->res.read = 0;
+    irp_complete(irp);
+}
+
+static void const_null_irp_write(irp_t* irp)
+{
+    irp_frame_t* frame = irp_current(irp);
+
+    irp->res.write = frame->write.len;
+    frame->write.off += frame->write.len;
+    irp_complete(irp);
+}
+
+static irp_vtable_t nullVtable = {
+    .funcs[IRP_MJ_READ] = const_null_irp_read,
+    .funcs[IRP_MJ_WRITE] = const_null_irp_write,
+};
+
 static uint64_t const_init(void)
 {
     constDir = devfs_dir_new(NULL, "const", NULL, NULL);
@@ -128,6 +171,7 @@ static uint64_t const_init(void)
         LOG_ERR("failed to init one file\n");
         return ERR;
     }
+    oneFile->vnode->vtable = &oneVtable;
 
     zeroFile = devfs_file_new(constDir, "zero", NULL, &zeroOps, NULL);
     if (zeroFile == NULL)
@@ -137,6 +181,7 @@ static uint64_t const_init(void)
         LOG_ERR("failed to init zero file\n");
         return ERR;
     }
+    zeroFile->vnode->vtable = &zeroVtable;
 
     nullFile = devfs_file_new(constDir, "null", NULL, &nullOps, NULL);
     if (nullFile == NULL)
@@ -147,6 +192,7 @@ static uint64_t const_init(void)
         LOG_ERR("failed to init null file\n");
         return ERR;
     }
+    nullFile->vnode->vtable = &nullVtable;
 
     return 0;
 }
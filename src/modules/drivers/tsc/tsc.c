@@ -0,0 +1,453 @@
+#include <kernel/drivers/tsc.h>
+
+#include <kernel/cpu/cli.h>
+#include <kernel/cpu/cpu.h>
+#include <kernel/cpu/ipi.h>
+#include <kernel/cpu/percpu.h>
+#include <kernel/cpu/regs.h>
+#include <kernel/log/log.h>
+#include <kernel/module/module.h>
+#include <kernel/proc/process.h>
+#include <kernel/sched/clock.h>
+#include <kernel/sched/sched.h>
+#include <kernel/sched/thread.h>
+#include <kernel/sched/wait.h>
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/cpuid.h>
+#include <sys/defs.h>
+#include <sys/math.h>
+
+/**
+ * @brief The time to calibrate the TSC frequency over.
+ */
+#define TSC_CALIBRATION_TIME (CLOCKS_PER_MS * 10)
+
+/**
+ * @brief The fixed point shift used when converting ticks to nanoseconds.
+ */
+#define TSC_SHIFT 32
+
+/**
+ * @brief The amount of round trips done when measuring the offset of a CPU.
+ */
+#define TSC_SYNC_ROUNDS 64
+
+/**
+ * @brief The maximum time to wait for another CPU during synchronization.
+ */
+#define TSC_SYNC_TIMEOUT (CLOCKS_PER_MS * 100)
+
+/**
+ * @brief The maximum offset in nanoseconds between two CPUs before we give up on the TSC.
+ *
+ * Each CPU reads the TSC directly, so a thread migrating between two CPUs can see the uptime go backwards by up to
+ * this amount.
+ */
+#define TSC_SYNC_MAX_OFFSET (CLOCKS_PER_US * 5)
+
+static uint64_t mult;    ///< Nanoseconds per tick, shifted left by `TSC_SHIFT`.
+static uint64_t baseTsc; ///< The TSC value at the end of calibration.
+static clock_t baseTime; ///< The uptime at the end of calibration.
+
+static uint64_t ticksPerMs = 0; ///< The TSC frequency in ticks per millisecond, `0` until calibrated.
+
+static bool hasAdjust = false;   ///< If `MSR_TSC_ADJUST` is supported.
+static uint64_t bootstrapAdjust; ///< The value of `MSR_TSC_ADJUST` on the bootstrap CPU.
+
+static int64_t offsets[CPU_MAX] = {0}; ///< Offset to add to the TSC of each CPU, indexed by CPU ID.
+static bool registered = false;        ///< If the TSC has been registered as a clock source.
+
+static atomic_uint64_t syncRequest = ATOMIC_VAR_INIT(0);  ///< Round requested by the target CPU.
+static atomic_uint64_t syncResponse = ATOMIC_VAR_INIT(0); ///< Round answered by the bootstrap CPU.
+static atomic_uint64_t syncTsc = ATOMIC_VAR_INIT(0);      ///< The TSC of the bootstrap CPU for the answered round.
+static atomic_bool syncDone = ATOMIC_VAR_INIT(false);     ///< Set by the target once its offset has been stored.
+
+static tid_t syncThreadTid = 0;                               ///< Thread ID of the late synchronization thread.
+static wait_queue_t syncQueue = WAIT_QUEUE_CREATE(syncQueue); ///< Wait queue for the late synchronization thread.
+static atomic_bool syncShouldStop = ATOMIC_VAR_INIT(false);   ///< Flag to signal the synchronization thread to stop.
+static atomic_bool syncPending[CPU_MAX] = {0};                ///< CPUs waiting to be measured by the thread.
+
+static inline clock_t tsc_ticks_to_ns(uint64_t ticks)
+{
+    return (clock_t)(((unsigned __int128)ticks * mult) >> TSC_SHIFT);
+}
+
+static clock_t tsc_read_ns(void)
+{
+    uint32_t aux;
+    int64_t delta = (int64_t)(tsc_read_aux(&aux) - baseTsc) + offsets[aux];
+    if (delta < 0) // Can only happen due to the small error of the synchronization
+    {
+        return baseTime;
+    }
+
+    return baseTime + tsc_ticks_to_ns((uint64_t)delta);
+}
+
+static clock_source_t source = {
+    .name = "TSC",
+    .precision = 1, // Less than a nanosecond on anything with an invariant TSC.
+    .read_ns = tsc_read_ns,
+    .read_epoch = NULL,
+};
+
+/**
+ * @brief Copy the `MSR_TSC_ADJUST` value of the bootstrap CPU to the current CPU.
+ */
+static void tsc_adjust_sync(void)
+{
+    if (!hasAdjust || SELF->id == CPU_ID_BOOTSTRAP)
+    {
+        return;
+    }
+
+    if (msr_read(MSR_TSC_ADJUST) != bootstrapAdjust)
+    {
+        msr_write(MSR_TSC_ADJUST, bootstrapAdjust);
+    }
+}
+
+// Also runs on CPUs started after the module was loaded, which are not covered by the handshake in `tsc_init()`, the
+// handshake can't be done from here so we leave it to the synchronization thread.
+PERCPU_DEFINE_CTOR(static uint8_t, pcpu_tsc)
+{
+    tsc_adjust_sync();
+
+    if (SELF->id != CPU_ID_BOOTSTRAP)
+    {
+        atomic_store(&syncPending[SELF->id], true);
+        wait_unblock(&syncQueue, WAIT_ALL, EOK);
+    }
+}
+
+/**
+ * @brief The target side of the synchronization handshake, runs on the CPU being measured.
+ *
+ * Each round we read our own TSC, ask the bootstrap CPU for its TSC and read ours again, the bootstrap CPU's TSC should
+ * then be roughly in the middle of our two reads. The round with the shortest round trip gives the best estimate.
+ */
+static void tsc_sync_target(ipi_func_data_t* data)
+{
+    UNUSED(data);
+
+    tsc_adjust_sync();
+
+    clock_t start = clock_uptime();
+    uint64_t bestRtt = UINT64_MAX;
+    int64_t bestOffset = 0;
+    for (uint64_t round = 1; round <= TSC_SYNC_ROUNDS; round++)
+    {
+        uint64_t before = tsc_read();
+        atomic_store(&syncRequest, round);
+        while (atomic_load(&syncResponse) != round)
+        {
+            if (clock_uptime() - start > TSC_SYNC_TIMEOUT) // The bootstrap CPU gave up on us
+            {
+                return;
+            }
+            ASM("pause");
+        }
+        uint64_t master = atomic_load(&syncTsc);
+        uint64_t after = tsc_read();
+
+        if (after - before < bestRtt)
+        {
+            bestRtt = after - before;
+            bestOffset = (int64_t)(master - (before + (after - before) / 2));
+        }
+    }
+
+    offsets[SELF->id] = bestOffset;
+    atomic_store(&syncDone, true);
+}
+
+/**
+ * @brief The bootstrap side of the synchronization handshake.
+ *
+ * @param cpu The CPU to measure.
+ * @return On success, `0`. On failure, `ERR`.
+ */
+static uint64_t tsc_sync_cpu(cpu_t* cpu)
+{
+    CLI_SCOPE();
+
+    atomic_store(&syncRequest, 0);
+    atomic_store(&syncResponse, 0);
+    atomic_store(&syncDone, false);
+
+    if (ipi_send(cpu, IPI_SINGLE, tsc_sync_target, NULL) == ERR)
+    {
+        return ERR;
+    }
+
+    clock_t start = clock_uptime();
+    for (uint64_t round = 1; round <= TSC_SYNC_ROUNDS; round++)
+    {
+        while (atomic_load(&syncRequest) != round)
+        {
+            if (clock_uptime() - start > TSC_SYNC_TIMEOUT)
+            {
+                return ERR;
+            }
+            ASM("pause");
+        }
+        atomic_store(&syncTsc, tsc_read());
+        atomic_store(&syncResponse, round);
+    }
+
+    while (!atomic_load(&syncDone))
+    {
+        if (clock_uptime() - start > TSC_SYNC_TIMEOUT)
+        {
+            return ERR;
+        }
+        ASM("pause");
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Get the measured offset of a CPU in nanoseconds.
+ *
+ * @param cpu The CPU to get the offset of.
+ * @return The absolute offset between the CPU and the bootstrap CPU.
+ */
+static clock_t tsc_offset_ns(cpu_t* cpu)
+{
+    int64_t offset = offsets[cpu->id];
+    return tsc_ticks_to_ns((uint64_t)(offset < 0 ? -offset : offset));
+}
+
+/**
+ * @brief Check if any CPU is waiting to be measured by the synchronization thread.
+ *
+ * @return `true` if a CPU is pending, `false` otherwise.
+ */
+static bool tsc_sync_is_pending(void)
+{
+    for (cpu_id_t id = 0; id < CPU_MAX; id++)
+    {
+        if (atomic_load(&syncPending[id]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Check if the current thread is running on the bootstrap CPU.
+ *
+ * @return `true` if running on the bootstrap CPU, `false` otherwise.
+ */
+static bool tsc_on_bootstrap(void)
+{
+    CLI_SCOPE();
+    return SELF->id == CPU_ID_BOOTSTRAP;
+}
+
+/**
+ * @brief Thread measuring the offset of CPUs started after the module was loaded.
+ *
+ * If a CPU can't be synchronized or is out of bounds, the TSC is unregistered as a clock source and the thread exits.
+ */
+static void tsc_sync_thread(void* arg)
+{
+    UNUSED(arg);
+
+    // Offsets are relative to the bootstrap CPU, so the handshake must be done from it, once there we are never moved.
+    sched_affinity_t affinity;
+    sched_affinity_clear(&affinity);
+    sched_affinity_add(&affinity, CPU_ID_BOOTSTRAP);
+    sched_affinity_set(&thread_current()->sched.affinity, &affinity);
+    while (!tsc_on_bootstrap())
+    {
+        sched_yield();
+    }
+
+    while (!atomic_load(&syncShouldStop))
+    {
+        WAIT_BLOCK(&syncQueue, tsc_sync_is_pending() || atomic_load(&syncShouldStop));
+
+        cpu_t* cpu;
+        CPU_FOR_EACH(cpu)
+        {
+            if (atomic_load(&syncShouldStop) || !atomic_exchange(&syncPending[cpu->id], false))
+            {
+                continue;
+            }
+
+            if (tsc_sync_cpu(cpu) == ERR)
+            {
+                LOG_WARN("failed to synchronize TSC with cpu %u, no longer using TSC as clock source\n", cpu->id);
+            }
+            else if (tsc_offset_ns(cpu) > TSC_SYNC_MAX_OFFSET)
+            {
+                LOG_WARN("TSC offset of cpu %u is %lluns, no longer using TSC as clock source\n", cpu->id,
+                    tsc_offset_ns(cpu));
+            }
+            else
+            {
+                continue;
+            }
+
+            clock_source_unregister(&source);
+            registered = false;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Measure the TSC frequency against the current clock source.
+ *
+ * @return On success, `0`. On failure, `ERR`.
+ */
+static uint64_t tsc_calibrate(void)
+{
+    CLI_SCOPE();
+
+    clock_t startTime = clock_uptime();
+    uint64_t startTsc = tsc_read();
+    if (startTime == 0)
+    {
+        return ERR;
+    }
+
+    clock_wait(TSC_CALIBRATION_TIME);
+
+    clock_t endTime = clock_uptime();
+    uint64_t endTsc = tsc_read();
+    if (endTsc <= startTsc)
+    {
+        return ERR;
+    }
+
+    mult = ((uint64_t)(endTime - startTime) << TSC_SHIFT) / (endTsc - startTsc);
+    baseTsc = endTsc;
+    baseTime = endTime;
+    ticksPerMs = ((uint64_t)CLOCKS_PER_MS << TSC_SHIFT) / mult;
+    return 0;
+}
+
+uint64_t tsc_ticks_per_ms(void)
+{
+    return ticksPerMs;
+}
+
+static uint64_t tsc_init(void)
+{
+    cpuid_tsc_features_t features = cpuid_tsc_features();
+    if (!(features & CPUID_TSC_INVARIANT) || !(features & CPUID_TSC_RDTSCP))
+    {
+        LOG_INFO("no invariant TSC, not using TSC as clock source\n");
+        return 0;
+    }
+
+    cpuid_extended_feature_info_t extInfo;
+    cpuid_extended_feature_info(&extInfo);
+    hasAdjust = extInfo.featuresEbx & CPUID_EBX_TSC_ADJUST;
+    if (hasAdjust)
+    {
+        bootstrapAdjust = msr_read(MSR_TSC_ADJUST);
+    }
+
+    if (SELF->id != CPU_ID_BOOTSTRAP)
+    {
+        LOG_ERR("TSC module must be loaded on the bootstrap CPU\n");
+        return ERR;
+    }
+
+    PERCPU_INIT();
+
+    if (tsc_calibrate() == ERR)
+    {
+        LOG_ERR("failed to calibrate TSC\n");
+        return ERR;
+    }
+
+    clock_t maxOffset = 0;
+    cpu_t* cpu;
+    CPU_FOR_EACH(cpu)
+    {
+        if (cpu->id == CPU_ID_BOOTSTRAP)
+        {
+            continue;
+        }
+
+        if (tsc_sync_cpu(cpu) == ERR)
+        {
+            LOG_ERR("failed to synchronize TSC with cpu %u\n", cpu->id);
+            return ERR;
+        }
+
+        maxOffset = MAX(maxOffset, tsc_offset_ns(cpu));
+    }
+
+    if (maxOffset > TSC_SYNC_MAX_OFFSET)
+    {
+        LOG_WARN("TSC offset between cpus is %lluns, not using TSC as clock source\n", maxOffset);
+        return 0;
+    }
+
+    LOG_INFO("TSC frequency %llu kHz, max cpu offset %lluns\n", ticksPerMs, maxOffset);
+
+    if (clock_source_register(&source) == ERR)
+    {
+        LOG_ERR("failed to register TSC as system time source\n");
+        return ERR;
+    }
+    registered = true;
+
+    syncThreadTid = thread_kernel_create(tsc_sync_thread, NULL);
+    if (syncThreadTid == ERR)
+    {
+        LOG_ERR("failed to create TSC synchronization thread\n");
+        clock_source_unregister(&source);
+        registered = false;
+        return ERR;
+    }
+
+    return 0;
+}
+
+uint64_t _module_procedure(const module_event_t* event)
+{
+    switch (event->type)
+    {
+    case MODULE_EVENT_DEVICE_ATTACH:
+        if (tsc_init() == ERR)
+        {
+            LOG_ERR("failed to initialize TSC\n");
+            return ERR;
+        }
+        break;
+    case MODULE_EVENT_DEVICE_DETACH:
+        if (syncThreadTid != 0 && syncThreadTid != ERR)
+        {
+            atomic_store(&syncShouldStop, true);
+            wait_unblock(&syncQueue, WAIT_ALL, EOK);
+            while (process_has_thread(process_get_kernel(), syncThreadTid))
+            {
+                sched_yield();
+            }
+        }
+        if (registered)
+        {
+            clock_source_unregister(&source);
+            registered = false;
+        }
+        PERCPU_DEINIT();
+        break;
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+MODULE_INFO("TSC Driver", "Kai Norberg", "A invariant Time Stamp Counter clock source", OS_VERSION, "MIT",
+    "BOOT_ALWAYS");
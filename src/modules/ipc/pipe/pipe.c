@@ -1,6 +1,7 @@
 #include <kernel/fs/file.h>
 #include <kernel/fs/path.h>
 #include <kernel/fs/vfs.h>
+#include <kernel/io/irp.h>
 #include <kernel/log/log.h>
 #include <kernel/log/panic.h>
 #include <kernel/mem/pmm.h>
@@ -33,6 +34,9 @@
  * Pipes can be read from and written to using the expected `read()` and `write()` system calls. Pipes are blocking and
  * pollable, following expected POSIX semantics.
  *
+ * Reads and writes submitted via an I/O ring never block a thread, if they can not be completed immediately they are
+ * kept pending in the pipe until the other end makes them ready.
+ *
  * @{
  */
 
@@ -43,6 +47,8 @@ typedef struct
     bool isReadClosed;
     bool isWriteClosed;
     wait_queue_t waitQueue;
+    list_t readIrps;  ///< Pending read IRPs.
+    list_t writeIrps; ///< Pending write IRPs.
     lock_t lock;
     // Note: These pointers are just for checking which end the current file is, they should not be referenced.
     void* readEnd;
@@ -69,6 +75,8 @@ static uint64_t pipe_open(file_t* file)
     data->isReadClosed = false;
     data->isWriteClosed = false;
     wait_queue_init(&data->waitQueue);
+    list_init(&data->readIrps);
+    list_init(&data->writeIrps);
     lock_init(&data->lock);
     data->readEnd = file;
     data->writeEnd = file;
@@ -94,6 +102,8 @@ static uint64_t pipe_open2(file_t* files[2])
     data->isReadClosed = false;
     data->isWriteClosed = false;
     wait_queue_init(&data->waitQueue);
+    list_init(&data->readIrps);
+    list_init(&data->writeIrps);
     lock_init(&data->lock);
 
     data->readEnd = files[PIPE_READ];
@@ -104,6 +114,88 @@ static uint64_t pipe_open2(file_t* files[2])
     return 0;
 }
 
+static size_t pipe_read_mdl(pipe_t* data, mdl_t* mdl, size_t count)
+{
+    fifo_t* ring = &data->ring;
+    count = MIN(count, fifo_bytes_readable(ring));
+
+    size_t firstSize = MIN(count, ring->size - ring->tail);
+    mdl_write(mdl, ring->buffer + ring->tail, firstSize, 0);
+    mdl_write(mdl, ring->buffer, count - firstSize, firstSize);
+    fifo_advance_tail(ring, count);
+    return count;
+}
+
+static size_t pipe_write_mdl(pipe_t* data, mdl_t* mdl, size_t count)
+{
+    fifo_t* ring = &data->ring;
+    count = MIN(count, fifo_bytes_writeable(ring));
+
+    size_t firstSize = MIN(count, ring->size - ring->head);
+    mdl_read(mdl, ring->buffer + ring->head, firstSize, 0);
+    mdl_read(mdl, ring->buffer, count - firstSize, firstSize);
+    fifo_advance_head(ring, count);
+    return count;
+}
+
+/**
+ * Performs as many pending IRPs as possible, must be called with the pipe lock held. The performed IRPs are moved to
+ * `done` and must be completed with `pipe_irps_complete()` after releasing the lock, as a completion might submit a
+ * new IRP to the same pipe.
+ */
+static void pipe_irps_collect(pipe_t* data, list_t* done)
+{
+    bool progress = true;
+    while (progress)
+    {
+        progress = false;
+
+        while (!list_is_empty(&data->readIrps) && (fifo_bytes_readable(&data->ring) != 0 || data->isWriteClosed))
+        {
+            irp_t* irp = CONTAINER_OF(list_pop_front(&data->readIrps), irp_t, entry);
+            if (irp_set_cancel(irp, NULL) == IRP_CANCELLED)
+            {
+                continue;
+            }
+
+            irp_frame_t* frame = irp_current(irp);
+            irp->res.read = pipe_read_mdl(data, frame->read.buffer, frame->read.len);
+            list_push_back(done, &irp->entry);
+            progress = true;
+        }
+
+        while (!list_is_empty(&data->writeIrps) && (fifo_bytes_writeable(&data->ring) != 0 || data->isReadClosed))
+        {
+            irp_t* irp = CONTAINER_OF(list_pop_front(&data->writeIrps), irp_t, entry);
+            if (irp_set_cancel(irp, NULL) == IRP_CANCELLED)
+            {
+                continue;
+            }
+
+            irp_frame_t* frame = irp_current(irp);
+            if (data->isReadClosed)
+            {
+                irp->err = EPIPE;
+            }
+            else
+            {
+                irp->res.write = pipe_write_mdl(data, frame->write.buffer, frame->write.len);
+            }
+            list_push_back(done, &irp->entry);
+            progress = true;
+        }
+    }
+}
+
+static void pipe_irps_complete(list_t* done)
+{
+    while (!list_is_empty(done))
+    {
+        irp_t* irp = CONTAINER_OF(list_pop_front(done), irp_t, entry);
+        irp_complete(irp);
+    }
+}
+
 static void pipe_close(file_t* file)
 {
     pipe_t* data = file->data;
@@ -118,8 +210,13 @@ static void pipe_close(file_t* file)
     }
 
     wait_unblock(&data->waitQueue, WAIT_ALL, EOK);
+
+    // Pending IRPs hold a reference to their file, so the pipe can not be freed while there are any.
+    list_t done = LIST_CREATE(done);
+    pipe_irps_collect(data, &done);
     if (data->isWriteClosed && data->isReadClosed)
     {
+        assert(list_is_empty(&done));
         lock_release(&data->lock);
         wait_queue_deinit(&data->waitQueue);
         free(data->buffer);
@@ -128,6 +225,7 @@ static void pipe_close(file_t* file)
     }
 
     lock_release(&data->lock);
+    pipe_irps_complete(&done);
 }
 
 static uint64_t pipe_read(file_t* file, void* buffer, size_t count, size_t* offset)
@@ -152,12 +250,13 @@ static uint64_t pipe_read(file_t* file, void* buffer, size_t count, size_t* offs
         return ERR;
     }
 
-    LOCK_SCOPE(&data->lock);
+    lock_acquire(&data->lock);
 
     if (fifo_bytes_readable(&data->ring) == 0)
     {
         if (file->mode & MODE_NONBLOCK)
         {
+            lock_release(&data->lock);
             errno = EAGAIN;
             return ERR;
         }
@@ -165,12 +264,19 @@ static uint64_t pipe_read(file_t* file, void* buffer, size_t count, size_t* offs
         if (WAIT_BLOCK_LOCK(&data->waitQueue, &data->lock,
                 fifo_bytes_readable(&data->ring) != 0 || data->isWriteClosed) == ERR)
         {
+            lock_release(&data->lock);
             return ERR;
         }
     }
 
     uint64_t result = fifo_read(&data->ring, buffer, count);
+
+    list_t done = LIST_CREATE(done);
+    pipe_irps_collect(data, &done);
     wait_unblock(&data->waitQueue, WAIT_ALL, EOK);
+    lock_release(&data->lock);
+
+    pipe_irps_complete(&done);
     return result;
 }
 
@@ -191,12 +297,13 @@ static uint64_t pipe_write(file_t* file, const void* buffer, size_t count, size_
         return ERR;
     }
 
-    LOCK_SCOPE(&data->lock);
+    lock_acquire(&data->lock);
 
     if (fifo_bytes_writeable(&data->ring) == 0)
     {
         if (file->mode & MODE_NONBLOCK)
         {
+            lock_release(&data->lock);
             errno = EAGAIN;
             return ERR;
         }
@@ -204,6 +311,7 @@ static uint64_t pipe_write(file_t* file, const void* buffer, size_t count, size_
         if (WAIT_BLOCK_LOCK(&data->waitQueue, &data->lock,
                 fifo_bytes_writeable(&data->ring) != 0 || data->isReadClosed) == ERR)
         {
+            lock_release(&data->lock);
             return ERR;
         }
     }
@@ -211,12 +319,19 @@ static uint64_t pipe_write(file_t* file, const void* buffer, size_t count, size_
     if (data->isReadClosed)
     {
         wait_unblock(&data->waitQueue, WAIT_ALL, EOK);
+        lock_release(&data->lock);
         errno = EPIPE;
         return ERR;
     }
 
     uint64_t result = fifo_write(&data->ring, buffer, count);
+
+    list_t done = LIST_CREATE(done);
+    pipe_irps_collect(data, &done);
     wait_unblock(&data->waitQueue, WAIT_ALL, EOK);
+    lock_release(&data->lock);
+
+    pipe_irps_complete(&done);
     return result;
 }
 
@@ -241,6 +356,77 @@ static wait_queue_t* pipe_poll(file_t* file, poll_events_t* revents)
     return &data->waitQueue;
 }
 
+static uint64_t pipe_irp_cancel(irp_t* irp)
+{
+    pipe_t* data = irp->file->data;
+    LOCK_SCOPE(&data->lock);
+
+    // If the IRP is no longer pending it has already been claimed by `pipe_irps_collect()`.
+    if (list_entry_in_list(&irp->entry))
+    {
+        list_remove(&irp->entry);
+    }
+    return 0;
+}
+
+static void pipe_irp_submit(irp_t* irp, list_t* pending)
+{
+    file_t* file = irp->file;
+    pipe_t* data = file->data;
+    irp_frame_t* frame = irp_current(irp);
+
+    if ((pending == &data->readIrps && data->readEnd != file) ||
+        (pending == &data->writeIrps && data->writeEnd != file))
+    {
+        irp_error(irp, ENOSYS);
+        return;
+    }
+
+    if (frame->read.len >= PAGE_SIZE)
+    {
+        irp_error(irp, EINVAL);
+        return;
+    }
+
+    lock_acquire(&data->lock);
+    list_push_back(pending, &irp->entry);
+    irp_set_cancel(irp, pipe_irp_cancel);
+
+    list_t done = LIST_CREATE(done);
+    pipe_irps_collect(data, &done);
+    if (list_entry_in_list(&irp->entry) && (file->mode & MODE_NONBLOCK))
+    {
+        list_remove(&irp->entry);
+        if (irp_set_cancel(irp, NULL) != IRP_CANCELLED)
+        {
+            irp->err = EAGAIN;
+            list_push_back(&done, &irp->entry);
+        }
+    }
+    if (!list_is_empty(&done))
+    {
+        wait_unblock(&data->waitQueue, WAIT_ALL, EOK);
+    }
+    lock_release(&data->lock);
+
+    pipe_irps_complete(&done);
+}
+
+static void pipe_irp_read(irp_t* irp)
+{
+    pipe_irp_submit(irp, &((pipe_t*)irp->file->data)->readIrps);
+}
+
+static void pipe_irp_write(irp_t* irp)
+{
+    pipe_irp_submit(irp, &((pipe_t*)irp->file->data)->writeIrps);
+}
+
+static irp_vtable_t vtable = {
+    .funcs[IRP_MJ_READ] = pipe_irp_read,
+    .funcs[IRP_MJ_WRITE] = pipe_irp_write,
+};
+
 static file_ops_t fileOps = {
     .open = pipe_open,
     .open2 = pipe_open2,
@@ -266,6 +452,7 @@ uint64_t pipe_init(void)
         LOG_ERR("failed to initialize pipe new file");
         return ERR;
     }
+    newFile->vnode->vtable = &vtable;
 
     return 0;
 }
@@ -1,10 +1,23 @@
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <threads.h>
 #include <time.h>
 
 #define MMAP_ITER 10000
+#define MMAP_THREAD_ITER 1000
+#define MMAP_THREAD_PAGES 50
+#define MMAP_MAX_THREADS 16
+#define MMAP_SPARSE_STRIDE 64
 #define GETPID_ITER 100000
+#define MALLOC_ITER 100000
+#define MALLOC_SLOTS 64
+#define MALLOC_MAX_THREADS 16
+#define PINGPONG_ITER 10000
+#define WAKEUP_ITER 200
+#define WAKEUP_HOGS 8
+#define WAKEUP_SLEEP (CLOCKS_PER_MS)
 
 #ifdef _PATCHWORK_OS_
 #include <sys/fs.h>
@@ -37,6 +50,11 @@ static uint64_t munmap_generic(void* addr, size_t length)
     return munmap(addr, length) == NULL ? ERR : 0;
 }
 
+static uint64_t pipe_generic(fd_t fds[2])
+{
+    return open2("/dev/pipe/new", fds);
+}
+
 static void benchmark_getpid(void)
 {
     clock_t start = clock();
@@ -63,6 +81,89 @@ static void benchmark_getpid(void)
     printf("overhead: %lluns\n", ((procEnd - procStart) - (end - start)) / GETPID_ITER);
 }
 
+static volatile bool wakeupStop;
+
+static int wakeup_hog_thread(void* arg)
+{
+    (void)arg;
+
+    while (!wakeupStop)
+    {
+    }
+
+    return 0;
+}
+
+static int wakeup_thread(void* arg)
+{
+    clock_t slice = (clock_t)(uintptr_t)arg;
+    if (slice != 0 && writefiles("/proc/self/ctl", F("slice %llu %llu", slice, gettid())) == ERR)
+    {
+        perror("Failed to set slice");
+        return -1;
+    }
+
+    clock_t total = 0;
+    clock_t max = 0;
+    for (uint64_t i = 0; i < WAKEUP_ITER; i++)
+    {
+        clock_t start = clock();
+        nanosleep(WAKEUP_SLEEP);
+        clock_t elapsed = clock() - start;
+        clock_t late = elapsed > WAKEUP_SLEEP ? elapsed - WAKEUP_SLEEP : 0;
+
+        total += late;
+        if (late > max)
+        {
+            max = late;
+        }
+    }
+
+    printf("wakeup slice=%lluns: avg %lluns max %lluns\n", slice, total / WAKEUP_ITER, max);
+    return 0;
+}
+
+/**
+ * Measures how late a sleeping thread wakes up while `WAKEUP_HOGS` threads keep the CPUs busy, with `slice` set to
+ * zero the default time slice is used. A short slice gives the thread earlier deadlines, letting it preempt the hogs as
+ * soon as it wakes up.
+ */
+static void benchmark_wakeup(clock_t slice)
+{
+    thrd_t hogs[WAKEUP_HOGS];
+
+    wakeupStop = false;
+    for (uint64_t i = 0; i < WAKEUP_HOGS; i++)
+    {
+        if (thrd_create(&hogs[i], wakeup_hog_thread, NULL) != thrd_success)
+        {
+            perror("thrd_create failed");
+            wakeupStop = true;
+            for (uint64_t j = 0; j < i; j++)
+            {
+                thrd_join(hogs[j], NULL);
+            }
+            return;
+        }
+    }
+
+    thrd_t thread;
+    if (thrd_create(&thread, wakeup_thread, (void*)(uintptr_t)slice) != thrd_success)
+    {
+        perror("thrd_create failed");
+    }
+    else
+    {
+        thrd_join(thread, NULL);
+    }
+
+    wakeupStop = true;
+    for (uint64_t i = 0; i < WAKEUP_HOGS; i++)
+    {
+        thrd_join(hogs[i], NULL);
+    }
+}
+
 #else
 
 #include <fcntl.h>
@@ -90,22 +191,29 @@ static uint64_t munmap_generic(void* addr, size_t length)
     return munmap(addr, length) == -1 ? ERR : 0;
 }
 
-#endif
+typedef int fd_t;
+#define PIPE_READ 0
+#define PIPE_WRITE 1
 
-static void benchmark_mmap(uint64_t pages)
+static uint64_t pipe_generic(fd_t fds[2])
 {
-    clock_t start = clock();
+    return pipe(fds) == -1 ? ERR : 0;
+}
 
-    for (uint64_t i = 0; i < MMAP_ITER; i++)
+#endif
+
+static uint64_t mmap_iterate(uint64_t pages, uint64_t iterations, uint64_t stride)
+{
+    for (uint64_t i = 0; i < iterations; i++)
     {
         void* ptr = mmap_generic(pages * 0x1000);
         if (ptr == NULL)
         {
             perror("mmap failed");
-            return;
+            return ERR;
         }
 
-        for (uint64_t j = 0; j < pages; j++)
+        for (uint64_t j = 0; j < pages; j += stride)
         {
             ((uint8_t*)ptr)[j * 0x1000] = 0;
         }
@@ -113,27 +221,264 @@ static void benchmark_mmap(uint64_t pages)
         if (munmap_generic(ptr, pages * 0x1000) != 0)
         {
             perror("munmap failed");
-            return;
+            return ERR;
         }
     }
 
+    return 0;
+}
+
+static void benchmark_mmap(uint64_t pages)
+{
+    clock_t start = clock();
+
+    if (mmap_iterate(pages, MMAP_ITER, 1) == ERR)
+    {
+        return;
+    }
+
     clock_t end = clock();
     printf("mmap pages=%llu bytes: %llums\n", pages, (end - start) / (CLOCKS_PER_MS));
 }
 
+/**
+ * Only touches one in every `MMAP_SPARSE_STRIDE` pages, with lazy allocation the time should mostly depend on the
+ * amount of touched pages, not the size of the mapping.
+ */
+static void benchmark_mmap_sparse(uint64_t pages)
+{
+    clock_t start = clock();
+
+    if (mmap_iterate(pages, MMAP_ITER, MMAP_SPARSE_STRIDE) == ERR)
+    {
+        return;
+    }
+
+    clock_t end = clock();
+    printf("mmap sparse pages=%llu stride=%d: %llums\n", pages, MMAP_SPARSE_STRIDE, (end - start) / (CLOCKS_PER_MS));
+}
+
+static int mmap_thread(void* arg)
+{
+    return mmap_iterate((uint64_t)(uintptr_t)arg, MMAP_THREAD_ITER, 1) == ERR ? -1 : 0;
+}
+
+/**
+ * Each thread does the same amount of work, so with perfect scaling the time should stay constant as the amount of
+ * threads increases.
+ */
+static void benchmark_mmap_threads(uint64_t threadAmount, uint64_t pages)
+{
+    thrd_t threads[MMAP_MAX_THREADS];
+
+    clock_t start = clock();
+
+    for (uint64_t i = 0; i < threadAmount; i++)
+    {
+        if (thrd_create(&threads[i], mmap_thread, (void*)(uintptr_t)pages) != thrd_success)
+        {
+            perror("thrd_create failed");
+            for (uint64_t j = 0; j < i; j++)
+            {
+                thrd_join(threads[j], NULL);
+            }
+            return;
+        }
+    }
+
+    for (uint64_t i = 0; i < threadAmount; i++)
+    {
+        thrd_join(threads[i], NULL);
+    }
+
+    clock_t end = clock();
+    printf("mmap threads=%llu pages=%llu: %llums\n", threadAmount, pages, (end - start) / (CLOCKS_PER_MS));
+}
+
+static int malloc_thread(void* arg)
+{
+    uint64_t seed = (uint64_t)(uintptr_t)arg;
+    void* slots[MALLOC_SLOTS] = {0};
+
+    for (uint64_t i = 0; i < MALLOC_ITER; i++)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64_t slot = (seed >> 33) % MALLOC_SLOTS;
+        uint64_t size = 16 + ((seed >> 17) % 1008);
+
+        free(slots[slot]);
+        slots[slot] = malloc(size);
+        if (slots[slot] == NULL)
+        {
+            perror("malloc failed");
+            return -1;
+        }
+        ((uint8_t*)slots[slot])[0] = (uint8_t)i;
+    }
+
+    for (uint64_t i = 0; i < MALLOC_SLOTS; i++)
+    {
+        free(slots[i]);
+    }
+
+    return 0;
+}
+
+static void benchmark_malloc(uint64_t threadAmount)
+{
+    thrd_t threads[MALLOC_MAX_THREADS];
+
+    clock_t start = clock();
+
+    for (uint64_t i = 0; i < threadAmount; i++)
+    {
+        if (thrd_create(&threads[i], malloc_thread, (void*)(uintptr_t)(i + 1)) != thrd_success)
+        {
+            perror("thrd_create failed");
+            for (uint64_t j = 0; j < i; j++)
+            {
+                thrd_join(threads[j], NULL);
+            }
+            return;
+        }
+    }
+
+    for (uint64_t i = 0; i < threadAmount; i++)
+    {
+        thrd_join(threads[i], NULL);
+    }
+
+    clock_t end = clock();
+    printf("malloc threads=%llu: %llums\n", threadAmount, (end - start) / (CLOCKS_PER_MS));
+}
+
+typedef struct
+{
+    fd_t in;
+    fd_t out;
+    bool simd;
+} pingpong_args_t;
+
+static volatile double pingpongSink;
+
+static int pingpong_thread(void* arg)
+{
+    pingpong_args_t* args = arg;
+    volatile double value = 1.0;
+
+    char byte;
+    for (uint64_t i = 0; i < PINGPONG_ITER; i++)
+    {
+        if (read(args->in, &byte, 1) != 1)
+        {
+            perror("read failed");
+            return -1;
+        }
+        if (args->simd)
+        {
+            value = value * 1.0001;
+        }
+        if (write(args->out, &byte, 1) != 1)
+        {
+            perror("write failed");
+            return -1;
+        }
+    }
+
+    pingpongSink = value;
+    return 0;
+}
+
+/**
+ * Bounces a byte between two threads using two pipes, each round trip requires two context switches. With `simd` set
+ * both threads also touch the FPU every iteration, which forces their SIMD state to actually be saved and restored.
+ */
+static void benchmark_pingpong(bool simd)
+{
+    fd_t ping[2];
+    fd_t pong[2];
+    if (pipe_generic(ping) == ERR || pipe_generic(pong) == ERR)
+    {
+        perror("pipe failed");
+        return;
+    }
+
+    pingpong_args_t args = {.in = ping[PIPE_READ], .out = pong[PIPE_WRITE], .simd = simd};
+    thrd_t thread;
+    if (thrd_create(&thread, pingpong_thread, &args) != thrd_success)
+    {
+        perror("thrd_create failed");
+        return;
+    }
+
+    volatile double value = 1.0;
+
+    clock_t start = clock();
+
+    char byte = 0;
+    for (uint64_t i = 0; i < PINGPONG_ITER; i++)
+    {
+        if (write(ping[PIPE_WRITE], &byte, 1) != 1)
+        {
+            perror("write failed");
+            break;
+        }
+        if (simd)
+        {
+            value = value * 1.0001;
+        }
+        if (read(pong[PIPE_READ], &byte, 1) != 1)
+        {
+            perror("read failed");
+            break;
+        }
+    }
+
+    clock_t end = clock();
+    thrd_join(thread, NULL);
+    pingpongSink = value;
+
+    printf("pingpong simd=%d: %lluns per round trip\n", simd, (end - start) / PINGPONG_ITER);
+
+    close(ping[PIPE_READ]);
+    close(ping[PIPE_WRITE]);
+    close(pong[PIPE_READ]);
+    close(pong[PIPE_WRITE]);
+}
+
 int main()
 {
     init_generic();
 
 #ifdef _PATCHWORK_OS_
     benchmark_getpid();
+    benchmark_wakeup(0);
+    benchmark_wakeup(CLOCKS_PER_MS);
 #endif
 
+    benchmark_pingpong(false);
+    benchmark_pingpong(true);
+
+    for (uint64_t i = 1; i <= MALLOC_MAX_THREADS; i *= 2)
+    {
+        benchmark_malloc(i);
+    }
+
     benchmark_mmap(1);
     for (uint64_t i = 50; i <= 1500; i += 50)
     {
         benchmark_mmap(i);
     }
 
+    for (uint64_t i = 250; i <= 1500; i += 250)
+    {
+        benchmark_mmap_sparse(i);
+    }
+
+    for (uint64_t i = 1; i <= MMAP_MAX_THREADS; i *= 2)
+    {
+        benchmark_mmap_threads(i, MMAP_THREAD_PAGES);
+    }
+
     return 0;
 }
@@ -1,10 +1,12 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/fs.h>
 #include <sys/ioring.h>
 
 #define SENTRIES 64
 #define CENTRIES 128
+#define FLOOD_AMOUNT 4096
 
 int main()
 {
@@ -45,6 +47,152 @@ int main()
         printf("cqe result: %llu\n", cqe._result);
     }
 
+    printf("pushing pipe read and write sqes to ring %llu...\n", ring.id);
+    fd_t pipe[2];
+    if (open2("/dev/pipe/new", pipe) == ERR)
+    {
+        printf("failed to open pipe\n");
+        return errno;
+    }
+
+    // The read is submitted first so that it has to wait for the write.
+    char readBuffer[16] = {0};
+    char writeBuffer[] = "hello ring";
+    sqe = (sqe_t)SQE_CREATE(IO_OP_READ, 0, CLOCKS_PER_SEC, 0x9ABC);
+    sqe.fd = pipe[PIPE_READ];
+    sqe.buffer = readBuffer;
+    sqe.count = sizeof(readBuffer) - 1;
+    sqe.offset = IO_OFF_CUR;
+    sqe_push(&ring, &sqe);
+
+    sqe = (sqe_t)SQE_CREATE(IO_OP_WRITE, 0, CLOCKS_PER_SEC, 0xDEF0);
+    sqe.fd = pipe[PIPE_WRITE];
+    sqe.buffer = writeBuffer;
+    sqe.count = sizeof(writeBuffer);
+    sqe.offset = IO_OFF_CUR;
+    sqe_push(&ring, &sqe);
+
+    printf("entering ring...\n");
+    if (ioring_enter(id, 2, 2) == ERR)
+    {
+        printf("failed to enter ring\n");
+        return errno;
+    }
+
+    while (cqe_pop(&ring, &cqe))
+    {
+        printf("cqe data: %p, op: %d, error: %s, result: %llu\n", cqe.data, cqe.op, strerror(cqe.error),
+            cqe._result);
+    }
+    printf("read from pipe: %s\n", readBuffer);
+
+    printf("pushing write sqe with invalid offset to ring %llu...\n", ring.id);
+    sqe = (sqe_t)SQE_CREATE(IO_OP_WRITE, 0, CLOCKS_PER_SEC, 0x2468);
+    sqe.fd = pipe[PIPE_WRITE];
+    sqe.buffer = writeBuffer;
+    sqe.count = sizeof(writeBuffer);
+    sqe.offset = -2;
+    sqe_push(&ring, &sqe);
+
+    if (ioring_enter(id, 1, 1) == ERR)
+    {
+        printf("failed to enter ring\n");
+        return errno;
+    }
+
+    if (!cqe_pop(&ring, &cqe) || cqe.error != EINVAL)
+    {
+        printf("write with invalid offset was not rejected\n");
+        return EIO;
+    }
+
+    printf("pushing multishot poll sqe to ring %llu...\n", ring.id);
+    sqe = (sqe_t)SQE_CREATE(IO_OP_POLL, SQE_MULTISHOT, CLOCKS_PER_SEC, 0x1357);
+    sqe.fd = pipe[PIPE_READ];
+    sqe.events = IO_POLL_READ;
+    sqe_push(&ring, &sqe);
+
+    if (ioring_enter(id, 1, 0) == ERR)
+    {
+        printf("failed to enter ring\n");
+        return errno;
+    }
+
+    // The first write should post a CQE that keeps the poll armed, closing the write end should then finish it.
+    write(pipe[PIPE_WRITE], writeBuffer, sizeof(writeBuffer));
+    if (ioring_enter(id, 0, 1) == ERR)
+    {
+        printf("failed to enter ring\n");
+        return errno;
+    }
+
+    close(pipe[PIPE_WRITE]);
+    if (ioring_enter(id, 0, 2) == ERR)
+    {
+        printf("failed to enter ring\n");
+        return errno;
+    }
+
+    while (cqe_pop(&ring, &cqe))
+    {
+        printf("cqe data: %p, op: %d, error: %s, events: %llu, more: %d\n", cqe.data, cqe.op, strerror(cqe.error),
+            cqe.events, (cqe.flags & CQE_MORE) != 0);
+    }
+
+    close(pipe[PIPE_READ]);
+
+    // CQEs are only popped once the kernel stops accepting SQEs, such that the ring is constantly kept full.
+    printf("flooding ring %llu with %d nop sqes...\n", ring.id, FLOOD_AMOUNT);
+    uint64_t pushed = 0;
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    uint64_t stalls = 0;
+    while (completed < FLOOD_AMOUNT)
+    {
+        while (pushed < FLOOD_AMOUNT)
+        {
+            sqe = (sqe_t)SQE_CREATE(IO_OP_NOP, 0, CLOCKS_PER_MS, pushed);
+            if (!sqe_push(&ring, &sqe))
+            {
+                break;
+            }
+            pushed++;
+        }
+
+        uint64_t result = ioring_enter(id, pushed - submitted, 1);
+        if (result == ERR)
+        {
+            printf("failed to enter ring\n");
+            return errno;
+        }
+        submitted += result;
+
+        if (result != 0 && submitted != FLOOD_AMOUNT)
+        {
+            continue;
+        }
+        stalls += result == 0;
+
+        while (cqe_pop(&ring, &cqe))
+        {
+            if (cqe.error != ETIMEDOUT)
+            {
+                printf("unexpected nop cqe error: %s\n", strerror(cqe.error));
+                return EIO;
+            }
+            completed++;
+        }
+    }
+
+    uint32_t dropped = atomic_load(&ring.ctrl->cdropped);
+    printf("flood completed %llu nops with %llu stalls, overflow: %d, dropped: %u\n", completed, stalls,
+        (atomic_load(&ring.ctrl->flags) & IORING_CTRL_OVERFLOW) != 0, dropped);
+    if (completed != FLOOD_AMOUNT || dropped != 0)
+    {
+        printf("flood lost completions\n");
+        return EIO;
+    }
+
     printf("registers:\n");
     for (uint64_t i = 0; i < SQE_REGS_MAX; i++)
     {
@@ -8,6 +8,10 @@
 
 #define PRIME_MAX (10000000)
 
+#define STORM_WAITERS 8
+#define STORM_LOCKERS 4
+#define STORM_ITER 10000
+
 static atomic_long count;
 static atomic_long next;
 
@@ -98,6 +102,127 @@ static void benchmark(uint64_t threadAmount)
     printf("\ttook %d ms to find %d primes\n", (end - start) / (CLOCKS_PER_MS), atomic_load(&count));
 }
 
+static mtx_t stormMutex;
+static cnd_t stormCond;
+static bool stormStop;
+static uint64_t stormCount;
+
+static int storm_waiter(void* arg)
+{
+    UNUSED(arg);
+
+    mtx_lock(&stormMutex);
+    while (!stormStop)
+    {
+        cnd_wait(&stormCond, &stormMutex);
+    }
+    mtx_unlock(&stormMutex);
+    return thrd_success;
+}
+
+static int storm_broadcaster(void* arg)
+{
+    UNUSED(arg);
+
+    for (uint64_t i = 0; i < STORM_ITER; i++)
+    {
+        mtx_lock(&stormMutex);
+        stormCount++;
+        cnd_broadcast(&stormCond);
+        mtx_unlock(&stormMutex);
+    }
+    return thrd_success;
+}
+
+static int storm_locker(void* arg)
+{
+    UNUSED(arg);
+
+    for (uint64_t i = 0; i < STORM_ITER; i++)
+    {
+        mtx_lock(&stormMutex);
+        stormCount++;
+        mtx_unlock(&stormMutex);
+    }
+    return thrd_success;
+}
+
+static void storm_stop(void)
+{
+    mtx_lock(&stormMutex);
+    stormStop = true;
+    cnd_broadcast(&stormCond);
+    mtx_unlock(&stormMutex);
+}
+
+/**
+ * Waiters requeued onto the mutex by `cnd_broadcast()` compete with threads starving in `mtx_lock()`, which hands the
+ * mutex off to woken waiters, a livelock or lost wakeup makes this hang.
+ */
+static bool storm_test(void)
+{
+    printf("broadcast storm: starting...");
+    fflush(stdout);
+    clock_t start = clock();
+
+    mtx_init(&stormMutex, mtx_plain);
+    cnd_init(&stormCond);
+    stormStop = false;
+    stormCount = 0;
+
+    thrd_t waiters[STORM_WAITERS];
+    thrd_t workers[STORM_LOCKERS + 1];
+    uint64_t waiterAmount = 0;
+    uint64_t workerAmount = 0;
+    bool success = true;
+    for (; waiterAmount < STORM_WAITERS; waiterAmount++)
+    {
+        if (thrd_create(&waiters[waiterAmount], storm_waiter, NULL) != thrd_success)
+        {
+            success = false;
+            break;
+        }
+    }
+    for (; success && workerAmount < STORM_LOCKERS + 1; workerAmount++)
+    {
+        if (thrd_create(&workers[workerAmount], workerAmount == 0 ? storm_broadcaster : storm_locker, NULL) !=
+            thrd_success)
+        {
+            success = false;
+            break;
+        }
+    }
+
+    for (uint64_t i = 0; i < workerAmount; i++)
+    {
+        thrd_join(workers[i], NULL);
+    }
+    storm_stop();
+    for (uint64_t i = 0; i < waiterAmount; i++)
+    {
+        thrd_join(waiters[i], NULL);
+    }
+
+    cnd_destroy(&stormCond);
+    mtx_destroy(&stormMutex);
+
+    if (!success)
+    {
+        printf(" (thrd_create error)\n");
+        return false;
+    }
+
+    if (stormCount != STORM_ITER * (STORM_LOCKERS + 1))
+    {
+        printf(" (lost %d increments)\n", STORM_ITER * (STORM_LOCKERS + 1) - stormCount);
+        return false;
+    }
+
+    clock_t end = clock();
+    printf("\ttook %d ms\n", (end - start) / (CLOCKS_PER_MS));
+    return true;
+}
+
 int main(void)
 {
     for (uint64_t threads = 1; threads <= 1024; threads *= 2)
@@ -105,6 +230,11 @@ int main(void)
         benchmark(threads);
     }
 
+    if (!storm_test())
+    {
+        return 1;
+    }
+
     printf("Testing complete.\n");
     return 0;
 }
@@ -8,6 +8,7 @@
 #include <time.h>
 
 #define SAMPLE_INTERVAL (CLOCKS_PER_SEC)
+#define HIST_BUCKETS 32
 
 static uint64_t terminalColumns;
 static uint64_t terminalRows;
@@ -89,6 +90,16 @@ typedef struct
     char cmdline[256];
 } proc_perfs_t;
 
+typedef struct
+{
+    uint64_t switches;
+    uint64_t involuntary;
+    uint64_t wakeups;
+    uint64_t migrations;
+    uint64_t runqueue[HIST_BUCKETS];
+    uint64_t wakeup[HIST_BUCKETS];
+} sched_perfs_t;
+
 typedef struct
 {
     cpu_perfs_t* prevCpuPerfs;
@@ -98,6 +109,8 @@ typedef struct
     uint64_t procAmount;
     proc_perfs_t* procPerfs;
     mem_perfs_t memPerfs;
+    sched_perfs_t prevSchedPerfs;
+    sched_perfs_t schedPerfs;
 } perfs_t;
 
 static uint64_t cpu_perf_count_cpus(void)
@@ -179,6 +192,82 @@ static uint64_t mem_perf_read(mem_perfs_t* memPerfs)
     return 0;
 }
 
+static uint64_t sched_perf_read(sched_perfs_t* schedPerfs)
+{
+    memset(schedPerfs, 0, sizeof(sched_perfs_t));
+
+    FILE* file = fopen("/dev/perf/sched", "r");
+    if (file == NULL)
+    {
+        return ERR;
+    }
+
+    char line[1024];
+    fgets(line, sizeof(line), file);
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        uint64_t id, switches, involuntary, wakeups, migrations;
+        if (sscanf(line, "%llu %llu %llu %llu %llu", &id, &switches, &involuntary, &wakeups, &migrations) != 5)
+        {
+            continue;
+        }
+
+        schedPerfs->switches += switches;
+        schedPerfs->involuntary += involuntary;
+        schedPerfs->wakeups += wakeups;
+        schedPerfs->migrations += migrations;
+    }
+
+    fclose(file);
+
+    file = fopen("/dev/perf/latency", "r");
+    if (file == NULL)
+    {
+        return ERR;
+    }
+
+    fgets(line, sizeof(line), file);
+
+    // Sum the histograms of all CPUs.
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char* ptr = line;
+        strtoul(ptr, &ptr, 10);
+        while (*ptr == ' ')
+        {
+            ptr++;
+        }
+
+        uint64_t* hist;
+        if (strncmp(ptr, "runqueue", 8) == 0)
+        {
+            hist = schedPerfs->runqueue;
+        }
+        else if (strncmp(ptr, "wakeup", 6) == 0)
+        {
+            hist = schedPerfs->wakeup;
+        }
+        else
+        {
+            continue;
+        }
+
+        while (*ptr != ' ' && *ptr != '\0')
+        {
+            ptr++;
+        }
+
+        for (uint64_t i = 0; i < HIST_BUCKETS; i++)
+        {
+            hist[i] += strtoul(ptr, &ptr, 10);
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
 static proc_perfs_t* proc_perfs_read(uint64_t* procAmount)
 {
     fd_t procDir = open("/proc:directory");
@@ -434,6 +523,13 @@ static void perfs_update(perfs_t* perfs)
         abort();
     }
 
+    perfs->prevSchedPerfs = perfs->schedPerfs;
+    if (sched_perf_read(&perfs->schedPerfs) == ERR)
+    {
+        printf("Failed to read scheduler performance data\n");
+        abort();
+    }
+
     perfs->procPerfs = proc_perfs_read(&perfs->procAmount);
     if (perfs->procPerfs == NULL)
     {
@@ -462,6 +558,57 @@ static void perf_percentage(clock_t part, clock_t total, uint64_t* whole, uint64
     *thousandths = percent % 1000;
 }
 
+/**
+ * Returns the upper bound in nanoseconds of the bucket containing the given permille of the samples added since the
+ * previous sample, or `0` if there are no new samples.
+ */
+static clock_t hist_percentile(const uint64_t* prev, const uint64_t* curr, uint64_t permille)
+{
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < HIST_BUCKETS; i++)
+    {
+        total += curr[i] - prev[i];
+    }
+
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    uint64_t target = (total * permille + 999) / 1000;
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < HIST_BUCKETS; i++)
+    {
+        count += curr[i] - prev[i];
+        if (count >= target)
+        {
+            return 1ULL << (i + 1);
+        }
+    }
+
+    return 1ULL << HIST_BUCKETS;
+}
+
+static void duration_format(char* buffer, uint64_t size, clock_t nanoseconds)
+{
+    if (nanoseconds == 0)
+    {
+        snprintf(buffer, size, "-");
+    }
+    else if (nanoseconds < 10000)
+    {
+        snprintf(buffer, size, "<%lluns", nanoseconds);
+    }
+    else if (nanoseconds < 10000000)
+    {
+        snprintf(buffer, size, "<%lluus", nanoseconds / 1000);
+    }
+    else
+    {
+        snprintf(buffer, size, "<%llums", nanoseconds / 1000000);
+    }
+}
+
 static void perfs_print(perfs_t* perfs)
 {
     printf("\033[H\n");
@@ -611,6 +758,32 @@ static void perfs_print(perfs_t* perfs)
 
     printf("\033[K\n");
 
+    sched_perfs_t* sched = &perfs->schedPerfs;
+    sched_perfs_t* prevSched = &perfs->prevSchedPerfs;
+    uint64_t switchesDelta = sched->switches - prevSched->switches;
+    perf_percentage(sched->involuntary - prevSched->involuntary, switchesDelta, &whole, &thousandths);
+
+    printf("\033[1;33m  Scheduler:\033[0m\033[K\n");
+    printf("  \033[90mSwitches:\033[0m %7llu/s  \033[90mInvoluntary:\033[0m %3llu.%03llu%%  \033[90mWakeups:\033[0m "
+           "%7llu/s  \033[90mMigrations:\033[0m %5llu/s\033[K\n",
+        switchesDelta * CLOCKS_PER_SEC / SAMPLE_INTERVAL, whole, thousandths,
+        (sched->wakeups - prevSched->wakeups) * CLOCKS_PER_SEC / SAMPLE_INTERVAL,
+        (sched->migrations - prevSched->migrations) * CLOCKS_PER_SEC / SAMPLE_INTERVAL);
+
+    char runqueueP50[16];
+    char runqueueP99[16];
+    char wakeupP50[16];
+    char wakeupP99[16];
+    duration_format(runqueueP50, sizeof(runqueueP50), hist_percentile(prevSched->runqueue, sched->runqueue, 500));
+    duration_format(runqueueP99, sizeof(runqueueP99), hist_percentile(prevSched->runqueue, sched->runqueue, 990));
+    duration_format(wakeupP50, sizeof(wakeupP50), hist_percentile(prevSched->wakeup, sched->wakeup, 500));
+    duration_format(wakeupP99, sizeof(wakeupP99), hist_percentile(prevSched->wakeup, sched->wakeup, 990));
+    printf("  \033[90mRunqueue delay:\033[0m p50 %-8s p99 %-8s  \033[90mWakeup latency:\033[0m p50 %-8s p99 "
+           "%-8s\033[K\n",
+        runqueueP50, runqueueP99, wakeupP50, wakeupP99);
+
+    printf("\033[K\n");
+
     const char* sortIndicator = "";
     switch (currentSortMode)
     {
@@ -634,7 +807,7 @@ static void perfs_print(perfs_t* perfs)
     }
     printf("\n\033[0m");
 
-    uint64_t headerLines = 4 + cpusPerColumn + 7;
+    uint64_t headerLines = 4 + cpusPerColumn + 7 + 4;
     uint64_t availableLines = (terminalRows - 1 > headerLines + 1) ? (terminalRows - 1 - headerLines - 1) : 10;
 
     if (processScrollOffset > perfs->procAmount)